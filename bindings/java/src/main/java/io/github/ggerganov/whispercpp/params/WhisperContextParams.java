@@ -40,6 +40,30 @@ public class WhisperContextParams extends Structure {
     /** DTW memory size (internal use) */
     public NativeLong dtw_mem_size;
 
+    /** Max memory for snapshots of the prompt decoded again on temperature fallback, 0 to disable (experimental) */
+    public NativeLong fallback_snapshot_size;
+
+    /** Compute the log mel spectrogram inside the encoder graph (experimental) */
+    public CBool mel_in_graph;
+
+    /** Map the model file into memory instead of reading it */
+    public CBool use_mmap;
+
+    /** Prefetch the mapped model file */
+    public CBool mmap_prefetch;
+
+    /** Type of the KV caches (ggml_type: 1 - f16, 8 - q8_0, 2 - q4_0), the quantized types require flash attention */
+    public int type_kv;
+
+    /** CPU threadpool shared by the states of the context (ggml_threadpool *), owned by the caller */
+    public Pointer threadpool;
+
+    /** Or create a threadpool with these params (ggml_threadpool_params *) */
+    public Pointer threadpool_params;
+
+    /** NUMA placement of the weights (whisper_numa_mode: 0 - disabled, 1 - distribute, 2 - replicate) */
+    public int numa;
+
     /** Use GPU for inference */
     public void useGpu(boolean enable) {
         use_gpu = enable ? CBool.TRUE : CBool.FALSE;
@@ -55,6 +79,11 @@ public class WhisperContextParams extends Structure {
         dtw_token_timestamps = enable ? CBool.TRUE : CBool.FALSE;
     }
 
+    /** Map the model file into memory instead of reading it */
+    public void useMmap(boolean enable) {
+        use_mmap = enable ? CBool.TRUE : CBool.FALSE;
+    }
+
     /** Set DTW alignment heads preset */
     public void setDtwAheadsPreset(int preset) {
         dtw_aheads_preset = preset;
@@ -70,7 +99,15 @@ public class WhisperContextParams extends Structure {
             "dtw_aheads_preset",
             "dtw_n_top",
             "dtw_aheads",
-            "dtw_mem_size"
+            "dtw_mem_size",
+            "fallback_snapshot_size",
+            "mel_in_graph",
+            "use_mmap",
+            "mmap_prefetch",
+            "type_kv",
+            "threadpool",
+            "threadpool_params",
+            "numa"
         );
     }
 
@@ -1,14 +1,17 @@
 #include "whisper.h"
 
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <string>
 #include <thread>
+#include <vector>
 
 // command-line parameters
 struct whisper_params {
     int32_t n_threads = std::min(4, (int32_t) std::thread::hardware_concurrency());
-    int32_t what = 0; // what to benchmark: 0 - whisper encoder, 1 - memcpy, 2 - ggml_mul_mat
+    int32_t what = 0; // what to benchmark: 0 - whisper encoder, 1 - memcpy, 2 - ggml_mul_mat, 3 - NUMA scaling of the encoder
+    int32_t n_iter = 4; // encodes per state in the NUMA scaling benchmark
 
     std::string model = "models/ggml-base.en.bin";
 
@@ -29,6 +32,7 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-t"     || arg == "--threads")       { params.n_threads  = std::stoi(argv[++i]); }
         else if (arg == "-m"     || arg == "--model")         { params.model      = argv[++i]; }
         else if (arg == "-w"     || arg == "--what")          { params.what       = atoi(argv[++i]); }
+        else if (arg == "-n"     || arg == "--n-iter")        { params.n_iter     = atoi(argv[++i]); }
         else if (arg == "-ng"    || arg == "--no-gpu")        { params.use_gpu    = false; }
         else if (arg == "-fa"    || arg == "--flash-attn")    { params.flash_attn = true; }
         else if (arg == "-nfa"   || arg == "--no-flash-attn") { params.flash_attn = false; }
@@ -54,6 +58,8 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "                             %-7s  0 - whisper\n",                                 "");
     fprintf(stderr, "                             %-7s  1 - memcpy\n",                                  "");
     fprintf(stderr, "                             %-7s  2 - ggml_mul_mat\n",                            "");
+    fprintf(stderr, "                             %-7s  3 - encoder scaling over the NUMA nodes (Linux)\n", "");
+    fprintf(stderr, "  -n N,     --n-iter N      [%-7d] encodes per node for -w 3\n",                  params.n_iter);
     fprintf(stderr, "  -ng,      --no-gpu        [%-7s] disable GPU\n",                                 params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,      --flash-attn    [%-7s] enable flash attention\n",                      params.flash_attn ? "true" : "false");
     fprintf(stderr, "  -nfa,     --no-flash-attn [%-7s] disable flash attention\n",                     params.flash_attn ? "false" : "true");
@@ -164,6 +170,96 @@ static int whisper_bench_full(const whisper_params & params) {
     return 0;
 }
 
+// one state per node, each encoding on its own thread with the weights of its node
+static int whisper_bench_numa(const whisper_params & params) {
+    struct whisper_context_params cparams = whisper_context_default_params();
+
+    cparams.use_gpu    = false;
+    cparams.flash_attn = params.flash_attn;
+    cparams.numa       = WHISPER_NUMA_REPLICATE;
+
+    struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(params.model.c_str(), cparams);
+    if (ctx == nullptr) {
+        fprintf(stderr, "error: failed to initialize whisper context\n");
+        return 2;
+    }
+
+    const int n_nodes = whisper_numa_n_nodes(ctx);
+    if (n_nodes == 0) {
+        fprintf(stderr, "error: no NUMA nodes found\n");
+        whisper_free(ctx);
+        return 2;
+    }
+
+    const int n_mels = whisper_model_n_mels(ctx);
+
+    std::vector<whisper_state *> states;
+    for (int i = 0; i < n_nodes; i++) {
+        whisper_state * state = whisper_init_state_on_node(ctx, i);
+        if (state == nullptr || whisper_set_mel_with_state(ctx, state, nullptr, 0, n_mels) != 0) {
+            fprintf(stderr, "error: failed to initialize the state of node %d\n", i);
+            return 3;
+        }
+
+        // heat encoder
+        if (whisper_encode_with_state(ctx, state, 0, params.n_threads) != 0) {
+            fprintf(stderr, "error: failed to encode\n");
+            return 4;
+        }
+
+        states.push_back(state);
+    }
+
+    fprintf(stderr, "\n");
+    fprintf(stderr, "%s: %d nodes, %d threads per node, %d encodes per node\n", __func__, n_nodes, params.n_threads, params.n_iter);
+    fprintf(stderr, "\n");
+
+    double rate_1 = 0.0;
+
+    for (int n = 1; n <= n_nodes; n++) {
+        std::vector<std::thread> workers;
+        std::vector<int> ret(n, 0);
+
+        const auto t_start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < n; i++) {
+            workers.emplace_back([&, i]() {
+                for (int j = 0; j < params.n_iter && ret[i] == 0; j++) {
+                    ret[i] = whisper_encode_with_state(ctx, states[i], 0, params.n_threads);
+                }
+            });
+        }
+
+        for (auto & worker : workers) {
+            worker.join();
+        }
+
+        const double t_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+
+        for (int i = 0; i < n; i++) {
+            if (ret[i] != 0) {
+                fprintf(stderr, "error: failed to encode: %d\n", ret[i]);
+                return 4;
+            }
+        }
+
+        const double rate = n*params.n_iter/t_s;
+        if (n == 1) {
+            rate_1 = rate;
+        }
+
+        fprintf(stderr, "%s: nodes = %2d, %8.2f encodes/s, speedup = %5.2fx\n", __func__, n, rate, rate/rate_1);
+    }
+
+    for (whisper_state * state : states) {
+        whisper_free_state(state);
+    }
+
+    whisper_free(ctx);
+
+    return 0;
+}
+
 int main(int argc, char ** argv) {
     ggml_backend_load_all();
 
@@ -179,6 +275,7 @@ int main(int argc, char ** argv) {
         case 0: ret = whisper_bench_full(params);                break;
         case 1: ret = whisper_bench_memcpy(params.n_threads);       break;
         case 2: ret = whisper_bench_ggml_mul_mat(params.n_threads); break;
+        case 3: ret = whisper_bench_numa(params);                break;
         default: fprintf(stderr, "error: unknown benchmark: %d\n", params.what); break;
     }
 
@@ -52,6 +52,7 @@ struct whisper_params {
     float grammar_penalty = 100.0f;
     float temperature     = 0.0f;
     float temperature_inc = 0.2f;
+    float beam_patience   = whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH).beam_search.patience;
 
     bool debug_mode      = false;
     bool translate       = false;
@@ -79,7 +80,20 @@ struct whisper_params {
     bool flash_attn      = true;
     bool suppress_nst    = false;
     bool carry_initial_prompt = false;
+    bool mel_in_graph    = false;
+    bool use_mmap        = true;
+    bool mmap_prefetch   = false;
 
+    // shared CPU threadpool
+    bool        threadpool = false;
+    std::string cpu_mask;
+    bool        cpu_strict = false;
+    int32_t     prio       = 0;
+    int32_t     poll       = 50;
+
+    std::string numa;
+
+    std::string kv_type   = "f16";
     std::string language  = "en";
     std::string prompt;
     std::string font_path = "/System/Library/Fonts/Supplemental/Courier New Bold.ttf";
@@ -128,6 +142,34 @@ static char * requires_value_error(const std::string & arg) {
     exit(0);
 }
 
+// hex mask with the lowest bit for CPU 0, e.g. "0xff" for CPUs 0-7
+static bool parse_cpu_mask(const std::string & mask, bool (&cpumask)[GGML_MAX_N_THREADS]) {
+    size_t start = 0;
+    if (mask.size() > 2 && mask[0] == '0' && (mask[1] == 'x' || mask[1] == 'X')) {
+        start = 2;
+    }
+
+    if (mask.size() - start > GGML_MAX_N_THREADS/4) {
+        return false;
+    }
+
+    for (size_t i = mask.size(); i > start; --i) {
+        const char c = (char) tolower((unsigned char) mask[i - 1]);
+
+        int id;
+        if      (c >= '0' && c <= '9') id = c - '0';
+        else if (c >= 'a' && c <= 'f') id = c - 'a' + 10;
+        else return false;
+
+        const size_t cpu = 4*(mask.size() - i);
+        for (int b = 0; b < 4; ++b) {
+            cpumask[cpu + b] = cpumask[cpu + b] || ((id >> b) & 1);
+        }
+    }
+
+    return true;
+}
+
 static bool whisper_params_parse(int argc, char ** argv, whisper_params & params) {
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -156,6 +198,7 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-ml"   || arg == "--max-len")              { params.max_len         = std::stoi(ARGV_NEXT); }
         else if (arg == "-bo"   || arg == "--best-of")              { params.best_of         = std::stoi(ARGV_NEXT); }
         else if (arg == "-bs"   || arg == "--beam-size")            { params.beam_size       = std::stoi(ARGV_NEXT); }
+        else if (arg == "-bp"   || arg == "--beam-patience")        { params.beam_patience   = std::stof(ARGV_NEXT); }
         else if (arg == "-ac"   || arg == "--audio-ctx")            { params.audio_ctx       = std::stoi(ARGV_NEXT); }
         else if (arg == "-wt"   || arg == "--word-thold")           { params.word_thold      = std::stof(ARGV_NEXT); }
         else if (arg == "-et"   || arg == "--entropy-thold")        { params.entropy_thold   = std::stof(ARGV_NEXT); }
@@ -197,6 +240,16 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-ng"   || arg == "--no-gpu")               { params.use_gpu         = false; }
         else if (arg == "-fa"   || arg == "--flash-attn")           { params.flash_attn      = true; }
         else if (arg == "-nfa"  || arg == "--no-flash-attn")        { params.flash_attn      = false; }
+        else if (                  arg == "--mel-in-graph")         { params.mel_in_graph    = true; }
+        else if (                  arg == "--no-mmap")              { params.use_mmap        = false; }
+        else if (                  arg == "--mmap-prefetch")        { params.mmap_prefetch   = true; }
+        else if (arg == "-kvt"  || arg == "--kv-type")              { params.kv_type         = ARGV_NEXT; }
+        else if (                  arg == "--threadpool")           { params.threadpool      = true; }
+        else if (arg == "-C"    || arg == "--cpu-mask")             { params.cpu_mask        = ARGV_NEXT; params.threadpool = true; }
+        else if (                  arg == "--cpu-strict")           { params.cpu_strict      = true; params.threadpool = true; }
+        else if (                  arg == "--prio")                 { params.prio            = std::stoi(ARGV_NEXT); params.threadpool = true; }
+        else if (                  arg == "--poll")                 { params.poll            = std::stoi(ARGV_NEXT); params.threadpool = true; }
+        else if (                  arg == "--numa")                 { params.numa            = ARGV_NEXT; }
         else if (arg == "-sns"  || arg == "--suppress-nst")         { params.suppress_nst    = true; }
         else if (                  arg == "--suppress-regex")       { params.suppress_regex  = ARGV_NEXT; }
         else if (                  arg == "--grammar")              { params.grammar         = ARGV_NEXT; }
@@ -238,7 +291,8 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -sow,      --split-on-word        [%-7s] split on word rather than on token\n",             params.split_on_word ? "true" : "false");
     fprintf(stderr, "  -bo N,     --best-of N            [%-7d] number of best candidates to keep\n",              params.best_of);
     fprintf(stderr, "  -bs N,     --beam-size N          [%-7d] beam size for beam search\n",                      params.beam_size);
-    fprintf(stderr, "  -ac N,     --audio-ctx N          [%-7d] audio context size (0 - all)\n",                   params.audio_ctx);
+    fprintf(stderr, "  -bp N,     --beam-patience N      [%-7.2f] beam search patience (<= 0 - disabled)\n",       params.beam_patience);
+    fprintf(stderr, "  -ac N,     --audio-ctx N          [%-7d] audio context size (0 - all, -1 - auto)\n",                   params.audio_ctx);
     fprintf(stderr, "  -wt N,     --word-thold N         [%-7.2f] word timestamp probability threshold\n",         params.word_thold);
     fprintf(stderr, "  -et N,     --entropy-thold N      [%-7.2f] entropy threshold for decoder fail\n",           params.entropy_thold);
     fprintf(stderr, "  -lpt N,    --logprob-thold N      [%-7.2f] log probability threshold for decoder fail\n",   params.logprob_thold);
@@ -273,11 +327,21 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -m FNAME,  --model FNAME          [%-7s] model path\n",                                     params.model.c_str());
     fprintf(stderr, "  -f FNAME,  --file FNAME           [%-7s] input audio file path\n",                          "");
     fprintf(stderr, "  -oved D,   --ov-e-device DNAME    [%-7s] the OpenVINO device used for encode inference\n",  params.openvino_encode_device.c_str());
-    fprintf(stderr, "  -dtw MODEL --dtw MODEL            [%-7s] compute token-level timestamps\n",                 params.dtw.c_str());
+    fprintf(stderr, "  -dtw MODEL --dtw MODEL            [%-7s] compute token-level timestamps (\"model\" - heads from the GGUF file)\n", params.dtw.c_str());
     fprintf(stderr, "  -ls,       --log-score            [%-7s] log best decoder scores of tokens\n",              params.log_score?"true":"false");
     fprintf(stderr, "  -ng,       --no-gpu               [%-7s] disable GPU\n",                                    params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,       --flash-attn           [%-7s] enable flash attention\n",                         params.flash_attn ? "true" : "false");
     fprintf(stderr, "  -nfa,      --no-flash-attn        [%-7s] disable flash attention\n",                        params.flash_attn ? "false" : "true");
+    fprintf(stderr, "  --mel-in-graph                    [%-7s] compute the mel spectrogram in the encoder graph\n", params.mel_in_graph ? "true" : "false");
+    fprintf(stderr, "  --no-mmap                         [%-7s] read the model file instead of mapping it\n",     params.use_mmap ? "false" : "true");
+    fprintf(stderr, "  --mmap-prefetch                   [%-7s] prefetch the mapped model file\n",                params.mmap_prefetch ? "true" : "false");
+    fprintf(stderr, "  -kvt TYPE, --kv-type TYPE         [%-7s] KV cache type: f16, q8_0 or q4_0 (quantized requires -fa)\n", params.kv_type.c_str());
+    fprintf(stderr, "  --threadpool                      [%-7s] run the CPU graphs on a threadpool shared by the processors\n", params.threadpool ? "true" : "false");
+    fprintf(stderr, "  -C M,      --cpu-mask M           [%-7s] threadpool CPU affinity mask, hex (implies --threadpool)\n", params.cpu_mask.c_str());
+    fprintf(stderr, "  --cpu-strict                      [%-7s] threadpool strict CPU placement (implies --threadpool)\n", params.cpu_strict ? "true" : "false");
+    fprintf(stderr, "  --prio N                          [%-7d] threadpool priority: -1 low, 0 normal, 1 medium, 2 high, 3 realtime (implies --threadpool)\n", params.prio);
+    fprintf(stderr, "  --poll N                          [%-7d] threadpool polling level, 0 - no polling, 100 - aggressive (implies --threadpool)\n", params.poll);
+    fprintf(stderr, "  --numa MODE                       [%-7s] NUMA placement of the weights: distribute or replicate (a copy per node)\n", params.numa.c_str());
     fprintf(stderr, "  -sns,      --suppress-nst         [%-7s] suppress non-speech tokens\n",                     params.suppress_nst ? "true" : "false");
     fprintf(stderr, "  --suppress-regex REGEX            [%-7s] regular expression matching tokens to suppress\n", params.suppress_regex.c_str());
     fprintf(stderr, "  --grammar GRAMMAR                 [%-7s] GBNF grammar to guide decoding\n",                 params.grammar.c_str());
@@ -1005,6 +1069,39 @@ int main(int argc, char ** argv) {
     cparams.use_gpu    = params.use_gpu;
     cparams.flash_attn = params.flash_attn;
 
+    cparams.mel_in_graph      = params.mel_in_graph;
+    cparams.use_mmap          = params.use_mmap;
+    cparams.mmap_prefetch     = params.mmap_prefetch;
+
+    if      (params.kv_type == "f16")  cparams.type_kv = GGML_TYPE_F16;
+    else if (params.kv_type == "q8_0") cparams.type_kv = GGML_TYPE_Q8_0;
+    else if (params.kv_type == "q4_0") cparams.type_kv = GGML_TYPE_Q4_0;
+    else {
+        fprintf(stderr, "error: unknown KV cache type '%s'\n", params.kv_type.c_str());
+        return 3;
+    }
+
+    struct ggml_threadpool_params tpp = ggml_threadpool_params_default(params.n_threads);
+    if (params.threadpool) {
+        if (!params.cpu_mask.empty() && !parse_cpu_mask(params.cpu_mask, tpp.cpumask)) {
+            fprintf(stderr, "error: invalid CPU mask '%s'\n", params.cpu_mask.c_str());
+            return 3;
+        }
+        tpp.strict_cpu = params.cpu_strict;
+        tpp.prio       = (enum ggml_sched_priority) params.prio;
+        tpp.poll       = params.poll;
+
+        cparams.threadpool_params = &tpp;
+    }
+
+    if      (params.numa.empty())         cparams.numa = WHISPER_NUMA_DISABLED;
+    else if (params.numa == "distribute") cparams.numa = WHISPER_NUMA_DISTRIBUTE;
+    else if (params.numa == "replicate")  cparams.numa = WHISPER_NUMA_REPLICATE;
+    else {
+        fprintf(stderr, "error: unknown NUMA mode '%s'\n", params.numa.c_str());
+        return 3;
+    }
+
     if (!params.dtw.empty()) {
         cparams.dtw_token_timestamps = true;
         cparams.dtw_aheads_preset = WHISPER_AHEADS_NONE;
@@ -1022,7 +1119,8 @@ int main(int argc, char ** argv) {
         if (params.dtw == "large.v3")  cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V3;
         if (params.dtw == "large.v3.turbo")  cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V3_TURBO;
 
-        if (cparams.dtw_aheads_preset == WHISPER_AHEADS_NONE) {
+        // "model" keeps WHISPER_AHEADS_NONE - the alignment heads are taken from the model file
+        if (cparams.dtw_aheads_preset == WHISPER_AHEADS_NONE && params.dtw != "model") {
             fprintf(stderr, "error: unknown DTW preset '%s'\n", params.dtw.c_str());
             return 3;
         }
@@ -1191,6 +1289,7 @@ int main(int argc, char ** argv) {
 
             wparams.greedy.best_of        = params.best_of;
             wparams.beam_search.beam_size = params.beam_size;
+            wparams.beam_search.patience  = params.beam_patience;
 
             wparams.temperature_inc  = params.no_fallback ? 0.0f : params.temperature_inc;
             wparams.temperature      = params.temperature;
@@ -1,5 +1,6 @@
 #include "ggml.h"
 #include "ggml-backend.h"
+#include "gguf.h"
 
 #include "common.h"
 #include "common-ggml.h"
@@ -9,6 +10,7 @@
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <memory>
 #include <map>
 #include <string>
 #include <vector>
@@ -36,6 +38,498 @@ struct whisper_filters {
     std::vector<float> data;
 };
 
+// GGUF metadata keys - keep in sync with src/whisper.cpp
+#define WHISPER_KV_ARCHITECTURE        "general.architecture"
+#define WHISPER_KV_FILE_TYPE           "general.file_type"
+#define WHISPER_KV_QNT_VERSION         "general.quantization_version"
+#define WHISPER_KV_VOCAB_SIZE          "whisper.vocab_size"
+#define WHISPER_KV_AUDIO_CTX           "whisper.audio.context_length"
+#define WHISPER_KV_AUDIO_STATE         "whisper.audio.embedding_length"
+#define WHISPER_KV_AUDIO_HEAD          "whisper.audio.head_count"
+#define WHISPER_KV_AUDIO_LAYER         "whisper.audio.block_count"
+#define WHISPER_KV_TEXT_CTX            "whisper.text.context_length"
+#define WHISPER_KV_TEXT_STATE          "whisper.text.embedding_length"
+#define WHISPER_KV_TEXT_HEAD           "whisper.text.head_count"
+#define WHISPER_KV_TEXT_LAYER          "whisper.text.block_count"
+#define WHISPER_KV_N_MELS              "whisper.audio.mel_count"
+#define WHISPER_KV_MEL_FILTERS         "whisper.mel_filters"
+#define WHISPER_KV_MEL_FILTERS_N_FFT   "whisper.mel_filters.n_fft"
+#define WHISPER_KV_ALIGNMENT_HEADS     "whisper.alignment_heads" // [n_text_layer, n_head] pairs
+#define WHISPER_KV_TOKEN_DATA          "whisper.tokenizer.token_data"
+#define WHISPER_KV_TOKEN_LEN           "whisper.tokenizer.token_len"
+
+// regexes of tensor names to not be quantized
+static const std::vector<std::string> k_to_skip = {
+    //"encoder.*",
+    "encoder.conv1.bias",
+    "encoder.conv2.bias",
+    "encoder.positional_embedding",
+    "decoder.positional_embedding",
+};
+
+// alignment heads of the OpenAI models (same as the presets in src/whisper.cpp)
+static const std::vector<int32_t> k_aheads_tiny_en   = { 1, 0, 2, 0, 2, 5, 3, 0, 3, 1, 3, 2, 3, 3, 3, 4 };
+static const std::vector<int32_t> k_aheads_tiny      = { 2, 2, 3, 0, 3, 2, 3, 3, 3, 4, 3, 5 };
+static const std::vector<int32_t> k_aheads_base_en   = { 3, 3, 4, 7, 5, 1, 5, 5, 5, 7 };
+static const std::vector<int32_t> k_aheads_base      = { 3, 1, 4, 2, 4, 3, 4, 7, 5, 1, 5, 2, 5, 4, 5, 6 };
+static const std::vector<int32_t> k_aheads_small_en  = { 6, 6, 7, 0, 7, 3, 7, 8, 8, 2, 8, 5, 8, 7, 9, 0, 9, 4, 9, 8, 9, 10, 10, 0, 10, 1, 10, 2, 10, 3, 10, 6, 10, 11, 11, 2, 11, 4 };
+static const std::vector<int32_t> k_aheads_small     = { 5, 3, 5, 9, 8, 0, 8, 4, 8, 7, 8, 8, 9, 0, 9, 7, 9, 9, 10, 5 };
+static const std::vector<int32_t> k_aheads_medium_en = { 11, 4, 14, 1, 14, 12, 14, 14, 15, 4, 16, 0, 16, 4, 16, 9, 17, 12, 17, 14, 18, 7, 18, 10, 18, 15, 20, 0, 20, 3, 20, 9, 20, 14, 21, 12 };
+static const std::vector<int32_t> k_aheads_medium    = { 13, 15, 15, 4, 15, 15, 16, 1, 20, 0, 23, 4 };
+static const std::vector<int32_t> k_aheads_large_v3  = { 7, 0, 10, 17, 12, 18, 13, 12, 16, 1, 17, 14, 19, 11, 21, 4, 24, 1, 25, 6 };
+static const std::vector<int32_t> k_aheads_large_v3_turbo = { 2, 4, 2, 11, 3, 3, 3, 6, 3, 11, 3, 14 };
+
+struct whisper_tensor_data {
+    std::string name;
+    int32_t     n_dims;
+    int64_t     ne[4];
+    ggml_type   type;
+
+    std::vector<uint8_t> data;
+};
+
+// the whole model in memory, independent of the container it was read from
+struct whisper_model_data {
+    whisper_hparams hparams; // ftype without the quantization version
+    whisper_filters filters;
+
+    std::vector<std::string> tokens;
+    std::vector<int32_t>     aheads; // [n_text_layer, n_head] pairs
+
+    std::vector<whisper_tensor_data> tensors;
+};
+
+static bool ends_with(const std::string & str, const std::string & suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool is_gguf_file(const std::string & fname) {
+    auto fin = std::ifstream(fname, std::ios::binary);
+
+    char magic[4] = { 0 };
+    fin.read(magic, sizeof(magic));
+
+    return fin && memcmp(magic, GGUF_MAGIC, sizeof(magic)) == 0;
+}
+
+// the legacy files do not store the alignment heads - infer them from the hparams when the model is unambiguous
+// (large-v1 and large-v2 have the same shape, so they get none)
+static std::vector<int32_t> whisper_guess_aheads(const whisper_hparams & hparams) {
+    const bool is_en = hparams.n_vocab == 51864;
+
+    switch (hparams.n_audio_layer) {
+        case  4: return is_en ? k_aheads_tiny_en   : k_aheads_tiny;
+        case  6: return is_en ? k_aheads_base_en   : k_aheads_base;
+        case 12: return is_en ? k_aheads_small_en  : k_aheads_small;
+        case 24: return is_en ? k_aheads_medium_en : k_aheads_medium;
+        case 32:
+            if (hparams.n_text_layer == 4) {
+                return k_aheads_large_v3_turbo;
+            }
+            if (hparams.n_vocab == 51866) {
+                return k_aheads_large_v3;
+            }
+            break;
+    }
+
+    return {};
+}
+
+// read a legacy ggml model file
+static bool whisper_model_read_ggml(const std::string & fname, whisper_model_data & model) {
+    auto finp = std::ifstream(fname, std::ios::binary);
+    if (!finp) {
+        fprintf(stderr, "%s: failed to open '%s' for reading\n", __func__, fname.c_str());
+        return false;
+    }
+
+    uint32_t magic;
+    finp.read((char *) &magic, sizeof(magic));
+    if (magic != GGML_FILE_MAGIC) {
+        fprintf(stderr, "%s: invalid model file '%s' (bad magic)\n", __func__, fname.c_str());
+        return false;
+    }
+
+    auto & hparams = model.hparams;
+
+    finp.read((char *) &hparams.n_vocab,       sizeof(hparams.n_vocab));
+    finp.read((char *) &hparams.n_audio_ctx,   sizeof(hparams.n_audio_ctx));
+    finp.read((char *) &hparams.n_audio_state, sizeof(hparams.n_audio_state));
+    finp.read((char *) &hparams.n_audio_head,  sizeof(hparams.n_audio_head));
+    finp.read((char *) &hparams.n_audio_layer, sizeof(hparams.n_audio_layer));
+    finp.read((char *) &hparams.n_text_ctx,    sizeof(hparams.n_text_ctx));
+    finp.read((char *) &hparams.n_text_state,  sizeof(hparams.n_text_state));
+    finp.read((char *) &hparams.n_text_head,   sizeof(hparams.n_text_head));
+    finp.read((char *) &hparams.n_text_layer,  sizeof(hparams.n_text_layer));
+    finp.read((char *) &hparams.n_mels,        sizeof(hparams.n_mels));
+    finp.read((char *) &hparams.ftype,         sizeof(hparams.ftype));
+
+    hparams.ftype %= GGML_QNT_VERSION_FACTOR;
+
+    auto & filters = model.filters;
+
+    finp.read((char *) &filters.n_mel, sizeof(filters.n_mel));
+    finp.read((char *) &filters.n_fft, sizeof(filters.n_fft));
+
+    filters.data.resize(filters.n_mel * filters.n_fft);
+    finp.read((char *) filters.data.data(), filters.data.size() * sizeof(float));
+
+    int32_t n_vocab = 0;
+    finp.read((char *) &n_vocab, sizeof(n_vocab));
+
+    model.tokens.resize(n_vocab);
+    for (int i = 0; i < n_vocab; i++) {
+        uint32_t len;
+        finp.read((char *) &len, sizeof(len));
+
+        model.tokens[i].resize(len);
+        finp.read(&model.tokens[i][0], len);
+    }
+
+    if (!finp) {
+        fprintf(stderr, "%s: invalid model file '%s' (truncated header)\n", __func__, fname.c_str());
+        return false;
+    }
+
+    while (true) {
+        int32_t n_dims;
+        int32_t length;
+        int32_t ttype;
+
+        finp.read(reinterpret_cast<char *>(&n_dims), sizeof(n_dims));
+        finp.read(reinterpret_cast<char *>(&length), sizeof(length));
+        finp.read(reinterpret_cast<char *>(&ttype),  sizeof(ttype));
+
+        if (finp.eof()) {
+            break;
+        }
+
+        if (n_dims < 1 || n_dims > 4 || length <= 0 || ttype < 0 || ttype >= GGML_TYPE_COUNT || ggml_blck_size(ggml_type(ttype)) == 0) {
+            fprintf(stderr, "%s: invalid tensor header in '%s'\n", __func__, fname.c_str());
+            return false;
+        }
+
+        whisper_tensor_data tensor;
+        tensor.n_dims = n_dims;
+        tensor.type   = ggml_type(ttype);
+
+        for (int i = 0; i < 4; ++i) {
+            int32_t ne = 1;
+            if (i < n_dims) {
+                finp.read(reinterpret_cast<char *>(&ne), sizeof(ne));
+            }
+            tensor.ne[i] = ne;
+        }
+
+        std::string name(length, 0);
+        finp.read(&name[0], length);
+
+        // the aligned files pad the name with '\0'
+        tensor.name = name.c_str();
+
+        const size_t nbytes = ggml_row_size(tensor.type, tensor.ne[0])*tensor.ne[1]*tensor.ne[2]*tensor.ne[3];
+
+        tensor.data.resize(nbytes);
+        finp.read(reinterpret_cast<char *>(tensor.data.data()), nbytes);
+
+        if (!finp) {
+            fprintf(stderr, "%s: tensor '%s' is truncated in '%s'\n", __func__, tensor.name.c_str(), fname.c_str());
+            return false;
+        }
+
+        model.tensors.push_back(std::move(tensor));
+    }
+
+    model.aheads = whisper_guess_aheads(hparams);
+
+    return true;
+}
+
+static bool whisper_gguf_get_i32(const gguf_context * gguf, const char * key, int32_t & dst) {
+    const int64_t kid = gguf_find_key(gguf, key);
+    if (kid < 0) {
+        fprintf(stderr, "%s: key '%s' not found\n", __func__, key);
+        return false;
+    }
+
+    switch (gguf_get_kv_type(gguf, kid)) {
+        case GGUF_TYPE_INT32:  dst = gguf_get_val_i32(gguf, kid);           return true;
+        case GGUF_TYPE_UINT32: dst = (int32_t) gguf_get_val_u32(gguf, kid); return true;
+        default:
+            fprintf(stderr, "%s: key '%s' has type %s, expected an int32\n", __func__, key, gguf_type_name(gguf_get_kv_type(gguf, kid)));
+            return false;
+    }
+}
+
+static const void * whisper_gguf_get_arr(const gguf_context * gguf, const char * key, gguf_type type, size_t & n) {
+    n = 0;
+
+    const int64_t kid = gguf_find_key(gguf, key);
+    if (kid < 0 || gguf_get_kv_type(gguf, kid) != GGUF_TYPE_ARRAY || gguf_get_arr_type(gguf, kid) != type) {
+        return nullptr;
+    }
+
+    n = gguf_get_arr_n(gguf, kid);
+
+    return gguf_get_arr_data(gguf, kid);
+}
+
+// read a GGUF model file written by whisper_model_write_gguf
+static bool whisper_model_read_gguf(const std::string & fname, whisper_model_data & model) {
+    ggml_context * meta = nullptr;
+
+    gguf_init_params params = {
+        /*.no_alloc =*/ false,
+        /*.ctx      =*/ &meta,
+    };
+
+    std::unique_ptr<gguf_context, decltype(&gguf_free)> gguf(gguf_init_from_file(fname.c_str(), params), gguf_free);
+    std::unique_ptr<ggml_context, decltype(&ggml_free)> ctx(meta, ggml_free);
+
+    if (!gguf) {
+        fprintf(stderr, "%s: failed to read GGUF file '%s'\n", __func__, fname.c_str());
+        return false;
+    }
+
+    const gguf_context * kv = gguf.get();
+
+    {
+        const int64_t kid = gguf_find_key(kv, WHISPER_KV_ARCHITECTURE);
+        if (kid < 0 || gguf_get_kv_type(kv, kid) != GGUF_TYPE_STRING || strcmp(gguf_get_val_str(kv, kid), "whisper") != 0) {
+            fprintf(stderr, "%s: '%s' is not a whisper model\n", __func__, fname.c_str());
+            return false;
+        }
+    }
+
+    auto & hparams = model.hparams;
+
+    if (!whisper_gguf_get_i32(kv, WHISPER_KV_VOCAB_SIZE,  hparams.n_vocab)       ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_CTX,   hparams.n_audio_ctx)   ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_STATE, hparams.n_audio_state) ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_HEAD,  hparams.n_audio_head)  ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_LAYER, hparams.n_audio_layer) ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_CTX,    hparams.n_text_ctx)    ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_STATE,  hparams.n_text_state)  ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_HEAD,   hparams.n_text_head)   ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_LAYER,  hparams.n_text_layer)  ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_N_MELS,      hparams.n_mels)        ||
+        !whisper_gguf_get_i32(kv, WHISPER_KV_FILE_TYPE,   hparams.ftype)) {
+        return false;
+    }
+
+    {
+        auto & filters = model.filters;
+
+        size_t n = 0;
+        const float * data = (const float *) whisper_gguf_get_arr(kv, WHISPER_KV_MEL_FILTERS, GGUF_TYPE_FLOAT32, n);
+
+        if (!whisper_gguf_get_i32(kv, WHISPER_KV_MEL_FILTERS_N_FFT, filters.n_fft)) {
+            return false;
+        }
+
+        if (data == nullptr || filters.n_fft <= 0 || n % filters.n_fft != 0) {
+            fprintf(stderr, "%s: invalid or missing '%s'\n", __func__, WHISPER_KV_MEL_FILTERS);
+            return false;
+        }
+
+        filters.n_mel = n / filters.n_fft;
+        filters.data.assign(data, data + n);
+    }
+
+    {
+        size_t n_data = 0;
+        size_t n_len  = 0;
+
+        const char     * data = (const char     *) whisper_gguf_get_arr(kv, WHISPER_KV_TOKEN_DATA, GGUF_TYPE_UINT8,  n_data);
+        const uint32_t * lens = (const uint32_t *) whisper_gguf_get_arr(kv, WHISPER_KV_TOKEN_LEN,  GGUF_TYPE_UINT32, n_len);
+
+        if (data == nullptr || lens == nullptr) {
+            fprintf(stderr, "%s: invalid or missing '%s'\n", __func__, WHISPER_KV_TOKEN_LEN);
+            return false;
+        }
+
+        size_t offs = 0;
+        for (size_t i = 0; i < n_len; ++i) {
+            if (offs + lens[i] > n_data) {
+                fprintf(stderr, "%s: token %d is out of bounds of '%s'\n", __func__, (int) i, WHISPER_KV_TOKEN_DATA);
+                return false;
+            }
+            model.tokens.emplace_back(data + offs, lens[i]);
+            offs += lens[i];
+        }
+    }
+
+    {
+        size_t n = 0;
+        const int32_t * data = (const int32_t *) whisper_gguf_get_arr(kv, WHISPER_KV_ALIGNMENT_HEADS, GGUF_TYPE_INT32, n);
+        if (data) {
+            model.aheads.assign(data, data + n);
+        }
+    }
+
+    for (int64_t i = 0; i < gguf_get_n_tensors(kv); ++i) {
+        const ggml_tensor * src = ggml_get_tensor(meta, gguf_get_tensor_name(kv, i));
+
+        whisper_tensor_data tensor;
+        tensor.name   = ggml_get_name(src);
+        tensor.n_dims = ggml_n_dims(src);
+        tensor.type   = src->type;
+
+        for (int j = 0; j < 4; ++j) {
+            tensor.ne[j] = src->ne[j];
+        }
+
+        const uint8_t * data = (const uint8_t *) src->data;
+        tensor.data.assign(data, data + ggml_nbytes(src));
+
+        model.tensors.push_back(std::move(tensor));
+    }
+
+    return true;
+}
+
+// write the model as GGUF, quantizing the 2D F32/F16 weights to ftype (GGML_FTYPE_UNKNOWN keeps the tensor types)
+static bool whisper_model_write_gguf(const std::string & fname, whisper_model_data & model, ggml_ftype ftype) {
+    const ggml_type qtype = ftype == GGML_FTYPE_UNKNOWN ? GGML_TYPE_COUNT : ggml_ftype_to_ggml_type(ftype);
+
+    if (ftype != GGML_FTYPE_UNKNOWN && !ggml_is_quantized(qtype)) {
+        fprintf(stderr, "%s: invalid quantization type %d\n", __func__, ftype);
+        return false;
+    }
+
+    size_t total_size_org = 0;
+    size_t total_size_new = 0;
+
+    std::vector<float> data_f32;
+
+    for (auto & tensor : model.tensors) {
+        total_size_org += tensor.data.size();
+
+        bool quantize = qtype != GGML_TYPE_COUNT && tensor.n_dims == 2;
+        quantize = quantize && (tensor.type == GGML_TYPE_F32 || tensor.type == GGML_TYPE_F16);
+        quantize = quantize && tensor.ne[0] % ggml_blck_size(qtype) == 0;
+
+        for (const auto & s : k_to_skip) {
+            if (std::regex_match(tensor.name, std::regex(s))) {
+                quantize = false;
+            }
+        }
+
+        printf("%64s - [%5d, %5d], type = %6s ", tensor.name.c_str(), (int) tensor.ne[0], (int) tensor.ne[1], ggml_type_name(tensor.type));
+
+        if (quantize) {
+            const int64_t nelements = tensor.ne[0]*tensor.ne[1];
+
+            data_f32.resize(nelements);
+            if (tensor.type == GGML_TYPE_F16) {
+                ggml_fp16_to_fp32_row((const ggml_fp16_t *) tensor.data.data(), data_f32.data(), nelements);
+            } else {
+                memcpy(data_f32.data(), tensor.data.data(), nelements*sizeof(float));
+            }
+
+            tensor.data.resize(ggml_row_size(qtype, tensor.ne[0])*tensor.ne[1]);
+            ggml_quantize_chunk(qtype, data_f32.data(), tensor.data.data(), 0, tensor.ne[1], tensor.ne[0], nullptr);
+
+            printf("-> %6s, size = %8.3f MB\n", ggml_type_name(qtype), tensor.data.size()/1024.0/1024.0);
+
+            tensor.type = qtype;
+        } else {
+            printf("size = %8.3f MB\n", tensor.data.size()/1024.0/1024.0);
+        }
+
+        total_size_new += tensor.data.size();
+    }
+
+    if (ftype != GGML_FTYPE_UNKNOWN) {
+        model.hparams.ftype = ftype;
+    }
+
+    printf("%s: model size  = %8.2f MB\n", __func__, total_size_org/1024.0/1024.0);
+    printf("%s: quant size  = %8.2f MB | ftype = %d\n", __func__, total_size_new/1024.0/1024.0, model.hparams.ftype);
+
+    std::unique_ptr<gguf_context, decltype(&gguf_free)> gguf(gguf_init_empty(), gguf_free);
+
+    const auto & hparams = model.hparams;
+
+    gguf_context * kv = gguf.get();
+
+    gguf_set_val_str(kv, WHISPER_KV_ARCHITECTURE, "whisper");
+    gguf_set_val_u32(kv, WHISPER_KV_FILE_TYPE,    hparams.ftype);
+    gguf_set_val_u32(kv, WHISPER_KV_QNT_VERSION,  GGML_QNT_VERSION);
+    gguf_set_val_u32(kv, WHISPER_KV_VOCAB_SIZE,   hparams.n_vocab);
+    gguf_set_val_u32(kv, WHISPER_KV_AUDIO_CTX,    hparams.n_audio_ctx);
+    gguf_set_val_u32(kv, WHISPER_KV_AUDIO_STATE,  hparams.n_audio_state);
+    gguf_set_val_u32(kv, WHISPER_KV_AUDIO_HEAD,   hparams.n_audio_head);
+    gguf_set_val_u32(kv, WHISPER_KV_AUDIO_LAYER,  hparams.n_audio_layer);
+    gguf_set_val_u32(kv, WHISPER_KV_TEXT_CTX,     hparams.n_text_ctx);
+    gguf_set_val_u32(kv, WHISPER_KV_TEXT_STATE,   hparams.n_text_state);
+    gguf_set_val_u32(kv, WHISPER_KV_TEXT_HEAD,    hparams.n_text_head);
+    gguf_set_val_u32(kv, WHISPER_KV_TEXT_LAYER,   hparams.n_text_layer);
+    gguf_set_val_u32(kv, WHISPER_KV_N_MELS,       hparams.n_mels);
+
+    gguf_set_arr_data(kv, WHISPER_KV_MEL_FILTERS, GGUF_TYPE_FLOAT32, model.filters.data.data(), model.filters.data.size());
+    gguf_set_val_u32 (kv, WHISPER_KV_MEL_FILTERS_N_FFT, model.filters.n_fft);
+
+    if (!model.aheads.empty()) {
+        gguf_set_arr_data(kv, WHISPER_KV_ALIGNMENT_HEADS, GGUF_TYPE_INT32, model.aheads.data(), model.aheads.size());
+    }
+
+    // the tokens are raw bytes (not necessarily valid UTF-8), so they are stored as one blob + lengths
+    {
+        std::vector<uint8_t>  token_data;
+        std::vector<uint32_t> token_len;
+
+        for (const auto & token : model.tokens) {
+            token_data.insert(token_data.end(), token.begin(), token.end());
+            token_len.push_back(token.size());
+        }
+
+        gguf_set_arr_data(kv, WHISPER_KV_TOKEN_DATA, GGUF_TYPE_UINT8,  token_data.data(), token_data.size());
+        gguf_set_arr_data(kv, WHISPER_KV_TOKEN_LEN,  GGUF_TYPE_UINT32, token_len.data(),  token_len.size());
+    }
+
+    ggml_init_params params = {
+        /*.mem_size   =*/ (model.tensors.size() + 1)*ggml_tensor_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    std::unique_ptr<ggml_context, decltype(&ggml_free)> ctx(ggml_init(params), ggml_free);
+
+    for (auto & tensor : model.tensors) {
+        ggml_tensor * cur = ggml_new_tensor(ctx.get(), tensor.type, tensor.n_dims, tensor.ne);
+        ggml_set_name(cur, tensor.name.c_str());
+        cur->data = tensor.data.data();
+
+        gguf_add_tensor(kv, cur);
+    }
+
+    if (!gguf_write_to_file(kv, fname.c_str(), false)) {
+        fprintf(stderr, "%s: failed to write '%s'\n", __func__, fname.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// convert a model to GGUF and optionally quantize it, or re-quantize a GGUF model
+static bool whisper_model_quantize_gguf(const std::string & fname_inp, const std::string & fname_out, ggml_ftype ftype) {
+    whisper_model_data model;
+
+    printf("%s: loading model from '%s'\n", __func__, fname_inp.c_str());
+
+    const bool ok = is_gguf_file(fname_inp) ? whisper_model_read_gguf(fname_inp, model) : whisper_model_read_ggml(fname_inp, model);
+    if (!ok) {
+        return false;
+    }
+
+    if (model.aheads.empty()) {
+        fprintf(stderr, "%s: unknown alignment heads for this model, use -dtw <preset> for token-level timestamps\n", __func__);
+    }
+
+    return whisper_model_write_gguf(fname_out, model, ftype);
+}
+
 // quantize a model
 static bool whisper_model_quantize(const std::string & fname_inp, const std::string & fname_out, ggml_ftype ftype) {
     gpt_vocab vocab;
@@ -156,16 +650,7 @@ static bool whisper_model_quantize(const std::string & fname_inp, const std::str
         }
     }
 
-    // regexes of tensor names to not be quantized
-    const std::vector<std::string> to_skip = {
-        //"encoder.*",
-        "encoder.conv1.bias",
-        "encoder.conv2.bias",
-        "encoder.positional_embedding",
-        "decoder.positional_embedding",
-    };
-
-    if (!ggml_common_quantize_0(finp, fout, ftype, { ".*" }, to_skip)) {
+    if (!ggml_common_quantize_0(finp, fout, ftype, { ".*" }, k_to_skip)) {
         fprintf(stderr, "%s: failed to quantize model '%s'\n", __func__, fname_inp.c_str());
         return false;
     }
@@ -179,8 +664,13 @@ static bool whisper_model_quantize(const std::string & fname_inp, const std::str
 int main(int argc, char ** argv) {
     ggml_backend_load_all();
 
-    if (argc != 4) {
+    if (argc != 4 && !(argc == 3 && ends_with(argv[2], ".gguf"))) {
         fprintf(stderr, "usage: %s model-f32.bin model-quant.bin type\n", argv[0]);
+        fprintf(stderr, "       %s model.bin model-quant.gguf [type]\n", argv[0]);
+        fprintf(stderr, "\n");
+        fprintf(stderr, "  the output is written as GGUF if its name ends with .gguf or if the input is a GGUF file\n");
+        fprintf(stderr, "  without a type the tensors are converted to GGUF as they are\n");
+        fprintf(stderr, "\n");
         ggml_print_ftypes(stderr);
         return 1;
     }
@@ -195,7 +685,14 @@ int main(int argc, char ** argv) {
     const std::string fname_inp = argv[1];
     const std::string fname_out = argv[2];
 
-    const ggml_ftype ftype = ggml_parse_ftype(argv[3]);
+    const ggml_ftype ftype = argc == 4 ? ggml_parse_ftype(argv[3]) : GGML_FTYPE_UNKNOWN;
+
+    if (argc == 4 && ftype == GGML_FTYPE_UNKNOWN) {
+        fprintf(stderr, "%s: invalid type '%s'\n", __func__, argv[3]);
+        return 1;
+    }
+
+    const bool use_gguf = ends_with(fname_out, ".gguf") || is_gguf_file(fname_inp);
 
     const int64_t t_main_start_us = ggml_time_us();
 
@@ -205,7 +702,11 @@ int main(int argc, char ** argv) {
     {
         const int64_t t_start_us = ggml_time_us();
 
-        if (!whisper_model_quantize(fname_inp, fname_out, ggml_ftype(ftype))) {
+        const bool ok = use_gguf ?
+            whisper_model_quantize_gguf(fname_inp, fname_out, ftype) :
+            whisper_model_quantize     (fname_inp, fname_out, ftype);
+
+        if (!ok) {
             fprintf(stderr, "%s: failed to quantize model from '%s'\n", __func__, fname_inp.c_str());
             return 1;
         }
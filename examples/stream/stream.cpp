@@ -171,7 +171,6 @@ int main(int argc, char ** argv) {
     }
 
     std::vector<float> pcmf32    (n_samples_30s, 0.0f);
-    std::vector<float> pcmf32_old;
     std::vector<float> pcmf32_new(n_samples_30s, 0.0f);
 
     std::vector<whisper_token> prompt_tokens;
@@ -275,20 +274,16 @@ int main(int argc, char ** argv) {
 
             const int n_samples_new = pcmf32_new.size();
 
-            // take up to params.length_ms audio from previous iteration
-            const int n_samples_take = std::min((int) pcmf32_old.size(), std::max(0, n_samples_keep + n_samples_len - n_samples_new));
-
-            //printf("processing: take = %d, new = %d, old = %d\n", n_samples_take, n_samples_new, (int) pcmf32_old.size());
-
-            pcmf32.resize(n_samples_new + n_samples_take);
+            // append the new audio to the rolling mel spectrogram - only the frames of the new audio are computed
+            whisper_mel_append_pcm(ctx, pcmf32_new.data(), n_samples_new);
 
-            for (int i = 0; i < n_samples_take; i++) {
-                pcmf32[i] = pcmf32_old[pcmf32_old.size() - n_samples_take + i];
-            }
+            // take up to params.length_ms audio from previous iteration
+            const int n_frames_max = std::max(n_samples_keep + n_samples_len, n_samples_new)/WHISPER_HOP_LENGTH;
+            const int n_frames     = whisper_mel_trim(ctx, 0);
 
-            memcpy(pcmf32.data() + n_samples_take, pcmf32_new.data(), n_samples_new*sizeof(float));
+            //printf("processing: frames = %d, new = %d\n", n_frames, n_samples_new);
 
-            pcmf32_old = pcmf32;
+            whisper_mel_trim(ctx, n_frames - n_frames_max);
         } else {
             const auto t_now  = std::chrono::high_resolution_clock::now();
             const auto t_diff = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_last).count();
@@ -338,7 +333,8 @@ int main(int argc, char ** argv) {
             wparams.prompt_tokens    = params.no_context ? nullptr : prompt_tokens.data();
             wparams.prompt_n_tokens  = params.no_context ? 0       : prompt_tokens.size();
 
-            if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+            // in sliding window mode, run on the rolling mel spectrogram
+            if (whisper_full(ctx, wparams, use_vad ? pcmf32.data() : nullptr, use_vad ? pcmf32.size() : 0) != 0) {
                 fprintf(stderr, "%s: failed to process audio\n", argv[0]);
                 return 6;
             }
@@ -409,7 +405,7 @@ int main(int argc, char ** argv) {
                 printf("\n");
 
                 // keep part of the audio for next iteration to try to mitigate word boundary issues
-                pcmf32_old = std::vector<float>(pcmf32.end() - n_samples_keep, pcmf32.end());
+                whisper_mel_trim(ctx, whisper_mel_trim(ctx, 0) - n_samples_keep/WHISPER_HOP_LENGTH);
 
                 // Add tokens of the last full length segment as the prompt
                 if (!params.no_context) {
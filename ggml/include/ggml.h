@@ -557,6 +557,8 @@ extern "C" {
 
         GGML_OP_GLU,
 
+        GGML_OP_CONV_1D_GELU,
+
         GGML_OP_COUNT,
     };
 
@@ -1906,6 +1908,17 @@ extern "C" {
             int                   s,  // stride
             int                   d); // dilation
 
+    // direct conv_1d with fused bias and GELU: gelu(conv_1d(a, b) + c)
+    // the im2col matrix is not materialized
+    GGML_API struct ggml_tensor * ggml_conv_1d_gelu(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,   // convolution kernel [K, IC, OC]
+            struct ggml_tensor  * b,   // data [L, IC]
+            struct ggml_tensor  * c,   // bias [1, OC]
+            int                   s0,  // stride
+            int                   p0,  // padding
+            int                   d0); // dilation
+
     // depthwise
     // TODO: this is very likely wrong for some cases! - needs more testing
     GGML_API struct ggml_tensor * ggml_conv_1d_dw(
@@ -1876,6 +1876,10 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
             {
                 ggml_compute_forward_conv_transpose_1d(params, tensor);
             } break;
+        case GGML_OP_CONV_1D_GELU:
+            {
+                ggml_compute_forward_conv_1d_gelu(params, tensor);
+            } break;
         case GGML_OP_IM2COL:
             {
                 ggml_compute_forward_im2col(params, tensor);
@@ -2277,6 +2281,7 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
         case GGML_OP_CONV_3D:
         case GGML_OP_CONV_2D_DW:
         case GGML_OP_CONV_TRANSPOSE_1D:
+        case GGML_OP_CONV_1D_GELU:
         case GGML_OP_CONV_TRANSPOSE_2D:
             {
                 n_tasks = n_threads;
@@ -2633,6 +2638,10 @@ void ggml_threadpool_free(struct ggml_threadpool* threadpool) {
     ggml_aligned_free(threadpool, sizeof(struct ggml_threadpool));
 }
 
+int ggml_threadpool_get_n_threads(struct ggml_threadpool * threadpool) {
+    return threadpool->n_threads_max;
+}
+
 #ifndef GGML_USE_OPENMP
 // pause/resume must be called under mutex
 static void ggml_threadpool_pause_locked(struct ggml_threadpool * threadpool) {
@@ -2803,6 +2812,14 @@ struct ggml_cplan ggml_graph_plan(
                     {
                         cur = GGML_IM2COL_WORK_SIZE;
                     } break;
+                case GGML_OP_CONV_1D_GELU:
+                    {
+                        const int64_t knl_n = node->src[0]->ne[0]*node->src[0]->ne[1];
+                        const int64_t c_out = node->src[0]->ne[2];
+
+                        // at least 8 patches per batch
+                        cur = MAX(GGML_CONV_1D_WORK_SIZE, 8*(knl_n*ggml_type_size(node->src[0]->type) + c_out*sizeof(float)));
+                    } break;
                 case GGML_OP_CONV_TRANSPOSE_2D:
                     {
                         const int64_t ne00 = node->src[0]->ne[0]; // W
@@ -2823,6 +2840,15 @@ struct ggml_cplan ggml_graph_plan(
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
                         cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+
+                        const int64_t n_chunks = ggml_flash_attn_ext_n_kv_chunks(node, n_tasks);
+                        if (n_chunks > 1) {
+                            const int64_t nr = node->src[0]->ne[1]*node->src[0]->ne[2]*node->src[0]->ne[3];
+
+                            // split-K partials: [VKQ, M, S] per (q row, KV chunk), after the padded per-thread scratch
+                            cur += sizeof(float)*CACHE_LINE_SIZE_F32*n_tasks;
+                            cur += sizeof(float)*(ne20 + 2)*nr*n_chunks;
+                        }
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
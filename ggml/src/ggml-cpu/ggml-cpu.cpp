@@ -449,6 +449,8 @@ static bool ggml_backend_cpu_device_supports_op(ggml_backend_dev_t dev, const st
         }
         case GGML_OP_IM2COL_BACK:
             return src0->type == GGML_TYPE_F32 && src1->type == GGML_TYPE_F32;
+        case GGML_OP_CONV_1D_GELU:
+            return (src0->type == GGML_TYPE_F32 || src0->type == GGML_TYPE_F16) && src1->type == GGML_TYPE_F32;
         case GGML_OP_GET_ROWS_BACK:
             return src0->type == GGML_TYPE_F32 || src0->type == GGML_TYPE_F16;
         case GGML_OP_OUT_PROD:
@@ -650,6 +652,15 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_threadpool_free") == 0) {
         return (void *)ggml_threadpool_free;
     }
+    if (strcmp(name, "ggml_threadpool_get_n_threads") == 0) {
+        return (void *)ggml_threadpool_get_n_threads;
+    }
+    if (strcmp(name, "ggml_threadpool_pause") == 0) {
+        return (void *)ggml_threadpool_pause;
+    }
+    if (strcmp(name, "ggml_threadpool_resume") == 0) {
+        return (void *)ggml_threadpool_resume;
+    }
     if (strcmp(name, "ggml_backend_cpu_set_threadpool") == 0) {
         return (void *)ggml_backend_cpu_set_threadpool;
     }
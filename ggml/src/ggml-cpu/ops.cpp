@@ -6797,6 +6797,122 @@ void ggml_compute_forward_conv_2d(
     ggml_compute_forward_conv_2d_impl(params, src0, src1, dst, src0->type);
 }
 
+// ggml_compute_forward_conv_1d_gelu
+
+static void ggml_compute_forward_conv_1d_gelu_impl(const ggml_compute_params * params,
+                                                   const ggml_tensor *         kernel,  // [K, IC, OC]
+                                                   const ggml_tensor *         src,     // [L, IC]
+                                                   const ggml_tensor *         bias,    // [1, OC]
+                                                   ggml_tensor *               dst,     // [OL, OC]
+                                                   ggml_type                   kernel_type) {
+
+    GGML_ASSERT(ggml_is_contiguous(kernel));
+    GGML_ASSERT(kernel_type == GGML_TYPE_F16 || kernel_type == GGML_TYPE_F32);
+    GGML_ASSERT(kernel->type == kernel_type);
+    GGML_ASSERT(src->type  == GGML_TYPE_F32 && src->nb[0] == sizeof(float));
+    GGML_ASSERT(bias->type == GGML_TYPE_F32 && ggml_is_contiguous(bias));
+    GGML_ASSERT(dst->nb[0] == sizeof(float));
+
+    const ggml_type_traits * traits = ggml_get_type_traits(kernel_type);
+
+    const int32_t stride   = dst->op_params[0];
+    const int32_t pad      = dst->op_params[1];
+    const int32_t dilation = dst->op_params[2];
+
+    const int64_t knl_w = kernel->ne[0];
+    const int64_t c_in  = kernel->ne[1];
+    const int64_t c_out = kernel->ne[2];
+    const int64_t src_w = src->ne[0];
+    const int64_t dst_w = dst->ne[0];
+
+    GGML_ASSERT(c_in == src->ne[1]);
+
+    const float * bias_data = (const float *) bias->data;
+
+    const int64_t knl_n = knl_w * c_in;
+
+    // the output positions are processed in batches that fit in the work buffer:
+    // the im2col rows of the batch followed by the GEMM output
+    const int64_t space_per_patch   = knl_n * traits->type_size + c_out * sizeof(float);
+    const int64_t batch_size        = params->wsize / space_per_patch;
+    const int64_t patches_per_batch = batch_size > 8 ? (batch_size / 8) * 8 : batch_size;
+    const int64_t batch_n           = (dst_w + patches_per_batch - 1) / patches_per_batch;
+
+    GGML_ASSERT(patches_per_batch > 0 && batch_size >= 1);
+
+    void * tmp = params->wdata;
+
+    for (int64_t batch_i = 0; batch_i < batch_n; ++batch_i) {
+        const int64_t patch_start_batch = batch_i * patches_per_batch;
+        const int64_t patch_end_batch   = std::min(patch_start_batch + patches_per_batch, dst_w);
+        const int64_t patch_n           = patch_end_batch - patch_start_batch;
+
+        const int64_t patch_per_thread  = (patch_n + params->nth - 1) / params->nth;
+        const int64_t patch_start       = patch_start_batch + params->ith * patch_per_thread;
+        const int64_t patch_end         = std::min(patch_start + patch_per_thread, patch_end_batch);
+
+        // im2col for the patches of this thread
+        for (int64_t p = patch_start; p < patch_end; ++p) {
+            char * dst_row = (char *) tmp + (p - patch_start_batch) * knl_n * traits->type_size;
+
+            for (int64_t ic = 0; ic < c_in; ++ic) {
+                const float * src_row = (const float *) ((const char *) src->data + ic * src->nb[1]);
+
+                for (int64_t kx = 0; kx < knl_w; ++kx) {
+                    const int64_t sx = p * stride + kx * dilation - pad;
+
+                    const float src_val = (sx < 0 || sx >= src_w) ? 0.0f : src_row[sx];
+
+                    const int64_t dst_idx = ic * knl_w + kx;
+
+                    if (kernel_type == GGML_TYPE_F32) {
+                        ((float *) dst_row)[dst_idx] = src_val;
+                    } else {
+                        ((ggml_fp16_t *) dst_row)[dst_idx] = GGML_CPU_FP32_TO_FP16(src_val);
+                    }
+                }
+            }
+        }
+
+        ggml_barrier(params->threadpool);
+
+        float * gemm_output = (float *) ((char *) tmp + patches_per_batch * knl_n * traits->type_size);
+
+        GGML_ASSERT(gemm_output + patch_n * c_out <= (float *) tmp + params->wsize / sizeof(float));
+
+        // GEMM: patches[patch_n, knl_n] x kernel[knl_n, c_out] = output[patch_n, c_out]
+        ggml_call_mul_mat(kernel_type, params, patch_n, c_out, knl_n, tmp, kernel->data, gemm_output);
+
+        ggml_barrier(params->threadpool);
+
+        // transpose to [OL, OC] with the bias and GELU fused
+        const int64_t oc_per_thread = (c_out + params->nth - 1) / params->nth;
+        const int64_t oc_start      = params->ith * oc_per_thread;
+        const int64_t oc_end        = std::min(oc_start + oc_per_thread, c_out);
+
+        for (int64_t oc = oc_start; oc < oc_end; ++oc) {
+            float * dst_row = (float *) ((char *) dst->data + oc * dst->nb[1]) + patch_start_batch;
+
+            for (int64_t i = 0; i < patch_n; ++i) {
+                dst_row[i] = gemm_output[i * c_out + oc] + bias_data[oc];
+            }
+
+            ggml_vec_gelu_f32(patch_n, dst_row, dst_row);
+        }
+    }
+}
+
+void ggml_compute_forward_conv_1d_gelu(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+    const ggml_tensor * src1 = dst->src[1];
+    const ggml_tensor * src2 = dst->src[2];
+
+    ggml_compute_forward_conv_1d_gelu_impl(params, src0, src1, src2, dst, src0->type);
+}
+
 // ggml_compute_forward_conv_3d
 
 static void ggml_compute_forward_conv_3d_impl(const ggml_compute_params * params,
@@ -7909,15 +8025,39 @@ void ggml_compute_forward_argsort(
 
 // ggml_compute_forward_flash_attn_ext
 
-static void ggml_compute_forward_flash_attn_ext_f16(
+// minimum number of KV entries per chunk for the split-K path
+#define GGML_FA_SPLIT_K_MIN_KV 64
+
+int64_t ggml_flash_attn_ext_n_kv_chunks(const struct ggml_tensor * dst, int nth) {
+    const ggml_tensor * q = dst->src[0];
+    const ggml_tensor * k = dst->src[1];
+
+    const int64_t nr  = q->ne[1]*q->ne[2]*q->ne[3];
+    const int64_t nkv = k->ne[1];
+
+    // with few q rows (e.g. a single-token decode step) most threads would be idle,
+    // so split the KV sequence as well - aim for >= 4 work units per thread
+    if (nth <= 1 || nr >= 4*nth) {
+        return 1;
+    }
+
+    const int64_t n_chunks = (4*nth + nr - 1)/nr;
+
+    return MAX(1, MIN(n_chunks, nkv/GGML_FA_SPLIT_K_MIN_KV));
+}
+
+// online softmax over the KV range [ic0, ic1) for q row ir
+// the result is left unnormalized in VKQ32 together with the running max M and sum S
+static void ggml_compute_forward_flash_attn_ext_f16_one_row(
         const ggml_compute_params * params,
-        ggml_tensor * dst) {
+        const ggml_tensor * dst,
+        int64_t ir, int64_t ic0, int64_t ic1,
+        float * VKQ32, float & M_out, float & S_out) {
 
     const ggml_tensor * q     = dst->src[0];
     const ggml_tensor * k     = dst->src[1];
     const ggml_tensor * v     = dst->src[2];
     const ggml_tensor * mask  = dst->src[3];
-    const ggml_tensor * sinks = dst->src[4];
 
     GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
     GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
@@ -7925,35 +8065,11 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
     GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
     GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
-    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
-    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int64_t DK = nek0;
     const int64_t DV = nev0;
-    const int64_t N  = neq1;
-
-    GGML_ASSERT(ne0 == DV);
-    GGML_ASSERT(ne2 == N);
-
-    // input tensor rows must be contiguous
-    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
-    GGML_ASSERT(nbk0 == ggml_type_size(k->type));
-    GGML_ASSERT(nbv0 == ggml_type_size(v->type));
-
-    GGML_ASSERT(neq0 == DK);
-    GGML_ASSERT(nek0 == DK);
-    GGML_ASSERT(nev0 == DV);
-
-    GGML_ASSERT(neq1 == N);
-
-    // dst cannot be transposed or permuted
-    GGML_ASSERT(nb0 == sizeof(float));
-    GGML_ASSERT(nb0 <= nb1);
-    GGML_ASSERT(nb1 <= nb2);
-    GGML_ASSERT(nb2 <= nb3);
 
     // broadcast factors
     const int64_t rk2 = neq2/nek2;
@@ -7962,25 +8078,13 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     const int64_t rv2 = neq2/nev2;
     const int64_t rv3 = neq3/nev3;
 
-    // parallelize by q rows using ggml_vec_dot_f32
-
-    // total rows in q
-    const int nr = neq1*neq2*neq3;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
     float scale         = 1.0f;
     float max_bias      = 0.0f;
     float logit_softcap = 0.0f;
 
-    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
-    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
-    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+    memcpy(&scale,         (const float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (const float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (const float *) dst->op_params + 2, sizeof(float));
 
     if (logit_softcap != 0) {
         scale /= logit_softcap;
@@ -8000,150 +8104,309 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     GGML_ASSERT((                            q_to_vec_dot) && "fattn: unsupported K-type");
     GGML_ASSERT((v->type == GGML_TYPE_F32 || v_to_float  ) && "fattn: unsupported V-type");
 
-    // loop over n_batch and n_head
-    for (int ir = ir0; ir < ir1; ++ir) {
-        // q indices
-        const int iq3 = ir/(neq2*neq1);
-        const int iq2 = (ir - iq3*neq2*neq1)/neq1;
-        const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
+    // q indices
+    const int iq3 = ir/(neq2*neq1);
+    const int iq2 = (ir - iq3*neq2*neq1)/neq1;
+    const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
+
+    const uint32_t h = iq2; // head index
+    const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+    float S = 0.0f;      // sum
+    float M = -INFINITY; // maximum KQ value
+
+    float       * scratch = (float       *) params->wdata + ith*(1*DK + 2*DV + CACHE_LINE_SIZE_F32);
+    float       * V32     =                 (scratch + 1*DV); // (temporary) FP32 V buffer
+    ggml_fp16_t * VKQ16   = (ggml_fp16_t *) (scratch + 1*DV); // (temporary) FP16 VKQ accumulator
+    ggml_fp16_t * Q_q     = (ggml_fp16_t *) (scratch + 2*DV); // (temporary) buffer for Q converted to quantized/FP16
+
+    if (v->type == GGML_TYPE_F16) {
+        memset(VKQ16, 0, DV*sizeof(ggml_fp16_t));
+    } else {
+        memset(VKQ32, 0, DV*sizeof(float));
+    }
+
+    const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1] + (iq2%mask->ne[2])*mask->nb[2] + (iq3%mask->ne[3])*mask->nb[3]) : NULL;
+
+    // k indices
+    const int ik3 = iq3 / rk3;
+    const int ik2 = iq2 / rk2;
+
+    // v indices
+    const int iv3 = iq3 / rv3;
+    const int iv2 = iq2 / rv2;
 
-        const uint32_t h = iq2; // head index
-        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+    const float * pq = (const float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3));
+    q_to_vec_dot(pq, Q_q, DK);
 
-        float S = 0.0f;      // sum
-        float M = -INFINITY; // maximum KQ value
+    // online softmax / attention
+    // loop over n_kv and n_head_kv
+    // ref: https://arxiv.org/pdf/2112.05682.pdf
+    for (int64_t ic = ic0; ic < ic1; ++ic) {
+        const float mv = mp ? slope*GGML_CPU_FP16_TO_FP32(mp[ic]) : 0.0f;
+        if (mv == -INFINITY) {
+            continue;
+        }
+
+        float s; // KQ value
+
+        const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
+        kq_vec_dot(DK, &s, 0, k_data, 0, Q_q, 0, 1);
+
+        s = s*scale; // scale KQ value
+
+        if (logit_softcap != 0.0f) {
+            s = logit_softcap*tanhf(s);
+        }
+
+        s += mv; // apply mask
+
+        const float Mold = M;
+
+        float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
+        float vs = 1.0f; // post-softmax KQ value, expf(s - M)
 
-        float       * VKQ32 = (float       *) params->wdata + ith*(1*DK + 2*DV + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulator
-        float       * V32   =                 (VKQ32 + 1*DV); // (temporary) FP32 V buffer
-        ggml_fp16_t * VKQ16 = (ggml_fp16_t *) (VKQ32 + 1*DV); // (temporary) FP16 VKQ accumulator
-        ggml_fp16_t * Q_q   = (ggml_fp16_t *) (VKQ32 + 2*DV); // (temporary) buffer for Q converted to quantized/FP16
+        const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
 
         if (v->type == GGML_TYPE_F16) {
-            memset(VKQ16, 0, DV*sizeof(ggml_fp16_t));
+            if (s > M) {
+                // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
+                M = s;
+                ms = expf(Mold - M);
+
+                // V = V*expf(Mold - M)
+                ggml_vec_scale_f16(DV, VKQ16, ms);
+            } else {
+                // no new maximum, ms == 1.0f, vs != 1.0f
+                vs = expf(s - M);
+            }
+
+            // V += v*expf(s - M)
+            ggml_vec_mad_f16(DV, VKQ16, (const ggml_fp16_t *) v_data, vs);
         } else {
-            memset(VKQ32, 0, DV*sizeof(float));
+            if (s > M) {
+                // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
+                M = s;
+                ms = expf(Mold - M);
+
+                // V = V*expf(Mold - M)
+                ggml_vec_scale_f32(DV, VKQ32, ms);
+            } else {
+                // no new maximum, ms == 1.0f, vs != 1.0f
+                vs = expf(s - M);
+            }
+
+            // V += v*expf(s - M)
+            if (v_to_float) {
+                v_to_float(v_data, V32, DV);
+                ggml_vec_mad_f32(DV, VKQ32, V32, vs);
+            } else {
+                // V is F32
+                ggml_vec_mad_f32(DV, VKQ32, (const float *) v_data, vs);
+            }
         }
 
-        const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1] + (iq2%mask->ne[2])*mask->nb[2] + (iq3%mask->ne[3])*mask->nb[3]) : NULL;
+        S = S*ms + vs; // scale and increment sum with partial sum
+    }
 
-        // k indices
-        const int ik3 = iq3 / rk3;
-        const int ik2 = iq2 / rk2;
+    if (v->type == GGML_TYPE_F16) {
+        for (int64_t d = 0; d < DV; ++d) {
+            VKQ32[d] = GGML_CPU_FP16_TO_FP32(VKQ16[d]);
+        }
+    }
 
-        // v indices
-        const int iv3 = iq3 / rv3;
-        const int iv2 = iq2 / rv2;
+    M_out = M;
+    S_out = S;
+}
 
-        const float * pq = (const float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3));
-        q_to_vec_dot(pq, Q_q, DK);
+// apply the sinks, normalize and write q row ir to dst
+static void ggml_compute_forward_flash_attn_ext_f16_finalize_row(
+        const ggml_tensor * dst,
+        int64_t ir,
+        float * VKQ32, float M, float S) {
 
-        // online softmax / attention
-        // loop over n_kv and n_head_kv
-        // ref: https://arxiv.org/pdf/2112.05682.pdf
-        for (int64_t ic = 0; ic < nek1; ++ic) {
-            const float mv = mp ? slope*GGML_CPU_FP16_TO_FP32(mp[ic]) : 0.0f;
-            if (mv == -INFINITY) {
-                continue;
-            }
+    const ggml_tensor * q     = dst->src[0];
+    const ggml_tensor * v     = dst->src[2];
+    const ggml_tensor * sinks = dst->src[4];
 
-            float s; // KQ value
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
-            const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
-            kq_vec_dot(DK, &s, 0, k_data, 0, Q_q, 0, 1);
+    const int64_t DV = v->ne[0];
 
-            s = s*scale; // scale KQ value
+    // q indices
+    const int iq3 = ir/(neq2*neq1);
+    const int iq2 = (ir - iq3*neq2*neq1)/neq1;
+    const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
 
-            if (logit_softcap != 0.0f) {
-                s = logit_softcap*tanhf(s);
-            }
+    const uint32_t h = iq2; // head index
 
-            s += mv; // apply mask
+    // sinks
+    if (sinks) {
+        const float s = ((float *)((char *) sinks->data))[h];
 
-            const float Mold = M;
+        float ms = 1.0f;
+        float vs = 1.0f;
 
-            float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
-            float vs = 1.0f; // post-softmax KQ value, expf(s - M)
+        if (s > M) {
+            ms = expf(M - s);
+            ggml_vec_scale_f32(DV, VKQ32, ms);
+        } else {
+            vs = expf(s - M);
+        }
 
-            const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
+        S = S*ms + vs;
+    }
 
-            if (v->type == GGML_TYPE_F16) {
-                if (s > M) {
-                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
-                    M = s;
-                    ms = expf(Mold - M);
+    // V /= S
+    const float S_inv = S == 0.0f ? 0.0f : 1.0f/S;
+    ggml_vec_scale_f32(DV, VKQ32, S_inv);
 
-                    // V = V*expf(Mold - M)
-                    ggml_vec_scale_f16(DV, VKQ16, ms);
-                } else {
-                    // no new maximum, ms == 1.0f, vs != 1.0f
-                    vs = expf(s - M);
-                }
+    // dst indices
+    const int i1 = iq1;
+    const int i2 = iq2;
+    const int i3 = iq3;
 
-                // V += v*expf(s - M)
-                ggml_vec_mad_f16(DV, VKQ16, (const ggml_fp16_t *) v_data, vs);
-            } else {
-                if (s > M) {
-                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
-                    M = s;
-                    ms = expf(Mold - M);
+    // original
+    //memcpy((char *) dst->data + (i1*nb1 + i2*nb2 + i3*nb3), V, nev0*sizeof(float));
 
-                    // V = V*expf(Mold - M)
-                    ggml_vec_scale_f32(DV, VKQ32, ms);
-                } else {
-                    // no new maximum, ms == 1.0f, vs != 1.0f
-                    vs = expf(s - M);
-                }
+    // permute(0, 2, 1, 3)
+    memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
+}
 
-                // V += v*expf(s - M)
-                if (v_to_float) {
-                    v_to_float(v_data, V32, DV);
-                    ggml_vec_mad_f32(DV, VKQ32, V32, vs);
-                } else {
-                    // V is F32
-                    ggml_vec_mad_f32(DV, VKQ32, (const float *) v_data, vs);
-                }
-            }
+static void ggml_compute_forward_flash_attn_ext_f16(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * q     = dst->src[0];
+    const ggml_tensor * k     = dst->src[1];
+    const ggml_tensor * v     = dst->src[2];
 
-            S = S*ms + vs; // scale and increment sum with partial sum
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t DK = nek0;
+    const int64_t DV = nev0;
+    const int64_t N  = neq1;
+
+    GGML_ASSERT(ne0 == DV);
+    GGML_ASSERT(ne2 == N);
+
+    // input tensor rows must be contiguous
+    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
+    GGML_ASSERT(nbk0 == ggml_type_size(k->type));
+    GGML_ASSERT(nbv0 == ggml_type_size(v->type));
+
+    GGML_ASSERT(neq0 == DK);
+    GGML_ASSERT(nek0 == DK);
+    GGML_ASSERT(nev0 == DV);
+
+    GGML_ASSERT(neq1 == N);
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    // total rows in q
+    const int64_t nr = neq1*neq2*neq3;
+
+    const int64_t n_chunks = ggml_flash_attn_ext_n_kv_chunks(dst, nth);
+
+    if (n_chunks == 1) {
+        // parallelize by q rows using ggml_vec_dot_f32
+
+        // rows per thread
+        const int64_t dr = (nr + nth - 1)/nth;
+
+        // row range for this thread
+        const int64_t ir0 = dr*ith;
+        const int64_t ir1 = MIN(ir0 + dr, nr);
+
+        float * VKQ32 = (float *) params->wdata + ith*(1*DK + 2*DV + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulator
+
+        for (int64_t ir = ir0; ir < ir1; ++ir) {
+            float M;
+            float S;
+
+            ggml_compute_forward_flash_attn_ext_f16_one_row(params, dst, ir, 0, nek1, VKQ32, M, S);
+            ggml_compute_forward_flash_attn_ext_f16_finalize_row(dst, ir, VKQ32, M, S);
         }
 
-        if (v->type == GGML_TYPE_F16) {
-            for (int64_t d = 0; d < DV; ++d) {
-                VKQ32[d] = GGML_CPU_FP16_TO_FP32(VKQ16[d]);
-            }
+        return;
+    }
+
+    // split-K: each work unit is a (q row, KV chunk) pair and writes its partial
+    // accumulator [VKQ, M, S] after the per-thread scratch buffers
+    float * partials = (float *) params->wdata + nth*(1*DK + 2*DV + CACHE_LINE_SIZE_F32);
+
+    const int64_t n_units  = nr*n_chunks;
+    const int64_t chunk_kv = (nek1 + n_chunks - 1)/n_chunks;
+
+    {
+        const int64_t du  = (n_units + nth - 1)/nth;
+        const int64_t iu0 = du*ith;
+        const int64_t iu1 = MIN(iu0 + du, n_units);
+
+        for (int64_t iu = iu0; iu < iu1; ++iu) {
+            const int64_t ir  = iu/n_chunks;
+            const int64_t ic0 = (iu%n_chunks)*chunk_kv;
+            const int64_t ic1 = MIN(ic0 + chunk_kv, nek1);
+
+            float * part = partials + iu*(DV + 2);
+
+            ggml_compute_forward_flash_attn_ext_f16_one_row(params, dst, ir, ic0, ic1, part, part[DV + 0], part[DV + 1]);
         }
+    }
 
-        // sinks
-        if (sinks) {
-            const float s = ((float *)((char *) sinks->data))[h];
+    ggml_barrier(params->threadpool);
 
-            float ms = 1.0f;
-            float vs = 1.0f;
+    // reduce the chunks of each row
+    {
+        const int64_t dr  = (nr + nth - 1)/nth;
+        const int64_t ir0 = dr*ith;
+        const int64_t ir1 = MIN(ir0 + dr, nr);
 
-            if (s > M) {
-                ms = expf(M - s);
-                ggml_vec_scale_f32(DV, VKQ32, ms);
-            } else {
-                vs = expf(s - M);
+        float * VKQ32 = (float *) params->wdata + ith*(1*DK + 2*DV + CACHE_LINE_SIZE_F32);
+
+        for (int64_t ir = ir0; ir < ir1; ++ir) {
+            const float * part = partials + ir*n_chunks*(DV + 2);
+
+            float M = -INFINITY;
+            for (int64_t c = 0; c < n_chunks; ++c) {
+                M = MAX(M, part[c*(DV + 2) + DV]);
             }
 
-            S = S*ms + vs;
-        }
+            float S = 0.0f;
+            memset(VKQ32, 0, DV*sizeof(float));
 
-        // V /= S
-        const float S_inv = S == 0.0f ? 0.0f : 1.0f/S;
-        ggml_vec_scale_f32(DV, VKQ32, S_inv);
+            if (M != -INFINITY) {
+                for (int64_t c = 0; c < n_chunks; ++c) {
+                    const float * pc = part + c*(DV + 2);
+                    if (pc[DV] == -INFINITY) {
+                        continue;
+                    }
 
-        // dst indices
-        const int i1 = iq1;
-        const int i2 = iq2;
-        const int i3 = iq3;
+                    const float ms = expf(pc[DV] - M);
 
-        // original
-        //memcpy((char *) dst->data + (i1*nb1 + i2*nb2 + i3*nb3), V, nev0*sizeof(float));
+                    ggml_vec_mad_f32(DV, VKQ32, pc, ms);
+                    S += pc[DV + 1]*ms;
+                }
+            }
 
-        // permute(0, 2, 1, 3)
-        memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
+            ggml_compute_forward_flash_attn_ext_f16_finalize_row(dst, ir, VKQ32, M, S);
+        }
     }
 }
 
@@ -113,12 +113,21 @@ extern "C" {
         const whisper_ahead * heads;
     } whisper_aheads;
 
+    // [EXPERIMENTAL] placement of the CPU weights on NUMA systems (Linux only)
+    // weights that are mapped from the model file (use_mmap) stay in the shared page cache and are not moved
+    enum whisper_numa_mode {
+        WHISPER_NUMA_DISABLED,   // weights on the node that loads the model
+        WHISPER_NUMA_DISTRIBUTE, // interleave the weights over the nodes and spread the CPU threads over them
+        WHISPER_NUMA_REPLICATE,  // weights and a threadpool on each node (one copy per extra node) - every state runs on one node
+    };
+
     struct whisper_context_params {
         bool  use_gpu;
         bool  flash_attn;
         int   gpu_device;  // CUDA device
 
         // [EXPERIMENTAL] Token-level timestamps with DTW
+        // WHISPER_AHEADS_NONE uses the alignment heads stored in the model file (GGUF)
         bool dtw_token_timestamps;
         enum whisper_alignment_heads_preset dtw_aheads_preset;
 
@@ -126,6 +135,42 @@ extern "C" {
         struct whisper_aheads dtw_aheads;
 
         size_t dtw_mem_size; // TODO: remove
+
+        // [EXPERIMENTAL] max memory for snapshots of the decoded prompt taken on temperature fallback (0 - disabled)
+        // when a fallback recreates the KV cache for more decoders, the prompt of the failed attempt is restored
+        // from a snapshot instead of being decoded again
+        // note: the K/V of the decoder depend on the audio, so a snapshot is only reused for the same segment
+        size_t fallback_snapshot_size;
+
+        // [EXPERIMENTAL] compute the log mel spectrogram inside the encoder graph from the raw PCM
+        // the STFT runs as a matrix multiplication on the compute backend instead of on the host
+        // note: the clamping is relative to the maximum of each 30 s window instead of the whole audio
+        bool mel_in_graph;
+
+        // map the model file into memory (whisper_init_from_file_with_params only)
+        // CPU weights that are aligned in the file are used in place, so processes that load
+        // the same model share the page cache instead of each holding a private copy
+        bool use_mmap;
+        bool mmap_prefetch; // populate the mapping up front instead of faulting the pages in on first use
+
+        // type of the self- and cross-attention KV caches: GGML_TYPE_F16, GGML_TYPE_Q8_0 or GGML_TYPE_Q4_0
+        // the quantized types require flash_attn and reduce the memory of a state and the bandwidth of a decoding step
+        enum ggml_type type_kv;
+
+        // CPU threadpool shared by the states of the context, instead of the threads of the CPU backend of each state
+        // the states run their CPU graphs on it one at a time, so concurrent states do not oversubscribe the cores
+        // (graphs that run entirely on other backends, e.g. GPU, are not serialized)
+        // it is paused between the calls of whisper_full(), whisper_encode() and whisper_decode()
+        //   threadpool:        use this threadpool - owned by the caller, must outlive the context
+        //   threadpool_params: otherwise create one with these params (CPU mask, priority, poll level, strict placement)
+        // the number of threads of a call is limited to the threads of the threadpool
+        struct ggml_threadpool * threadpool;
+        const struct ggml_threadpool_params * threadpool_params; // only read by the init functions
+
+        // [EXPERIMENTAL] NUMA placement of the weights
+        // with WHISPER_NUMA_REPLICATE the states are assigned round-robin to the nodes (see whisper_init_state_on_node)
+        // and run on a threadpool bound to the CPUs of their node - threadpool_params sets its number of threads
+        enum whisper_numa_mode numa;
     };
 
     typedef struct whisper_token_data {
@@ -240,6 +285,12 @@ extern "C" {
 
     WHISPER_API struct whisper_state * whisper_init_state(struct whisper_context * ctx);
 
+    // [EXPERIMENTAL] number of NUMA nodes with a replica of the weights (0 unless the context uses WHISPER_NUMA_REPLICATE)
+    WHISPER_API int whisper_numa_n_nodes(struct whisper_context * ctx);
+
+    // [EXPERIMENTAL] like whisper_init_state(), on the given node (0 <= node < whisper_numa_n_nodes())
+    WHISPER_API struct whisper_state * whisper_init_state_on_node(struct whisper_context * ctx, int node);
+
     // Given a context, enable use of OpenVINO for encode inference.
     // model_path: Optional path to OpenVINO encoder IR model. If set to nullptr,
     //                      the path will be generated from the ggml model path that was passed
@@ -270,6 +321,43 @@ extern "C" {
     WHISPER_API void whisper_free_params(struct whisper_full_params * params);
     WHISPER_API void whisper_free_context_params(struct whisper_context_params * params);
 
+    // Memory used by a state: the KV caches, the compute and other backend buffers and the larger host buffers
+    WHISPER_API size_t whisper_state_memory_size(struct whisper_state * state);
+
+    // State pool
+    //
+    // Recycles the states of a context for callers that process many independent requests (e.g. a server).
+    // Creating a state allocates its KV caches, compute buffers and backends, so instead the pool creates the
+    // states on demand and resets the released ones (KV caches, results, VAD segments) for the next acquire.
+    // The functions are thread-safe. The states of a pool must not be freed with whisper_free_state() and
+    // must not outlive it.
+
+    struct whisper_state_pool;
+
+    struct whisper_state_pool_params {
+        int    n_states_init; // states created by whisper_state_pool_init()
+        int    n_states_idle; // idle states kept on release, the rest are freed (-1 - keep all)
+        int    n_states_max;  // max number of states at once (0 - no limit)
+        size_t mem_max;       // max memory of all states at once in bytes, see whisper_state_memory_size() (0 - no limit)
+    };
+
+    WHISPER_API struct whisper_state_pool_params whisper_state_pool_default_params(void);
+
+    WHISPER_API struct whisper_state_pool * whisper_state_pool_init(struct whisper_context * ctx, struct whisper_state_pool_params params);
+    WHISPER_API void                        whisper_state_pool_free(struct whisper_state_pool * pool);
+
+    // Returns an idle state, or a new one if the limits allow it
+    // Otherwise waits for a state to be released if wait is true, or returns NULL
+    WHISPER_API struct whisper_state * whisper_state_pool_acquire(struct whisper_state_pool * pool, bool wait);
+    WHISPER_API void                   whisper_state_pool_release(struct whisper_state_pool * pool, struct whisper_state * state);
+
+    // Frees idle states until at most n_idle remain
+    WHISPER_API void whisper_state_pool_trim(struct whisper_state_pool * pool, int n_idle);
+
+    WHISPER_API int    whisper_state_pool_n_states    (struct whisper_state_pool * pool); // idle and in use
+    WHISPER_API int    whisper_state_pool_n_idle      (struct whisper_state_pool * pool);
+    WHISPER_API size_t whisper_state_pool_memory_size (struct whisper_state_pool * pool); // of all states
+
     // Convert RAW PCM audio to log mel spectrogram.
     // The resulting spectrogram is stored inside the default state of the provided whisper context.
     // Returns 0 on success
@@ -303,6 +391,40 @@ extern "C" {
                                int   n_len,
                                int   n_mel);
 
+    // Incremental log mel spectrogram for streaming audio.
+    // Appends RAW PCM samples to a rolling spectrogram kept inside the state and computes mel frames only for the new audio.
+    // The overlap of the Hann window is retained between calls, so appending audio in chunks yields the same frames as a
+    // single call. Each frame is 10 ms (WHISPER_HOP_LENGTH samples).
+    // The rolling spectrogram replaces the one stored inside the state, so whisper_full_with_state() can be called with
+    // n_samples = 0 to run directly on it.
+    // Clamping is relative to the maximum of the frames currently held, so trimming old frames can change the normalization.
+    // Returns 0 on success
+    WHISPER_API int whisper_mel_append_pcm(
+            struct whisper_context * ctx,
+                       const float * samples,
+                               int   n_samples);
+
+    WHISPER_API int whisper_mel_append_pcm_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                       const float * samples,
+                               int   n_samples);
+
+    // Drop the oldest n_frames frames from the rolling spectrogram.
+    // Returns the number of frames still held (use n_frames = 0 to query it)
+    WHISPER_API int whisper_mel_trim(
+            struct whisper_context * ctx,
+                               int   n_frames);
+
+    WHISPER_API int whisper_mel_trim_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                               int   n_frames);
+
+    // Clear the rolling spectrogram and the retained audio - the next append starts a new stream
+    WHISPER_API void whisper_mel_reset(struct whisper_context * ctx);
+    WHISPER_API void whisper_mel_reset_with_state(struct whisper_context * ctx, struct whisper_state * state);
+
     // Run the Whisper encoder on the log mel spectrogram stored inside the default state in the provided whisper context.
     // Make sure to call whisper_pcm_to_mel() or whisper_set_mel() first.
     // offset can be used to specify the offset of the first frame in the spectrogram.
@@ -390,6 +512,7 @@ extern "C" {
 
     WHISPER_API int whisper_n_len           (struct whisper_context * ctx); // mel length
     WHISPER_API int whisper_n_len_from_state(struct whisper_state * state); // mel length
+    WHISPER_API int whisper_n_kv_used_from_state(struct whisper_state * state); // used cells of the self-attention KV cache
     WHISPER_API int whisper_n_vocab         (struct whisper_context * ctx);
     WHISPER_API int whisper_n_text_ctx      (struct whisper_context * ctx);
     WHISPER_API int whisper_n_audio_ctx     (struct whisper_context * ctx);
@@ -415,6 +538,13 @@ extern "C" {
     WHISPER_API float * whisper_get_logits           (struct whisper_context * ctx);
     WHISPER_API float * whisper_get_logits_from_state(struct whisper_state * state);
 
+    // Logits of the i-th token of the last decoded batch, negative indices count from the end (-1 is the last token)
+    // Only the tokens for which logits were requested have them (whisper_decode(): the last token)
+    // Returns NULL if i is out of range or there are no logits for the token
+    // Cols: n_vocab
+    WHISPER_API float * whisper_get_logits_ith           (struct whisper_context * ctx, int32_t i);
+    WHISPER_API float * whisper_get_logits_ith_from_state(struct whisper_state * state, int32_t i);
+
     // Token Id -> String. Uses the vocabulary in the provided context
     WHISPER_API const char * whisper_token_to_str(struct whisper_context * ctx, whisper_token token);
     WHISPER_API const char * whisper_model_type_readable(struct whisper_context * ctx);
@@ -441,8 +571,14 @@ extern "C" {
         float decode_ms;
         float batchd_ms;
         float prompt_ms;
+
+        int32_t n_graph_reuse; // number of decoder calls that reused the previous decoder graph
+
+        int32_t n_fallback_restore;     // number of prompts restored from a fallback snapshot instead of being decoded
+        size_t  fallback_restore_bytes; // number of KV cache bytes restored from fallback snapshots
     };
     WHISPER_API struct whisper_timings * whisper_get_timings(struct whisper_context * ctx);
+    WHISPER_API struct whisper_timings * whisper_get_timings_from_state(struct whisper_state * state);
     WHISPER_API void whisper_print_timings(struct whisper_context * ctx);
     WHISPER_API void whisper_reset_timings(struct whisper_context * ctx);
 
@@ -512,7 +648,7 @@ extern "C" {
         // [EXPERIMENTAL] speed-up techniques
         // note: these can significantly reduce the quality of the output
         bool debug_mode;        // enable debug_mode provides extra info (eg. Dump log_mel)
-        int  audio_ctx;         // overwrite the audio context size (0 = use default)
+        int  audio_ctx;         // overwrite the audio context size (0 = use default, -1 = auto: smallest context covering the audio)
 
         // [EXPERIMENTAL] [TDRZ] tinydiarize
         bool tdrz_enable;       // enable tinydiarize speaker turn detection
@@ -555,7 +691,9 @@ extern "C" {
         struct {
             int beam_size;  // ref: https://github.com/openai/whisper/blob/f82bc59f5ea234d4b97fb2860842ed38519f7e65/whisper/transcribe.py#L265
 
-            float patience; // TODO: not implemented, ref: https://arxiv.org/pdf/2204.05424.pdf
+            // if > 0, decode until round(n_beams*patience) hypotheses have finished - the beams that finish are
+            // replaced by the next best candidates. if <= 0, a finished beam is not replaced
+            float patience; // ref: https://arxiv.org/pdf/2204.05424.pdf
         } beam_search;
 
         // called for every newly generated text segment
@@ -0,0 +1,117 @@
+# Align the tensor data of a Whisper ggml model file for mmap loading
+#
+# Usage: python ggml-align.py ./models/ggml-base.en.bin ./models/ggml-base.en-aligned.bin
+#
+# whisper.cpp maps the model file into memory (whisper_context_params.use_mmap) and uses the CPU
+# weights in place when their data starts at a multiple of 32 bytes in the file. The files written
+# by the converters store the data right after the tensor header, so most tensors end up unaligned
+# and get copied into a separate buffer instead.
+#
+# This script rewrites the file so that the data of every tensor is aligned. The tensor name of
+# each header is padded with '\0' bytes, which the loader strips. Everything else is copied as is.
+#
+# note: older versions of whisper.cpp do not strip the padding and cannot load the aligned files
+#
+
+import struct
+import sys
+
+GGML_FILE_MAGIC = 0x67676d6c
+
+ALIGNMENT = 32
+
+# ggml_type -> (block size, bytes per block)
+GGML_TYPE_SIZE = {
+     0: (  1,   4), # F32
+     1: (  1,   2), # F16
+     2: ( 32,  18), # Q4_0
+     3: ( 32,  20), # Q4_1
+     6: ( 32,  22), # Q5_0
+     7: ( 32,  24), # Q5_1
+     8: ( 32,  34), # Q8_0
+     9: ( 32,  36), # Q8_1
+    10: (256,  84), # Q2_K
+    11: (256, 110), # Q3_K
+    12: (256, 144), # Q4_K
+    13: (256, 176), # Q5_K
+    14: (256, 210), # Q6_K
+    15: (256, 292), # Q8_K
+    24: (  1,   1), # I8
+    25: (  1,   2), # I16
+    26: (  1,   4), # I32
+    30: (  1,   2), # BF16
+}
+
+if len(sys.argv) < 3:
+    print("Usage: ggml-align.py model-in.bin model-out.bin\n")
+    sys.exit(1)
+
+fname_inp = sys.argv[1]
+fname_out = sys.argv[2]
+
+with open(fname_inp, "rb") as fin, open(fname_out, "wb") as fout:
+    def copy(n):
+        data = fin.read(n)
+        if len(data) != n:
+            raise EOFError("unexpected end of file")
+        fout.write(data)
+        return data
+
+    def copy_i32(n = 1):
+        return struct.unpack("<%di" % n, copy(4*n))
+
+    magic = struct.unpack("<I", copy(4))[0]
+    if magic != GGML_FILE_MAGIC:
+        print("%s: invalid model file (bad magic)" % fname_inp)
+        sys.exit(1)
+
+    # hparams
+    copy_i32(11)
+
+    # mel filters
+    n_mel, n_fft = copy_i32(2)
+    copy(4*n_mel*n_fft)
+
+    # vocab
+    n_vocab = copy_i32()[0]
+    for i in range(n_vocab):
+        n = struct.unpack("<I", copy(4))[0]
+        copy(n)
+
+    # tensors
+    n_tensors = 0
+    n_padding = 0
+
+    while True:
+        header = fin.read(12)
+        if len(header) < 12:
+            break
+
+        n_dims, length, ttype = struct.unpack("<iii", header)
+        if ttype not in GGML_TYPE_SIZE:
+            print("%s: unsupported tensor type %d" % (fname_inp, ttype))
+            sys.exit(1)
+
+        ne   = struct.unpack("<%di" % n_dims, fin.read(4*n_dims))
+        name = fin.read(length).rstrip(b"\0")
+
+        # pad the name so that the data that follows is aligned
+        offs = fout.tell() + 12 + 4*n_dims + len(name)
+        pad  = (ALIGNMENT - offs % ALIGNMENT) % ALIGNMENT
+
+        fout.write(struct.pack("<iii", n_dims, len(name) + pad, ttype))
+        fout.write(struct.pack("<%di" % n_dims, *ne))
+        fout.write(name + b"\0"*pad)
+
+        nelements = 1
+        for n in ne:
+            nelements *= n
+
+        blck_size, type_size = GGML_TYPE_SIZE[ttype]
+        copy(nelements*type_size//blck_size)
+
+        n_tensors += 1
+        n_padding += pad
+
+print("Done. Output file: " + fname_out)
+print("Aligned %d tensors (%d bytes of padding)" % (n_tensors, n_padding))
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "ggml.h"
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES // for M_PI on MSVC
+#endif
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// mixed-radix FFT plan for the real-valued STFT frames
+//
+// a real input of size n is transformed as a complex sequence of size n/2 (even samples in the real part,
+// odd samples in the imaginary part), followed by a post-processing pass that recovers bins [0, n/2]
+// the complex FFT is a Stockham auto-sort with radix 4, 2, 3 and 5 stages, so no bit reversal is needed
+// for WHISPER_N_FFT = 400 the complex size is 200 = 4*2*5*5
+struct whisper_fft_plan {
+    int n = 0; // real size
+    int m = 0; // complex size
+
+    struct stage {
+        int radix;
+        int n;      // size of the sub-transforms at this stage
+        int stride;
+        int offs;   // offset in w_re/w_im
+    };
+
+    std::vector<stage> stages;
+
+    // per stage twiddles: w[p*(radix - 1) + r - 1] = exp(-2*pi*i*p*r/n), p in [0, n/radix), r in [1, radix)
+    std::vector<float> w_re;
+    std::vector<float> w_im;
+
+    // real-to-complex post-processing twiddles: exp(-2*pi*i*k/n), k in [0, m]
+    std::vector<float> r_re;
+    std::vector<float> r_im;
+
+    void init(int n_real) {
+        n = n_real;
+        m = n_real/2;
+
+        GGML_ASSERT(n == 2*m);
+
+        stages.clear();
+        w_re.clear();
+        w_im.clear();
+
+        int n_cur  = m;
+        int stride = 1;
+        while (n_cur > 1) {
+            int radix = 0;
+            for (int r : { 4, 2, 3, 5 }) {
+                if (n_cur % r == 0) {
+                    radix = r;
+                    break;
+                }
+            }
+            GGML_ASSERT(radix > 0 && "unsupported FFT size");
+
+            stages.push_back({ radix, n_cur, stride, (int) w_re.size() });
+
+            for (int p = 0; p < n_cur/radix; ++p) {
+                for (int r = 1; r < radix; ++r) {
+                    const double theta = (2*M_PI*p*r)/n_cur;
+                    w_re.push_back( cos(theta));
+                    w_im.push_back(-sin(theta));
+                }
+            }
+
+            n_cur  /= radix;
+            stride *= radix;
+        }
+
+        r_re.resize(m + 1);
+        r_im.resize(m + 1);
+        for (int k = 0; k <= m; ++k) {
+            const double theta = (2*M_PI*k)/n;
+            r_re[k] =  cos(theta);
+            r_im[k] = -sin(theta);
+        }
+    }
+};
+
+// Stockham FFT stages
+// x[q + s*(p + j*m)], j in [0, radix) -> y[q + s*(radix*p + r)], r in [0, radix), with m = n/radix
+// the innermost loop runs over the contiguous q dimension, so the later stages are vectorized by the compiler
+
+static void whisper_fft_radix2(int n, int s, const float * w_re, const float * w_im,
+        const float * x_re, const float * x_im, float * y_re, float * y_im) {
+    const int m = n/2;
+    for (int p = 0; p < m; ++p) {
+        const float wr = w_re[p];
+        const float wi = w_im[p];
+        for (int q = 0; q < s; ++q) {
+            const float a0r = x_re[q + s*(p + 0*m)], a0i = x_im[q + s*(p + 0*m)];
+            const float a1r = x_re[q + s*(p + 1*m)], a1i = x_im[q + s*(p + 1*m)];
+
+            const float b1r = a0r - a1r;
+            const float b1i = a0i - a1i;
+
+            y_re[q + s*(2*p + 0)] = a0r + a1r;
+            y_im[q + s*(2*p + 0)] = a0i + a1i;
+            y_re[q + s*(2*p + 1)] = b1r*wr - b1i*wi;
+            y_im[q + s*(2*p + 1)] = b1r*wi + b1i*wr;
+        }
+    }
+}
+
+static void whisper_fft_radix3(int n, int s, const float * w_re, const float * w_im,
+        const float * x_re, const float * x_im, float * y_re, float * y_im) {
+    const float c1 = -0.5f;
+    const float s1 = 0.86602540378443864676f; // sin(2*pi/3)
+
+    const int m = n/3;
+    for (int p = 0; p < m; ++p) {
+        const float * wr = w_re + 2*p;
+        const float * wi = w_im + 2*p;
+        for (int q = 0; q < s; ++q) {
+            const float a0r = x_re[q + s*(p + 0*m)], a0i = x_im[q + s*(p + 0*m)];
+            const float a1r = x_re[q + s*(p + 1*m)], a1i = x_im[q + s*(p + 1*m)];
+            const float a2r = x_re[q + s*(p + 2*m)], a2i = x_im[q + s*(p + 2*m)];
+
+            const float br = a1r + a2r, bi = a1i + a2i;
+            const float dr = a1r - a2r, di = a1i - a2i;
+
+            const float tr = a0r + c1*br, ti = a0i + c1*bi;
+            const float ur = s1*dr,       ui = s1*di;
+
+            // y1 = t - i*u, y2 = t + i*u
+            const float y1r = tr + ui, y1i = ti - ur;
+            const float y2r = tr - ui, y2i = ti + ur;
+
+            y_re[q + s*(3*p + 0)] = a0r + br;
+            y_im[q + s*(3*p + 0)] = a0i + bi;
+            y_re[q + s*(3*p + 1)] = y1r*wr[0] - y1i*wi[0];
+            y_im[q + s*(3*p + 1)] = y1r*wi[0] + y1i*wr[0];
+            y_re[q + s*(3*p + 2)] = y2r*wr[1] - y2i*wi[1];
+            y_im[q + s*(3*p + 2)] = y2r*wi[1] + y2i*wr[1];
+        }
+    }
+}
+
+static void whisper_fft_radix4(int n, int s, const float * w_re, const float * w_im,
+        const float * x_re, const float * x_im, float * y_re, float * y_im) {
+    const int m = n/4;
+    for (int p = 0; p < m; ++p) {
+        const float * wr = w_re + 3*p;
+        const float * wi = w_im + 3*p;
+        for (int q = 0; q < s; ++q) {
+            const float a0r = x_re[q + s*(p + 0*m)], a0i = x_im[q + s*(p + 0*m)];
+            const float a1r = x_re[q + s*(p + 1*m)], a1i = x_im[q + s*(p + 1*m)];
+            const float a2r = x_re[q + s*(p + 2*m)], a2i = x_im[q + s*(p + 2*m)];
+            const float a3r = x_re[q + s*(p + 3*m)], a3i = x_im[q + s*(p + 3*m)];
+
+            const float t0r = a0r + a2r, t0i = a0i + a2i;
+            const float t1r = a0r - a2r, t1i = a0i - a2i;
+            const float t2r = a1r + a3r, t2i = a1i + a3i;
+            // t3 = -i*(a1 - a3)
+            const float t3r = a1i - a3i, t3i = a3r - a1r;
+
+            const float y1r = t1r + t3r, y1i = t1i + t3i;
+            const float y2r = t0r - t2r, y2i = t0i - t2i;
+            const float y3r = t1r - t3r, y3i = t1i - t3i;
+
+            y_re[q + s*(4*p + 0)] = t0r + t2r;
+            y_im[q + s*(4*p + 0)] = t0i + t2i;
+            y_re[q + s*(4*p + 1)] = y1r*wr[0] - y1i*wi[0];
+            y_im[q + s*(4*p + 1)] = y1r*wi[0] + y1i*wr[0];
+            y_re[q + s*(4*p + 2)] = y2r*wr[1] - y2i*wi[1];
+            y_im[q + s*(4*p + 2)] = y2r*wi[1] + y2i*wr[1];
+            y_re[q + s*(4*p + 3)] = y3r*wr[2] - y3i*wi[2];
+            y_im[q + s*(4*p + 3)] = y3r*wi[2] + y3i*wr[2];
+        }
+    }
+}
+
+static void whisper_fft_radix5(int n, int s, const float * w_re, const float * w_im,
+        const float * x_re, const float * x_im, float * y_re, float * y_im) {
+    const float c1 =  0.30901699437494742410f; // cos(2*pi/5)
+    const float c2 = -0.80901699437494742410f; // cos(4*pi/5)
+    const float s1 =  0.95105651629515357212f; // sin(2*pi/5)
+    const float s2 =  0.58778525229247312917f; // sin(4*pi/5)
+
+    const int m = n/5;
+    for (int p = 0; p < m; ++p) {
+        const float * wr = w_re + 4*p;
+        const float * wi = w_im + 4*p;
+        for (int q = 0; q < s; ++q) {
+            const float a0r = x_re[q + s*(p + 0*m)], a0i = x_im[q + s*(p + 0*m)];
+            const float a1r = x_re[q + s*(p + 1*m)], a1i = x_im[q + s*(p + 1*m)];
+            const float a2r = x_re[q + s*(p + 2*m)], a2i = x_im[q + s*(p + 2*m)];
+            const float a3r = x_re[q + s*(p + 3*m)], a3i = x_im[q + s*(p + 3*m)];
+            const float a4r = x_re[q + s*(p + 4*m)], a4i = x_im[q + s*(p + 4*m)];
+
+            const float b1r = a1r + a4r, b1i = a1i + a4i;
+            const float b2r = a2r + a3r, b2i = a2i + a3i;
+            const float d1r = a1r - a4r, d1i = a1i - a4i;
+            const float d2r = a2r - a3r, d2i = a2i - a3i;
+
+            const float t1r = a0r + c1*b1r + c2*b2r, t1i = a0i + c1*b1i + c2*b2i;
+            const float t2r = a0r + c2*b1r + c1*b2r, t2i = a0i + c2*b1i + c1*b2i;
+
+            const float u1r = s1*d1r + s2*d2r, u1i = s1*d1i + s2*d2i;
+            const float u2r = s2*d1r - s1*d2r, u2i = s2*d1i - s1*d2i;
+
+            // y1 = t1 - i*u1, y4 = t1 + i*u1, y2 = t2 - i*u2, y3 = t2 + i*u2
+            const float y1r = t1r + u1i, y1i = t1i - u1r;
+            const float y4r = t1r - u1i, y4i = t1i + u1r;
+            const float y2r = t2r + u2i, y2i = t2i - u2r;
+            const float y3r = t2r - u2i, y3i = t2i + u2r;
+
+            y_re[q + s*(5*p + 0)] = a0r + b1r + b2r;
+            y_im[q + s*(5*p + 0)] = a0i + b1i + b2i;
+            y_re[q + s*(5*p + 1)] = y1r*wr[0] - y1i*wi[0];
+            y_im[q + s*(5*p + 1)] = y1r*wi[0] + y1i*wr[0];
+            y_re[q + s*(5*p + 2)] = y2r*wr[1] - y2i*wi[1];
+            y_im[q + s*(5*p + 2)] = y2r*wi[1] + y2i*wr[1];
+            y_re[q + s*(5*p + 3)] = y3r*wr[2] - y3i*wi[2];
+            y_im[q + s*(5*p + 3)] = y3r*wi[2] + y3i*wr[2];
+            y_re[q + s*(5*p + 4)] = y4r*wr[3] - y4i*wi[3];
+            y_im[q + s*(5*p + 4)] = y4r*wi[3] + y4i*wr[3];
+        }
+    }
+}
+
+// real-input FFT
+// input is real-valued, plan.n samples
+// output is complex-valued, bins [0, plan.n/2] (interleaved re, im)
+// work must hold 4*plan.m floats
+static void whisper_fft(const whisper_fft_plan & plan, const float * in, float * out, float * work) {
+    const int m = plan.m;
+
+    float * x_re = work + 0*m;
+    float * x_im = work + 1*m;
+    float * y_re = work + 2*m;
+    float * y_im = work + 3*m;
+
+    // pack the even samples in the real part and the odd samples in the imaginary part
+    for (int i = 0; i < m; ++i) {
+        x_re[i] = in[2*i + 0];
+        x_im[i] = in[2*i + 1];
+    }
+
+    for (const auto & st : plan.stages) {
+        const float * w_re = plan.w_re.data() + st.offs;
+        const float * w_im = plan.w_im.data() + st.offs;
+
+        switch (st.radix) {
+            case 2: whisper_fft_radix2(st.n, st.stride, w_re, w_im, x_re, x_im, y_re, y_im); break;
+            case 3: whisper_fft_radix3(st.n, st.stride, w_re, w_im, x_re, x_im, y_re, y_im); break;
+            case 4: whisper_fft_radix4(st.n, st.stride, w_re, w_im, x_re, x_im, y_re, y_im); break;
+            case 5: whisper_fft_radix5(st.n, st.stride, w_re, w_im, x_re, x_im, y_re, y_im); break;
+            default: GGML_ASSERT(false);
+        }
+
+        std::swap(x_re, y_re);
+        std::swap(x_im, y_im);
+    }
+
+    // X[k] = (Z[k] + conj(Z[m - k]))/2 - i*exp(-2*pi*i*k/n)*(Z[k] - conj(Z[m - k]))/2
+    for (int k = 0; k <= m; ++k) {
+        const int k0 = k == m ? 0 : k;
+        const int k1 = k == 0 ? 0 : m - k;
+
+        const float zr = x_re[k0], zi = x_im[k0];
+        const float cr = x_re[k1], ci = -x_im[k1];
+
+        const float er = 0.5f*(zr + cr), ei = 0.5f*(zi + ci);
+        const float or_ = 0.5f*(zi - ci), oi = -0.5f*(zr - cr); // -i*(z - c)/2
+
+        out[2*k + 0] = er + plan.r_re[k]*or_ - plan.r_im[k]*oi;
+        out[2*k + 1] = ei + plan.r_re[k]*oi  + plan.r_im[k]*or_;
+    }
+}
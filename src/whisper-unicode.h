@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstdint>
+
+// unicode character classes of the GPT-2 pre-tokenizer (regex \p{L} and \p{N}) for the non-ASCII codepoints
+//
+// generated from unicode_ranges_flags in examples/talk-llama/unicode-data.cpp - a range extends from its start
+// up to the start of the next one
+
+enum whisper_cpt_class : uint8_t {
+    WHISPER_CPT_OTHER  = 0,
+    WHISPER_CPT_LETTER = 1,
+    WHISPER_CPT_NUMBER = 2,
+};
+
+struct whisper_cpt_range {
+    uint32_t start;
+    uint8_t  cls; // whisper_cpt_class
+};
+
+static const whisper_cpt_range WHISPER_CPT_RANGES[] = {
+    {0x00080, 0}, {0x000AA, 1}, {0x000AB, 0}, {0x000B2, 2}, {0x000B4, 0}, {0x000B5, 1}, {0x000B6, 0}, {0x000B9, 2},
+    {0x000BA, 1}, {0x000BB, 0}, {0x000BC, 2}, {0x000BF, 0}, {0x000C0, 1}, {0x000D7, 0}, {0x000D8, 1}, {0x000F7, 0},
+    {0x000F8, 1}, {0x002C2, 0}, {0x002C6, 1}, {0x002D2, 0}, {0x002E0, 1}, {0x002E5, 0}, {0x002EC, 1}, {0x002ED, 0},
+    {0x002EE, 1}, {0x002EF, 0}, {0x00370, 1}, {0x00375, 0}, {0x00376, 1}, {0x00378, 0}, {0x0037A, 1}, {0x0037E, 0},
+    {0x0037F, 1}, {0x00380, 0}, {0x00386, 1}, {0x00387, 0}, {0x00388, 1}, {0x0038B, 0}, {0x0038C, 1}, {0x0038D, 0},
+    {0x0038E, 1}, {0x003A2, 0}, {0x003A3, 1}, {0x003F6, 0}, {0x003F7, 1}, {0x00482, 0}, {0x0048A, 1}, {0x00530, 0},
+    {0x00531, 1}, {0x00557, 0}, {0x00559, 1}, {0x0055A, 0}, {0x00560, 1}, {0x00589, 0}, {0x005D0, 1}, {0x005EB, 0},
+    {0x005EF, 1}, {0x005F3, 0}, {0x00620, 1}, {0x0064B, 0}, {0x00660, 2}, {0x0066A, 0}, {0x0066E, 1}, {0x00670, 0},
+    {0x00671, 1}, {0x006D4, 0}, {0x006D5, 1}, {0x006D6, 0}, {0x006E5, 1}, {0x006E7, 0}, {0x006EE, 1}, {0x006F0, 2},
+    {0x006FA, 1}, {0x006FD, 0}, {0x006FF, 1}, {0x00700, 0}, {0x00710, 1}, {0x00711, 0}, {0x00712, 1}, {0x00730, 0},
+    {0x0074D, 1}, {0x007A6, 0}, {0x007B1, 1}, {0x007B2, 0}, {0x007C0, 2}, {0x007CA, 1}, {0x007EB, 0}, {0x007F4, 1},
+    {0x007F6, 0}, {0x007FA, 1}, {0x007FB, 0}, {0x00800, 1}, {0x00816, 0}, {0x0081A, 1}, {0x0081B, 0}, {0x00824, 1},
+    {0x00825, 0}, {0x00828, 1}, {0x00829, 0}, {0x00840, 1}, {0x00859, 0}, {0x00860, 1}, {0x0086B, 0}, {0x00870, 1},
+    {0x00888, 0}, {0x00889, 1}, {0x0088F, 0}, {0x008A0, 1}, {0x008CA, 0}, {0x00904, 1}, {0x0093A, 0}, {0x0093D, 1},
+    {0x0093E, 0}, {0x00950, 1}, {0x00951, 0}, {0x00958, 1}, {0x00962, 0}, {0x00966, 2}, {0x00970, 0}, {0x00971, 1},
+    {0x00981, 0}, {0x00985, 1}, {0x0098D, 0}, {0x0098F, 1}, {0x00991, 0}, {0x00993, 1}, {0x009A9, 0}, {0x009AA, 1},
+    {0x009B1, 0}, {0x009B2, 1}, {0x009B3, 0}, {0x009B6, 1}, {0x009BA, 0}, {0x009BD, 1}, {0x009BE, 0}, {0x009CE, 1},
+    {0x009CF, 0}, {0x009DC, 1}, {0x009DE, 0}, {0x009DF, 1}, {0x009E2, 0}, {0x009E6, 2}, {0x009F0, 1}, {0x009F2, 0},
+    {0x009F4, 2}, {0x009FA, 0}, {0x009FC, 1}, {0x009FD, 0}, {0x00A05, 1}, {0x00A0B, 0}, {0x00A0F, 1}, {0x00A11, 0},
+    {0x00A13, 1}, {0x00A29, 0}, {0x00A2A, 1}, {0x00A31, 0}, {0x00A32, 1}, {0x00A34, 0}, {0x00A35, 1}, {0x00A37, 0},
+    {0x00A38, 1}, {0x00A3A, 0}, {0x00A59, 1}, {0x00A5D, 0}, {0x00A5E, 1}, {0x00A5F, 0}, {0x00A66, 2}, {0x00A70, 0},
+    {0x00A72, 1}, {0x00A75, 0}, {0x00A85, 1}, {0x00A8E, 0}, {0x00A8F, 1}, {0x00A92, 0}, {0x00A93, 1}, {0x00AA9, 0},
+    {0x00AAA, 1}, {0x00AB1, 0}, {0x00AB2, 1}, {0x00AB4, 0}, {0x00AB5, 1}, {0x00ABA, 0}, {0x00ABD, 1}, {0x00ABE, 0},
+    {0x00AD0, 1}, {0x00AD1, 0}, {0x00AE0, 1}, {0x00AE2, 0}, {0x00AE6, 2}, {0x00AF0, 0}, {0x00AF9, 1}, {0x00AFA, 0},
+    {0x00B05, 1}, {0x00B0D, 0}, {0x00B0F, 1}, {0x00B11, 0}, {0x00B13, 1}, {0x00B29, 0}, {0x00B2A, 1}, {0x00B31, 0},
+    {0x00B32, 1}, {0x00B34, 0}, {0x00B35, 1}, {0x00B3A, 0}, {0x00B3D, 1}, {0x00B3E, 0}, {0x00B5C, 1}, {0x00B5E, 0},
+    {0x00B5F, 1}, {0x00B62, 0}, {0x00B66, 2}, {0x00B70, 0}, {0x00B71, 1}, {0x00B72, 2}, {0x00B78, 0}, {0x00B83, 1},
+    {0x00B84, 0}, {0x00B85, 1}, {0x00B8B, 0}, {0x00B8E, 1}, {0x00B91, 0}, {0x00B92, 1}, {0x00B96, 0}, {0x00B99, 1},
+    {0x00B9B, 0}, {0x00B9C, 1}, {0x00B9D, 0}, {0x00B9E, 1}, {0x00BA0, 0}, {0x00BA3, 1}, {0x00BA5, 0}, {0x00BA8, 1},
+    {0x00BAB, 0}, {0x00BAE, 1}, {0x00BBA, 0}, {0x00BD0, 1}, {0x00BD1, 0}, {0x00BE6, 2}, {0x00BF3, 0}, {0x00C05, 1},
+    {0x00C0D, 0}, {0x00C0E, 1}, {0x00C11, 0}, {0x00C12, 1}, {0x00C29, 0}, {0x00C2A, 1}, {0x00C3A, 0}, {0x00C3D, 1},
+    {0x00C3E, 0}, {0x00C58, 1}, {0x00C5B, 0}, {0x00C5D, 1}, {0x00C5E, 0}, {0x00C60, 1}, {0x00C62, 0}, {0x00C66, 2},
+    {0x00C70, 0}, {0x00C78, 2}, {0x00C7F, 0}, {0x00C80, 1}, {0x00C81, 0}, {0x00C85, 1}, {0x00C8D, 0}, {0x00C8E, 1},
+    {0x00C91, 0}, {0x00C92, 1}, {0x00CA9, 0}, {0x00CAA, 1}, {0x00CB4, 0}, {0x00CB5, 1}, {0x00CBA, 0}, {0x00CBD, 1},
+    {0x00CBE, 0}, {0x00CDD, 1}, {0x00CDF, 0}, {0x00CE0, 1}, {0x00CE2, 0}, {0x00CE6, 2}, {0x00CF0, 0}, {0x00CF1, 1},
+    {0x00CF3, 0}, {0x00D04, 1}, {0x00D0D, 0}, {0x00D0E, 1}, {0x00D11, 0}, {0x00D12, 1}, {0x00D3B, 0}, {0x00D3D, 1},
+    {0x00D3E, 0}, {0x00D4E, 1}, {0x00D4F, 0}, {0x00D54, 1}, {0x00D57, 0}, {0x00D58, 2}, {0x00D5F, 1}, {0x00D62, 0},
+    {0x00D66, 2}, {0x00D79, 0}, {0x00D7A, 1}, {0x00D80, 0}, {0x00D85, 1}, {0x00D97, 0}, {0x00D9A, 1}, {0x00DB2, 0},
+    {0x00DB3, 1}, {0x00DBC, 0}, {0x00DBD, 1}, {0x00DBE, 0}, {0x00DC0, 1}, {0x00DC7, 0}, {0x00DE6, 2}, {0x00DF0, 0},
+    {0x00E01, 1}, {0x00E31, 0}, {0x00E32, 1}, {0x00E34, 0}, {0x00E40, 1}, {0x00E47, 0}, {0x00E50, 2}, {0x00E5A, 0},
+    {0x00E81, 1}, {0x00E83, 0}, {0x00E84, 1}, {0x00E85, 0}, {0x00E86, 1}, {0x00E8B, 0}, {0x00E8C, 1}, {0x00EA4, 0},
+    {0x00EA5, 1}, {0x00EA6, 0}, {0x00EA7, 1}, {0x00EB1, 0}, {0x00EB2, 1}, {0x00EB4, 0}, {0x00EBD, 1}, {0x00EBE, 0},
+    {0x00EC0, 1}, {0x00EC5, 0}, {0x00EC6, 1}, {0x00EC7, 0}, {0x00ED0, 2}, {0x00EDA, 0}, {0x00EDC, 1}, {0x00EE0, 0},
+    {0x00F00, 1}, {0x00F01, 0}, {0x00F20, 2}, {0x00F34, 0}, {0x00F40, 1}, {0x00F48, 0}, {0x00F49, 1}, {0x00F6D, 0},
+    {0x00F88, 1}, {0x00F8D, 0}, {0x01000, 1}, {0x0102B, 0}, {0x0103F, 1}, {0x01040, 2}, {0x0104A, 0}, {0x01050, 1},
+    {0x01056, 0}, {0x0105A, 1}, {0x0105E, 0}, {0x01061, 1}, {0x01062, 0}, {0x01065, 1}, {0x01067, 0}, {0x0106E, 1},
+    {0x01071, 0}, {0x01075, 1}, {0x01082, 0}, {0x0108E, 1}, {0x0108F, 0}, {0x01090, 2}, {0x0109A, 0}, {0x010A0, 1},
+    {0x010C6, 0}, {0x010C7, 1}, {0x010C8, 0}, {0x010CD, 1}, {0x010CE, 0}, {0x010D0, 1}, {0x010FB, 0}, {0x010FC, 1},
+    {0x01249, 0}, {0x0124A, 1}, {0x0124E, 0}, {0x01250, 1}, {0x01257, 0}, {0x01258, 1}, {0x01259, 0}, {0x0125A, 1},
+    {0x0125E, 0}, {0x01260, 1}, {0x01289, 0}, {0x0128A, 1}, {0x0128E, 0}, {0x01290, 1}, {0x012B1, 0}, {0x012B2, 1},
+    {0x012B6, 0}, {0x012B8, 1}, {0x012BF, 0}, {0x012C0, 1}, {0x012C1, 0}, {0x012C2, 1}, {0x012C6, 0}, {0x012C8, 1},
+    {0x012D7, 0}, {0x012D8, 1}, {0x01311, 0}, {0x01312, 1}, {0x01316, 0}, {0x01318, 1}, {0x0135B, 0}, {0x01369, 2},
+    {0x0137D, 0}, {0x01380, 1}, {0x01390, 0}, {0x013A0, 1}, {0x013F6, 0}, {0x013F8, 1}, {0x013FE, 0}, {0x01401, 1},
+    {0x0166D, 0}, {0x0166F, 1}, {0x01680, 0}, {0x01681, 1}, {0x0169B, 0}, {0x016A0, 1}, {0x016EB, 0}, {0x016EE, 2},
+    {0x016F1, 1}, {0x016F9, 0}, {0x01700, 1}, {0x01712, 0}, {0x0171F, 1}, {0x01732, 0}, {0x01740, 1}, {0x01752, 0},
+    {0x01760, 1}, {0x0176D, 0}, {0x0176E, 1}, {0x01771, 0}, {0x01780, 1}, {0x017B4, 0}, {0x017D7, 1}, {0x017D8, 0},
+    {0x017DC, 1}, {0x017DD, 0}, {0x017E0, 2}, {0x017EA, 0}, {0x017F0, 2}, {0x017FA, 0}, {0x01810, 2}, {0x0181A, 0},
+    {0x01820, 1}, {0x01879, 0}, {0x01880, 1}, {0x01885, 0}, {0x01887, 1}, {0x018A9, 0}, {0x018AA, 1}, {0x018AB, 0},
+    {0x018B0, 1}, {0x018F6, 0}, {0x01900, 1}, {0x0191F, 0}, {0x01946, 2}, {0x01950, 1}, {0x0196E, 0}, {0x01970, 1},
+    {0x01975, 0}, {0x01980, 1}, {0x019AC, 0}, {0x019B0, 1}, {0x019CA, 0}, {0x019D0, 2}, {0x019DB, 0}, {0x01A00, 1},
+    {0x01A17, 0}, {0x01A20, 1}, {0x01A55, 0}, {0x01A80, 2}, {0x01A8A, 0}, {0x01A90, 2}, {0x01A9A, 0}, {0x01AA7, 1},
+    {0x01AA8, 0}, {0x01B05, 1}, {0x01B34, 0}, {0x01B45, 1}, {0x01B4D, 0}, {0x01B50, 2}, {0x01B5A, 0}, {0x01B83, 1},
+    {0x01BA1, 0}, {0x01BAE, 1}, {0x01BB0, 2}, {0x01BBA, 1}, {0x01BE6, 0}, {0x01C00, 1}, {0x01C24, 0}, {0x01C40, 2},
+    {0x01C4A, 0}, {0x01C4D, 1}, {0x01C50, 2}, {0x01C5A, 1}, {0x01C7E, 0}, {0x01C80, 1}, {0x01C89, 0}, {0x01C90, 1},
+    {0x01CBB, 0}, {0x01CBD, 1}, {0x01CC0, 0}, {0x01CE9, 1}, {0x01CED, 0}, {0x01CEE, 1}, {0x01CF4, 0}, {0x01CF5, 1},
+    {0x01CF7, 0}, {0x01CFA, 1}, {0x01CFB, 0}, {0x01D00, 1}, {0x01DC0, 0}, {0x01E00, 1}, {0x01F16, 0}, {0x01F18, 1},
+    {0x01F1E, 0}, {0x01F20, 1}, {0x01F46, 0}, {0x01F48, 1}, {0x01F4E, 0}, {0x01F50, 1}, {0x01F58, 0}, {0x01F59, 1},
+    {0x01F5A, 0}, {0x01F5B, 1}, {0x01F5C, 0}, {0x01F5D, 1}, {0x01F5E, 0}, {0x01F5F, 1}, {0x01F7E, 0}, {0x01F80, 1},
+    {0x01FB5, 0}, {0x01FB6, 1}, {0x01FBD, 0}, {0x01FBE, 1}, {0x01FBF, 0}, {0x01FC2, 1}, {0x01FC5, 0}, {0x01FC6, 1},
+    {0x01FCD, 0}, {0x01FD0, 1}, {0x01FD4, 0}, {0x01FD6, 1}, {0x01FDC, 0}, {0x01FE0, 1}, {0x01FED, 0}, {0x01FF2, 1},
+    {0x01FF5, 0}, {0x01FF6, 1}, {0x01FFD, 0}, {0x02070, 2}, {0x02071, 1}, {0x02072, 0}, {0x02074, 2}, {0x0207A, 0},
+    {0x0207F, 1}, {0x02080, 2}, {0x0208A, 0}, {0x02090, 1}, {0x0209D, 0}, {0x02102, 1}, {0x02103, 0}, {0x02107, 1},
+    {0x02108, 0}, {0x0210A, 1}, {0x02114, 0}, {0x02115, 1}, {0x02116, 0}, {0x02119, 1}, {0x0211E, 0}, {0x02124, 1},
+    {0x02125, 0}, {0x02126, 1}, {0x02127, 0}, {0x02128, 1}, {0x02129, 0}, {0x0212A, 1}, {0x0212E, 0}, {0x0212F, 1},
+    {0x0213A, 0}, {0x0213C, 1}, {0x02140, 0}, {0x02145, 1}, {0x0214A, 0}, {0x0214E, 1}, {0x0214F, 0}, {0x02150, 2},
+    {0x02183, 1}, {0x02185, 2}, {0x0218A, 0}, {0x02460, 2}, {0x0249C, 0}, {0x024EA, 2}, {0x02500, 0}, {0x02776, 2},
+    {0x02794, 0}, {0x02C00, 1}, {0x02CE5, 0}, {0x02CEB, 1}, {0x02CEF, 0}, {0x02CF2, 1}, {0x02CF4, 0}, {0x02CFD, 2},
+    {0x02CFE, 0}, {0x02D00, 1}, {0x02D26, 0}, {0x02D27, 1}, {0x02D28, 0}, {0x02D2D, 1}, {0x02D2E, 0}, {0x02D30, 1},
+    {0x02D68, 0}, {0x02D6F, 1}, {0x02D70, 0}, {0x02D80, 1}, {0x02D97, 0}, {0x02DA0, 1}, {0x02DA7, 0}, {0x02DA8, 1},
+    {0x02DAF, 0}, {0x02DB0, 1}, {0x02DB7, 0}, {0x02DB8, 1}, {0x02DBF, 0}, {0x02DC0, 1}, {0x02DC7, 0}, {0x02DC8, 1},
+    {0x02DCF, 0}, {0x02DD0, 1}, {0x02DD7, 0}, {0x02DD8, 1}, {0x02DDF, 0}, {0x02E2F, 1}, {0x02E30, 0}, {0x03005, 1},
+    {0x03007, 2}, {0x03008, 0}, {0x03021, 2}, {0x0302A, 0}, {0x03031, 1}, {0x03036, 0}, {0x03038, 2}, {0x0303B, 1},
+    {0x0303D, 0}, {0x03041, 1}, {0x03097, 0}, {0x0309D, 1}, {0x030A0, 0}, {0x030A1, 1}, {0x030FB, 0}, {0x030FC, 1},
+    {0x03100, 0}, {0x03105, 1}, {0x03130, 0}, {0x03131, 1}, {0x0318F, 0}, {0x03192, 2}, {0x03196, 0}, {0x031A0, 1},
+    {0x031C0, 0}, {0x031F0, 1}, {0x03200, 0}, {0x03220, 2}, {0x0322A, 0}, {0x03248, 2}, {0x03250, 0}, {0x03251, 2},
+    {0x03260, 0}, {0x03280, 2}, {0x0328A, 0}, {0x032B1, 2}, {0x032C0, 0}, {0x03400, 1}, {0x04DC0, 0}, {0x04E00, 1},
+    {0x0A48D, 0}, {0x0A4D0, 1}, {0x0A4FE, 0}, {0x0A500, 1}, {0x0A60D, 0}, {0x0A610, 1}, {0x0A620, 2}, {0x0A62A, 1},
+    {0x0A62C, 0}, {0x0A640, 1}, {0x0A66F, 0}, {0x0A67F, 1}, {0x0A69E, 0}, {0x0A6A0, 1}, {0x0A6E6, 2}, {0x0A6F0, 0},
+    {0x0A717, 1}, {0x0A720, 0}, {0x0A722, 1}, {0x0A789, 0}, {0x0A78B, 1}, {0x0A7CB, 0}, {0x0A7D0, 1}, {0x0A7D2, 0},
+    {0x0A7D3, 1}, {0x0A7D4, 0}, {0x0A7D5, 1}, {0x0A7DA, 0}, {0x0A7F2, 1}, {0x0A802, 0}, {0x0A803, 1}, {0x0A806, 0},
+    {0x0A807, 1}, {0x0A80B, 0}, {0x0A80C, 1}, {0x0A823, 0}, {0x0A830, 2}, {0x0A836, 0}, {0x0A840, 1}, {0x0A874, 0},
+    {0x0A882, 1}, {0x0A8B4, 0}, {0x0A8D0, 2}, {0x0A8DA, 0}, {0x0A8F2, 1}, {0x0A8F8, 0}, {0x0A8FB, 1}, {0x0A8FC, 0},
+    {0x0A8FD, 1}, {0x0A8FF, 0}, {0x0A900, 2}, {0x0A90A, 1}, {0x0A926, 0}, {0x0A930, 1}, {0x0A947, 0}, {0x0A960, 1},
+    {0x0A97D, 0}, {0x0A984, 1}, {0x0A9B3, 0}, {0x0A9CF, 1}, {0x0A9D0, 2}, {0x0A9DA, 0}, {0x0A9E0, 1}, {0x0A9E5, 0},
+    {0x0A9E6, 1}, {0x0A9F0, 2}, {0x0A9FA, 1}, {0x0A9FF, 0}, {0x0AA00, 1}, {0x0AA29, 0}, {0x0AA40, 1}, {0x0AA43, 0},
+    {0x0AA44, 1}, {0x0AA4C, 0}, {0x0AA50, 2}, {0x0AA5A, 0}, {0x0AA60, 1}, {0x0AA77, 0}, {0x0AA7A, 1}, {0x0AA7B, 0},
+    {0x0AA7E, 1}, {0x0AAB0, 0}, {0x0AAB1, 1}, {0x0AAB2, 0}, {0x0AAB5, 1}, {0x0AAB7, 0}, {0x0AAB9, 1}, {0x0AABE, 0},
+    {0x0AAC0, 1}, {0x0AAC1, 0}, {0x0AAC2, 1}, {0x0AAC3, 0}, {0x0AADB, 1}, {0x0AADE, 0}, {0x0AAE0, 1}, {0x0AAEB, 0},
+    {0x0AAF2, 1}, {0x0AAF5, 0}, {0x0AB01, 1}, {0x0AB07, 0}, {0x0AB09, 1}, {0x0AB0F, 0}, {0x0AB11, 1}, {0x0AB17, 0},
+    {0x0AB20, 1}, {0x0AB27, 0}, {0x0AB28, 1}, {0x0AB2F, 0}, {0x0AB30, 1}, {0x0AB5B, 0}, {0x0AB5C, 1}, {0x0AB6A, 0},
+    {0x0AB70, 1}, {0x0ABE3, 0}, {0x0ABF0, 2}, {0x0ABFA, 0}, {0x0AC00, 1}, {0x0D7A4, 0}, {0x0D7B0, 1}, {0x0D7C7, 0},
+    {0x0D7CB, 1}, {0x0D7FC, 0}, {0x0F900, 1}, {0x0FA6E, 0}, {0x0FA70, 1}, {0x0FADA, 0}, {0x0FB00, 1}, {0x0FB07, 0},
+    {0x0FB13, 1}, {0x0FB18, 0}, {0x0FB1D, 1}, {0x0FB1E, 0}, {0x0FB1F, 1}, {0x0FB29, 0}, {0x0FB2A, 1}, {0x0FB37, 0},
+    {0x0FB38, 1}, {0x0FB3D, 0}, {0x0FB3E, 1}, {0x0FB3F, 0}, {0x0FB40, 1}, {0x0FB42, 0}, {0x0FB43, 1}, {0x0FB45, 0},
+    {0x0FB46, 1}, {0x0FBB2, 0}, {0x0FBD3, 1}, {0x0FD3E, 0}, {0x0FD50, 1}, {0x0FD90, 0}, {0x0FD92, 1}, {0x0FDC8, 0},
+    {0x0FDF0, 1}, {0x0FDFC, 0}, {0x0FE70, 1}, {0x0FE75, 0}, {0x0FE76, 1}, {0x0FEFD, 0}, {0x0FF10, 2}, {0x0FF1A, 0},
+    {0x0FF21, 1}, {0x0FF3B, 0}, {0x0FF41, 1}, {0x0FF5B, 0}, {0x0FF66, 1}, {0x0FFBF, 0}, {0x0FFC2, 1}, {0x0FFC8, 0},
+    {0x0FFCA, 1}, {0x0FFD0, 0}, {0x0FFD2, 1}, {0x0FFD8, 0}, {0x0FFDA, 1}, {0x0FFDD, 0}, {0x10000, 1}, {0x1000C, 0},
+    {0x1000D, 1}, {0x10027, 0}, {0x10028, 1}, {0x1003B, 0}, {0x1003C, 1}, {0x1003E, 0}, {0x1003F, 1}, {0x1004E, 0},
+    {0x10050, 1}, {0x1005E, 0}, {0x10080, 1}, {0x100FB, 0}, {0x10107, 2}, {0x10134, 0}, {0x10140, 2}, {0x10179, 0},
+    {0x1018A, 2}, {0x1018C, 0}, {0x10280, 1}, {0x1029D, 0}, {0x102A0, 1}, {0x102D1, 0}, {0x102E1, 2}, {0x102FC, 0},
+    {0x10300, 1}, {0x10320, 2}, {0x10324, 0}, {0x1032D, 1}, {0x10341, 2}, {0x10342, 1}, {0x1034A, 2}, {0x1034B, 0},
+    {0x10350, 1}, {0x10376, 0}, {0x10380, 1}, {0x1039E, 0}, {0x103A0, 1}, {0x103C4, 0}, {0x103C8, 1}, {0x103D0, 0},
+    {0x103D1, 2}, {0x103D6, 0}, {0x10400, 1}, {0x1049E, 0}, {0x104A0, 2}, {0x104AA, 0}, {0x104B0, 1}, {0x104D4, 0},
+    {0x104D8, 1}, {0x104FC, 0}, {0x10500, 1}, {0x10528, 0}, {0x10530, 1}, {0x10564, 0}, {0x10570, 1}, {0x1057B, 0},
+    {0x1057C, 1}, {0x1058B, 0}, {0x1058C, 1}, {0x10593, 0}, {0x10594, 1}, {0x10596, 0}, {0x10597, 1}, {0x105A2, 0},
+    {0x105A3, 1}, {0x105B2, 0}, {0x105B3, 1}, {0x105BA, 0}, {0x105BB, 1}, {0x105BD, 0}, {0x10600, 1}, {0x10737, 0},
+    {0x10740, 1}, {0x10756, 0}, {0x10760, 1}, {0x10768, 0}, {0x10780, 1}, {0x10786, 0}, {0x10787, 1}, {0x107B1, 0},
+    {0x107B2, 1}, {0x107BB, 0}, {0x10800, 1}, {0x10806, 0}, {0x10808, 1}, {0x10809, 0}, {0x1080A, 1}, {0x10836, 0},
+    {0x10837, 1}, {0x10839, 0}, {0x1083C, 1}, {0x1083D, 0}, {0x1083F, 1}, {0x10856, 0}, {0x10858, 2}, {0x10860, 1},
+    {0x10877, 0}, {0x10879, 2}, {0x10880, 1}, {0x1089F, 0}, {0x108A7, 2}, {0x108B0, 0}, {0x108E0, 1}, {0x108F3, 0},
+    {0x108F4, 1}, {0x108F6, 0}, {0x108FB, 2}, {0x10900, 1}, {0x10916, 2}, {0x1091C, 0}, {0x10920, 1}, {0x1093A, 0},
+    {0x10980, 1}, {0x109B8, 0}, {0x109BC, 2}, {0x109BE, 1}, {0x109C0, 2}, {0x109D0, 0}, {0x109D2, 2}, {0x10A00, 1},
+    {0x10A01, 0}, {0x10A10, 1}, {0x10A14, 0}, {0x10A15, 1}, {0x10A18, 0}, {0x10A19, 1}, {0x10A36, 0}, {0x10A40, 2},
+    {0x10A49, 0}, {0x10A60, 1}, {0x10A7D, 2}, {0x10A7F, 0}, {0x10A80, 1}, {0x10A9D, 2}, {0x10AA0, 0}, {0x10AC0, 1},
+    {0x10AC8, 0}, {0x10AC9, 1}, {0x10AE5, 0}, {0x10AEB, 2}, {0x10AF0, 0}, {0x10B00, 1}, {0x10B36, 0}, {0x10B40, 1},
+    {0x10B56, 0}, {0x10B58, 2}, {0x10B60, 1}, {0x10B73, 0}, {0x10B78, 2}, {0x10B80, 1}, {0x10B92, 0}, {0x10BA9, 2},
+    {0x10BB0, 0}, {0x10C00, 1}, {0x10C49, 0}, {0x10C80, 1}, {0x10CB3, 0}, {0x10CC0, 1}, {0x10CF3, 0}, {0x10CFA, 2},
+    {0x10D00, 1}, {0x10D24, 0}, {0x10D30, 2}, {0x10D3A, 0}, {0x10E60, 2}, {0x10E7F, 0}, {0x10E80, 1}, {0x10EAA, 0},
+    {0x10EB0, 1}, {0x10EB2, 0}, {0x10F00, 1}, {0x10F1D, 2}, {0x10F27, 1}, {0x10F28, 0}, {0x10F30, 1}, {0x10F46, 0},
+    {0x10F51, 2}, {0x10F55, 0}, {0x10F70, 1}, {0x10F82, 0}, {0x10FB0, 1}, {0x10FC5, 2}, {0x10FCC, 0}, {0x10FE0, 1},
+    {0x10FF7, 0}, {0x11003, 1}, {0x11038, 0}, {0x11052, 2}, {0x11070, 0}, {0x11071, 1}, {0x11073, 0}, {0x11075, 1},
+    {0x11076, 0}, {0x11083, 1}, {0x110B0, 0}, {0x110D0, 1}, {0x110E9, 0}, {0x110F0, 2}, {0x110FA, 0}, {0x11103, 1},
+    {0x11127, 0}, {0x11136, 2}, {0x11140, 0}, {0x11144, 1}, {0x11145, 0}, {0x11147, 1}, {0x11148, 0}, {0x11150, 1},
+    {0x11173, 0}, {0x11176, 1}, {0x11177, 0}, {0x11183, 1}, {0x111B3, 0}, {0x111C1, 1}, {0x111C5, 0}, {0x111D0, 2},
+    {0x111DA, 1}, {0x111DB, 0}, {0x111DC, 1}, {0x111DD, 0}, {0x111E1, 2}, {0x111F5, 0}, {0x11200, 1}, {0x11212, 0},
+    {0x11213, 1}, {0x1122C, 0}, {0x1123F, 1}, {0x11241, 0}, {0x11280, 1}, {0x11287, 0}, {0x11288, 1}, {0x11289, 0},
+    {0x1128A, 1}, {0x1128E, 0}, {0x1128F, 1}, {0x1129E, 0}, {0x1129F, 1}, {0x112A9, 0}, {0x112B0, 1}, {0x112DF, 0},
+    {0x112F0, 2}, {0x112FA, 0}, {0x11305, 1}, {0x1130D, 0}, {0x1130F, 1}, {0x11311, 0}, {0x11313, 1}, {0x11329, 0},
+    {0x1132A, 1}, {0x11331, 0}, {0x11332, 1}, {0x11334, 0}, {0x11335, 1}, {0x1133A, 0}, {0x1133D, 1}, {0x1133E, 0},
+    {0x11350, 1}, {0x11351, 0}, {0x1135D, 1}, {0x11362, 0}, {0x11400, 1}, {0x11435, 0}, {0x11447, 1}, {0x1144B, 0},
+    {0x11450, 2}, {0x1145A, 0}, {0x1145F, 1}, {0x11462, 0}, {0x11480, 1}, {0x114B0, 0}, {0x114C4, 1}, {0x114C6, 0},
+    {0x114C7, 1}, {0x114C8, 0}, {0x114D0, 2}, {0x114DA, 0}, {0x11580, 1}, {0x115AF, 0}, {0x115D8, 1}, {0x115DC, 0},
+    {0x11600, 1}, {0x11630, 0}, {0x11644, 1}, {0x11645, 0}, {0x11650, 2}, {0x1165A, 0}, {0x11680, 1}, {0x116AB, 0},
+    {0x116B8, 1}, {0x116B9, 0}, {0x116C0, 2}, {0x116CA, 0}, {0x11700, 1}, {0x1171B, 0}, {0x11730, 2}, {0x1173C, 0},
+    {0x11740, 1}, {0x11747, 0}, {0x11800, 1}, {0x1182C, 0}, {0x118A0, 1}, {0x118E0, 2}, {0x118F3, 0}, {0x118FF, 1},
+    {0x11907, 0}, {0x11909, 1}, {0x1190A, 0}, {0x1190C, 1}, {0x11914, 0}, {0x11915, 1}, {0x11917, 0}, {0x11918, 1},
+    {0x11930, 0}, {0x1193F, 1}, {0x11940, 0}, {0x11941, 1}, {0x11942, 0}, {0x11950, 2}, {0x1195A, 0}, {0x119A0, 1},
+    {0x119A8, 0}, {0x119AA, 1}, {0x119D1, 0}, {0x119E1, 1}, {0x119E2, 0}, {0x119E3, 1}, {0x119E4, 0}, {0x11A00, 1},
+    {0x11A01, 0}, {0x11A0B, 1}, {0x11A33, 0}, {0x11A3A, 1}, {0x11A3B, 0}, {0x11A50, 1}, {0x11A51, 0}, {0x11A5C, 1},
+    {0x11A8A, 0}, {0x11A9D, 1}, {0x11A9E, 0}, {0x11AB0, 1}, {0x11AF9, 0}, {0x11C00, 1}, {0x11C09, 0}, {0x11C0A, 1},
+    {0x11C2F, 0}, {0x11C40, 1}, {0x11C41, 0}, {0x11C50, 2}, {0x11C6D, 0}, {0x11C72, 1}, {0x11C90, 0}, {0x11D00, 1},
+    {0x11D07, 0}, {0x11D08, 1}, {0x11D0A, 0}, {0x11D0B, 1}, {0x11D31, 0}, {0x11D46, 1}, {0x11D47, 0}, {0x11D50, 2},
+    {0x11D5A, 0}, {0x11D60, 1}, {0x11D66, 0}, {0x11D67, 1}, {0x11D69, 0}, {0x11D6A, 1}, {0x11D8A, 0}, {0x11D98, 1},
+    {0x11D99, 0}, {0x11DA0, 2}, {0x11DAA, 0}, {0x11EE0, 1}, {0x11EF3, 0}, {0x11F02, 1}, {0x11F03, 0}, {0x11F04, 1},
+    {0x11F11, 0}, {0x11F12, 1}, {0x11F34, 0}, {0x11F50, 2}, {0x11F5A, 0}, {0x11FB0, 1}, {0x11FB1, 0}, {0x11FC0, 2},
+    {0x11FD5, 0}, {0x12000, 1}, {0x1239A, 0}, {0x12400, 2}, {0x1246F, 0}, {0x12480, 1}, {0x12544, 0}, {0x12F90, 1},
+    {0x12FF1, 0}, {0x13000, 1}, {0x13430, 0}, {0x13441, 1}, {0x13447, 0}, {0x14400, 1}, {0x14647, 0}, {0x16800, 1},
+    {0x16A39, 0}, {0x16A40, 1}, {0x16A5F, 0}, {0x16A60, 2}, {0x16A6A, 0}, {0x16A70, 1}, {0x16ABF, 0}, {0x16AC0, 2},
+    {0x16ACA, 0}, {0x16AD0, 1}, {0x16AEE, 0}, {0x16B00, 1}, {0x16B30, 0}, {0x16B40, 1}, {0x16B44, 0}, {0x16B50, 2},
+    {0x16B5A, 0}, {0x16B5B, 2}, {0x16B62, 0}, {0x16B63, 1}, {0x16B78, 0}, {0x16B7D, 1}, {0x16B90, 0}, {0x16E40, 1},
+    {0x16E80, 2}, {0x16E97, 0}, {0x16F00, 1}, {0x16F4B, 0}, {0x16F50, 1}, {0x16F51, 0}, {0x16F93, 1}, {0x16FA0, 0},
+    {0x16FE0, 1}, {0x16FE2, 0}, {0x16FE3, 1}, {0x16FE4, 0}, {0x17000, 1}, {0x187F8, 0}, {0x18800, 1}, {0x18CD6, 0},
+    {0x18D00, 1}, {0x18D09, 0}, {0x1AFF0, 1}, {0x1AFF4, 0}, {0x1AFF5, 1}, {0x1AFFC, 0}, {0x1AFFD, 1}, {0x1AFFF, 0},
+    {0x1B000, 1}, {0x1B123, 0}, {0x1B132, 1}, {0x1B133, 0}, {0x1B150, 1}, {0x1B153, 0}, {0x1B155, 1}, {0x1B156, 0},
+    {0x1B164, 1}, {0x1B168, 0}, {0x1B170, 1}, {0x1B2FC, 0}, {0x1BC00, 1}, {0x1BC6B, 0}, {0x1BC70, 1}, {0x1BC7D, 0},
+    {0x1BC80, 1}, {0x1BC89, 0}, {0x1BC90, 1}, {0x1BC9A, 0}, {0x1D2C0, 2}, {0x1D2D4, 0}, {0x1D2E0, 2}, {0x1D2F4, 0},
+    {0x1D360, 2}, {0x1D379, 0}, {0x1D400, 1}, {0x1D455, 0}, {0x1D456, 1}, {0x1D49D, 0}, {0x1D49E, 1}, {0x1D4A0, 0},
+    {0x1D4A2, 1}, {0x1D4A3, 0}, {0x1D4A5, 1}, {0x1D4A7, 0}, {0x1D4A9, 1}, {0x1D4AD, 0}, {0x1D4AE, 1}, {0x1D4BA, 0},
+    {0x1D4BB, 1}, {0x1D4BC, 0}, {0x1D4BD, 1}, {0x1D4C4, 0}, {0x1D4C5, 1}, {0x1D506, 0}, {0x1D507, 1}, {0x1D50B, 0},
+    {0x1D50D, 1}, {0x1D515, 0}, {0x1D516, 1}, {0x1D51D, 0}, {0x1D51E, 1}, {0x1D53A, 0}, {0x1D53B, 1}, {0x1D53F, 0},
+    {0x1D540, 1}, {0x1D545, 0}, {0x1D546, 1}, {0x1D547, 0}, {0x1D54A, 1}, {0x1D551, 0}, {0x1D552, 1}, {0x1D6A6, 0},
+    {0x1D6A8, 1}, {0x1D6C1, 0}, {0x1D6C2, 1}, {0x1D6DB, 0}, {0x1D6DC, 1}, {0x1D6FB, 0}, {0x1D6FC, 1}, {0x1D715, 0},
+    {0x1D716, 1}, {0x1D735, 0}, {0x1D736, 1}, {0x1D74F, 0}, {0x1D750, 1}, {0x1D76F, 0}, {0x1D770, 1}, {0x1D789, 0},
+    {0x1D78A, 1}, {0x1D7A9, 0}, {0x1D7AA, 1}, {0x1D7C3, 0}, {0x1D7C4, 1}, {0x1D7CC, 0}, {0x1D7CE, 2}, {0x1D800, 0},
+    {0x1DF00, 1}, {0x1DF1F, 0}, {0x1DF25, 1}, {0x1DF2B, 0}, {0x1E030, 1}, {0x1E06E, 0}, {0x1E100, 1}, {0x1E12D, 0},
+    {0x1E137, 1}, {0x1E13E, 0}, {0x1E140, 2}, {0x1E14A, 0}, {0x1E14E, 1}, {0x1E14F, 0}, {0x1E290, 1}, {0x1E2AE, 0},
+    {0x1E2C0, 1}, {0x1E2EC, 0}, {0x1E2F0, 2}, {0x1E2FA, 0}, {0x1E4D0, 1}, {0x1E4EC, 0}, {0x1E4F0, 2}, {0x1E4FA, 0},
+    {0x1E7E0, 1}, {0x1E7E7, 0}, {0x1E7E8, 1}, {0x1E7EC, 0}, {0x1E7ED, 1}, {0x1E7EF, 0}, {0x1E7F0, 1}, {0x1E7FF, 0},
+    {0x1E800, 1}, {0x1E8C5, 0}, {0x1E8C7, 2}, {0x1E8D0, 0}, {0x1E900, 1}, {0x1E944, 0}, {0x1E94B, 1}, {0x1E94C, 0},
+    {0x1E950, 2}, {0x1E95A, 0}, {0x1EC71, 2}, {0x1ECAC, 0}, {0x1ECAD, 2}, {0x1ECB0, 0}, {0x1ECB1, 2}, {0x1ECB5, 0},
+    {0x1ED01, 2}, {0x1ED2E, 0}, {0x1ED2F, 2}, {0x1ED3E, 0}, {0x1EE00, 1}, {0x1EE04, 0}, {0x1EE05, 1}, {0x1EE20, 0},
+    {0x1EE21, 1}, {0x1EE23, 0}, {0x1EE24, 1}, {0x1EE25, 0}, {0x1EE27, 1}, {0x1EE28, 0}, {0x1EE29, 1}, {0x1EE33, 0},
+    {0x1EE34, 1}, {0x1EE38, 0}, {0x1EE39, 1}, {0x1EE3A, 0}, {0x1EE3B, 1}, {0x1EE3C, 0}, {0x1EE42, 1}, {0x1EE43, 0},
+    {0x1EE47, 1}, {0x1EE48, 0}, {0x1EE49, 1}, {0x1EE4A, 0}, {0x1EE4B, 1}, {0x1EE4C, 0}, {0x1EE4D, 1}, {0x1EE50, 0},
+    {0x1EE51, 1}, {0x1EE53, 0}, {0x1EE54, 1}, {0x1EE55, 0}, {0x1EE57, 1}, {0x1EE58, 0}, {0x1EE59, 1}, {0x1EE5A, 0},
+    {0x1EE5B, 1}, {0x1EE5C, 0}, {0x1EE5D, 1}, {0x1EE5E, 0}, {0x1EE5F, 1}, {0x1EE60, 0}, {0x1EE61, 1}, {0x1EE63, 0},
+    {0x1EE64, 1}, {0x1EE65, 0}, {0x1EE67, 1}, {0x1EE6B, 0}, {0x1EE6C, 1}, {0x1EE73, 0}, {0x1EE74, 1}, {0x1EE78, 0},
+    {0x1EE79, 1}, {0x1EE7D, 0}, {0x1EE7E, 1}, {0x1EE7F, 0}, {0x1EE80, 1}, {0x1EE8A, 0}, {0x1EE8B, 1}, {0x1EE9C, 0},
+    {0x1EEA1, 1}, {0x1EEA4, 0}, {0x1EEA5, 1}, {0x1EEAA, 0}, {0x1EEAB, 1}, {0x1EEBC, 0}, {0x1F100, 2}, {0x1F10D, 0},
+    {0x1FBF0, 2}, {0x1FBFA, 0}, {0x20000, 1}, {0x2A6E0, 0}, {0x2A700, 1}, {0x2B73A, 0}, {0x2B740, 1}, {0x2B81E, 0},
+    {0x2B820, 1}, {0x2CEA2, 0}, {0x2CEB0, 1}, {0x2EBE1, 0}, {0x2EBF0, 1}, {0x2EE5E, 0}, {0x2F800, 1}, {0x2FA1E, 0},
+    {0x30000, 1}, {0x3134B, 0}, {0x31350, 1}, {0x323B0, 0},
+};
@@ -1,10 +1,13 @@
 #include "whisper.h"
 #include "whisper-arch.h"
+#include "whisper-fft.h"
+#include "whisper-unicode.h"
 
 #include "ggml.h"
 #include "ggml-cpp.h"
 #include "ggml-alloc.h"
 #include "ggml-backend.h"
+#include "gguf.h"
 
 #ifdef WHISPER_USE_COREML
 #include "coreml/whisper-encoder.h"
@@ -21,23 +24,50 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <climits>
+#include <condition_variable>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <regex>
-#include <set>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #ifdef _MSC_VER
 #include <codecvt>
 #endif
 
+#ifdef __has_include
+    #if __has_include(<unistd.h>)
+        #include <unistd.h>
+        #if defined(_POSIX_MAPPED_FILES)
+            #include <fcntl.h>
+            #include <sys/mman.h>
+            #include <sys/stat.h>
+        #endif
+    #endif
+#endif
+
+#ifdef __linux__
+    #include <sched.h>
+    #include <sys/syscall.h>
+#endif
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#endif
+
 #if defined(WHISPER_BIG_ENDIAN)
 template<typename T>
 static T byteswap(T value) {
@@ -144,6 +174,9 @@ static void whisper_log_callback_default(ggml_log_level level, const char * text
 // temperature below which we condition on past text history
 static constexpr float WHISPER_HISTORY_CONDITIONING_TEMP_CUTOFF = 0.5f;
 
+// extra encoder positions (20 ms each) kept past the end of the audio when audio_ctx is selected automatically
+static constexpr int WHISPER_AUDIO_CTX_AUTO_MARGIN = 64;
+
 #define WHISPER_MAX_NODES 4096
 
 static std::string format(const char * fmt, ...) {
@@ -165,33 +198,169 @@ static std::string format(const char * fmt, ...) {
 // ggml helpers
 //
 
-static bool ggml_graph_compute_helper(
-          struct ggml_cgraph * graph,
-                         int   n_threads,
-         ggml_abort_callback   abort_callback,
-                        void * abort_callback_data) {
-    ggml_backend_ptr backend { ggml_backend_init_by_type(GGML_BACKEND_DEVICE_TYPE_CPU, nullptr) };
+// the threadpool functions of the CPU backend - looked up through the registry, since the backend can be loaded dynamically
+typedef ggml_threadpool_t (*whisper_threadpool_new_t)(struct ggml_threadpool_params * params);
+typedef void              (*whisper_threadpool_fn_t) (ggml_threadpool_t threadpool);
+typedef int               (*whisper_threadpool_n_threads_t)(ggml_threadpool_t threadpool);
+typedef void              (*whisper_backend_set_threadpool_t)(ggml_backend_t backend, ggml_threadpool_t threadpool);
+
+static void * whisper_cpu_get_proc_address(const char * name) {
+    ggml_backend_dev_t dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    ggml_backend_reg_t reg = dev ? ggml_backend_dev_backend_reg(dev) : nullptr;
+
+    return reg ? ggml_backend_reg_get_proc_address(reg, name) : nullptr;
+}
+
+// CPU threadpool shared by the states of a context (whisper_context_params.threadpool)
+struct whisper_threadpool {
+    ggml_threadpool_t tp = nullptr;
+
+    bool owned     = false;
+    int  n_threads = 0;
+
+    // a threadpool computes one graph at a time
+    std::mutex mutex;
+
+    // calls in progress - the threadpool is paused when the last one returns
+    std::atomic<int> n_users { 0 };
+
+    whisper_threadpool_fn_t fn_pause  = nullptr;
+    whisper_threadpool_fn_t fn_resume = nullptr;
+    whisper_threadpool_fn_t fn_free   = nullptr;
+};
+
+// keeps the threadpool running for the duration of a call (e.g. between the graphs of whisper_full)
+struct whisper_threadpool_scope {
+    whisper_threadpool * threadpool;
+
+    explicit whisper_threadpool_scope(whisper_threadpool * threadpool) : threadpool(threadpool) {
+        if (threadpool && threadpool->n_users++ == 0 && threadpool->fn_resume) {
+            threadpool->fn_resume(threadpool->tp);
+        }
+    }
+
+    ~whisper_threadpool_scope() {
+        // a graph that starts after the pause resumes the threadpool on its own
+        if (threadpool && --threadpool->n_users == 0 && threadpool->fn_pause) {
+            threadpool->fn_pause(threadpool->tp);
+        }
+    }
+};
+
+static void whisper_threadpool_free(whisper_threadpool * threadpool) {
+    if (threadpool) {
+        if (threadpool->owned && threadpool->fn_free) {
+            threadpool->fn_free(threadpool->tp);
+        }
+
+        delete threadpool;
+    }
+}
+
+// returns nullptr when the context does not use a threadpool or on failure
+static whisper_threadpool * whisper_threadpool_init(const whisper_context_params & params) {
+    if (!params.threadpool && !params.threadpool_params) {
+        return nullptr;
+    }
+
+    auto fn_new       = (whisper_threadpool_new_t)       whisper_cpu_get_proc_address("ggml_threadpool_new");
+    auto fn_n_threads = (whisper_threadpool_n_threads_t) whisper_cpu_get_proc_address("ggml_threadpool_get_n_threads");
+
+    if (!fn_new || !fn_n_threads) {
+        WHISPER_LOG_ERROR("%s: the CPU backend does not support threadpools\n", __func__);
+        return nullptr;
+    }
+
+    whisper_threadpool * result = new whisper_threadpool;
+
+    result->fn_pause  = (whisper_threadpool_fn_t) whisper_cpu_get_proc_address("ggml_threadpool_pause");
+    result->fn_resume = (whisper_threadpool_fn_t) whisper_cpu_get_proc_address("ggml_threadpool_resume");
+    result->fn_free   = (whisper_threadpool_fn_t) whisper_cpu_get_proc_address("ggml_threadpool_free");
+
+    if (params.threadpool) {
+        result->tp = params.threadpool;
+    } else {
+        // start paused - the first call resumes it
+        struct ggml_threadpool_params tpp = *params.threadpool_params;
+        tpp.paused = true;
+
+        result->tp    = fn_new(&tpp);
+        result->owned = true;
+
+        if (!result->tp) {
+            WHISPER_LOG_ERROR("%s: failed to create the threadpool\n", __func__);
+            whisper_threadpool_free(result);
+            return nullptr;
+        }
+    }
+
+    result->n_threads = fn_n_threads(result->tp);
+
+    return result;
+}
+
+// use the threadpool for the CPU backends of a state
+static bool whisper_threadpool_attach(whisper_threadpool * threadpool, const std::vector<ggml_backend_t> & backends) {
+    if (!threadpool) {
+        return true;
+    }
 
-    auto * reg = ggml_backend_dev_backend_reg(ggml_backend_get_device(backend.get()));
+    auto fn_set_threadpool = (whisper_backend_set_threadpool_t) whisper_cpu_get_proc_address("ggml_backend_cpu_set_threadpool");
+    if (!fn_set_threadpool) {
+        return false;
+    }
 
-    auto * set_abort_callback_fn = (ggml_backend_set_abort_callback_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_set_abort_callback");
-    if (set_abort_callback_fn) {
-        set_abort_callback_fn(backend.get(), abort_callback, abort_callback_data);
+    for (ggml_backend_t backend : backends) {
+        ggml_backend_dev_t dev = ggml_backend_get_device(backend);
+        if (dev && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU) {
+            fn_set_threadpool(backend, threadpool->tp);
+        }
     }
 
+    return true;
+}
+
+static bool ggml_graph_compute_helper(
+              ggml_backend_t   backend,
+          struct ggml_cgraph * graph,
+                         int   n_threads) {
+    auto * reg = ggml_backend_dev_backend_reg(ggml_backend_get_device(backend));
+
     auto ggml_backend_set_n_threads_fn = (ggml_backend_set_n_threads_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_set_n_threads");
     if (ggml_backend_set_n_threads_fn) {
-        ggml_backend_set_n_threads_fn(backend.get(), n_threads);
+        ggml_backend_set_n_threads_fn(backend, n_threads);
+    }
+
+    return ggml_backend_graph_compute(backend, graph) == GGML_STATUS_SUCCESS;
+}
+
+// check if a node of an allocated graph is assigned to a CPU backend
+static bool whisper_sched_graph_uses_cpu(ggml_backend_sched_t sched, struct ggml_cgraph * graph) {
+    for (int i = 0; i < ggml_graph_n_nodes(graph); ++i) {
+        ggml_backend_t backend = ggml_backend_sched_get_tensor_backend(sched, ggml_graph_node(graph, i));
+        ggml_backend_dev_t dev = backend ? ggml_backend_get_device(backend) : nullptr;
+        if (dev && ggml_backend_dev_type(dev) == GGML_BACKEND_DEVICE_TYPE_CPU) {
+            return true;
+        }
     }
 
-    return ggml_backend_graph_compute(backend.get(), graph) == GGML_STATUS_SUCCESS;
+    return false;
 }
 
 static bool ggml_graph_compute_helper(
-      ggml_backend_sched_t   sched,
-        struct ggml_cgraph * graph,
-                       int   n_threads,
-                      bool   sched_reset = true) {
+        ggml_backend_sched_t   sched,
+          struct ggml_cgraph * graph,
+                         int   n_threads,
+                        bool   sched_reset = true,
+          whisper_threadpool * threadpool  = nullptr) {
+    // the threadpool is only needed by the CPU splits - graphs on other backends run concurrently
+    std::unique_lock<std::mutex> lock;
+    if (threadpool && whisper_sched_graph_uses_cpu(sched, graph)) {
+        lock = std::unique_lock<std::mutex>(threadpool->mutex);
+
+        n_threads = std::min(n_threads, threadpool->n_threads);
+    }
+
     for (int i = 0; i < ggml_backend_sched_get_n_backends(sched); ++i) {
         ggml_backend_t backend = ggml_backend_sched_get_backend(sched, i);
         ggml_backend_dev_t dev = ggml_backend_get_device(backend);
@@ -417,6 +586,19 @@ struct whisper_mel {
     int n_mel;
 
     std::vector<float> data;
+
+    // [EXPERIMENTAL] mel computed inside the encoder graph (whisper_context_params.mel_in_graph)
+    // when not empty, holds the reflective-padded PCM and data is not used
+    std::vector<float> pcm;
+};
+
+// rolling log mel spectrogram for streaming callers (see whisper_mel_append_pcm)
+struct whisper_mel_stream {
+    bool started = false; // the reflective pad at the start of the stream has been applied
+
+    std::vector<float> pcm;        // samples not consumed yet - the overlap of the next Hann window
+    std::vector<float> frames;     // raw log10 mel values, [n_frames][n_mel]
+    std::vector<float> frames_max; // maximum of each frame
 };
 
 struct whisper_filters {
@@ -424,16 +606,45 @@ struct whisper_filters {
     int32_t n_fft;
 
     std::vector<float> data;
+
+    // the triangular filters are non-zero only over a few bins
+    // filter j covers bins [band_start[j], band_start[j] + band_len[j]) with weights band_data[band_offs[j]...]
+    std::vector<int32_t> band_start;
+    std::vector<int32_t> band_len;
+    std::vector<int32_t> band_offs;
+    std::vector<float>   band_data;
 };
 
+static void whisper_filters_init_bands(whisper_filters & filters) {
+    filters.band_start.resize(filters.n_mel);
+    filters.band_len  .resize(filters.n_mel);
+    filters.band_offs .resize(filters.n_mel);
+    filters.band_data .clear();
+
+    for (int j = 0; j < filters.n_mel; ++j) {
+        const float * row = filters.data.data() + j*filters.n_fft;
+
+        int k0 = 0;
+        int k1 = filters.n_fft;
+        while (k0 < k1 && row[k0]     == 0.0f) k0++;
+        while (k1 > k0 && row[k1 - 1] == 0.0f) k1--;
+
+        filters.band_start[j] = k0;
+        filters.band_len[j]   = k1 - k0;
+        filters.band_offs[j]  = filters.band_data.size();
+
+        filters.band_data.insert(filters.band_data.end(), row + k0, row + k1);
+    }
+}
+
 struct whisper_vocab {
     using id    = int32_t;
     using token = std::string;
 
     int n_vocab = 51864;
 
-    std::map<token, id> token_to_id;
-    std::map<id, token> id_to_token;
+    std::vector<token>            id_to_token; // indexed by the token id
+    std::unordered_map<token, id> token_to_id;
 
     // reference: https://github.com/openai/whisper/blob/248b6cb124225dd263bb9bd32d060b6517e067f8/whisper/tokenizer.py#L334-L349
     id token_eot        = 50256;
@@ -572,6 +783,58 @@ static bool whisper_sched_graph_init(struct whisper_sched & allocr, std::vector<
     return true;
 }
 
+// reserve the compute buffers of a scheduler that is shared by graphs that run one after another
+// the buffers only grow, so once all graphs are reserved they fit the largest of them
+// size: the compute buffer size that the graph alone would need
+static bool whisper_sched_graph_reserve(struct whisper_sched & allocr, std::vector<ggml_backend_t> backends, std::function<struct ggml_cgraph *()> && get_graph, size_t & size) {
+    auto & sched = allocr.sched;
+    auto & meta  = allocr.meta;
+
+    if (!sched) {
+        sched = ggml_backend_sched_new(backends.data(), nullptr, backends.size(), WHISPER_MAX_NODES, false, true);
+
+        meta.resize(ggml_tensor_overhead()*WHISPER_MAX_NODES + ggml_graph_overhead());
+    }
+
+    struct ggml_cgraph * gf = get_graph();
+
+    std::vector<size_t> sizes(backends.size());
+    ggml_backend_sched_reserve_size(sched, gf, sizes.data());
+
+    size = 0;
+    for (size_t s : sizes) {
+        size += s;
+    }
+
+    if (!ggml_backend_sched_reserve(sched, gf)) {
+        WHISPER_LOG_ERROR("%s: failed to allocate the compute buffer\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+// the parameters that determine the topology of the decoder graph
+// consecutive decoder calls with the same parameters reuse the previously built and allocated graph
+struct whisper_decoder_graph_params {
+    int32_t n_tokens    = 0;
+    int32_t n_outputs   = 0;
+    int32_t n_kv        = 0;
+    int32_t n_audio_ctx = 0;
+
+    bool flash_attn               = false;
+    bool save_alignment_heads_QKs = false;
+
+    bool operator==(const whisper_decoder_graph_params & other) const {
+        return n_tokens    == other.n_tokens    &&
+               n_outputs   == other.n_outputs   &&
+               n_kv        == other.n_kv        &&
+               n_audio_ctx == other.n_audio_ctx &&
+               flash_attn  == other.flash_attn  &&
+               save_alignment_heads_QKs == other.save_alignment_heads_QKs;
+    }
+};
+
 // medium
 // hparams: {
 // 'n_mels': 80,
@@ -689,16 +952,22 @@ struct whisper_layer_decoder {
     struct ggml_tensor * mlp_1_b;
 };
 
+// the data of a cell is written once and never modified afterwards, so the sequences (decoders) that share
+// a prefix share the cells instead of copying them - forking a beam only sets the bit of the new sequence
+// a cell is released when no sequence references it anymore
 struct whisper_kv_cell {
     whisper_pos pos = -1;
 
-    std::set<whisper_seq_id> seq_id;
+    // bit i is set if the cell belongs to sequence i
+    uint32_t seq_mask = 0;
 
     bool has_seq_id(const whisper_seq_id & id) const {
-        return seq_id.find(id) != seq_id.end();
+        return seq_mask & (1u << id);
     }
 };
 
+static_assert(WHISPER_MAX_DECODERS <= 32, "the KV cell sequence mask is too small for WHISPER_MAX_DECODERS");
+
 struct whisper_kv_cache {
     uint32_t head = 0;
     uint32_t size = 0;
@@ -708,6 +977,9 @@ struct whisper_kv_cache {
 
     std::vector<whisper_kv_cell> cells;
 
+    // the cells assigned to the tokens of the last batch - they don't have to be contiguous
+    std::vector<uint32_t> slots;
+
     struct ggml_tensor * k;
     struct ggml_tensor * v;
 
@@ -716,6 +988,308 @@ struct whisper_kv_cache {
     std::vector<uint8_t> ctx_buf;
 };
 
+// [EXPERIMENTAL] snapshot of the self-attention KV cells of a decoded prompt
+//
+// the K/V of the decoder depend on the audio features through the cross-attention (from the second layer on, the
+// self-attention reads the output of the cross-attention of the previous layer), so a snapshot can only be reused
+// for the same encoder input (audio_hash) and a prompt that starts with the same tokens
+struct whisper_prompt_snapshot {
+    uint64_t audio_hash  = 0;
+    uint64_t tokens_hash = 0;
+
+    std::vector<whisper_token> tokens;
+
+    // flash attention: [n_layer][n_tokens][n_state] for both K and V
+    // otherwise V is stored transposed: [n_layer][n_state][n_tokens]
+    std::vector<uint8_t> k;
+    std::vector<uint8_t> v;
+
+    int64_t t_last_used = 0;
+};
+
+struct whisper_prompt_snapshots {
+    size_t size_max = 0; // 0 - disabled
+    size_t size     = 0;
+
+    std::vector<whisper_prompt_snapshot> entries;
+
+    int32_t n_hit  = 0;
+    int32_t n_miss = 0;
+
+    size_t n_bytes_reused = 0;
+};
+
+// read-only mapping of the model file
+// doubles as the loader context (offs is the read position) and backs the weights that are aligned in the file
+struct whisper_mmap {
+    void * addr = nullptr;
+    size_t size = 0;
+    size_t offs = 0;
+
+#if defined(_WIN32)
+    HANDLE hfile = INVALID_HANDLE_VALUE;
+    HANDLE hmap  = NULL;
+#endif
+
+    whisper_mmap() = default;
+    whisper_mmap(const whisper_mmap &) = delete;
+    whisper_mmap & operator=(const whisper_mmap &) = delete;
+
+    bool init(const char * path, bool prefetch) {
+#if defined(_POSIX_MAPPED_FILES)
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+
+        size = (size_t) st.st_size;
+
+        int flags = MAP_SHARED;
+#ifdef __linux__
+        if (prefetch) {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        addr = mmap(NULL, size, PROT_READ, flags, fd, 0);
+        close(fd);
+
+        if (addr == MAP_FAILED) {
+            addr = nullptr;
+            return false;
+        }
+
+        if (prefetch) {
+            will_need(0, size);
+        }
+
+        return true;
+#elif defined(_WIN32)
+        const int n = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+        std::vector<wchar_t> wpath(n > 0 ? n : 1, 0);
+        if (n <= 0 || MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath.data(), n) != n) {
+            return false;
+        }
+
+        hfile = CreateFileW(wpath.data(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hfile == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fsize;
+        if (!GetFileSizeEx(hfile, &fsize) || fsize.QuadPart <= 0) {
+            return false;
+        }
+
+        size = (size_t) fsize.QuadPart;
+
+        hmap = CreateFileMappingW(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hmap == NULL) {
+            return false;
+        }
+
+        addr = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+        if (addr == NULL) {
+            return false;
+        }
+
+        if (prefetch) {
+            will_need(0, size);
+        }
+
+        return true;
+#else
+        GGML_UNUSED(path);
+        GGML_UNUSED(prefetch);
+
+        return false;
+#endif
+    }
+
+    // ask the OS to start reading [offs, offs + n) of the file in the background
+    void will_need(size_t offs, size_t n) const {
+#if defined(_POSIX_MAPPED_FILES)
+        static const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+        const size_t beg = offs - offs % page_size;
+        if (posix_madvise((char *) addr + beg, offs + n - beg, POSIX_MADV_WILLNEED) != 0) {
+            WHISPER_LOG_WARN("%s: posix_madvise(.., POSIX_MADV_WILLNEED) failed\n", __func__);
+        }
+#elif defined(_WIN32) && _WIN32_WINNT >= 0x602
+        // not available before Windows 8
+        BOOL (WINAPI * pPrefetchVirtualMemory) (HANDLE, ULONG_PTR, PWIN32_MEMORY_RANGE_ENTRY, ULONG);
+        pPrefetchVirtualMemory = (decltype(pPrefetchVirtualMemory))(void *) GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory");
+
+        if (pPrefetchVirtualMemory) {
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = (char *) addr + offs;
+            range.NumberOfBytes  = (SIZE_T) n;
+            if (!pPrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0)) {
+                WHISPER_LOG_WARN("%s: PrefetchVirtualMemory failed\n", __func__);
+            }
+        }
+#else
+        GGML_UNUSED(offs);
+        GGML_UNUSED(n);
+#endif
+    }
+
+    ~whisper_mmap() {
+#if defined(_POSIX_MAPPED_FILES)
+        if (addr) {
+            munmap(addr, size);
+        }
+#elif defined(_WIN32)
+        if (addr) {
+            UnmapViewOfFile(addr);
+        }
+        if (hmap != NULL) {
+            CloseHandle(hmap);
+        }
+        if (hfile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hfile);
+        }
+#endif
+    }
+};
+
+// [EXPERIMENTAL] NUMA node of the host - see whisper_context_params.numa
+struct whisper_numa_node {
+    int id;
+    std::vector<int> cpus;
+};
+
+// parse a sysfs list, e.g. "0-3,8-11"
+static std::vector<int> whisper_parse_id_list(const std::string & str) {
+    std::vector<int> result;
+
+    size_t pos = 0;
+    while (pos < str.size()) {
+        size_t end = str.find(',', pos);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+
+        const std::string range = str.substr(pos, end - pos);
+        const size_t dash = range.find('-');
+
+        try {
+            const int first = std::stoi(range.substr(0, dash));
+            const int last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int i = first; i <= last; ++i) {
+                result.push_back(i);
+            }
+        } catch (const std::exception &) {
+            // empty or malformed entry
+        }
+
+        pos = end + 1;
+    }
+
+    return result;
+}
+
+// the online nodes that have CPUs (Linux only - empty elsewhere)
+static std::vector<whisper_numa_node> whisper_numa_get_nodes() {
+    std::vector<whisper_numa_node> result;
+
+#ifdef __linux__
+    auto read_line = [](const std::string & path) {
+        std::string line;
+        std::ifstream fin(path);
+        std::getline(fin, line);
+        return line;
+    };
+
+    for (int id : whisper_parse_id_list(read_line("/sys/devices/system/node/online"))) {
+        whisper_numa_node node = { id, whisper_parse_id_list(read_line("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist")) };
+        if (!node.cpus.empty()) {
+            result.push_back(std::move(node));
+        }
+    }
+#endif
+
+    return result;
+}
+
+// pin the calling thread to the CPUs of a node while in scope
+// the pages that it touches first are allocated on the node
+struct whisper_numa_affinity_scope {
+#ifdef __linux__
+    cpu_set_t mask_old;
+    bool      set = false;
+#endif
+
+    explicit whisper_numa_affinity_scope(const whisper_numa_node * node) {
+#ifdef __linux__
+        if (node == nullptr) {
+            return;
+        }
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (int cpu : node->cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &mask);
+            }
+        }
+
+        set = sched_getaffinity(0, sizeof(mask_old), &mask_old) == 0 && sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+        (void) node;
+#endif
+    }
+
+    ~whisper_numa_affinity_scope() {
+#ifdef __linux__
+        if (set) {
+            sched_setaffinity(0, sizeof(mask_old), &mask_old);
+        }
+#endif
+    }
+};
+
+// place the pages of [addr, addr + size) on the nodes, moving the pages that are already allocated
+// interleave: round-robin over the nodes, otherwise on the first one
+// must not be used on file mappings - their pages are in the page cache shared with other processes
+static bool whisper_numa_move(void * addr, size_t size, const std::vector<whisper_numa_node> & nodes, bool interleave) {
+#if defined(__linux__) && defined(SYS_mbind)
+    const uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+
+    const uintptr_t beg = ((uintptr_t) addr + page_size - 1) / page_size * page_size;
+    const uintptr_t end = ((uintptr_t) addr + size) / page_size * page_size;
+    if (end <= beg) {
+        return true;
+    }
+
+    const int bits = 8*sizeof(unsigned long);
+
+    unsigned long mask[1024/(8*sizeof(unsigned long))] = { 0 };
+    for (const auto & node : nodes) {
+        if (node.id < 1024) {
+            mask[node.id/bits] |= 1ul << (node.id % bits);
+        }
+        if (!interleave) {
+            break;
+        }
+    }
+
+    // MPOL_BIND = 2, MPOL_INTERLEAVE = 3, MPOL_MF_MOVE = 1 << 1
+    return syscall(SYS_mbind, (void *) beg, (unsigned long) (end - beg), interleave ? 3 : 2, mask, (unsigned long) (8*sizeof(mask) + 1), 1 << 1) == 0;
+#else
+    (void) addr;
+    (void) size;
+    (void) nodes;
+    (void) interleave;
+    return false;
+#endif
+}
+
 struct whisper_model {
     e_model type = MODEL_UNKNOWN;
 
@@ -756,28 +1330,180 @@ struct whisper_model {
     // the model backend data is read-only and can be shared between processors
     std::vector<ggml_backend_buffer_t> buffers;
 
+    // the model file when loaded with use_mmap - the CPU weights that are aligned in the file point into it
+    std::unique_ptr<whisper_mmap> mapping;
+
+    // DTW alignment heads stored in the model file (GGUF only)
+    std::vector<whisper_ahead> aheads;
+
     // tensors
     int n_loaded;
     std::map<std::string, struct ggml_tensor *> tensors;
 };
 
-struct whisper_partial_utf8 {
-    uint32_t value;    // bit value so far (unshifted)
-    int      n_remain; // num bytes remaining; -1 indicates invalid sequence
-};
-
-struct whisper_grammar {
-    /*const*/ std::vector<std::vector<whisper_grammar_element>> rules;
-    std::vector<std::vector<const whisper_grammar_element *>>   stacks;
+// [EXPERIMENTAL] copy of the host weights on one NUMA node (WHISPER_NUMA_REPLICATE)
+// the host tensors of `model` point into `buffer` - the other tensors are shared with the model of the context
+// the first node uses the weights of the context, so its replica is empty
+struct whisper_model_replica {
+    int node = -1;
 
-    // buffer for partially generated UTF-8 sequence from accepted tokens
-    whisper_partial_utf8 partial_utf8;
-};
+    whisper_model model;
 
-struct whisper_grammar_candidate {
-    whisper_token          id;
-    const uint32_t       * code_points;
-    whisper_partial_utf8   partial_utf8;
+    ggml_context *        ctx    = nullptr;
+    ggml_backend_buffer_t buffer = nullptr;
+};
+
+static void whisper_remap_layer(whisper_layer_encoder & layer, const std::function<ggml_tensor *(ggml_tensor *)> & remap) {
+    layer.attn_ln_0_w = remap(layer.attn_ln_0_w);
+    layer.attn_ln_0_b = remap(layer.attn_ln_0_b);
+    layer.attn_ln_1_w = remap(layer.attn_ln_1_w);
+    layer.attn_ln_1_b = remap(layer.attn_ln_1_b);
+    layer.attn_q_w    = remap(layer.attn_q_w);
+    layer.attn_q_b    = remap(layer.attn_q_b);
+    layer.attn_k_w    = remap(layer.attn_k_w);
+    layer.attn_v_w    = remap(layer.attn_v_w);
+    layer.attn_v_b    = remap(layer.attn_v_b);
+    layer.mlp_ln_w    = remap(layer.mlp_ln_w);
+    layer.mlp_ln_b    = remap(layer.mlp_ln_b);
+    layer.mlp_0_w     = remap(layer.mlp_0_w);
+    layer.mlp_0_b     = remap(layer.mlp_0_b);
+    layer.mlp_1_w     = remap(layer.mlp_1_w);
+    layer.mlp_1_b     = remap(layer.mlp_1_b);
+}
+
+static void whisper_remap_layer(whisper_layer_decoder & layer, const std::function<ggml_tensor *(ggml_tensor *)> & remap) {
+    layer.attn_ln_0_w       = remap(layer.attn_ln_0_w);
+    layer.attn_ln_0_b       = remap(layer.attn_ln_0_b);
+    layer.attn_ln_1_w       = remap(layer.attn_ln_1_w);
+    layer.attn_ln_1_b       = remap(layer.attn_ln_1_b);
+    layer.attn_q_w          = remap(layer.attn_q_w);
+    layer.attn_q_b          = remap(layer.attn_q_b);
+    layer.attn_k_w          = remap(layer.attn_k_w);
+    layer.attn_v_w          = remap(layer.attn_v_w);
+    layer.attn_v_b          = remap(layer.attn_v_b);
+    layer.cross_attn_ln_0_w = remap(layer.cross_attn_ln_0_w);
+    layer.cross_attn_ln_0_b = remap(layer.cross_attn_ln_0_b);
+    layer.cross_attn_ln_1_w = remap(layer.cross_attn_ln_1_w);
+    layer.cross_attn_ln_1_b = remap(layer.cross_attn_ln_1_b);
+    layer.cross_attn_q_w    = remap(layer.cross_attn_q_w);
+    layer.cross_attn_q_b    = remap(layer.cross_attn_q_b);
+    layer.cross_attn_k_w    = remap(layer.cross_attn_k_w);
+    layer.cross_attn_v_w    = remap(layer.cross_attn_v_w);
+    layer.cross_attn_v_b    = remap(layer.cross_attn_v_b);
+    layer.mlp_ln_w          = remap(layer.mlp_ln_w);
+    layer.mlp_ln_b          = remap(layer.mlp_ln_b);
+    layer.mlp_0_w           = remap(layer.mlp_0_w);
+    layer.mlp_0_b           = remap(layer.mlp_0_b);
+    layer.mlp_1_w           = remap(layer.mlp_1_w);
+    layer.mlp_1_b           = remap(layer.mlp_1_b);
+}
+
+// must run on a thread pinned to the node of the replica, so that its pages are allocated there
+static bool whisper_model_replicate(const whisper_model & src, whisper_model_replica & dst) {
+    std::vector<ggml_tensor *> tensors;
+    for (const auto & it : src.tensors) {
+        if (it.second->buffer && ggml_backend_buffer_is_host(it.second->buffer)) {
+            tensors.push_back(it.second);
+        }
+    }
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ std::max<size_t>(1, tensors.size())*ggml_tensor_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    dst.ctx = ggml_init(params);
+    if (!dst.ctx) {
+        return false;
+    }
+
+    std::unordered_map<const ggml_tensor *, ggml_tensor *> map;
+    for (ggml_tensor * t : tensors) {
+        ggml_tensor * r = ggml_dup_tensor(dst.ctx, t);
+        ggml_set_name(r, ggml_get_name(t));
+        map[t] = r;
+    }
+
+    if (!tensors.empty()) {
+        dst.buffer = ggml_backend_alloc_ctx_tensors_from_buft(dst.ctx, ggml_backend_cpu_buffer_type());
+        if (!dst.buffer) {
+            return false;
+        }
+        ggml_backend_buffer_set_usage(dst.buffer, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+
+        for (const auto & p : map) {
+            memcpy(p.second->data, p.first->data, ggml_nbytes(p.first));
+        }
+    }
+
+    auto remap = [&](ggml_tensor * t) -> ggml_tensor * {
+        auto it = map.find(t);
+        return it == map.end() ? t : it->second;
+    };
+
+    auto & model = dst.model;
+
+    model.type    = src.type;
+    model.hparams = src.hparams;
+    model.filters = src.filters;
+
+    model.e_pe       = remap(src.e_pe);
+    model.e_conv_1_w = remap(src.e_conv_1_w);
+    model.e_conv_1_b = remap(src.e_conv_1_b);
+    model.e_conv_2_w = remap(src.e_conv_2_w);
+    model.e_conv_2_b = remap(src.e_conv_2_b);
+    model.e_ln_w     = remap(src.e_ln_w);
+    model.e_ln_b     = remap(src.e_ln_b);
+    model.d_pe       = remap(src.d_pe);
+    model.d_te       = remap(src.d_te);
+    model.d_ln_w     = remap(src.d_ln_w);
+    model.d_ln_b     = remap(src.d_ln_b);
+
+    model.layers_encoder = src.layers_encoder;
+    model.layers_decoder = src.layers_decoder;
+
+    for (auto & layer : model.layers_encoder) {
+        whisper_remap_layer(layer, remap);
+    }
+    for (auto & layer : model.layers_decoder) {
+        whisper_remap_layer(layer, remap);
+    }
+
+    for (const auto & it : src.tensors) {
+        model.tensors[it.first] = remap(it.second);
+    }
+
+    model.aheads   = src.aheads;
+    model.n_loaded = src.n_loaded;
+
+    return true;
+}
+
+static void whisper_model_replica_free(whisper_model_replica & replica) {
+    ggml_free(replica.ctx);
+    ggml_backend_buffer_free(replica.buffer);
+    replica.ctx    = nullptr;
+    replica.buffer = nullptr;
+}
+
+struct whisper_partial_utf8 {
+    uint32_t value;    // bit value so far (unshifted)
+    int      n_remain; // num bytes remaining; -1 indicates invalid sequence
+};
+
+struct whisper_grammar {
+    /*const*/ std::vector<std::vector<whisper_grammar_element>> rules;
+    std::vector<std::vector<const whisper_grammar_element *>>   stacks;
+
+    // buffer for partially generated UTF-8 sequence from accepted tokens
+    whisper_partial_utf8 partial_utf8;
+};
+
+struct whisper_grammar_candidate {
+    whisper_token          id;
+    const uint32_t       * code_points;
+    whisper_partial_utf8   partial_utf8;
 };
 
 struct whisper_sequence {
@@ -793,6 +1519,12 @@ struct whisper_sequence {
     double score;            // likelihood rank score
 };
 
+// flags of whisper_state::logits_suppress
+enum whisper_suppress_flags : uint8_t {
+    WHISPER_SUPPRESS_PRE  = 1 << 0,
+    WHISPER_SUPPRESS_POST = 1 << 1,
+};
+
 // TAGS: WHISPER_DECODER_INIT
 struct whisper_decoder {
     // the currently generated sequence of tokens
@@ -809,10 +1541,17 @@ struct whisper_decoder {
     bool has_ts;    // have we already sampled a non-beg timestamp token for the current segment?
 
     // new token probs, logits and logprobs after the last whisper_decode (1-dimensional array: [n_vocab])
+    // note: for greedy sampling at t = 0 only the probs of the timestamp tokens and of best_id are computed
     std::vector<float> probs;
     std::vector<float> logits;
     std::vector<float> logprobs;
 
+    // summary of the probs used by the samplers - computed by whisper_process_logits together with the probs
+    whisper_token best_id; // the most probable token          (-1 if all tokens are suppressed)
+    whisper_token ts_id;   // the most probable timestamp token (-1 if all timestamps are suppressed)
+    double        ts_sum;  // sum of the timestamp probs
+    double        ts_max;  // prob of ts_id
+
     // work container used to avoid memory allocations
     std::vector<whisper_pair<double, whisper_vocab::id>> logits_id;
 
@@ -826,11 +1565,123 @@ struct whisper_aheads_masks {
     ggml_backend_buffer_t buffer = nullptr;
 };
 
+// [EXPERIMENTAL] log mel spectrogram inside the encoder graph
+struct whisper_mel_graph {
+    struct ggml_tensor * dft_cos = nullptr; // Hann-windowed DFT basis, [WHISPER_N_FFT, 1, n_fft]
+    struct ggml_tensor * dft_sin = nullptr;
+    struct ggml_tensor * filters = nullptr; // mel filterbank, [n_fft, n_mel]
+
+    struct ggml_context * ctx = nullptr;
+    ggml_backend_buffer_t buffer = nullptr;
+};
+
 struct vad_time_mapping {
     int64_t processed_time;  // Time in processed (VAD) audio
     int64_t original_time;   // Corresponding time in original audio
 };
 
+// persistent worker threads for the host-side work of the decoders (logits processing, sampling)
+// the workers are created on first use and are parked on a condition variable between the jobs
+struct whisper_worker_pool {
+    std::vector<std::thread> threads;
+
+    std::mutex              mutex;
+    std::condition_variable cv_job;
+    std::condition_variable cv_done;
+
+    // the current job
+    void (*job_fn)(void * data) = nullptr;
+    void  * job_data            = nullptr;
+
+    uint64_t n_jobs    = 0; // incremented for every job to wake up the workers
+    int      n_active  = 0; // number of workers that take part in the current job
+    int      n_running = 0; // number of workers that have not finished the current job yet
+
+    bool stop = false;
+};
+
+static void whisper_worker_pool_loop(whisper_worker_pool & pool, int iw, uint64_t n_jobs_seen) {
+    std::unique_lock<std::mutex> lock(pool.mutex);
+
+    while (true) {
+        pool.cv_job.wait(lock, [&] { return pool.stop || pool.n_jobs != n_jobs_seen; });
+
+        if (pool.stop) {
+            return;
+        }
+
+        n_jobs_seen = pool.n_jobs;
+
+        if (iw >= pool.n_active) {
+            continue;
+        }
+
+        const auto job_fn   = pool.job_fn;
+        const auto job_data = pool.job_data;
+
+        lock.unlock();
+        job_fn(job_data);
+        lock.lock();
+
+        if (--pool.n_running == 0) {
+            pool.cv_done.notify_one();
+        }
+    }
+}
+
+// run the job on n_threads threads, including the calling thread, and wait for all of them to finish
+// the job is responsible for distributing the work between the threads
+template <typename F>
+static void whisper_worker_pool_run(whisper_worker_pool & pool, int n_threads, F & job) {
+    const int n_workers = n_threads - 1;
+
+    if (n_workers <= 0) {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        while ((int) pool.threads.size() < n_workers) {
+            pool.threads.emplace_back(whisper_worker_pool_loop, std::ref(pool), (int) pool.threads.size(), pool.n_jobs);
+        }
+
+        pool.job_fn    = [](void * data) { (*(F *) data)(); };
+        pool.job_data  = &job;
+        pool.n_active  = n_workers;
+        pool.n_running = n_workers;
+        pool.n_jobs++;
+    }
+
+    pool.cv_job.notify_all();
+
+    job();
+
+    {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.cv_done.wait(lock, [&] { return pool.n_running == 0; });
+
+        pool.job_fn   = nullptr;
+        pool.job_data = nullptr;
+    }
+}
+
+static void whisper_worker_pool_free(whisper_worker_pool & pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stop = true;
+    }
+
+    pool.cv_job.notify_all();
+
+    for (auto & thread : pool.threads) {
+        thread.join();
+    }
+
+    pool.threads.clear();
+}
+
 struct whisper_state {
     int64_t t_sample_us = 0;
     int64_t t_encode_us = 0;
@@ -846,6 +1697,7 @@ struct whisper_state {
     int32_t n_prompt = 0; // number of decoder calls with n_tokens >  1  (prompt encoding)
     int32_t n_fail_p = 0; // number of logprob threshold failures
     int32_t n_fail_h = 0; // number of entropy threshold failures
+    int32_t n_reuse  = 0; // number of decoder calls that reused the previous graph
 
     // number of decoders for which we have constructed the KV cache
     int32_t kv_self_n_dec = 0;
@@ -860,31 +1712,72 @@ struct whisper_state {
     // padded buffer for flash-attention
     whisper_kv_cache kv_pad;
 
+    // [EXPERIMENTAL] snapshots of kv_self for the prompts that are decoded again on temperature fallback
+    whisper_prompt_snapshots prompt_snapshots;
+
+    // hash of the encoder input of the last encoded segment (only computed when the fallback snapshots are enabled)
+    uint64_t audio_hash = 0;
+
     whisper_mel mel;
+    whisper_mel_stream mel_stream;
 
     whisper_batch batch;
 
     whisper_decoder decoders[WHISPER_MAX_DECODERS];
 
+    whisper_worker_pool worker_pool;
+
+    // [EXPERIMENTAL] NUMA node of the state (-1 - not bound) - its graphs read the weights of the replica on the node
+    int numa_node = -1;
+
+    // the CPU threadpool of the context or of the node of the state (nullptr - the threads of the CPU backend)
+    whisper_threadpool * threadpool = nullptr;
+
+    // per-token flags of the logits that are always suppressed for the current whisper_full parameters
+    // (WHISPER_SUPPRESS_PRE - before the logits filter callback, WHISPER_SUPPRESS_POST - after it)
+    std::vector<uint8_t> logits_suppress;
+
+    // the tokens matching params.suppress_regex - cached across whisper_full calls with the same pattern
+    bool                       suppress_regex_valid = false;
+    std::string                suppress_regex;
+    std::vector<whisper_token> suppress_regex_tokens;
+
     std::vector<ggml_backend_t> backends;
 
-    // - stores meta info about the intermediate tensors into the `meta` buffers
-    whisper_sched sched_conv;
-    whisper_sched sched_encode;
-    whisper_sched sched_cross;
-    whisper_sched sched_decode;
+    // the conv, encoder, cross and decoder graphs run strictly one after another, so they share one scheduler:
+    // its compute buffers are sized to the largest of the graphs instead of their sum
+    // - stores meta info about the intermediate tensors into the `meta` buffer
+    whisper_sched sched;
 
-    // result of the encoder
+    // the last decoder graph - stays allocated in sched until the parameters change or the encoder runs
+    // must be invalidated with whisper_decoder_graph_reset() when the tensors that it references are re-created
+    ggml_cgraph * gf_decode = nullptr;
+    whisper_decoder_graph_params gf_decode_params;
+
+    // results of the conv and encoder graphs, [n_audio_state, n_audio_ctx]
+    // kept in a persistent buffer, since the next graph reuses the compute buffers
     struct ggml_tensor * embd_conv = nullptr;
     struct ggml_tensor * embd_enc  = nullptr;
 
+    struct ggml_context * ctx_embd = nullptr;
+    ggml_backend_buffer_t buf_embd = nullptr;
+
     // helpers for GPU offloading
     std::vector<float> inp_mel;
+    std::vector<float> inp_pcm;
     std::vector<float> inp_mask;
+    std::vector<int32_t> inp_out_ids;
+    std::vector<int64_t> inp_kv_idxs;
+    std::vector<int64_t> inp_kv_idxs_v;
 
-    // decode output (2-dimensional array: [n_tokens][n_vocab])
+    // decode output (2-dimensional array: [n_outputs][n_vocab])
+    // only the tokens with batch.logits[i] != 0 have a row, except after whisper_decode() (see whisper_get_logits())
     std::vector<float> logits;
 
+    // map from batch index to row in `logits` (-1 if no logits were requested for the token)
+    std::vector<int32_t> output_ids;
+    int32_t n_outputs = 0;
+
     std::vector<whisper_segment> result_all;
 
     // prompt history split into static prefix (prompt_past0) and dynamic rolling context (prompt_past1)
@@ -914,6 +1807,9 @@ struct whisper_state {
 
     // [EXPERIMENTAL] Token-level timestamps with DTW
     whisper_aheads_masks aheads_masks;
+
+    // [EXPERIMENTAL] mel inside the encoder graph
+    whisper_mel_graph mel_graph;
     ggml_tensor * aheads_cross_QKs = nullptr;
     std::vector<float> aheads_cross_QKs_data;
 
@@ -940,6 +1836,7 @@ struct whisper_context {
 
     ggml_type wtype = ggml_type::GGML_TYPE_F16; // weight type (FP32 / FP16 / QX)
     ggml_type itype = ggml_type::GGML_TYPE_F16; // intermediate type (FP32 or FP16)
+    ggml_type ktype = ggml_type::GGML_TYPE_F16; // type of kv_self and kv_cross (FP16 / Q8_0 / Q4_0)
 
     whisper_context_params params;
 
@@ -948,6 +1845,17 @@ struct whisper_context {
 
     whisper_state * state = nullptr;
 
+    // CPU threadpool shared by the states (nullptr - each state uses the threads of its CPU backend)
+    whisper_threadpool * threadpool = nullptr;
+
+    // [EXPERIMENTAL] NUMA (whisper_context_params.numa)
+    // with WHISPER_NUMA_REPLICATE each node has a replica of the host weights and a threadpool bound to its CPUs
+    std::vector<whisper_numa_node>     numa_nodes;
+    std::vector<whisper_model_replica> numa_replicas;
+    std::vector<whisper_threadpool *>  numa_threadpools;
+
+    std::atomic<uint32_t> numa_next { 0 }; // round-robin assignment of the states to the nodes
+
     std::string path_model; // populated by whisper_init_from_file_with_params()
 };
 
@@ -1014,6 +1922,7 @@ static bool whisper_kv_cache_init(
 
 static void whisper_kv_cache_free(struct whisper_kv_cache & cache) {
     ggml_backend_buffer_free(cache.buffer);
+    cache.buffer = nullptr;
 }
 
 static bool whisper_kv_cache_find_slot(
@@ -1027,50 +1936,42 @@ static bool whisper_kv_cache_find_slot(
         return false;
     }
 
-    uint32_t n_tested = 0;
-
-    while (true) {
-        if (cache.head + n_tokens > n_ctx) {
-            n_tested += n_ctx - cache.head;
-            cache.head = 0;
-            continue;
-        }
+    // the K/V of the batch are written with ggml_set_rows, so any free cells can be used
+    // take the first free cells starting at the head - this keeps the cells of a prompt contiguous after a clear
+    cache.slots.clear();
 
-        bool found = true;
-        for (uint32_t i = 0; i < n_tokens; i++) {
-            if (cache.cells[cache.head + i].pos >= 0) {
-                found = false;
-                cache.head += i + 1;
-                n_tested   += i + 1;
-                break;
-            }
-        }
+    for (uint32_t n_tested = 0; n_tested < n_ctx && cache.slots.size() < n_tokens; ++n_tested) {
+        const uint32_t i = (cache.head + n_tested) % n_ctx;
 
-        if (found) {
-            break;
+        if (cache.cells[i].pos < 0) {
+            cache.slots.push_back(i);
         }
+    }
 
-        if (n_tested >= n_ctx) {
-            //WHISPER_LOG_ERROR("%s: failed to find a slot for %d tokens\n", __func__, n_tokens);
-            return false;
-        }
+    if (cache.slots.size() < n_tokens) {
+        //WHISPER_LOG_ERROR("%s: failed to find a slot for %d tokens\n", __func__, n_tokens);
+        return false;
     }
 
     for (uint32_t i = 0; i < n_tokens; i++) {
-        cache.cells[cache.head + i].pos = batch.pos[i];
+        auto & cell = cache.cells[cache.slots[i]];
+
+        cell.pos = batch.pos[i];
 
         for (int32_t j = 0; j < batch.n_seq_id[i]; j++) {
-            cache.cells[cache.head + i].seq_id.insert(batch.seq_id[i][j]);
+            cell.seq_mask |= 1u << batch.seq_id[i][j];
         }
     }
 
+    cache.head = (cache.slots.back() + 1) % n_ctx;
+
     return true;
 }
 
 // find how many cells are currently in use
 static int32_t whisper_kv_cache_cell_max(const struct whisper_kv_cache & cache) {
     for (uint32_t i = cache.size - 1; i > 0; --i) {
-        if (cache.cells[i].pos >= 0 && !cache.cells[i].seq_id.empty()) {
+        if (cache.cells[i].pos >= 0 && cache.cells[i].seq_mask != 0) {
             return i + 1;
         }
     }
@@ -1078,12 +1979,17 @@ static int32_t whisper_kv_cache_cell_max(const struct whisper_kv_cache & cache)
     return 1;
 }
 
-static void whisper_kv_cache_clear(struct whisper_kv_cache & cache) {
+// mark all cells as free without touching the K/V data - the unused cells are masked out
+static void whisper_kv_cache_clear_cells(struct whisper_kv_cache & cache) {
     for (int32_t i = 0; i < (int32_t) cache.size; ++i) {
         cache.cells[i].pos = -1;
-        cache.cells[i].seq_id.clear();
+        cache.cells[i].seq_mask = 0;
     }
     cache.head = 0;
+}
+
+static void whisper_kv_cache_clear(struct whisper_kv_cache & cache) {
+    whisper_kv_cache_clear_cells(cache);
 
     ggml_backend_buffer_clear(cache.buffer, 0);
 }
@@ -1101,13 +2007,13 @@ static void whisper_kv_cache_seq_rm(
     for (uint32_t i = 0; i < cache.size; ++i) {
         if (cache.cells[i].pos >= p0 && cache.cells[i].pos < p1) {
             if (seq_id < 0) {
-                cache.cells[i].seq_id.clear();
+                cache.cells[i].seq_mask = 0;
             } else if (cache.cells[i].has_seq_id(seq_id)) {
-                cache.cells[i].seq_id.erase(seq_id);
+                cache.cells[i].seq_mask &= ~(1u << seq_id);
             } else {
                 continue;
             }
-            if (cache.cells[i].seq_id.empty()) {
+            if (cache.cells[i].seq_mask == 0) {
                 cache.cells[i].pos = -1;
                 if (new_head == cache.size) new_head = i;
             }
@@ -1118,6 +2024,26 @@ static void whisper_kv_cache_seq_rm(
     if (new_head != cache.size) cache.head = new_head;
 }
 
+// remove all sequences except seq_id
+static void whisper_kv_cache_seq_keep(
+        struct whisper_kv_cache & cache,
+                 whisper_seq_id   seq_id) {
+    uint32_t new_head = cache.size;
+
+    for (uint32_t i = 0; i < cache.size; ++i) {
+        if (!cache.cells[i].has_seq_id(seq_id)) {
+            if (cache.cells[i].pos >= 0 && new_head == cache.size) new_head = i;
+            cache.cells[i].pos = -1;
+            cache.cells[i].seq_mask = 0;
+        } else {
+            cache.cells[i].seq_mask = 1u << seq_id;
+        }
+    }
+
+    // If we freed up a slot, set head to it so searching can start there.
+    if (new_head != cache.size) cache.head = new_head;
+}
+
 static void whisper_kv_cache_seq_cp(
         struct whisper_kv_cache & cache,
                  whisper_seq_id   seq_id_src,
@@ -1131,14 +2057,57 @@ static void whisper_kv_cache_seq_cp(
 
     for (uint32_t i = 0; i < cache.size; ++i) {
         if (cache.cells[i].has_seq_id(seq_id_src) && cache.cells[i].pos >= p0 && cache.cells[i].pos < p1) {
-            cache.cells[i].seq_id.insert(seq_id_dst);
+            cache.cells[i].seq_mask |= 1u << seq_id_dst;
+        }
+    }
+}
+
+// reassign the sequences in a single pass over the cells: sequence j takes over the cells of sequence src[j]
+// src[j] < 0 leaves sequence j unchanged
+// the cells are shared, so no data is copied - cells that are no longer referenced are released
+static void whisper_kv_cache_seq_remap(
+        struct whisper_kv_cache & cache,
+           const whisper_seq_id * src,
+                            int   n_seq) {
+    uint32_t mask_dst = 0;
+    for (int j = 0; j < n_seq; ++j) {
+        if (src[j] >= 0) {
+            mask_dst |= 1u << j;
+        }
+    }
+
+    uint32_t new_head = cache.size;
+
+    for (uint32_t i = 0; i < cache.size; ++i) {
+        auto & cell = cache.cells[i];
+
+        if (cell.seq_mask == 0) {
+            continue;
+        }
+
+        uint32_t mask = cell.seq_mask & ~mask_dst;
+        for (int j = 0; j < n_seq; ++j) {
+            if (src[j] >= 0 && cell.has_seq_id(src[j])) {
+                mask |= 1u << j;
+            }
+        }
+
+        cell.seq_mask = mask;
+
+        if (mask == 0) {
+            cell.pos = -1;
+            if (new_head == cache.size) new_head = i;
         }
     }
+
+    if (new_head != cache.size) cache.head = new_head;
 }
 
+// the number of KV cells used by the decoder is padded to a multiple of this value
+// besides the backend requirements, the padding allows consecutive decoder calls to reuse the same graph
 static uint32_t whisper_kv_cache_get_padding(const struct whisper_context & wctx) {
     if (!wctx.params.flash_attn || !wctx.params.use_gpu) {
-        return 1u;
+        return 32u;
     }
 
 #ifdef GGML_USE_METAL
@@ -1153,71 +2122,276 @@ static uint32_t whisper_kv_cache_get_padding(const struct whisper_context & wctx
     }
 #endif
 
-    return 1u;
+    return 32u;
 }
 
-// [EXPERIMENTAL] Token-level timestamps with DTW
-static bool aheads_masks_init(
-        const whisper_context_params & cparams,
-               const whisper_hparams & hparams,
-         struct whisper_aheads_masks & aheads_masks,
-                      ggml_backend_t   backend) {
+//
+// [EXPERIMENTAL] prompt snapshots for the temperature fallback
+//
 
-    const int32_t n_text_layer = hparams.n_text_layer;
-    const int32_t n_head = hparams.n_text_head;
+static uint64_t whisper_hash_fnv1a(uint64_t hash, const void * data, size_t size) {
+    const uint8_t * p = (const uint8_t *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
 
-    // Sanity checks
-    if (cparams.dtw_aheads_preset == WHISPER_AHEADS_NONE) {
-        WHISPER_LOG_ERROR("%s: dtw_aheads_preset should be != DTW_AHEADS_NONE\n", __func__);
-        return false;
-    } else if (cparams.dtw_aheads_preset == WHISPER_AHEADS_N_TOP_MOST) {
-        if (cparams.dtw_n_top > n_text_layer || cparams.dtw_n_top <= 0) {
-            WHISPER_LOG_ERROR("%s: dtw_n_top must be between %d and %d for this model.", __func__, 1, n_text_layer);
-            return false;
+static const uint64_t WHISPER_HASH_SEED = 0xcbf29ce484222325ULL;
+
+// copy the K/V of cells [0, n_tokens) of sequence 0 between kv_self and a snapshot buffer
+static void whisper_prompt_snapshot_copy(
+        const whisper_context & wctx,
+        const whisper_kv_cache & cache,
+         std::vector<uint8_t> & k,
+         std::vector<uint8_t> & v,
+                          int   n_tokens,
+                          int   n_tokens_snapshot,
+                         bool   to_cache) {
+    const auto & hparams = wctx.model.hparams;
+
+    const int n_ctx   = cache.size;
+    const int n_state = hparams.n_text_state;
+    const int n_layer = hparams.n_text_layer;
+
+    // the rows of K (and of V with flash attention) can be quantized
+    const size_t rsk = ggml_row_size(cache.k->type, n_state);
+    const size_t rsv = ggml_row_size(cache.v->type, n_state);
+    const size_t esv = ggml_element_size(cache.v);
+
+    auto copy = [&](ggml_tensor * t, uint8_t * data, size_t offs, size_t size) {
+        if (to_cache) {
+            ggml_backend_tensor_get(t, data, offs, size);
+        } else {
+            ggml_backend_tensor_set(t, data, offs, size);
         }
-    } else {
-        const auto aheads = cparams.dtw_aheads_preset == WHISPER_AHEADS_CUSTOM ? cparams.dtw_aheads : g_aheads.at(cparams.dtw_aheads_preset);
-        if (cparams.dtw_aheads_preset == WHISPER_AHEADS_CUSTOM) {
-            if (aheads.n_heads == 0) {
-                WHISPER_LOG_ERROR("%s: dtw_aheads.n_heads should be > 0", __func__);
-                return false;
-            }
-            if (aheads.heads == NULL) {
-                WHISPER_LOG_ERROR("%s: dtw_aheads.heads unset", __func__);
-                return false;
-            }
+    };
+
+    // without flash attention V is transposed - the n_tokens columns of a layer are n_state strided rows
+    const bool   v_host = ggml_backend_buffer_is_host(cache.buffer);
+    const size_t v_span = esv*((size_t) n_ctx*(n_state - 1) + n_tokens);
+
+    std::vector<uint8_t> v_buf;
+
+    for (int il = 0; il < n_layer; ++il) {
+        copy(cache.k, k.data() + rsk*n_tokens_snapshot*il, rsk*n_ctx*il, rsk*n_tokens);
+
+        if (wctx.params.flash_attn) {
+            copy(cache.v, v.data() + rsv*n_tokens_snapshot*il, rsv*n_ctx*il, rsv*n_tokens);
+            continue;
         }
-        for (size_t i = 0; i < aheads.n_heads; ++i) {
-            if (aheads.heads[i].n_text_layer >= n_text_layer) {
-                WHISPER_LOG_ERROR("%s: tried to set alignment head on text layer %d, but model only has %d text layers", __func__, aheads.heads[i].n_text_layer + 1, n_text_layer);
-                return false;
-            }
-            if (aheads.heads[i].n_text_layer < 0) {
-                WHISPER_LOG_ERROR("%s: tried to set alignment head on text layer < 0", __func__);
-                return false;
-            }
-            if (aheads.heads[i].n_head >= n_head) {
-                WHISPER_LOG_ERROR("%s: tried to set alignment head on head %d, but model only has %d heads", __func__, aheads.heads[i].n_head + 1, n_head);
-                return false;
-            }
-            if (aheads.heads[i].n_head < 0) {
-                WHISPER_LOG_ERROR("%s: tried to set alignment head on head < 0", __func__);
-                return false;
+
+        uint8_t * data_snap = v.data() + esv*n_tokens_snapshot*n_state*il;
+        uint8_t * data_kv   = (uint8_t *) cache.v->data + esv*n_ctx*n_state*il;
+
+        // device memory: transfer the span of the rows at once and (un)pack the columns on the host
+        if (!v_host) {
+            v_buf.resize(v_span);
+            data_kv = v_buf.data();
+            ggml_backend_tensor_get(cache.v, v_buf.data(), esv*n_ctx*n_state*il, v_span);
+        }
+
+        for (int j = 0; j < n_state; ++j) {
+            if (to_cache) {
+                memcpy(data_snap + esv*n_tokens_snapshot*j, data_kv + esv*n_ctx*j, esv*n_tokens);
+            } else {
+                memcpy(data_kv + esv*n_ctx*j, data_snap + esv*n_tokens_snapshot*j, esv*n_tokens);
             }
         }
+
+        if (!v_host && !to_cache) {
+            ggml_backend_tensor_set(cache.v, v_buf.data(), esv*n_ctx*n_state*il, v_span);
+        }
     }
+}
 
-    struct ggml_init_params params = {
-        /*.mem_size   =*/ (size_t) static_cast<size_t>(n_text_layer)*ggml_tensor_overhead(),
-        /*.mem_buffer =*/ nullptr,
-        /*.no_alloc   =*/ true,
-    };
+// find the longest cached prefix of the prompt for the current audio segment and restore it into kv_self
+// at least the last token of the prompt is left for decoding, so that its logits are computed
+// returns the number of restored tokens
+static int whisper_prompt_snapshot_restore(
+        const whisper_context & wctx,
+                whisper_state & wstate,
+  const std::vector<whisper_token> & prompt) {
+    auto & pc = wstate.prompt_snapshots;
 
-    aheads_masks.ctx = ggml_init(params);
+    if (pc.size_max == 0 || prompt.size() < 2) {
+        return 0;
+    }
 
-    if (!aheads_masks.ctx) {
-        WHISPER_LOG_ERROR("%s: failed to allocate memory for the aheads_masks context\n", __func__);
-        return false;
+    // hashes of all prefixes of the prompt
+    std::vector<uint64_t> hashes(prompt.size() + 1);
+    hashes[0] = WHISPER_HASH_SEED;
+    for (size_t i = 0; i < prompt.size(); ++i) {
+        hashes[i + 1] = whisper_hash_fnv1a(hashes[i], &prompt[i], sizeof(whisper_token));
+    }
+
+    whisper_prompt_snapshot * best = nullptr;
+
+    for (auto & entry : pc.entries) {
+        const size_t n = entry.tokens.size();
+
+        if (entry.audio_hash != wstate.audio_hash || n > prompt.size() || entry.tokens_hash != hashes[n]) {
+            continue;
+        }
+
+        if (!std::equal(entry.tokens.begin(), entry.tokens.end(), prompt.begin())) {
+            continue;
+        }
+
+        if (best == nullptr || n > best->tokens.size()) {
+            best = &entry;
+        }
+    }
+
+    if (best == nullptr) {
+        pc.n_miss++;
+        return 0;
+    }
+
+    auto & kv_self = wstate.kv_self;
+
+    const int n_restore = std::min<int>(best->tokens.size(), prompt.size() - 1);
+
+    whisper_prompt_snapshot_copy(wctx, kv_self, best->k, best->v, n_restore, best->tokens.size(), false);
+
+    for (int i = 0; i < n_restore; ++i) {
+        kv_self.cells[i].pos = i;
+        kv_self.cells[i].seq_mask |= 1u;
+    }
+    kv_self.head = n_restore;
+
+    best->t_last_used = ggml_time_us();
+
+    pc.n_hit++;
+    pc.n_bytes_reused += (best->k.size() + best->v.size())/best->tokens.size()*n_restore;
+
+    return n_restore;
+}
+
+// snapshot the prompt that is decoded in cells [0, prompt.size()) of kv_self
+// only called when the prompt is about to be decoded again for the same audio, so that every snapshot can be hit
+static void whisper_prompt_snapshot_store(
+        const whisper_context & wctx,
+                whisper_state & wstate,
+  const std::vector<whisper_token> & prompt) {
+    auto & pc = wstate.prompt_snapshots;
+
+    if (pc.size_max == 0 || prompt.size() < 2) {
+        return;
+    }
+
+    const auto & hparams = wctx.model.hparams;
+    const auto & kv_self = wstate.kv_self;
+
+    const int n_tokens = prompt.size();
+
+    const size_t size_k = ggml_row_size(kv_self.k->type, hparams.n_text_state)*hparams.n_text_layer*n_tokens;
+    const size_t size_v = ggml_row_size(kv_self.v->type, hparams.n_text_state)*hparams.n_text_layer*n_tokens;
+
+    if (size_k + size_v > pc.size_max) {
+        return;
+    }
+
+    uint64_t tokens_hash = WHISPER_HASH_SEED;
+    for (const auto & token : prompt) {
+        tokens_hash = whisper_hash_fnv1a(tokens_hash, &token, sizeof(whisper_token));
+    }
+
+    for (const auto & entry : pc.entries) {
+        if (entry.audio_hash == wstate.audio_hash && entry.tokens_hash == tokens_hash && entry.tokens == prompt) {
+            return;
+        }
+    }
+
+    // evict the least recently used entries
+    while (pc.size + size_k + size_v > pc.size_max) {
+        auto it = std::min_element(pc.entries.begin(), pc.entries.end(),
+                [](const whisper_prompt_snapshot & a, const whisper_prompt_snapshot & b) {
+                    return a.t_last_used < b.t_last_used;
+                });
+
+        pc.size -= it->k.size() + it->v.size();
+        pc.entries.erase(it);
+    }
+
+    whisper_prompt_snapshot entry;
+
+    entry.audio_hash  = wstate.audio_hash;
+    entry.tokens_hash = tokens_hash;
+    entry.tokens      = prompt;
+    entry.k.resize(size_k);
+    entry.v.resize(size_v);
+    entry.t_last_used = ggml_time_us();
+
+    whisper_prompt_snapshot_copy(wctx, kv_self, entry.k, entry.v, n_tokens, n_tokens, true);
+
+    pc.size += size_k + size_v;
+    pc.entries.push_back(std::move(entry));
+}
+
+// [EXPERIMENTAL] Token-level timestamps with DTW
+static bool aheads_masks_init(
+        const whisper_context_params & cparams,
+               const whisper_hparams & hparams,
+         struct whisper_aheads_masks & aheads_masks,
+                      ggml_backend_t   backend) {
+
+    const int32_t n_text_layer = hparams.n_text_layer;
+    const int32_t n_head = hparams.n_text_head;
+
+    // Sanity checks
+    if (cparams.dtw_aheads_preset == WHISPER_AHEADS_NONE) {
+        WHISPER_LOG_ERROR("%s: dtw_aheads_preset should be != DTW_AHEADS_NONE\n", __func__);
+        return false;
+    } else if (cparams.dtw_aheads_preset == WHISPER_AHEADS_N_TOP_MOST) {
+        if (cparams.dtw_n_top > n_text_layer || cparams.dtw_n_top <= 0) {
+            WHISPER_LOG_ERROR("%s: dtw_n_top must be between %d and %d for this model.", __func__, 1, n_text_layer);
+            return false;
+        }
+    } else {
+        const auto aheads = cparams.dtw_aheads_preset == WHISPER_AHEADS_CUSTOM ? cparams.dtw_aheads : g_aheads.at(cparams.dtw_aheads_preset);
+        if (cparams.dtw_aheads_preset == WHISPER_AHEADS_CUSTOM) {
+            if (aheads.n_heads == 0) {
+                WHISPER_LOG_ERROR("%s: dtw_aheads.n_heads should be > 0", __func__);
+                return false;
+            }
+            if (aheads.heads == NULL) {
+                WHISPER_LOG_ERROR("%s: dtw_aheads.heads unset", __func__);
+                return false;
+            }
+        }
+        for (size_t i = 0; i < aheads.n_heads; ++i) {
+            if (aheads.heads[i].n_text_layer >= n_text_layer) {
+                WHISPER_LOG_ERROR("%s: tried to set alignment head on text layer %d, but model only has %d text layers", __func__, aheads.heads[i].n_text_layer + 1, n_text_layer);
+                return false;
+            }
+            if (aheads.heads[i].n_text_layer < 0) {
+                WHISPER_LOG_ERROR("%s: tried to set alignment head on text layer < 0", __func__);
+                return false;
+            }
+            if (aheads.heads[i].n_head >= n_head) {
+                WHISPER_LOG_ERROR("%s: tried to set alignment head on head %d, but model only has %d heads", __func__, aheads.heads[i].n_head + 1, n_head);
+                return false;
+            }
+            if (aheads.heads[i].n_head < 0) {
+                WHISPER_LOG_ERROR("%s: tried to set alignment head on head < 0", __func__);
+                return false;
+            }
+        }
+    }
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ (size_t) static_cast<size_t>(n_text_layer)*ggml_tensor_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    aheads_masks.ctx = ggml_init(params);
+
+    if (!aheads_masks.ctx) {
+        WHISPER_LOG_ERROR("%s: failed to allocate memory for the aheads_masks context\n", __func__);
+        return false;
     }
 
     for (int64_t il = 0; il < n_text_layer; ++il) {
@@ -1471,9 +2645,324 @@ static ggml_backend_buffer_type_t select_weight_buft(const whisper_hparams & hpa
     return nullptr;
 }
 
-// load the model from a ggml file
+// location of the data of a tensor in the model file
+struct whisper_tensor_loc {
+    std::string name;
+    ggml_type   type;
+    size_t      offs;
+    size_t      nbytes;
+};
+
+// scan the tensor headers of a legacy ggml file, starting at the current read position of the mapping (the start of the weights)
+static std::vector<whisper_tensor_loc> whisper_tensor_locs_ggml(const whisper_mmap & mm) {
+    std::vector<whisper_tensor_loc> locs;
+
+    const uint8_t * base = (const uint8_t *) mm.addr;
+
+    size_t offs = mm.offs;
+    while (offs + 3*sizeof(int32_t) <= mm.size) {
+        int32_t hdr[3]; // n_dims, length, ttype
+        memcpy(hdr, base + offs, sizeof(hdr));
+        offs += sizeof(hdr);
+
+        const int32_t n_dims = hdr[0];
+        const int32_t length = hdr[1];
+        const int32_t ttype  = hdr[2];
+
+        if (n_dims < 1 || n_dims > 4 || length <= 0 || ttype < 0 || ttype >= GGML_TYPE_COUNT || ggml_blck_size(ggml_type(ttype)) == 0) {
+            break;
+        }
+
+        if (offs + n_dims*sizeof(int32_t) + length > mm.size) {
+            break;
+        }
+
+        int64_t nelements = 1;
+        for (int i = 0; i < n_dims; ++i) {
+            int32_t ne;
+            memcpy(&ne, base + offs, sizeof(ne));
+            offs += sizeof(ne);
+            nelements *= ne;
+        }
+
+        // aligned files pad the names with '\0'
+        std::string name((const char *) base + offs, strnlen((const char *) base + offs, length));
+        offs += length;
+
+        if (nelements < 0) {
+            break;
+        }
+
+        const size_t nbytes = (nelements*ggml_type_size(ggml_type(ttype)))/ggml_blck_size(ggml_type(ttype));
+        if (offs + nbytes > mm.size) {
+            break;
+        }
+
+        locs.push_back({ name, ggml_type(ttype), offs, nbytes });
+
+        offs += nbytes;
+    }
+
+    return locs;
+}
+
+// the tensors of a GGUF file, ordered by their offset
+static std::vector<whisper_tensor_loc> whisper_tensor_locs_gguf(const gguf_context * gguf) {
+    std::vector<whisper_tensor_loc> locs;
+
+    const size_t offs_data = gguf_get_data_offset(gguf);
+
+    for (int64_t i = 0; i < gguf_get_n_tensors(gguf); ++i) {
+        locs.push_back({
+            gguf_get_tensor_name(gguf, i),
+            gguf_get_tensor_type(gguf, i),
+            offs_data + gguf_get_tensor_offset(gguf, i),
+            gguf_get_tensor_size(gguf, i),
+        });
+    }
+
+    std::sort(locs.begin(), locs.end(), [](const whisper_tensor_loc & a, const whisper_tensor_loc & b) {
+        return a.offs < b.offs;
+    });
+
+    return locs;
+}
+
+// point the tensors of ctx that are stored aligned in the mapped model file to the mapping
+// returns the buffer that wraps the mapping, or nullptr if no tensor could be mapped
+static ggml_backend_buffer_t whisper_model_mmap_tensors(
+        whisper_model & model,
+        ggml_context * ctx,
+        const std::vector<whisper_tensor_loc> & locs,
+        int & n_mapped, int & n_unaligned, size_t & size_mapped) {
+    const whisper_mmap & mm = *model.mapping;
+
+    const size_t align = ggml_backend_buft_get_alignment(ggml_backend_cpu_buffer_type());
+
+    std::map<ggml_tensor *, bool> in_ctx;
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+        in_ctx[t] = true;
+    }
+
+    std::vector<std::pair<ggml_tensor *, size_t>> mapped;
+
+    n_unaligned = 0;
+    size_mapped = 0;
+
+    for (const auto & loc : locs) {
+        auto it = model.tensors.find(loc.name);
+        if (it == model.tensors.end() || in_ctx.count(it->second) == 0 ||
+            it->second->type != loc.type || ggml_nbytes(it->second) != loc.nbytes || loc.offs + loc.nbytes > mm.size) {
+            continue;
+        }
+
+        if (((uintptr_t) mm.addr + loc.offs) % align == 0) {
+            mapped.emplace_back(it->second, loc.offs);
+            size_mapped += loc.nbytes;
+        } else {
+            n_unaligned++;
+        }
+    }
+
+    n_mapped = (int) mapped.size();
+
+    if (mapped.empty()) {
+        return nullptr;
+    }
+
+    ggml_backend_buffer_t buf = ggml_backend_cpu_buffer_from_ptr(mm.addr, mm.size);
+    if (buf == nullptr) {
+        n_mapped    = 0;
+        size_mapped = 0;
+        return nullptr;
+    }
+
+    for (const auto & p : mapped) {
+        if (ggml_backend_tensor_alloc(buf, p.first, (char *) mm.addr + p.second) != GGML_STATUS_SUCCESS) {
+            GGML_ABORT("%s: failed to map tensor", __func__);
+        }
+    }
+
+    return buf;
+}
+
+#define WHISPER_LOAD_MAX_THREADS 8
+#define WHISPER_LOAD_CHUNK_SIZE  (4*1024*1024)
+
+// a tensor whose data is copied out of the mapped model file after the tensor index has been parsed
+struct whisper_load_job {
+    ggml_tensor * tensor;
+    size_t        offs; // of the data in the file
+};
+
+// copy the data of the tensors that do not use the mapping in place into their buffers
+//
+// the host tensors are split into chunks that a few threads copy in parallel - the page faults of the copies
+// read the file, so the reads of different parts of it overlap. meanwhile, the calling thread uploads the device
+// tensors with async copies straight from the mapping (it stays valid until the backends are synchronized) and
+// asks the OS to read ahead the next device tensor while the current one is uploaded
+static void whisper_model_load_mapped(const whisper_mmap & mm, const std::vector<whisper_load_job> & jobs, int n_threads) {
+    std::vector<whisper_load_job> jobs_dev;
+
+    struct chunk {
+        ggml_tensor * tensor;
+        size_t        offs;      // in the tensor
+        size_t        offs_file; // of the tensor data
+        size_t        size;
+    };
+
+    std::vector<chunk> chunks;
+
+    for (const auto & job : jobs) {
+        if (!ggml_backend_buffer_is_host(job.tensor->buffer)) {
+            jobs_dev.push_back(job);
+            continue;
+        }
+
+        const size_t nbytes = ggml_nbytes(job.tensor);
+        for (size_t offs = 0; offs < nbytes; offs += WHISPER_LOAD_CHUNK_SIZE) {
+            chunks.push_back({ job.tensor, offs, job.offs, std::min<size_t>(WHISPER_LOAD_CHUNK_SIZE, nbytes - offs) });
+        }
+    }
+
+    std::atomic<size_t> i_chunk(0);
+    std::atomic<int>    i_thread(0);
+
+    auto work = [&]() {
+        // the first thread to arrive does the device uploads before it helps with the host copies
+        if (i_thread++ == 0 && !jobs_dev.empty()) {
+            std::map<ggml_backend_dev_t, ggml_backend_t> backends;
+
+            for (size_t i = 0; i < jobs_dev.size(); ++i) {
+                ggml_tensor * tensor = jobs_dev[i].tensor;
+
+                if (i + 1 < jobs_dev.size()) {
+                    mm.will_need(jobs_dev[i + 1].offs, ggml_nbytes(jobs_dev[i + 1].tensor));
+                }
+
+                ggml_backend_dev_t dev = ggml_backend_buft_get_device(ggml_backend_buffer_get_type(tensor->buffer));
+                if (backends.count(dev) == 0) {
+                    backends[dev] = dev ? ggml_backend_dev_init(dev, nullptr) : nullptr;
+                }
+
+                const void * data = (const char *) mm.addr + jobs_dev[i].offs;
+
+                if (backends[dev]) {
+                    ggml_backend_tensor_set_async(backends[dev], tensor, data, 0, ggml_nbytes(tensor));
+                } else {
+                    ggml_backend_tensor_set(tensor, data, 0, ggml_nbytes(tensor));
+                }
+            }
+
+            for (auto & p : backends) {
+                if (p.second) {
+                    ggml_backend_synchronize(p.second);
+                    ggml_backend_free(p.second);
+                }
+            }
+        }
+
+        while (true) {
+            const size_t i = i_chunk++;
+            if (i >= chunks.size()) {
+                break;
+            }
+
+            const chunk & c = chunks[i];
+
+            memcpy((char *) c.tensor->data + c.offs, (const char *) mm.addr + c.offs_file + c.offs, c.size);
+        }
+    };
+
+    whisper_worker_pool pool;
+    whisper_worker_pool_run(pool, n_threads, work);
+    whisper_worker_pool_free(pool);
+}
+
+// GGUF metadata keys
+// the tokens are stored as raw bytes (they are not valid UTF-8 in general and can contain '\0'):
+// token i is token_data[offs_i, offs_i + token_len[i])
+// this is not the tokenizer.ggml.tokens string array, so the keys are under the whisper. prefix
+#define WHISPER_KV_ARCHITECTURE        "general.architecture"
+#define WHISPER_KV_FILE_TYPE           "general.file_type"
+#define WHISPER_KV_QNT_VERSION         "general.quantization_version"
+#define WHISPER_KV_VOCAB_SIZE          "whisper.vocab_size"
+#define WHISPER_KV_AUDIO_CTX           "whisper.audio.context_length"
+#define WHISPER_KV_AUDIO_STATE         "whisper.audio.embedding_length"
+#define WHISPER_KV_AUDIO_HEAD          "whisper.audio.head_count"
+#define WHISPER_KV_AUDIO_LAYER         "whisper.audio.block_count"
+#define WHISPER_KV_TEXT_CTX            "whisper.text.context_length"
+#define WHISPER_KV_TEXT_STATE          "whisper.text.embedding_length"
+#define WHISPER_KV_TEXT_HEAD           "whisper.text.head_count"
+#define WHISPER_KV_TEXT_LAYER          "whisper.text.block_count"
+#define WHISPER_KV_N_MELS              "whisper.audio.mel_count"
+#define WHISPER_KV_MEL_FILTERS         "whisper.mel_filters"
+#define WHISPER_KV_MEL_FILTERS_N_FFT   "whisper.mel_filters.n_fft"
+#define WHISPER_KV_ALIGNMENT_HEADS     "whisper.alignment_heads" // [n_text_layer, n_head] pairs
+#define WHISPER_KV_TOKEN_DATA          "whisper.tokenizer.token_data"
+#define WHISPER_KV_TOKEN_LEN           "whisper.tokenizer.token_len"
+
+// metadata of a GGUF model file
+struct whisper_model_gguf {
+    gguf_context * gguf = nullptr;
+    ggml_context * meta = nullptr; // tensor shapes
+
+    whisper_model_gguf() = default;
+    whisper_model_gguf(const whisper_model_gguf &) = delete;
+    whisper_model_gguf & operator=(const whisper_model_gguf &) = delete;
+
+    ~whisper_model_gguf() {
+        if (gguf) {
+            gguf_free(gguf);
+        }
+        if (meta) {
+            ggml_free(meta);
+        }
+    }
+};
+
+static bool whisper_gguf_get_i32(const gguf_context * gguf, const char * key, int32_t & dst) {
+    const int64_t kid = gguf_find_key(gguf, key);
+    if (kid < 0) {
+        WHISPER_LOG_ERROR("%s: key '%s' not found in model file\n", __func__, key);
+        return false;
+    }
+
+    switch (gguf_get_kv_type(gguf, kid)) {
+        case GGUF_TYPE_INT32:  dst = gguf_get_val_i32(gguf, kid);           return true;
+        case GGUF_TYPE_UINT32: dst = (int32_t) gguf_get_val_u32(gguf, kid); return true;
+        default:
+            WHISPER_LOG_ERROR("%s: key '%s' has type %s, expected an int32\n", __func__, key, gguf_type_name(gguf_get_kv_type(gguf, kid)));
+            return false;
+    }
+}
+
+// the array at key, or nullptr with n = 0 if the key is missing or has a different element type
+static const void * whisper_gguf_get_arr(const gguf_context * gguf, const char * key, gguf_type type, size_t & n) {
+    n = 0;
+
+    const int64_t kid = gguf_find_key(gguf, key);
+    if (kid < 0 || gguf_get_kv_type(gguf, kid) != GGUF_TYPE_ARRAY || gguf_get_arr_type(gguf, kid) != type) {
+        return nullptr;
+    }
+
+    n = gguf_get_arr_n(gguf, kid);
+
+    return gguf_get_arr_data(gguf, kid);
+}
+
+// skip n bytes of the loader stream
+static void whisper_loader_skip(whisper_model_loader * loader, size_t n, std::vector<char> & buf) {
+    while (n > 0) {
+        buf.resize(std::min<size_t>(n, 1024*1024));
+        loader->read(loader->context, buf.data(), buf.size());
+        n -= buf.size();
+    }
+}
+
+// load the model from a ggml or GGUF file
 //
-// file format:
+// file format (ggml):
 //
 //   - hparams
 //   - pre-computed mel filters
@@ -1482,7 +2971,11 @@ static ggml_backend_buffer_type_t select_weight_buft(const whisper_hparams & hpa
 //
 // see the convert-pt-to-ggml.py script for details
 //
-static bool whisper_model_load(struct whisper_model_loader * loader, whisper_context & wctx) {
+// GGUF files (see examples/quantize) store the hparams, mel filters, vocab and alignment heads as
+// WHISPER_KV_* metadata and the weights aligned - the metadata is parsed up front by the caller (gguf)
+// and the loader stream is only used for the tensor data
+//
+static bool whisper_model_load(struct whisper_model_loader * loader, const whisper_model_gguf * gguf, whisper_context & wctx) {
     WHISPER_LOG_INFO("%s: loading model\n", __func__);
 
     const int64_t t_start_us = ggml_time_us();
@@ -1496,7 +2989,15 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
     {
         uint32_t magic;
         read_safe(loader, magic);
-        if (magic != GGML_FILE_MAGIC) {
+        if (gguf) {
+            if (memcmp(&magic, GGUF_MAGIC, sizeof(magic)) != 0) {
+                WHISPER_LOG_ERROR("%s: invalid model data (bad GGUF magic)\n", __func__);
+                return false;
+            }
+        } else if (memcmp(&magic, GGUF_MAGIC, sizeof(magic)) == 0) {
+            WHISPER_LOG_ERROR("%s: GGUF models can only be loaded with whisper_init_from_file*\n", __func__);
+            return false;
+        } else if (magic != GGML_FILE_MAGIC) {
             WHISPER_LOG_ERROR("%s: invalid model data (bad magic)\n", __func__);
             return false;
         }
@@ -1506,17 +3007,47 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
     {
         auto & hparams = model.hparams;
 
-        read_safe(loader, hparams.n_vocab);
-        read_safe(loader, hparams.n_audio_ctx);
-        read_safe(loader, hparams.n_audio_state);
-        read_safe(loader, hparams.n_audio_head);
-        read_safe(loader, hparams.n_audio_layer);
-        read_safe(loader, hparams.n_text_ctx);
-        read_safe(loader, hparams.n_text_state);
-        read_safe(loader, hparams.n_text_head);
-        read_safe(loader, hparams.n_text_layer);
-        read_safe(loader, hparams.n_mels);
-        read_safe(loader, hparams.ftype);
+        if (gguf) {
+            const gguf_context * kv = gguf->gguf;
+
+            const int64_t kid = gguf_find_key(kv, WHISPER_KV_ARCHITECTURE);
+            if (kid < 0 || gguf_get_kv_type(kv, kid) != GGUF_TYPE_STRING || strcmp(gguf_get_val_str(kv, kid), "whisper") != 0) {
+                WHISPER_LOG_ERROR("%s: not a whisper model (%s != 'whisper')\n", __func__, WHISPER_KV_ARCHITECTURE);
+                return false;
+            }
+
+            int32_t qntvr = 0;
+
+            if (!whisper_gguf_get_i32(kv, WHISPER_KV_VOCAB_SIZE,  hparams.n_vocab)       ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_CTX,   hparams.n_audio_ctx)   ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_STATE, hparams.n_audio_state) ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_HEAD,  hparams.n_audio_head)  ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_AUDIO_LAYER, hparams.n_audio_layer) ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_CTX,    hparams.n_text_ctx)    ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_STATE,  hparams.n_text_state)  ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_HEAD,   hparams.n_text_head)   ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_TEXT_LAYER,  hparams.n_text_layer)  ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_N_MELS,      hparams.n_mels)        ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_FILE_TYPE,   hparams.ftype)         ||
+                !whisper_gguf_get_i32(kv, WHISPER_KV_QNT_VERSION, qntvr)) {
+                return false;
+            }
+
+            // same encoding as the ggml header
+            hparams.ftype += qntvr*GGML_QNT_VERSION_FACTOR;
+        } else {
+            read_safe(loader, hparams.n_vocab);
+            read_safe(loader, hparams.n_audio_ctx);
+            read_safe(loader, hparams.n_audio_state);
+            read_safe(loader, hparams.n_audio_head);
+            read_safe(loader, hparams.n_audio_layer);
+            read_safe(loader, hparams.n_text_ctx);
+            read_safe(loader, hparams.n_text_state);
+            read_safe(loader, hparams.n_text_head);
+            read_safe(loader, hparams.n_text_layer);
+            read_safe(loader, hparams.n_mels);
+            read_safe(loader, hparams.ftype);
+        }
 
         assert(hparams.n_text_state == hparams.n_audio_state);
 
@@ -1577,48 +3108,104 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
     {
         auto & filters = wctx.model.filters;
 
-        read_safe(loader, filters.n_mel);
-        read_safe(loader, filters.n_fft);
+        if (gguf) {
+            size_t n = 0;
+            const float * data = (const float *) whisper_gguf_get_arr(gguf->gguf, WHISPER_KV_MEL_FILTERS, GGUF_TYPE_FLOAT32, n);
+
+            if (!whisper_gguf_get_i32(gguf->gguf, WHISPER_KV_MEL_FILTERS_N_FFT, filters.n_fft)) {
+                return false;
+            }
+
+            if (data == nullptr || filters.n_fft <= 0 || n % filters.n_fft != 0) {
+                WHISPER_LOG_ERROR("%s: invalid or missing '%s' in model file\n", __func__, WHISPER_KV_MEL_FILTERS);
+                return false;
+            }
+
+            filters.n_mel = (int32_t) (n/filters.n_fft);
+            filters.data.assign(data, data + n);
+        } else {
+            read_safe(loader, filters.n_mel);
+            read_safe(loader, filters.n_fft);
 
-        filters.data.resize(filters.n_mel * filters.n_fft);
-        loader->read(loader->context, filters.data.data(), filters.data.size() * sizeof(float));
-        BYTESWAP_FILTERS(filters);
+            filters.data.resize(filters.n_mel * filters.n_fft);
+            loader->read(loader->context, filters.data.data(), filters.data.size() * sizeof(float));
+            BYTESWAP_FILTERS(filters);
+        }
+
+        whisper_filters_init_bands(filters);
     }
 
     // load vocab
     {
         int32_t n_vocab = 0;
-        read_safe(loader, n_vocab);
-
-        //if (n_vocab != model.hparams.n_vocab) {
-        //    WHISPER_LOG_ERROR("%s: invalid model file '%s' (bad vocab size %d != %d)\n",
-        //            __func__, fname.c_str(), n_vocab, model.hparams.n_vocab);
-        //    return false;
-        //}
 
         std::string word;
-        std::vector<char> tmp;
 
-        tmp.reserve(128);
+        if (gguf) {
+            size_t n_data = 0;
+            size_t n_len  = 0;
 
-        for (int i = 0; i < n_vocab; i++) {
-            uint32_t len;
-            read_safe(loader, len);
+            const char     * data = (const char     *) whisper_gguf_get_arr(gguf->gguf, WHISPER_KV_TOKEN_DATA, GGUF_TYPE_UINT8,  n_data);
+            const uint32_t * lens = (const uint32_t *) whisper_gguf_get_arr(gguf->gguf, WHISPER_KV_TOKEN_LEN,  GGUF_TYPE_UINT32, n_len);
 
-            if (len > 0) {
-                tmp.resize(len);
-                loader->read(loader->context, &tmp[0], tmp.size()); // read to buffer
-                word.assign(&tmp[0], tmp.size());
-            } else {
-                // seems like we have an empty-string token in multi-language models (i = 50256)
-                //WHISPER_LOG_WARN("%s: warning: empty-string token in vocab, i = %d\n", __func__, i);
-                word = "";
+            if (lens == nullptr || (data == nullptr && n_data > 0)) {
+                WHISPER_LOG_ERROR("%s: invalid or missing '%s' in model file\n", __func__, WHISPER_KV_TOKEN_LEN);
+                return false;
+            }
+
+            n_vocab = (int32_t) n_len;
+
+            vocab.id_to_token.reserve(std::max(n_vocab, model.hparams.n_vocab));
+            vocab.token_to_id.reserve(std::max(n_vocab, model.hparams.n_vocab));
+
+            size_t offs = 0;
+            for (int i = 0; i < n_vocab; i++) {
+                if (offs + lens[i] > n_data) {
+                    WHISPER_LOG_ERROR("%s: token %d is out of bounds of '%s'\n", __func__, i, WHISPER_KV_TOKEN_DATA);
+                    return false;
+                }
+
+                word.assign(data + offs, lens[i]);
+                offs += lens[i];
+
+                vocab.token_to_id[word] = i;
+                vocab.id_to_token.push_back(word);
             }
+        } else {
+            read_safe(loader, n_vocab);
+
+            //if (n_vocab != model.hparams.n_vocab) {
+            //    WHISPER_LOG_ERROR("%s: invalid model file '%s' (bad vocab size %d != %d)\n",
+            //            __func__, fname.c_str(), n_vocab, model.hparams.n_vocab);
+            //    return false;
+            //}
+
+            std::vector<char> tmp;
+
+            tmp.reserve(128);
+
+            vocab.id_to_token.reserve(std::max(n_vocab, model.hparams.n_vocab));
+            vocab.token_to_id.reserve(std::max(n_vocab, model.hparams.n_vocab));
+
+            for (int i = 0; i < n_vocab; i++) {
+                uint32_t len;
+                read_safe(loader, len);
+
+                if (len > 0) {
+                    tmp.resize(len);
+                    loader->read(loader->context, &tmp[0], tmp.size()); // read to buffer
+                    word.assign(&tmp[0], tmp.size());
+                } else {
+                    // seems like we have an empty-string token in multi-language models (i = 50256)
+                    //WHISPER_LOG_WARN("%s: warning: empty-string token in vocab, i = %d\n", __func__, i);
+                    word = "";
+                }
 
-            vocab.token_to_id[word] = i;
-            vocab.id_to_token[i] = word;
+                vocab.token_to_id[word] = i;
+                vocab.id_to_token.push_back(word);
 
-            //printf("%s: vocab[%d] = '%s'\n", __func__, i, word.c_str());
+                //printf("%s: vocab[%d] = '%s'\n", __func__, i, word.c_str());
+            }
         }
 
         vocab.n_vocab = model.hparams.n_vocab;
@@ -1667,13 +3254,23 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
                     word = "[_extra_token_" + std::to_string(i) + "]";
                 }
                 vocab.token_to_id[word] = i;
-                vocab.id_to_token[i] = word;
+                vocab.id_to_token.push_back(word);
             }
         }
 
         WHISPER_LOG_INFO("%s: n_langs       = %d\n", __func__, vocab.num_languages());
     }
 
+    // alignment heads for DTW
+    if (gguf) {
+        size_t n = 0;
+        const int32_t * data = (const int32_t *) whisper_gguf_get_arr(gguf->gguf, WHISPER_KV_ALIGNMENT_HEADS, GGUF_TYPE_INT32, n);
+
+        for (size_t i = 0; i + 1 < n; i += 2) {
+            model.aheads.push_back({ data[i + 0], data[i + 1] });
+        }
+    }
+
     const ggml_type wtype = wctx.wtype;
     const ggml_type vtype = wctx.wtype == GGML_TYPE_F32 ? GGML_TYPE_F32 : GGML_TYPE_F16; // conv type
 
@@ -1712,6 +3309,21 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
     buft_list_t buft_list = make_buft_list(wctx.params);
 
     auto create_tensor = [&](asr_tensor type, asr_system system, ggml_tensor * meta, int layer = 0) -> ggml_tensor * {
+        const std::string name = format(ASR_TENSOR_NAMES.at(system).at(type), layer);
+
+        if (gguf) {
+            // GGUF files record the type of each tensor, so it does not have to follow ftype
+            const ggml_tensor * src = ggml_get_tensor(gguf->meta, name.c_str());
+            if (src && src->type != meta->type && ggml_are_same_shape(src, meta) && meta->ne[0] % ggml_blck_size(src->type) == 0) {
+                meta->type  = src->type;
+                meta->nb[0] = ggml_type_size(src->type);
+                meta->nb[1] = meta->nb[0]*(meta->ne[0]/ggml_blck_size(src->type));
+                for (int i = 2; i < GGML_MAX_DIMS; i++) {
+                    meta->nb[i] = meta->nb[i - 1]*meta->ne[i - 1];
+                }
+            }
+        }
+
         ggml_op op = ASR_TENSOR_INFO.at(type);
         ggml_backend_buffer_type_t buft = select_weight_buft(hparams, meta, op, buft_list);
         if (!buft) {
@@ -1721,7 +3333,7 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
         ggml_context * ctx = get_ctx(buft);
         ggml_tensor * tensor = ggml_dup_tensor(ctx, meta);
 
-        model.tensors[format(ASR_TENSOR_NAMES.at(system).at(type), layer)] = tensor;
+        model.tensors[name] = tensor;
 
         return tensor;
     };
@@ -1845,6 +3457,31 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
         ggml_free(ctx);
     }
 
+    // map the CPU weights that are aligned in the file instead of reading them
+    // the remaining tensors of the context are allocated and read as usual below
+    ggml_backend_buffer_t buf_mmap = nullptr;
+#if !defined(WHISPER_BIG_ENDIAN)
+    if (model.mapping && ctx_map.count(ggml_backend_cpu_buffer_type()) > 0) {
+        GGML_ASSERT(loader->context == model.mapping.get());
+
+        int    n_mapped    = 0;
+        int    n_unaligned = 0;
+        size_t size_mapped = 0;
+
+        const std::vector<whisper_tensor_loc> locs = gguf ? whisper_tensor_locs_gguf(gguf->gguf) : whisper_tensor_locs_ggml(*model.mapping);
+
+        buf_mmap = whisper_model_mmap_tensors(model, ctx_map[ggml_backend_cpu_buffer_type()], locs, n_mapped, n_unaligned, size_mapped);
+        if (buf_mmap) {
+            model.buffers.emplace_back(buf_mmap);
+        }
+
+        WHISPER_LOG_INFO("%s: mmap: %d tensors mapped (%.2f MB), %d not aligned in the file\n", __func__, n_mapped, size_mapped/1e6, n_unaligned);
+        if (n_unaligned > 0) {
+            WHISPER_LOG_INFO("%s: mmap: convert the model to GGUF (examples/quantize) or use models/ggml-align.py to align the tensor data\n", __func__);
+        }
+    }
+#endif
+
     // allocate tensors in the backend buffers
     for (auto & p : ctx_map) {
         ggml_backend_buffer_type_t buft = p.first;
@@ -1866,7 +3503,80 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
 
         std::vector<char> read_buf;
 
-        while (true) {
+        // with a mapping, the data is copied after all tensors have been located (see whisper_model_load_mapped)
+#if !defined(WHISPER_BIG_ENDIAN)
+        const bool defer = model.mapping != nullptr;
+#else
+        const bool defer = false;
+#endif
+        std::vector<whisper_load_job> jobs;
+
+        // read the data of the tensor at the current position of the loader
+        auto load_tensor_data = [&](ggml_tensor * tensor) {
+            if (buf_mmap && tensor->buffer == buf_mmap) {
+                // already points into the mapped file
+                model.mapping->offs += ggml_nbytes(tensor);
+            } else if (defer) {
+                if (model.mapping->offs + ggml_nbytes(tensor) > model.mapping->size) {
+                    WHISPER_LOG_ERROR("%s: tensor '%s' is truncated in model file\n", __func__, ggml_get_name(tensor));
+                    return false;
+                }
+                jobs.push_back({ tensor, model.mapping->offs });
+                model.mapping->offs += ggml_nbytes(tensor);
+            } else if (ggml_backend_buffer_is_host(tensor->buffer)) {
+                // for the CPU and Metal backend, we can read directly into the tensor
+                loader->read(loader->context, tensor->data, ggml_nbytes(tensor));
+                BYTESWAP_TENSOR(tensor);
+            } else {
+                // read into a temporary buffer first, then copy to device memory
+                read_buf.resize(ggml_nbytes(tensor));
+
+                loader->read(loader->context, read_buf.data(), read_buf.size());
+
+                ggml_backend_tensor_set(tensor, read_buf.data(), 0, ggml_nbytes(tensor));
+            }
+
+            total_size += ggml_nbytes(tensor);
+            model.n_loaded++;
+
+            return true;
+        };
+
+        if (gguf) {
+            // the data section follows the metadata, the tensors are read in file order
+            size_t pos = sizeof(uint32_t); // magic
+
+            for (const auto & loc : whisper_tensor_locs_gguf(gguf->gguf)) {
+                auto it = model.tensors.find(loc.name);
+                if (it == model.tensors.end()) {
+                    WHISPER_LOG_ERROR("%s: unknown tensor '%s' in model file\n", __func__, loc.name.c_str());
+                    return false;
+                }
+
+                ggml_tensor * tensor = it->second;
+
+                const ggml_tensor * src = ggml_get_tensor(gguf->meta, loc.name.c_str());
+                if (src == nullptr || !ggml_are_same_shape(src, tensor) || loc.type != tensor->type || loc.nbytes != ggml_nbytes(tensor)) {
+                    WHISPER_LOG_ERROR("%s: tensor '%s' has wrong shape or type in model file\n", __func__, loc.name.c_str());
+                    return false;
+                }
+
+                if (loc.offs < pos) {
+                    WHISPER_LOG_ERROR("%s: tensor '%s' overlaps the previous tensor in model file\n", __func__, loc.name.c_str());
+                    return false;
+                }
+
+                whisper_loader_skip(loader, loc.offs - pos, read_buf);
+
+                if (!load_tensor_data(tensor)) {
+                    return false;
+                }
+
+                pos = loc.offs + loc.nbytes;
+            }
+        }
+
+        while (!gguf) {
             int32_t n_dims;
             int32_t length;
             int32_t ttype;
@@ -1889,7 +3599,7 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
             std::string name;
             std::vector<char> tmp(length); // create a buffer
             loader->read(loader->context, &tmp[0], tmp.size()); // read to buffer
-            name.assign(&tmp[0], tmp.size());
+            name.assign(&tmp[0], strnlen(&tmp[0], tmp.size())); // aligned files pad the names with '\0'
 
             if (model.tensors.find(name) == model.tensors.end()) {
                 WHISPER_LOG_ERROR("%s: unknown tensor '%s' in model file\n", __func__, name.data());
@@ -1919,21 +3629,15 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
                 return false;
             }
 
-            if (ggml_backend_buffer_is_host(tensor->buffer)) {
-                // for the CPU and Metal backend, we can read directly into the tensor
-                loader->read(loader->context, tensor->data, ggml_nbytes(tensor));
-                BYTESWAP_TENSOR(tensor);
-            } else {
-                // read into a temporary buffer first, then copy to device memory
-                read_buf.resize(ggml_nbytes(tensor));
-
-                loader->read(loader->context, read_buf.data(), read_buf.size());
-
-                ggml_backend_tensor_set(tensor, read_buf.data(), 0, ggml_nbytes(tensor));
+            if (!load_tensor_data(tensor)) {
+                return false;
             }
+        }
 
-            total_size += ggml_nbytes(tensor);
-            model.n_loaded++;
+        if (!jobs.empty()) {
+            const int n_threads = std::max(1, std::min<int>(std::thread::hardware_concurrency(), WHISPER_LOAD_MAX_THREADS));
+
+            whisper_model_load_mapped(*model.mapping, jobs, n_threads);
         }
 
         WHISPER_LOG_INFO("%s: model size    = %7.2f MB\n", __func__, total_size/1e6);
@@ -1950,6 +3654,11 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
         ggml_backend_buffer_set_usage(buf, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
     }
 
+    if (model.mapping && !buf_mmap) {
+        // nothing points into the mapping - it was only used for reading
+        model.mapping.reset();
+    }
+
     wctx.t_load_us = ggml_time_us() - t_start_us;
 
     return true;
@@ -1973,20 +3682,84 @@ static bool whisper_encode_external(const whisper_state & wstate) {
     return use_coreml || use_openvino;
 }
 
+// [EXPERIMENTAL] log mel spectrogram of n_frames frames from the raw PCM, same as log_mel_spectrogram()
+// except that the clamping is relative to the maximum of these frames instead of the whole audio
+// the STFT is a matrix multiplication of the frames with the Hann-windowed DFT basis
+static struct ggml_tensor * whisper_build_graph_mel(
+        struct ggml_context * ctx0,
+    const whisper_mel_graph & mel_graph,
+         struct ggml_tensor * pcm) {
+    // [WHISPER_N_FFT, n_frames]
+    struct ggml_tensor * frames = ggml_im2col(ctx0, mel_graph.dft_cos, ggml_reshape_2d(ctx0, pcm, pcm->ne[0], 1), WHISPER_HOP_LENGTH, 0, 0, 0, 1, 0, false, GGML_TYPE_F32);
+    frames = ggml_reshape_2d(ctx0, frames, frames->ne[0], frames->ne[1]);
+
+    // power spectrum, [n_fft, n_frames]
+    struct ggml_tensor * re = ggml_mul_mat(ctx0, ggml_reshape_2d(ctx0, mel_graph.dft_cos, WHISPER_N_FFT, mel_graph.dft_cos->ne[2]), frames);
+    struct ggml_tensor * im = ggml_mul_mat(ctx0, ggml_reshape_2d(ctx0, mel_graph.dft_sin, WHISPER_N_FFT, mel_graph.dft_sin->ne[2]), frames);
+
+    struct ggml_tensor * cur = ggml_add(ctx0, ggml_sqr(ctx0, re), ggml_sqr(ctx0, im));
+
+    // log10 of the mel band energies, [n_frames, n_mel]
+    cur = ggml_mul_mat(ctx0, mel_graph.filters, cur);
+    cur = ggml_clamp(ctx0, cur, 1e-10f, FLT_MAX);
+    cur = ggml_scale(ctx0, ggml_log(ctx0, cur), 1.0f/logf(10.0f));
+    cur = ggml_cont(ctx0, ggml_transpose(ctx0, cur));
+
+    // clamping and normalization: (max(x, mmax - 8) + 4)/4
+    struct ggml_tensor * mmax = ggml_pool_2d(ctx0, cur, GGML_OP_POOL_MAX, cur->ne[0], cur->ne[1], cur->ne[0], cur->ne[1], 0, 0);
+
+    cur = ggml_relu(ctx0, ggml_scale_bias(ctx0, ggml_sub(ctx0, cur, mmax), 1.0f, 8.0f));
+    cur = ggml_scale_bias(ctx0, ggml_add(ctx0, cur, mmax), 0.25f, -1.0f);
+
+    return cur;
+}
+
+// conv1d (padding 1) + bias + gelu
+// uses the fused op when the backend has it - it skips the im2col tensor in the compute buffer
+static struct ggml_tensor * whisper_conv_1d_gelu(
+        struct ggml_context * ctx0,
+        whisper_state & wstate,
+        struct ggml_tensor * w,
+        struct ggml_tensor * x,
+        struct ggml_tensor * b,
+        int s0) {
+    struct ggml_tensor * cur = ggml_conv_1d_gelu(ctx0, w, x, b, s0, 1, 1);
+
+    if (ggml_backend_supports_op(wstate.backends[0], cur)) {
+        return cur;
+    }
+
+    cur = ggml_conv_1d_ph(ctx0, w, x, s0, 1);
+    cur = ggml_add(ctx0, cur, b);
+    cur = ggml_gelu(ctx0, cur);
+
+    return cur;
+}
+
+// the weights that the graphs of a state read - the replica on the node of the state with WHISPER_NUMA_REPLICATE
+static const whisper_model & whisper_state_model(const whisper_context & wctx, const whisper_state & wstate) {
+    if (wstate.numa_node > 0 && wstate.numa_node < (int) wctx.numa_replicas.size()) {
+        return wctx.numa_replicas[wstate.numa_node].model;
+    }
+
+    return wctx.model;
+}
+
 static struct ggml_cgraph * whisper_build_graph_conv(
         whisper_context & wctx,
-          whisper_state & wstate) {
-    const auto & model   = wctx.model;
+          whisper_state & wstate,
+                   bool   mel_in_graph) {
+    const auto & model   = whisper_state_model(wctx, wstate);
     const auto & hparams = model.hparams;
 
     const int n_ctx   = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : hparams.n_audio_ctx;
-    const int n_state = hparams.n_audio_state; GGML_UNUSED(n_state);
+    const int n_state = hparams.n_audio_state;
 
     const int n_mels = hparams.n_mels;
 
     struct ggml_init_params params = {
-        /*.mem_size   =*/ wstate.sched_conv.meta.size(),
-        /*.mem_buffer =*/ wstate.sched_conv.meta.data(),
+        /*.mem_size   =*/ wstate.sched.meta.size(),
+        /*.mem_buffer =*/ wstate.sched.meta.data(),
         /*.no_alloc   =*/ true,
     };
 
@@ -1994,40 +3767,37 @@ static struct ggml_cgraph * whisper_build_graph_conv(
 
     ggml_cgraph * gf = ggml_new_graph(ctx0);
 
-    struct ggml_tensor * mel = ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, 2*n_ctx, n_mels);
-    ggml_set_name(mel, "mel");
-    ggml_set_input(mel);
+    struct ggml_tensor * mel = nullptr;
+
+    if (mel_in_graph) {
+        // raw PCM covering the frames of the segment
+        struct ggml_tensor * pcm = ggml_new_tensor_1d(ctx0, GGML_TYPE_F32, (2*n_ctx - 1)*WHISPER_HOP_LENGTH + WHISPER_N_FFT);
+        ggml_set_name(pcm, "pcm");
+        ggml_set_input(pcm);
+
+        mel = whisper_build_graph_mel(ctx0, wstate.mel_graph, pcm);
+    } else {
+        mel = ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, 2*n_ctx, n_mels);
+        ggml_set_name(mel, "mel");
+        ggml_set_input(mel);
+    }
 
     struct ggml_tensor * cur = nullptr;
 
     if (!whisper_encode_external(wstate)) {
         // convolution + gelu
         {
-            cur = ggml_conv_1d_ph(ctx0, model.e_conv_1_w, mel, 1, 1);
-            cur = ggml_add(ctx0, cur, model.e_conv_1_b);
-
-            cur = ggml_gelu(ctx0, cur);
-
-            cur = ggml_conv_1d_ph(ctx0, model.e_conv_2_w, cur, 2, 1);
-            cur = ggml_add(ctx0, cur, model.e_conv_2_b);
-
-            cur = ggml_gelu(ctx0, cur);
+            cur = whisper_conv_1d_gelu(ctx0, wstate, model.e_conv_1_w, mel, model.e_conv_1_b, 1);
+            cur = whisper_conv_1d_gelu(ctx0, wstate, model.e_conv_2_w, cur, model.e_conv_2_b, 2);
         }
 
-        ggml_set_name(cur, "embd_conv");
-        wstate.embd_conv = cur;
+        // stored transposed, as consumed by the encoder
+        cur = ggml_cpy(ctx0, ggml_transpose(ctx0, cur), ggml_view_2d(ctx0, wstate.embd_conv, n_state, n_ctx, wstate.embd_conv->nb[1], 0));
     } else {
-        ggml_build_forward_expand(gf, mel);
-
-        cur = ggml_new_tensor_2d(ctx0, GGML_TYPE_F32, n_state, n_ctx);
-        ggml_set_input(cur); // the external encoder will write into this tensor
-
-        ggml_set_name(cur, "embd_enc");
-        wstate.embd_enc = cur;
+        // the external encoder writes into wstate.embd_enc
+        cur = mel;
     }
 
-    ggml_set_output(cur);
-
     ggml_build_forward_expand(gf, cur);
 
     ggml_free(ctx0);
@@ -2038,7 +3808,7 @@ static struct ggml_cgraph * whisper_build_graph_conv(
 static struct ggml_cgraph * whisper_build_graph_encoder(
         whisper_context & wctx,
           whisper_state & wstate) {
-    const auto & model   = wctx.model;
+    const auto & model   = whisper_state_model(wctx, wstate);
     const auto & hparams = model.hparams;
 
     const int n_ctx   = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : hparams.n_audio_ctx;
@@ -2055,8 +3825,8 @@ static struct ggml_cgraph * whisper_build_graph_encoder(
     const int n_ctx_pad = GGML_PAD(n_ctx, 256);
 
     struct ggml_init_params params = {
-        /*.mem_size   =*/ wstate.sched_encode.meta.size(),
-        /*.mem_buffer =*/ wstate.sched_encode.meta.data(),
+        /*.mem_size   =*/ wstate.sched.meta.size(),
+        /*.mem_buffer =*/ wstate.sched.meta.data(),
         /*.no_alloc   =*/ true,
     };
 
@@ -2064,7 +3834,7 @@ static struct ggml_cgraph * whisper_build_graph_encoder(
 
     ggml_cgraph * gf = ggml_new_graph_custom(ctx0, WHISPER_MAX_NODES, false);
 
-    struct ggml_tensor * cur = ggml_view_tensor(ctx0, wstate.embd_conv);
+    struct ggml_tensor * cur = ggml_view_2d(ctx0, wstate.embd_conv, n_state, n_ctx, wstate.embd_conv->nb[1], 0);
 
     const float KQscale = 1.0f/sqrtf(float(n_state_head));
 
@@ -2086,7 +3856,7 @@ static struct ggml_cgraph * whisper_build_graph_encoder(
     const size_t e_pe_offset = model.e_pe->ne[0]*ggml_element_size(model.e_pe)*n_ctx*iter;
 
     struct ggml_tensor * e_pe = ggml_view_2d(ctx0, model.e_pe, model.e_pe->ne[0], n_ctx, e_pe_stride, e_pe_offset);
-    cur = ggml_add(ctx0, e_pe, ggml_cont(ctx0, ggml_transpose(ctx0, cur)));
+    cur = ggml_add(ctx0, e_pe, cur);
 
     // ===================================================================
 
@@ -2248,9 +4018,7 @@ static struct ggml_cgraph * whisper_build_graph_encoder(
                 model.e_ln_b);
     }
 
-    ggml_build_forward_expand(gf, cur);
-
-    wstate.embd_enc = cur;
+    ggml_build_forward_expand(gf, ggml_cpy(ctx0, cur, ggml_view_2d(ctx0, wstate.embd_enc, n_state, n_ctx, wstate.embd_enc->nb[1], 0)));
 
     //ggml_graph_print(gf);
 
@@ -2272,7 +4040,7 @@ static struct ggml_cgraph * whisper_build_graph_encoder(
 static struct ggml_cgraph * whisper_build_graph_cross(
         whisper_context & wctx,
           whisper_state & wstate) {
-    const auto & model   = wctx.model;
+    const auto & model   = whisper_state_model(wctx, wstate);
     const auto & hparams = model.hparams;
 
     const int n_ctx   = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : hparams.n_audio_ctx;
@@ -2284,8 +4052,8 @@ static struct ggml_cgraph * whisper_build_graph_cross(
     const int n_ctx_pad = GGML_PAD(n_ctx, 256);
 
     struct ggml_init_params params = {
-        /*.mem_size   =*/ wstate.sched_cross.meta.size(),
-        /*.mem_buffer =*/ wstate.sched_cross.meta.data(),
+        /*.mem_size   =*/ wstate.sched.meta.size(),
+        /*.mem_buffer =*/ wstate.sched.meta.data(),
         /*.no_alloc   =*/ true,
     };
 
@@ -2293,7 +4061,7 @@ static struct ggml_cgraph * whisper_build_graph_cross(
 
     ggml_cgraph * gf = ggml_new_graph(ctx0);
 
-    struct ggml_tensor * cur = ggml_view_tensor(ctx0, wstate.embd_enc);
+    struct ggml_tensor * cur = ggml_view_2d(ctx0, wstate.embd_enc, n_state, n_ctx, wstate.embd_enc->nb[1], 0);
 
     const float  Kscale = pow(float(n_state_head), -0.25);
 
@@ -2318,11 +4086,12 @@ static struct ggml_cgraph * whisper_build_graph_cross(
         struct ggml_tensor * v;
 
         if (wctx.params.flash_attn) {
+            // the copies quantize K and V if the cache is quantized
             k = ggml_view_1d(ctx0, wstate.kv_cross.k, n_state*n_ctx,
-                    (ggml_element_size(wstate.kv_cross.k)*n_state)*(il*n_ctx_pad));
+                    ggml_row_size(wstate.kv_cross.k->type, n_state)*(il*n_ctx_pad));
 
             v = ggml_view_1d(ctx0, wstate.kv_cross.v, n_state*n_ctx,
-                    (ggml_element_size(wstate.kv_cross.v)*n_state)*(il*n_ctx_pad));
+                    ggml_row_size(wstate.kv_cross.v->type, n_state)*(il*n_ctx_pad));
         } else {
             Vcross = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, Vcross, n_state, n_ctx));
 
@@ -2345,6 +4114,13 @@ static struct ggml_cgraph * whisper_build_graph_cross(
     return gf;
 }
 
+// drop the cached decoder graph and release its allocation
+static void whisper_decoder_graph_reset(whisper_state & wstate) {
+    wstate.gf_decode = nullptr;
+
+    ggml_backend_sched_reset(wstate.sched.sched);
+}
+
 // evaluate the encoder with the given state
 //
 // given audio recording (more specifically, its log mel spectrogram), runs forward pass of the encoder
@@ -2364,11 +4140,18 @@ static bool whisper_encode_internal(
                    void * abort_callback_data) {
     const int64_t t_start_us = ggml_time_us();
 
+    whisper_threadpool_scope threadpool_scope(wstate.threadpool);
+
+    // the graphs below reuse the compute buffers of the decoder graph
+    whisper_decoder_graph_reset(wstate);
+
     // conv
     {
-        auto & sched = wstate.sched_conv.sched;
+        auto & sched = wstate.sched.sched;
 
-        ggml_cgraph * gf = whisper_build_graph_conv(wctx, wstate);
+        const bool mel_in_graph = !wstate.mel.pcm.empty();
+
+        ggml_cgraph * gf = whisper_build_graph_conv(wctx, wstate, mel_in_graph);
 
         if (!ggml_backend_sched_alloc_graph(sched, gf)) {
             // should never happen as we pre-allocate the memory
@@ -2376,9 +4159,31 @@ static bool whisper_encode_internal(
         }
 
         struct ggml_tensor * mel = ggml_graph_get_tensor(gf, "mel");
+        struct ggml_tensor * pcm = ggml_graph_get_tensor(gf, "pcm");
 
         // set the input
-        {
+        if (mel_in_graph) {
+            const auto & pcm_inp = wstate.mel.pcm;
+            const int n_ctx      = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : wctx.model.hparams.n_audio_ctx;
+
+            wstate.inp_pcm.resize(ggml_nelements(pcm));
+
+            float * dst = wstate.inp_pcm.data();
+            memset(dst, 0, ggml_nbytes(pcm));
+
+            // samples after the end of the audio are zero
+            const int64_t i0 = std::min<int64_t>((int64_t) mel_offset*WHISPER_HOP_LENGTH, pcm_inp.size());
+            const int64_t i1 = std::min<int64_t>(i0 + ggml_nelements(pcm),                pcm_inp.size());
+
+            std::copy(pcm_inp.begin() + i0, pcm_inp.begin() + i1, dst);
+
+            ggml_backend_tensor_set(pcm, wstate.inp_pcm.data(), 0, ggml_nbytes(pcm));
+
+            if (wstate.prompt_snapshots.size_max > 0) {
+                wstate.audio_hash = whisper_hash_fnv1a(WHISPER_HASH_SEED, &n_ctx, sizeof(n_ctx));
+                wstate.audio_hash = whisper_hash_fnv1a(wstate.audio_hash, wstate.inp_pcm.data(), ggml_nbytes(pcm));
+            }
+        } else {
             const auto & mel_inp = wstate.mel;
             const int n_ctx      = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : wctx.model.hparams.n_audio_ctx;
 
@@ -2400,10 +4205,15 @@ static bool whisper_encode_internal(
             }
 
             ggml_backend_tensor_set(mel, wstate.inp_mel.data(), 0, ggml_nelements(mel)*sizeof(float));
+
+            if (wstate.prompt_snapshots.size_max > 0) {
+                wstate.audio_hash = whisper_hash_fnv1a(WHISPER_HASH_SEED, &n_ctx, sizeof(n_ctx));
+                wstate.audio_hash = whisper_hash_fnv1a(wstate.audio_hash, wstate.inp_mel.data(), ggml_nbytes(mel));
+            }
         }
 
         if (!whisper_encode_external(wstate)) {
-            if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
+            if (!ggml_graph_compute_helper(sched, gf, n_threads, true, wstate.threadpool)) {
                 return false;
             }
         } else {
@@ -2419,7 +4229,7 @@ static bool whisper_encode_internal(
 
     // encoder
     if (!whisper_encode_external(wstate)) {
-        auto & sched = wstate.sched_encode.sched;
+        auto & sched = wstate.sched.sched;
 
         ggml_cgraph * gf = whisper_build_graph_encoder(wctx, wstate);
 
@@ -2428,14 +4238,14 @@ static bool whisper_encode_internal(
             return false;
         }
 
-        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
+        if (!ggml_graph_compute_helper(sched, gf, n_threads, true, wstate.threadpool)) {
             return false;
         }
     }
 
     // cross
     {
-        auto & sched = wstate.sched_cross.sched;
+        auto & sched = wstate.sched.sched;
 
         ggml_cgraph * gf = whisper_build_graph_cross(wctx, wstate);
 
@@ -2444,7 +4254,7 @@ static bool whisper_encode_internal(
             return false;
         }
 
-        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
+        if (!ggml_graph_compute_helper(sched, gf, n_threads, true, wstate.threadpool)) {
             return false;
         }
     }
@@ -2461,7 +4271,7 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
      const whisper_batch & batch,
                     bool   save_alignment_heads_QKs,
                     bool   worst_case) {
-    const auto & model   = wctx.model;
+    const auto & model   = whisper_state_model(wctx, wstate);
     const auto & hparams = model.hparams;
 
     auto & kv_self = wstate.kv_self;
@@ -2480,14 +4290,16 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
 
     const int n_audio_ctx_pad = GGML_PAD(n_audio_ctx, 256);
 
-    const int32_t n_kv    = worst_case ? n_ctx            : kv_self.n;
-    const int32_t kv_head = worst_case ? n_ctx - n_tokens : kv_self.head;
+    const int32_t n_kv = worst_case ? n_ctx : kv_self.n;
+
+    // number of tokens for which we compute logits
+    const int32_t n_outputs = worst_case ? std::min(n_tokens, WHISPER_MAX_DECODERS) : wstate.n_outputs;
 
     //WHISPER_LOG_DEBUG("%s: n_past = %d, n_tokens = %d, n_audio_ctx = %d, n_ctx = %d\n", __func__, n_past, n_tokens, n_audio_ctx, n_ctx);
 
     struct ggml_init_params params = {
-        /*.mem_size   =*/ wstate.sched_decode.meta.size(),
-        /*.mem_buffer =*/ wstate.sched_decode.meta.data(),
+        /*.mem_size   =*/ wstate.sched.meta.size(),
+        /*.mem_buffer =*/ wstate.sched.meta.data(),
         /*.no_alloc   =*/ true,
     };
 
@@ -2511,6 +4323,24 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
 
     struct ggml_tensor * KQ_mask_f16 = ggml_cast(ctx0, KQ_mask, GGML_TYPE_F16);
 
+    struct ggml_tensor * out_ids = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, n_outputs);
+    ggml_set_name(out_ids, "out_ids");
+    ggml_set_input(out_ids);
+
+    // the KV cells into which the new tokens are stored
+    // passed as inputs instead of view offsets so that the graph does not depend on the position of the slot
+    struct ggml_tensor * kv_idxs = ggml_new_tensor_1d(ctx0, GGML_TYPE_I64, n_tokens);
+    ggml_set_name(kv_idxs, "kv_idxs");
+    ggml_set_input(kv_idxs);
+
+    // V is stored transposed without flash attention - one index per element
+    struct ggml_tensor * kv_idxs_v = nullptr;
+    if (!wctx.params.flash_attn) {
+        kv_idxs_v = ggml_new_tensor_1d(ctx0, GGML_TYPE_I64, n_tokens*n_state);
+        ggml_set_name(kv_idxs_v, "kv_idxs_v");
+        ggml_set_input(kv_idxs_v);
+    }
+
     // token encoding + position encoding
     struct ggml_tensor * cur =
         ggml_add(ctx0,
@@ -2566,28 +4396,28 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
                             Vcur,
                             layer.attn_v_b);
 
-                struct ggml_tensor * k;
-                struct ggml_tensor * v;
+                struct ggml_tensor * k = ggml_view_2d(ctx0, kv_self.k, n_state, n_ctx,
+                        ggml_row_size(kv_self.k->type, n_state),
+                        ggml_row_size(kv_self.k->type, n_state)*n_ctx*il);
+
+                ggml_build_forward_expand(gf, ggml_set_rows(ctx0, k, Kcur, kv_idxs));
 
                 if (wctx.params.flash_attn) {
-                    k = ggml_view_1d(ctx0, kv_self.k, n_tokens*n_state,
-                            (ggml_element_size(kv_self.k)*n_state)*(il*n_ctx + kv_head));
+                    struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, n_state, n_ctx,
+                            ggml_row_size(kv_self.v->type, n_state),
+                            ggml_row_size(kv_self.v->type, n_state)*n_ctx*il);
 
-                    v = ggml_view_1d(ctx0, kv_self.v, n_tokens*n_state,
-                            (ggml_element_size(kv_self.v)*n_state)*(il*n_ctx + kv_head));
+                    ggml_build_forward_expand(gf, ggml_set_rows(ctx0, v, Vcur, kv_idxs));
                 } else {
-                    Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, Vcur, n_state, n_tokens));
+                    // store each element as a separate row at its transposed position
+                    struct ggml_tensor * v = ggml_view_2d(ctx0, kv_self.v, 1, n_ctx*n_state,
+                            ggml_element_size(kv_self.v),
+                            ggml_element_size(kv_self.v)*n_state*n_ctx*il);
 
-                    k = ggml_view_1d(ctx0, kv_self.k, n_tokens*n_state,
-                            (ggml_element_size(kv_self.k)*n_state)*(il*n_ctx + kv_head));
+                    Vcur = ggml_reshape_2d(ctx0, Vcur, 1, n_state*n_tokens);
 
-                    v = ggml_view_2d(ctx0, kv_self.v, n_tokens, n_state,
-                            (   n_ctx)*ggml_element_size(kv_self.v),
-                            (il*n_ctx)*ggml_element_size(kv_self.v)*n_state + kv_head*ggml_element_size(kv_self.v));
+                    ggml_build_forward_expand(gf, ggml_set_rows(ctx0, v, Vcur, kv_idxs_v));
                 }
-
-                ggml_build_forward_expand(gf, ggml_cpy(ctx0, Kcur, k));
-                ggml_build_forward_expand(gf, ggml_cpy(ctx0, Vcur, v));
             }
 
             // ------
@@ -2600,17 +4430,17 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
             struct ggml_tensor * K =
                 ggml_view_3d(ctx0, kv_self.k,
                         n_state_head, n_kv, n_head,
-                        ggml_element_size(kv_self.k)*n_state,
-                        ggml_element_size(kv_self.k)*n_state_head,
-                        ggml_element_size(kv_self.k)*n_state*n_ctx*il);
+                        ggml_row_size(kv_self.k->type, n_state),
+                        ggml_row_size(kv_self.k->type, n_state_head),
+                        ggml_row_size(kv_self.k->type, n_state)*n_ctx*il);
 
             if (wctx.params.flash_attn) {
                 struct ggml_tensor * V =
                     ggml_view_3d(ctx0, kv_self.v,
                             n_state_head, n_kv, n_head,
-                            ggml_element_size(kv_self.v)*n_state,
-                            ggml_element_size(kv_self.v)*n_state_head,
-                            ggml_element_size(kv_self.v)*n_state*n_ctx*il);
+                            ggml_row_size(kv_self.v->type, n_state),
+                            ggml_row_size(kv_self.v->type, n_state_head),
+                            ggml_row_size(kv_self.v->type, n_state)*n_ctx*il);
 
                 cur = ggml_flash_attn_ext(ctx0, Q, K, V, KQ_mask_f16, 1.0f, 0.0f, 0.0f);
 
@@ -2681,16 +4511,16 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
                 struct ggml_tensor * Kcross =
                     ggml_view_3d(ctx0, wstate.kv_cross.k,
                             n_state_head, n_audio_ctx_pad, n_head,
-                            ggml_element_size(wstate.kv_cross.k)*n_state,
-                            ggml_element_size(wstate.kv_cross.k)*n_state_head,
-                            ggml_element_size(wstate.kv_cross.k)*n_state*n_audio_ctx_pad*il);
+                            ggml_row_size(wstate.kv_cross.k->type, n_state),
+                            ggml_row_size(wstate.kv_cross.k->type, n_state_head),
+                            ggml_row_size(wstate.kv_cross.k->type, n_state)*n_audio_ctx_pad*il);
 
                 struct ggml_tensor * Vcross =
                     ggml_view_3d(ctx0, wstate.kv_cross.v,
                             n_state_head, n_audio_ctx_pad, n_head,
-                            ggml_element_size(wstate.kv_cross.v)*n_state,
-                            ggml_element_size(wstate.kv_cross.v)*n_state_head,
-                            ggml_element_size(wstate.kv_cross.v)*n_state*n_audio_ctx_pad*il);
+                            ggml_row_size(wstate.kv_cross.v->type, n_state),
+                            ggml_row_size(wstate.kv_cross.v->type, n_state_head),
+                            ggml_row_size(wstate.kv_cross.v->type, n_state)*n_audio_ctx_pad*il);
 
                 cur = ggml_flash_attn_ext(ctx0, Q, Kcross, Vcross, nullptr, KQscale, 0.0f, 0.0f);
 
@@ -2811,10 +4641,10 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
                 model.d_ln_b);
     }
 
-    // compute logits only for the last token
-    // comment this line to compute logits for all n_tokens
-    // might be useful in the future
-    //cur = ggml_view_2d(ctx0, cur, cur->ne[0], 1, cur->nb[1], (cur->ne[1] - 1)*cur->nb[1]);
+    // compute logits only for the tokens that requested them (batch.logits[i] != 0)
+    if (n_outputs != n_tokens) {
+        cur = ggml_get_rows(ctx0, cur, out_ids);
+    }
 
     struct ggml_tensor * logits = ggml_mul_mat(ctx0, model.d_te, cur);
 
@@ -2855,6 +4685,8 @@ static bool whisper_decode_internal(
                    void * abort_callback_data) {
     const int64_t t_start_us = ggml_time_us();
 
+    whisper_threadpool_scope threadpool_scope(wstate.threadpool);
+
     const auto & model   = wctx.model;
     const auto & hparams = model.hparams;
 
@@ -2880,15 +4712,57 @@ static bool whisper_decode_internal(
         //printf("n_tokens = %5d, kv_self.head = %5d, kv_self.n = %5d, seq_id = %5d\n", batch.n_tokens, kv_self.head, kv_self.n, batch.seq_id[0][0]);
     }
 
+    // map the tokens that requested logits to consecutive output rows
+    {
+        wstate.output_ids.resize(n_tokens);
+        wstate.inp_out_ids.clear();
+
+        for (int i = 0; i < n_tokens; ++i) {
+            if (batch.logits[i] != 0) {
+                wstate.output_ids[i] = wstate.inp_out_ids.size();
+                wstate.inp_out_ids.push_back(i);
+            } else {
+                wstate.output_ids[i] = -1;
+            }
+        }
+
+        wstate.n_outputs = wstate.inp_out_ids.size();
+    }
+
+    const int n_outputs = wstate.n_outputs;
+
     // decoder
     {
-        auto & sched = wstate.sched_decode.sched;
+        auto & sched = wstate.sched.sched;
 
-        ggml_cgraph * gf = whisper_build_graph_decoder(wctx, wstate, batch, save_alignment_heads_QKs, false);
+        whisper_decoder_graph_params gparams;
 
-        if (!ggml_backend_sched_alloc_graph(sched, gf)) {
-            // should never happen as we pre-allocate the memory
-            return false;
+        gparams.n_tokens    = n_tokens;
+        gparams.n_outputs   = n_outputs;
+        gparams.n_kv        = wstate.kv_self.n;
+        gparams.n_audio_ctx = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : hparams.n_audio_ctx;
+        gparams.flash_attn  = wctx.params.flash_attn;
+        gparams.save_alignment_heads_QKs = save_alignment_heads_QKs;
+
+        ggml_cgraph * gf = nullptr;
+
+        if (wstate.gf_decode && wstate.gf_decode_params == gparams) {
+            // the previous graph is still allocated - only the inputs need to be updated
+            gf = wstate.gf_decode;
+
+            wstate.n_reuse++;
+        } else {
+            whisper_decoder_graph_reset(wstate);
+
+            gf = whisper_build_graph_decoder(wctx, wstate, batch, save_alignment_heads_QKs, false);
+
+            if (!ggml_backend_sched_alloc_graph(sched, gf)) {
+                // should never happen as we pre-allocate the memory
+                return false;
+            }
+
+            wstate.gf_decode        = gf;
+            wstate.gf_decode_params = gparams;
         }
 
         // set the inputs
@@ -2899,9 +4773,33 @@ static bool whisper_decode_internal(
 
         {
             struct ggml_tensor * position = ggml_graph_get_tensor(gf, "position");
+            ggml_backend_tensor_set(position, batch.pos, 0, n_tokens*ggml_element_size(position));
+        }
+
+        {
+            auto & kv_self = wstate.kv_self;
+
+            const int n_ctx   = kv_self.size;
+            const int n_state = hparams.n_text_state;
+
+            wstate.inp_kv_idxs.resize(n_tokens);
             for (int i = 0; i < n_tokens; ++i) {
-                const int32_t val = batch.pos[i];
-                ggml_backend_tensor_set(position, &val, i*sizeof(int32_t), sizeof(int32_t));
+                wstate.inp_kv_idxs[i] = kv_self.slots[i];
+            }
+
+            struct ggml_tensor * kv_idxs = ggml_graph_get_tensor(gf, "kv_idxs");
+            ggml_backend_tensor_set(kv_idxs, wstate.inp_kv_idxs.data(), 0, n_tokens*sizeof(int64_t));
+
+            if (!wctx.params.flash_attn) {
+                wstate.inp_kv_idxs_v.resize(n_tokens*n_state);
+                for (int i = 0; i < n_tokens; ++i) {
+                    for (int j = 0; j < n_state; ++j) {
+                        wstate.inp_kv_idxs_v[i*n_state + j] = j*n_ctx + wstate.inp_kv_idxs[i];
+                    }
+                }
+
+                struct ggml_tensor * kv_idxs_v = ggml_graph_get_tensor(gf, "kv_idxs_v");
+                ggml_backend_tensor_set(kv_idxs_v, wstate.inp_kv_idxs_v.data(), 0, n_tokens*n_state*sizeof(int64_t));
             }
         }
 
@@ -2939,20 +4837,25 @@ static bool whisper_decode_internal(
             ggml_backend_tensor_set(KQ_mask, wstate.inp_mask.data(), 0, ggml_nelements(KQ_mask)*sizeof(float));
         }
 
+        {
+            // not part of the graph when all tokens request logits
+            struct ggml_tensor * out_ids = ggml_graph_get_tensor(gf, "out_ids");
+            if (out_ids) {
+                ggml_backend_tensor_set(out_ids, wstate.inp_out_ids.data(), 0, n_outputs*sizeof(int32_t));
+            }
+        }
+
         logits = ggml_graph_node(gf, -1);
 
-        if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
+        // keep the allocation so that the graph can be reused by the next call
+        if (!ggml_graph_compute_helper(sched, gf, n_threads, false, wstate.threadpool)) {
+            wstate.gf_decode = nullptr;
             return false;
         }
     }
 
-    logits_out.resize(n_tokens*n_vocab);
-    for (int i = 0; i < n_tokens; i++) {
-        if (batch.logits[i] == 0) {
-            continue;
-        }
-        ggml_backend_tensor_get(logits, logits_out.data() + (n_vocab*i), sizeof(float)*(n_vocab*i), sizeof(float)*n_vocab);
-    }
+    logits_out.resize(n_outputs*n_vocab);
+    ggml_backend_tensor_get(logits, logits_out.data(), 0, sizeof(float)*n_outputs*n_vocab);
 
     if (batch.n_tokens > 1) {
         //printf("%s: used_mem = %f MB, %f MB, %f MB %f MB %f MB\n", __func__,
@@ -2994,13 +4897,10 @@ static std::string to_timestamp(int64_t t, bool comma = false) {
     return std::string(buf);
 }
 
-#define SIN_COS_N_COUNT WHISPER_N_FFT
 namespace {
 struct whisper_global_cache {
-    // In FFT, we frequently use sine and cosine operations with the same values.
-    // We can use precalculated values to speed up the process.
-    float sin_vals[SIN_COS_N_COUNT];
-    float cos_vals[SIN_COS_N_COUNT];
+    // FFT plan for WHISPER_N_FFT with precalculated twiddles
+    whisper_fft_plan fft_plan;
 
     // Hann window (Use cosf to eliminate difference)
     // ref: https://pytorch.org/docs/stable/generated/torch.hann_window.html
@@ -3008,18 +4908,10 @@ struct whisper_global_cache {
     float hann_window[WHISPER_N_FFT];
 
     whisper_global_cache() {
-        fill_sin_cos_table();
+        fft_plan.init(WHISPER_N_FFT);
         fill_hann_window(sizeof(hann_window)/sizeof(hann_window[0]), true, hann_window);
     }
 
-    void fill_sin_cos_table() {
-        for (int i = 0; i < SIN_COS_N_COUNT; i++) {
-            double theta = (2 * M_PI * i) / SIN_COS_N_COUNT;
-            sin_vals[i] = sinf(theta);
-            cos_vals[i] = cosf(theta);
-        }
-    }
-
     void fill_hann_window(int length, bool periodic, float * output) {
         int offset = -1;
         if (periodic) {
@@ -3032,138 +4924,109 @@ struct whisper_global_cache {
 } global_cache;
 }
 
-// naive Discrete Fourier Transform
-// input is real-valued
-// output is complex-valued
-static void dft(const float* in, int N, float* out) {
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
+// log mel values of a single frame
+// samples points to the start of the frame and holds n_avail valid samples - the rest of the frame is zero
+// the values are written to out[j*out_stride] and the maximum is returned
+static float log_mel_spectrogram_frame(const whisper_filters & filters, const float * hann, const float * samples, int n_avail,
+                                       float * fft_in, float * fft_out, float * fft_work, float * out, int out_stride) {
+    const whisper_fft_plan & plan = global_cache.fft_plan;
 
-    for (int k = 0; k < N; k++) {
-        float re = 0;
-        float im = 0;
+    const int frame_size = plan.n;
+    const int n_fft      = filters.n_fft;
 
-        for (int n = 0; n < N; n++) {
-            int idx = (k * n * sin_cos_step) % (SIN_COS_N_COUNT); // t = 2*M_PI*k*n/N
-            re += in[n]*global_cache.cos_vals[idx]; // cos(t)
-            im -= in[n]*global_cache.sin_vals[idx]; // sin(t)
-        }
+    // make sure n_fft == 1 + (WHISPER_N_FFT / 2), bin_0 to bin_nyquist
+    assert(n_fft == 1 + (frame_size / 2));
 
-        out[k*2 + 0] = re;
-        out[k*2 + 1] = im;
-    }
-}
+    const int n_copy = std::min(frame_size, n_avail);
 
-// Cooley-Tukey FFT
-// poor man's implementation - use something better
-// input is real-valued
-// output is complex-valued
-static void fft(float* in, int N, float* out) {
-    if (N == 1) {
-        out[0] = in[0];
-        out[1] = 0;
-        return;
+    // apply Hann window (~10% faster)
+    for (int j = 0; j < n_copy; j++) {
+        fft_in[j] = hann[j] * samples[j];
     }
 
-    const int half_N = N / 2;
-    if (N - half_N*2 == 1) {
-        dft(in, N, out);
-        return;
+    // fill the rest with zeros
+    for (int j = n_copy; j < frame_size; j++) {
+        fft_in[j] = 0.0f;
     }
 
-    float* even = in + N;
-    for (int i = 0; i < half_N; ++i) {
-        even[i]= in[2*i];
-    }
-    float* even_fft = out + 2 * N;
-    fft(even, half_N, even_fft);
+    // FFT
+    whisper_fft(plan, fft_in, fft_out, fft_work);
 
-    float* odd = even;
-    for (int i = 0; i < half_N; ++i) {
-        odd[i] = in[2*i + 1];
+    // Calculate modulus^2 of complex numbers
+    // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
+    for (int j = 0; j < n_fft; j++) {
+        fft_out[j] = (fft_out[2 * j + 0] * fft_out[2 * j + 0] + fft_out[2 * j + 1] * fft_out[2 * j + 1]);
     }
-    float* odd_fft = even_fft + N;
-    fft(odd, half_N, odd_fft);
 
-    const int sin_cos_step = SIN_COS_N_COUNT / N;
-    for (int k = 0; k < half_N; k++) {
-        int idx = k * sin_cos_step; // t = 2*M_PI*k/N
-        float re = global_cache.cos_vals[idx]; // cos(t)
-        float im = -global_cache.sin_vals[idx]; // sin(t)
+    float vmax = -1e20f;
+
+    // mel spectrogram - only the non-zero band of each filter
+    for (int j = 0; j < filters.n_mel; j++) {
+        const float * x = fft_out + filters.band_start[j];
+        const float * w = filters.band_data.data() + filters.band_offs[j];
+
+        const int n = filters.band_len[j];
 
-        float re_odd = odd_fft[2*k + 0];
-        float im_odd = odd_fft[2*k + 1];
+        // independent accumulators so that the compiler can keep them in vector registers
+        float acc[8] = { 0.0f };
 
-        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
-        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
+        int k = 0;
+        for (; k + 8 <= n; k += 8) {
+            for (int l = 0; l < 8; l++) {
+                acc[l] += x[k + l]*w[k + l];
+            }
+        }
+        for (; k < n; k++) {
+            acc[0] += x[k]*w[k];
+        }
+
+        const float sum = ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
 
-        out[2*(k + half_N) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
-        out[2*(k + half_N) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
+        const float val = log10f(std::max(sum, 1e-10f));
+        out[j*out_stride] = val;
+
+        vmax = std::max(vmax, val);
     }
+
+    return vmax;
 }
 
 static void log_mel_spectrogram_worker_thread(int ith, const float * hann, const std::vector<float> & samples,
                                               int n_samples, int frame_size, int frame_step, int n_threads,
-                                              const whisper_filters & filters, whisper_mel & mel) {
-    std::vector<float> fft_in(frame_size * 2, 0.0);
-    std::vector<float> fft_out(frame_size * 2 * 2 * 2);
+                                              const whisper_filters & filters, whisper_mel & mel, float * mmax) {
+    const whisper_fft_plan & plan = global_cache.fft_plan;
+
+    std::vector<float> fft_in(frame_size, 0.0);
+    std::vector<float> fft_out(frame_size + 2);
+    std::vector<float> fft_work(4*plan.m);
 
-    int n_fft = filters.n_fft;
     int i = ith;
 
-    // make sure n_fft == 1 + (WHISPER_N_FFT / 2), bin_0 to bin_nyquist
-    assert(n_fft == 1 + (frame_size / 2));
+    assert(plan.n == frame_size);
+    assert(mel.n_mel == filters.n_mel);
+
+    float vmax = -1e20f;
 
     // calculate FFT only when fft_in are not all zero
     for (; i < std::min(n_samples / frame_step + 1, mel.n_len); i += n_threads) {
         const int offset = i * frame_step;
 
-        // apply Hann window (~10% faster)
-        for (int j = 0; j < std::min(frame_size, n_samples - offset); j++) {
-            fft_in[j] = hann[j] * samples[offset + j];
-        }
-
-        // fill the rest with zeros
-        if (n_samples - offset < frame_size) {
-            std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
-        }
-
-        // FFT
-        fft(fft_in.data(), frame_size, fft_out.data());
-
-        // Calculate modulus^2 of complex numbers
-        // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
-        for (int j = 0; j < n_fft; j++) {
-            fft_out[j] = (fft_out[2 * j + 0] * fft_out[2 * j + 0] + fft_out[2 * j + 1] * fft_out[2 * j + 1]);
-        }
+        const float val = log_mel_spectrogram_frame(filters, hann, samples.data() + offset, n_samples - offset,
+                fft_in.data(), fft_out.data(), fft_work.data(), mel.data.data() + i, mel.n_len);
 
-        // mel spectrogram
-        for (int j = 0; j < mel.n_mel; j++) {
-            double sum = 0.0;
-            // unroll loop (suggested by GH user @lunixbochs)
-            int k = 0;
-            for (k = 0; k < n_fft - 3; k += 4) {
-                sum +=
-                        fft_out[k + 0] * filters.data[j * n_fft + k + 0] +
-                        fft_out[k + 1] * filters.data[j * n_fft + k + 1] +
-                        fft_out[k + 2] * filters.data[j * n_fft + k + 2] +
-                        fft_out[k + 3] * filters.data[j * n_fft + k + 3];
-            }
-            // handle n_fft remainder
-            for (; k < n_fft; k++) {
-                sum += fft_out[k] * filters.data[j * n_fft + k];
-            }
-            sum = log10(std::max(sum, 1e-10));
-            mel.data[j * mel.n_len + i] = sum;
-        }
+        vmax = std::max(vmax, val);
     }
 
     // Otherwise fft_out are all zero
-    double sum = log10(1e-10);
+    const float sum = log10f(1e-10f);
     for (; i < mel.n_len; i += n_threads) {
         for (int j = 0; j < mel.n_mel; j++) {
             mel.data[j * mel.n_len + i] = sum;
         }
+        vmax = std::max(vmax, sum);
     }
+
+    *mmax = vmax;
 }
 
 // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L110-L157
@@ -3200,6 +5063,8 @@ static bool log_mel_spectrogram(
     // reflective pad 200 samples at the beginning of audio
     std::reverse_copy(samples + 1, samples + 1 + stage_2_pad, samples_padded.begin());
 
+    mel.pcm.clear();
+
     mel.n_mel     = n_mel;
     // https://github.com/pytorch/pytorch/blob/main/aten/src/ATen/native/SpectralOps.cpp#L936
     // Calculate number of frames + remove the last frame
@@ -3208,17 +5073,20 @@ static bool log_mel_spectrogram(
     mel.n_len_org = 1 + (n_samples + stage_2_pad - frame_size) / frame_step;
     mel.data.resize(mel.n_mel * mel.n_len);
 
+    // per-thread maximum of the log mel values
+    std::vector<float> mmax_thread(n_threads, -1e20f);
+
     {
         std::vector<std::thread> workers(n_threads - 1);
         for (int iw = 0; iw < n_threads - 1; ++iw) {
             workers[iw] = std::thread(
                     log_mel_spectrogram_worker_thread, iw + 1, hann, std::cref(samples_padded),
                     n_samples + stage_2_pad, frame_size, frame_step, n_threads,
-                    std::cref(filters), std::ref(mel));
+                    std::cref(filters), std::ref(mel), &mmax_thread[iw + 1]);
         }
 
         // main thread
-        log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel);
+        log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel, &mmax_thread[0]);
 
         for (int iw = 0; iw < n_threads - 1; ++iw) {
             workers[iw].join();
@@ -3226,21 +5094,14 @@ static bool log_mel_spectrogram(
     }
 
     // clamping and normalization
-    double mmax = -1e20;
-    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
-        if (mel.data[i] > mmax) {
-            mmax = mel.data[i];
-        }
-    }
-
-    mmax -= 8.0;
+    // the maximum is tracked by the workers, so this is a single pass over the data
+    {
+        const float mmax = *std::max_element(mmax_thread.begin(), mmax_thread.end()) - 8.0f;
 
-    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
-        if (mel.data[i] < mmax) {
-            mel.data[i] = mmax;
+        float * data = mel.data.data();
+        for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
+            data[i] = (std::max(data[i], mmax) + 4.0f)*0.25f;
         }
-
-        mel.data[i] = (mel.data[i] + 4.0)/4.0;
     }
 
     wstate.t_mel_us += ggml_time_us() - t_start_us;
@@ -3259,61 +5120,463 @@ static bool log_mel_spectrogram(
     return true;
 }
 
-// split text into tokens
-//
-// ref: https://github.com/openai/gpt-2/blob/a74da5d99abaaba920de8131d64da2862a8f213b/src/encoder.py#L53
-//
-// Regex (Python):
-// r"""'s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+"""
-//
-// Regex (C++):
-// R"('s|'t|'re|'ve|'m|'ll|'d| ?[[:alpha:]]+| ?[[:digit:]]+| ?[^\s[:alpha:][:digit:]]+|\s+(?!\S)|\s+)"
-//
-static std::vector<whisper_vocab::id> tokenize(const whisper_vocab & vocab, const std::string & text) {
-    std::vector<std::string> words;
-
-    // first split the text into words
-    {
-        std::string str = text;
-        std::string pat = R"('s|'t|'re|'ve|'m|'ll|'d| ?[[:alpha:]]+| ?[[:digit:]]+| ?[^\s[:alpha:][:digit:]]+|\s+(?!\S)|\s+)";
-
-        std::regex re(pat);
-        std::smatch m;
-
-        while (std::regex_search(str, m, re)) {
-            for (auto x : m) {
-                words.push_back(x);
-            }
-            str = m.suffix();
+// [EXPERIMENTAL] keep the padded PCM for the mel inside the encoder graph
+// the frame counts are the same as log_mel_spectrogram(), the 30 seconds of padding at the end are implicit
+static void log_mel_spectrogram_pcm(
+              const float * samples,
+              const int   n_samples,
+              const int   frame_size,
+              const int   frame_step,
+              const int   n_mel,
+              whisper_mel & mel) {
+    const int stage_1_pad = WHISPER_SAMPLE_RATE * 30;
+    const int stage_2_pad = frame_size / 2;
+
+    mel.pcm.resize(n_samples + stage_2_pad);
+    std::copy(samples, samples + n_samples, mel.pcm.begin() + stage_2_pad);
+
+    // reflective pad 200 samples at the beginning of audio
+    std::reverse_copy(samples + 1, samples + 1 + stage_2_pad, mel.pcm.begin());
+
+    mel.n_mel     = n_mel;
+    mel.n_len     = (n_samples + stage_1_pad + 2*stage_2_pad - frame_size) / frame_step;
+    mel.n_len_org = 1 + (n_samples + stage_2_pad - frame_size) / frame_step;
+    mel.data.clear();
+}
+
+// append samples to a rolling spectrogram - only the frames whose Hann window is complete are computed,
+// the remaining samples are kept for the next call
+static void log_mel_spectrogram_append(
+        whisper_mel_stream & stream,
+        const float * samples,
+        const int   n_samples,
+        const int   frame_size,
+        const int   frame_step,
+        const whisper_filters & filters) {
+    WHISPER_ASSERT(frame_size == WHISPER_N_FFT && "Unsupported frame_size");
+    const float * hann = global_cache.hann_window;
+
+    const int stage_2_pad = frame_size / 2;
+
+    stream.pcm.insert(stream.pcm.end(), samples, samples + n_samples);
+
+    // reflective pad 200 samples at the beginning of the stream, same as log_mel_spectrogram()
+    if (!stream.started) {
+        if ((int) stream.pcm.size() <= stage_2_pad) {
+            return;
         }
+
+        std::vector<float> pad(stage_2_pad);
+        std::reverse_copy(stream.pcm.begin() + 1, stream.pcm.begin() + 1 + stage_2_pad, pad.begin());
+        stream.pcm.insert(stream.pcm.begin(), pad.begin(), pad.end());
+
+        stream.started = true;
     }
 
-    // find the longest tokens that form the words:
-    std::vector<whisper_vocab::id> tokens;
-    for (const auto & word : words) {
-        if (word.empty()) continue;
-
-        int i = 0;
-        int n = word.size();
-        while (i < n) {
-            int j = n;
-            bool found = false;
-            while (j > i) {
-                auto sub = word.substr(i, j-i);
-                auto it = vocab.token_to_id.find(sub);
-                if (it != vocab.token_to_id.end()) {
-                    tokens.push_back(it->second);
-                    i = j;
-                    found = true;
-                    break;
-                }
-                --j;
+    const int n_mel = filters.n_mel;
+    const int n_new = (int) stream.pcm.size() < frame_size ? 0 : 1 + ((int) stream.pcm.size() - frame_size) / frame_step;
+    if (n_new == 0) {
+        return;
+    }
+
+    std::vector<float> fft_in(frame_size, 0.0);
+    std::vector<float> fft_out(frame_size + 2);
+    std::vector<float> fft_work(2*frame_size);
+
+    const size_t n_frames = stream.frames_max.size();
+
+    stream.frames.resize((n_frames + n_new)*n_mel);
+    stream.frames_max.resize(n_frames + n_new);
+
+    for (int i = 0; i < n_new; ++i) {
+        stream.frames_max[n_frames + i] = log_mel_spectrogram_frame(filters, hann, stream.pcm.data() + i*frame_step, frame_size,
+                fft_in.data(), fft_out.data(), fft_work.data(), stream.frames.data() + (n_frames + i)*n_mel, 1);
+    }
+
+    stream.pcm.erase(stream.pcm.begin(), stream.pcm.begin() + n_new*frame_step);
+}
+
+// normalize the frames of a rolling spectrogram into mel
+// clamping is relative to the maximum of the frames currently held, and 30 seconds of padding frames are added
+// at the end, so the result matches log_mel_spectrogram() over the same audio except for the last, incomplete frames
+static void log_mel_spectrogram_from_stream(const whisper_mel_stream & stream, const int n_mel, whisper_mel & mel) {
+    const int n_frames = stream.frames_max.size();
+
+    const float pad = log10f(1e-10f);
+
+    float mmax = pad;
+    for (int i = 0; i < n_frames; ++i) {
+        mmax = std::max(mmax, stream.frames_max[i]);
+    }
+    mmax -= 8.0f;
+
+    mel.n_mel     = n_mel;
+    mel.n_len     = n_frames + (WHISPER_SAMPLE_RATE * 30) / WHISPER_HOP_LENGTH;
+    mel.n_len_org = n_frames;
+    mel.data.resize(mel.n_mel * mel.n_len);
+    mel.pcm.clear();
+
+    for (int j = 0; j < n_mel; ++j) {
+        float * dst = mel.data.data() + j*mel.n_len;
+        for (int i = 0; i < n_frames; ++i) {
+            dst[i] = (std::max(stream.frames[i*n_mel + j], mmax) + 4.0f)*0.25f;
+        }
+        std::fill(dst + n_frames, dst + mel.n_len, (std::max(pad, mmax) + 4.0f)*0.25f);
+    }
+}
+
+static bool whisper_mel_graph_init(
+        const whisper_filters & filters,
+       struct whisper_mel_graph & mel_graph,
+                 ggml_backend_t   backend) {
+    const int n_frame = WHISPER_N_FFT;
+    const int n_fft   = filters.n_fft;
+    const int n_mel   = filters.n_mel;
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 3*ggml_tensor_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    mel_graph.ctx = ggml_init(params);
+    if (!mel_graph.ctx) {
+        WHISPER_LOG_ERROR("%s: failed to allocate memory for the mel graph context\n", __func__);
+        return false;
+    }
+
+    mel_graph.dft_cos = ggml_new_tensor_3d(mel_graph.ctx, GGML_TYPE_F32, n_frame, 1, n_fft);
+    mel_graph.dft_sin = ggml_new_tensor_3d(mel_graph.ctx, GGML_TYPE_F32, n_frame, 1, n_fft);
+    mel_graph.filters = ggml_new_tensor_2d(mel_graph.ctx, GGML_TYPE_F32, n_fft, n_mel);
+
+    mel_graph.buffer = ggml_backend_alloc_ctx_tensors(mel_graph.ctx, backend);
+    if (!mel_graph.buffer) {
+        WHISPER_LOG_ERROR("%s: failed to allocate memory for the mel graph\n", __func__);
+        return false;
+    }
+
+    // the Hann window is folded into the DFT basis
+    std::vector<float> dft_cos(n_frame*n_fft);
+    std::vector<float> dft_sin(n_frame*n_fft);
+
+    for (int k = 0; k < n_fft; ++k) {
+        for (int n = 0; n < n_frame; ++n) {
+            const double theta = (2*M_PI*((int64_t) k*n % n_frame))/n_frame;
+            dft_cos[k*n_frame + n] = global_cache.hann_window[n]*cos(theta);
+            dft_sin[k*n_frame + n] = global_cache.hann_window[n]*sin(theta);
+        }
+    }
+
+    ggml_backend_tensor_set(mel_graph.dft_cos, dft_cos.data(), 0, ggml_nbytes(mel_graph.dft_cos));
+    ggml_backend_tensor_set(mel_graph.dft_sin, dft_sin.data(), 0, ggml_nbytes(mel_graph.dft_sin));
+    ggml_backend_tensor_set(mel_graph.filters, filters.data.data(), 0, ggml_nbytes(mel_graph.filters));
+
+    return true;
+}
+
+static void whisper_mel_graph_free(struct whisper_mel_graph & mel_graph) {
+    ggml_free(mel_graph.ctx);
+    ggml_backend_buffer_free(mel_graph.buffer);
+    mel_graph.ctx    = nullptr;
+    mel_graph.buffer = nullptr;
+}
+
+// allocate the outputs of the conv and encoder graphs for the largest audio context
+static bool whisper_embd_init(
+          struct whisper_state & wstate,
+   const struct whisper_hparams & hparams,
+                  ggml_backend_t   backend) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 2*ggml_tensor_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    wstate.ctx_embd = ggml_init(params);
+    if (!wstate.ctx_embd) {
+        WHISPER_LOG_ERROR("%s: failed to allocate memory for the embd context\n", __func__);
+        return false;
+    }
+
+    wstate.embd_conv = ggml_new_tensor_2d(wstate.ctx_embd, GGML_TYPE_F32, hparams.n_audio_state, hparams.n_audio_ctx);
+    wstate.embd_enc  = ggml_new_tensor_2d(wstate.ctx_embd, GGML_TYPE_F32, hparams.n_audio_state, hparams.n_audio_ctx);
+
+    ggml_set_name(wstate.embd_conv, "embd_conv");
+    ggml_set_name(wstate.embd_enc,  "embd_enc");
+
+    wstate.buf_embd = ggml_backend_alloc_ctx_tensors(wstate.ctx_embd, backend);
+    if (!wstate.buf_embd) {
+        WHISPER_LOG_ERROR("%s: failed to allocate memory for the embd buffer\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+// the class of a codepoint for the pre-tokenizer
+enum whisper_pretok_class : uint8_t {
+    WHISPER_PRETOK_OTHER  = WHISPER_CPT_OTHER,
+    WHISPER_PRETOK_LETTER = WHISPER_CPT_LETTER,
+    WHISPER_PRETOK_NUMBER = WHISPER_CPT_NUMBER,
+    WHISPER_PRETOK_SPACE,
+};
+
+static whisper_pretok_class whisper_pretok_get_class(uint32_t cpt) {
+    // regex: \s
+    if ((cpt >= 0x09 && cpt <= 0x0D) || cpt == 0x20 || cpt == 0x85 || cpt == 0xA0 || cpt == 0x1680 ||
+        (cpt >= 0x2000 && cpt <= 0x200A) || cpt == 0x2028 || cpt == 0x2029 || cpt == 0x202F || cpt == 0x205F || cpt == 0x3000) {
+        return WHISPER_PRETOK_SPACE;
+    }
+
+    if (cpt < 0x80) {
+        if ((cpt >= 'a' && cpt <= 'z') || (cpt >= 'A' && cpt <= 'Z')) {
+            return WHISPER_PRETOK_LETTER;
+        }
+        if (cpt >= '0' && cpt <= '9') {
+            return WHISPER_PRETOK_NUMBER;
+        }
+        return WHISPER_PRETOK_OTHER;
+    }
+
+    const auto * end = WHISPER_CPT_RANGES + sizeof(WHISPER_CPT_RANGES)/sizeof(WHISPER_CPT_RANGES[0]);
+    const auto * it  = std::upper_bound(WHISPER_CPT_RANGES, end, cpt, [](uint32_t c, const whisper_cpt_range & r) { return c < r.start; });
+
+    return (whisper_pretok_class) (it - 1)->cls;
+}
+
+// decode the UTF-8 sequence at text[pos] and store its length in len
+// invalid bytes are decoded one at a time as U+FFFD
+static uint32_t whisper_utf8_decode(const std::string & text, size_t pos, size_t & len) {
+    const uint8_t c = text[pos];
+
+    len = 1;
+
+    int      n   = 0;
+    uint32_t cpt = 0;
+
+    if (c < 0x80) {
+        return c;
+    } else if ((c & 0xE0) == 0xC0) {
+        n = 1; cpt = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        n = 2; cpt = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        n = 3; cpt = c & 0x07;
+    } else {
+        return 0xFFFD;
+    }
+
+    if (pos + n >= text.size()) {
+        return 0xFFFD;
+    }
+
+    for (int i = 1; i <= n; ++i) {
+        const uint8_t cc = text[pos + i];
+        if ((cc & 0xC0) != 0x80) {
+            return 0xFFFD;
+        }
+        cpt = (cpt << 6) | (cc & 0x3F);
+    }
+
+    len = n + 1;
+
+    return cpt;
+}
+
+// split text into words, the byte offset of the end of every word is appended to ends
+//
+// ref: https://github.com/openai/gpt-2/blob/a74da5d99abaaba920de8131d64da2862a8f213b/src/encoder.py#L53
+//
+// Regex (Python):
+// r"""'s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+"""
+//
+static void whisper_pretokenize(const std::string & text, std::vector<size_t> & ends) {
+    std::vector<size_t>               offs; // byte offset of every codepoint
+    std::vector<whisper_pretok_class> cls;
+
+    offs.reserve(text.size() + 1);
+    cls .reserve(text.size());
+
+    for (size_t pos = 0; pos < text.size(); ) {
+        size_t len = 0;
+        const uint32_t cpt = whisper_utf8_decode(text, pos, len);
+
+        offs.push_back(pos);
+        cls .push_back(whisper_pretok_get_class(cpt));
+
+        pos += len;
+    }
+
+    offs.push_back(text.size());
+
+    const size_t n = cls.size();
+
+    // the codepoint at i if it is ASCII, 0 otherwise
+    auto ascii = [&](size_t i) -> char {
+        return i < n && offs[i + 1] - offs[i] == 1 ? text[offs[i]] : 0;
+    };
+
+    size_t i = 0;
+    while (i < n) {
+        const char c = ascii(i);
+
+        // regex: 's|'t|'re|'ve|'m|'ll|'d
+        if (c == '\'') {
+            const char c1 = ascii(i + 1);
+            const char c2 = ascii(i + 2);
+
+            if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') {
+                i += 2;
+                ends.push_back(offs[i]);
+                continue;
+            }
+            if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l')) {
+                i += 3;
+                ends.push_back(offs[i]);
+                continue;
             }
-            if (!found) {
-                WHISPER_LOG_ERROR("unknown token\n");
+        }
+
+        // regex: <space>?\p{L}+ | <space>?\p{N}+ | <space>?[^\s\p{L}\p{N}]+
+        const size_t j = c == ' ' && i + 1 < n && cls[i + 1] != WHISPER_PRETOK_SPACE ? i + 1 : i;
+        if (cls[j] != WHISPER_PRETOK_SPACE) {
+            i = j + 1;
+            while (i < n && cls[i] == cls[j]) {
                 ++i;
             }
+            ends.push_back(offs[i]);
+            continue;
+        }
+
+        // regex: \s+(?!\S) | \s+
+        size_t k = i + 1;
+        while (k < n && cls[k] == WHISPER_PRETOK_SPACE) {
+            ++k;
+        }
+        if (k - i > 1 && k < n) {
+            // the last space goes with the next word
+            --k;
+        }
+        i = k;
+        ends.push_back(offs[i]);
+    }
+}
+
+// byte-level BPE of a single word
+//
+// the vocab is a tiktoken vocab: the rank of a merge is the id of the merged token and only the ordinary tokens
+// (the ones before EOT) take part in the merges
+//
+// the ggml model files store the tokens as UTF-8 strings in which the incomplete sequences were replaced by U+FFFD,
+// so the single bytes >= 0x80 are usually not in the vocab. in that case the merges start from the whole codepoint
+//
+// ref: https://github.com/openai/tiktoken/blob/main/src/lib.rs (_byte_pair_merge)
+//
+static void whisper_bpe(const whisper_vocab & vocab, const char * word, size_t n, std::vector<whisper_vocab::id> & tokens, std::string & tmp) {
+    const whisper_vocab::id rank_none = INT32_MAX;
+
+    auto get_rank = [&](size_t beg, size_t end) {
+        tmp.assign(word + beg, end - beg);
+
+        const auto it = vocab.token_to_id.find(tmp);
+
+        return it != vocab.token_to_id.end() && it->second < vocab.token_eot ? it->second : rank_none;
+    };
+
+    // the whole word is a token
+    {
+        const whisper_vocab::id id = get_rank(0, n);
+        if (id != rank_none) {
+            tokens.push_back(id);
+            return;
+        }
+    }
+
+    struct part {
+        size_t            beg;
+        whisper_vocab::id rank; // of the merge of this part with the next one
+    };
+
+    std::vector<part> parts;
+    parts.reserve(n + 1);
+
+    for (size_t pos = 0; pos < n; ) {
+        size_t len = 1;
+        if ((uint8_t) word[pos] >= 0x80) {
+            while (pos + len < n && ((uint8_t) word[pos + len] & 0xC0) == 0x80) {
+                ++len;
+            }
+        }
+
+        // start from the single bytes of the codepoint only if all of them are tokens
+        bool bytes = true;
+        for (size_t i = 0; len > 1 && i < len && bytes; ++i) {
+            bytes = get_rank(pos + i, pos + i + 1) != rank_none;
+        }
+
+        for (size_t i = 0; i < (bytes ? len : 1); ++i) {
+            parts.push_back({ pos + i, rank_none });
+        }
+
+        pos += len;
+    }
+
+    parts.push_back({ n, rank_none });
+
+    for (size_t i = 0; i + 2 < parts.size(); ++i) {
+        parts[i].rank = get_rank(parts[i].beg, parts[i + 2].beg);
+    }
+
+    // rank of the merge of part i with the next one, given that parts[i + 1] is about to be removed
+    auto get_rank_merged = [&](size_t i) {
+        return i + 3 < parts.size() ? get_rank(parts[i].beg, parts[i + 3].beg) : rank_none;
+    };
+
+    while (parts.size() > 2) {
+        size_t i_min = 0;
+        for (size_t i = 1; i + 1 < parts.size(); ++i) {
+            if (parts[i].rank < parts[i_min].rank) {
+                i_min = i;
+            }
+        }
+
+        if (parts[i_min].rank == rank_none) {
+            break;
         }
+
+        parts[i_min].rank = get_rank_merged(i_min);
+        if (i_min > 0) {
+            parts[i_min - 1].rank = get_rank_merged(i_min - 1);
+        }
+
+        parts.erase(parts.begin() + i_min + 1);
+    }
+
+    for (size_t i = 0; i + 1 < parts.size(); ++i) {
+        const whisper_vocab::id id = get_rank(parts[i].beg, parts[i + 1].beg);
+        if (id == rank_none) {
+            WHISPER_LOG_ERROR("unknown token\n");
+            continue;
+        }
+
+        tokens.push_back(id);
+    }
+}
+
+// split text into tokens
+static std::vector<whisper_vocab::id> tokenize(const whisper_vocab & vocab, const std::string & text) {
+    std::vector<size_t> ends;
+    whisper_pretokenize(text, ends);
+
+    std::vector<whisper_vocab::id> tokens;
+    tokens.reserve(text.size());
+
+    std::string tmp;
+
+    size_t beg = 0;
+    for (const size_t end : ends) {
+        whisper_bpe(vocab, text.data() + beg, end - beg, tokens, tmp);
+        beg = end;
     }
 
     return tokens;
@@ -3371,9 +5634,16 @@ static std::string whisper_openvino_get_path_cache(std::string path_bin) {
 }
 #endif
 
-struct whisper_state * whisper_init_state(whisper_context * ctx) {
+// node: index of the NUMA replica used by the state (-1 - none)
+static struct whisper_state * whisper_init_state_impl(whisper_context * ctx, int node) {
+    // the buffers of the state are first touched on its node
+    whisper_numa_affinity_scope affinity(node >= 0 ? &ctx->numa_nodes[node] : nullptr);
+
     whisper_state * state = new whisper_state;
 
+    state->numa_node  = node;
+    state->threadpool = node >= 0 && !ctx->numa_threadpools.empty() ? ctx->numa_threadpools[node] : ctx->threadpool;
+
     state->backends = whisper_backend_init(ctx->params);
     if (state->backends.empty()) {
         WHISPER_LOG_ERROR("%s: whisper_backend_init() failed\n", __func__);
@@ -3381,10 +5651,16 @@ struct whisper_state * whisper_init_state(whisper_context * ctx) {
         return nullptr;
     }
 
+    if (!whisper_threadpool_attach(state->threadpool, state->backends)) {
+        WHISPER_LOG_ERROR("%s: whisper_threadpool_attach() failed\n", __func__);
+        whisper_free_state(state);
+        return nullptr;
+    }
+
     // at this point, we don't know yet how many decoders will be used
     // later during decoding, if more decoders are used, we will recreate the KV cache respectively
     state->kv_self_n_dec = 1;
-    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], ctx->itype,
+    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], ctx->ktype,
                 ctx->model.hparams.n_text_state,
                 ctx->model.hparams.n_text_layer,
                 GGML_PAD(ctx->model.hparams.n_text_ctx, 256))) {
@@ -3398,7 +5674,7 @@ struct whisper_state * whisper_init_state(whisper_context * ctx) {
         WHISPER_LOG_INFO("%s: kv self size  = %7.2f MB\n", __func__, memory_size / 1e6);
     }
 
-    if (!whisper_kv_cache_init(state->kv_cross, state->backends[0], ctx->itype,
+    if (!whisper_kv_cache_init(state->kv_cross, state->backends[0], ctx->ktype,
                 ctx->model.hparams.n_text_state,
                 ctx->model.hparams.n_text_layer,
                 GGML_PAD(ctx->model.hparams.n_audio_ctx, 256))) {
@@ -3455,7 +5731,19 @@ struct whisper_state * whisper_init_state(whisper_context * ctx) {
     }
 #endif
 
-    state->logits.reserve(ctx->vocab.n_vocab * ctx->model.hparams.n_text_ctx);
+    // [EXPERIMENTAL] mel inside the encoder graph - the external encoders need the mel on the host
+    if (ctx->params.mel_in_graph && !whisper_encode_external(*state)) {
+        if (!whisper_mel_graph_init(ctx->model.filters, state->mel_graph, state->backends[0])) {
+            WHISPER_LOG_ERROR("%s: whisper_mel_graph_init() failed for the mel graph\n", __func__);
+            whisper_free_state(state);
+            return nullptr;
+        }
+        WHISPER_LOG_INFO("%s: mel graph size = %7.2f MB\n", __func__, ggml_backend_buffer_get_size(state->mel_graph.buffer) / 1e6);
+    }
+
+    state->logits.reserve(ctx->vocab.n_vocab * WHISPER_MAX_DECODERS);
+
+    state->prompt_snapshots.size_max = ctx->params.fallback_snapshot_size;
 
     state->batch = whisper_batch_init(ctx->model.hparams.n_text_ctx, WHISPER_MAX_DECODERS);
 
@@ -3469,79 +5757,85 @@ struct whisper_state * whisper_init_state(whisper_context * ctx) {
 
     state->decoders[0].rng = std::mt19937(0);
 
-    // conv allocator
+    if (!whisper_embd_init(*state, ctx->model.hparams, state->backends[0])) {
+        WHISPER_LOG_ERROR("%s: whisper_embd_init() failed\n", __func__);
+        whisper_free_state(state);
+        return nullptr;
+    }
+
+    // compute allocator - shared by the conv, encoder, cross and decoder graphs
     {
-        bool ok = whisper_sched_graph_init(state->sched_conv, state->backends,
-                [&]() {
-                    return whisper_build_graph_conv(*ctx, *state);
-                });
+        struct graph_info {
+            const char * name;
+            std::function<struct ggml_cgraph *()> get_graph;
+        };
 
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init conv allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
+        std::vector<graph_info> graphs;
+
+        graphs.push_back({ "conv",   [&]() { return whisper_build_graph_conv(*ctx, *state, state->mel_graph.ctx != nullptr); } });
+
+        if (!whisper_encode_external(*state)) {
+            graphs.push_back({ "encode", [&]() { return whisper_build_graph_encoder(*ctx, *state); } });
         }
 
-        WHISPER_LOG_INFO("%s: compute buffer (conv)   = %7.2f MB\n", __func__, whisper_sched_size(state->sched_conv) / 1e6);
-    }
+        graphs.push_back({ "cross",  [&]() { return whisper_build_graph_cross(*ctx, *state); } });
+        graphs.push_back({ "decode", [&]() {
+            const auto & hparams = ctx->model.hparams;
 
-    // encoder allocator
-    if (!whisper_encode_external(*state)) {
-        bool ok = whisper_sched_graph_init(state->sched_encode, state->backends,
-                [&]() {
-                    return whisper_build_graph_encoder(*ctx, *state);
-                });
+            // TODO: make sure this is the worst-case scenario
+            const int n_tokens = hparams.n_text_ctx;
+            const int n_past   = 0;
 
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init encoder allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
-        }
+            whisper_batch_prep_legacy(state->batch, nullptr, n_tokens, n_past, 0);
 
-        WHISPER_LOG_INFO("%s: compute buffer (encode) = %7.2f MB\n", __func__, whisper_sched_size(state->sched_encode) / 1e6);
-    }
+            return whisper_build_graph_decoder(*ctx, *state, state->batch, ctx->params.dtw_token_timestamps, true);
+        } });
 
-    // cross allocator
-    {
-        bool ok = whisper_sched_graph_init(state->sched_cross, state->backends,
-                [&]() {
-                    return whisper_build_graph_cross(*ctx, *state);
-                });
+        size_t size_separate = 0;
 
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init cross allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
+        for (auto & graph : graphs) {
+            size_t size = 0;
+            if (!whisper_sched_graph_reserve(state->sched, state->backends, std::move(graph.get_graph), size)) {
+                WHISPER_LOG_ERROR("%s: failed to init the compute allocator for the %s graph\n", __func__, graph.name);
+                whisper_free_state(state);
+                return nullptr;
+            }
+
+            WHISPER_LOG_INFO("%s: compute buffer (%-6s) = %7.2f MB\n", __func__, graph.name, size / 1e6);
+
+            size_separate += size;
         }
 
-        WHISPER_LOG_INFO("%s: compute buffer (cross)  = %7.2f MB\n", __func__, whisper_sched_size(state->sched_cross) / 1e6);
-    }
+        const size_t size_shared = whisper_sched_size(state->sched) - state->sched.meta.size();
 
-    // decoder allocator
-    {
-        bool ok = whisper_sched_graph_init(state->sched_decode, state->backends,
-                [&]() {
-                    const auto & hparams = ctx->model.hparams;
+        WHISPER_LOG_INFO("%s: compute buffer (shared) = %7.2f MB (separate: %7.2f MB, saved %7.2f MB)\n", __func__,
+                size_shared / 1e6, size_separate / 1e6, (size_separate - size_shared) / 1e6);
+
+        WHISPER_LOG_INFO("%s: embd buffer             = %7.2f MB\n", __func__, ggml_backend_buffer_get_size(state->buf_embd) / 1e6);
+    }
 
-                    // TODO: make sure this is the worst-case scenario
-                    const int n_tokens = hparams.n_text_ctx;
-                    const int n_past   = 0;
+    return state;
+}
 
-                    whisper_batch_prep_legacy(state->batch, nullptr, n_tokens, n_past, 0);
+struct whisper_state * whisper_init_state(whisper_context * ctx) {
+    if (!ctx->numa_replicas.empty()) {
+        return whisper_init_state_impl(ctx, ctx->numa_next++ % ctx->numa_replicas.size());
+    }
 
-                    return whisper_build_graph_decoder(*ctx, *state, state->batch, ctx->params.dtw_token_timestamps, true);
-                });
+    return whisper_init_state_impl(ctx, -1);
+}
 
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init decoder allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
-        }
+int whisper_numa_n_nodes(struct whisper_context * ctx) {
+    return (int) ctx->numa_replicas.size();
+}
 
-        WHISPER_LOG_INFO("%s: compute buffer (decode) = %7.2f MB\n", __func__, whisper_sched_size(state->sched_decode) / 1e6);
+struct whisper_state * whisper_init_state_on_node(struct whisper_context * ctx, int node) {
+    if (node < 0 || node >= whisper_numa_n_nodes(ctx)) {
+        WHISPER_LOG_ERROR("%s: invalid NUMA node %d (the context has %d)\n", __func__, node, whisper_numa_n_nodes(ctx));
+        return nullptr;
     }
 
-    return state;
+    return whisper_init_state_impl(ctx, node);
 }
 
 int whisper_ctx_init_openvino_encoder_with_state(
@@ -3617,12 +5911,100 @@ struct whisper_context_params whisper_context_default_params() {
             /*.heads            =*/ NULL,
         },
         /*.dtw_mem_size         =*/ 1024*1024*128,
-    };
-    return result;
+
+        /*.fallback_snapshot_size =*/ 0,
+
+        /*.mel_in_graph         =*/ false,
+
+        /*.use_mmap             =*/ true,
+        /*.mmap_prefetch        =*/ false,
+
+        /*.type_kv              =*/ GGML_TYPE_F16,
+
+        /*.threadpool           =*/ nullptr,
+        /*.threadpool_params    =*/ nullptr,
+
+        /*.numa                 =*/ WHISPER_NUMA_DISABLED,
+    };
+    return result;
 }
 
+static struct whisper_context * whisper_init_with_params_no_state_impl(struct whisper_model_loader * loader, struct whisper_context_params params, whisper_mmap * mapping, const whisper_model_gguf * gguf);
+
 struct whisper_context * whisper_init_from_file_with_params_no_state(const char * path_model, struct whisper_context_params params) {
     WHISPER_LOG_INFO("%s: loading model from '%s'\n", __func__, path_model);
+
+    // GGUF: parse the metadata up front, the loader below only reads the tensor data
+    whisper_model_gguf gguf;
+    {
+        char magic[4] = { 0 };
+
+        FILE * f = ggml_fopen(path_model, "rb");
+        if (f) {
+            if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)) {
+                magic[0] = 0;
+            }
+            fclose(f);
+        }
+
+        if (memcmp(magic, GGUF_MAGIC, sizeof(magic)) == 0) {
+            gguf_init_params gparams = {
+                /*.no_alloc =*/ true,
+                /*.ctx      =*/ &gguf.meta,
+            };
+
+            gguf.gguf = gguf_init_from_file(path_model, gparams);
+            if (!gguf.gguf) {
+                WHISPER_LOG_ERROR("%s: failed to read the GGUF metadata of '%s'\n", __func__, path_model);
+                return nullptr;
+            }
+        }
+    }
+
+    const whisper_model_gguf * model_gguf = gguf.gguf ? &gguf : nullptr;
+
+    if (params.use_mmap) {
+        whisper_mmap * mapping = new whisper_mmap;
+
+        if (mapping->init(path_model, params.mmap_prefetch)) {
+            whisper_model_loader loader = {};
+
+            loader.context = mapping;
+
+            loader.read = [](void * ctx, void * output, size_t read_size) {
+                whisper_mmap * mm = (whisper_mmap *) ctx;
+
+                size_t size_to_copy = mm->offs + read_size < mm->size ? read_size : mm->size - mm->offs;
+
+                memcpy(output, (const uint8_t *) mm->addr + mm->offs, size_to_copy);
+                mm->offs += size_to_copy;
+
+                return size_to_copy;
+            };
+
+            loader.eof = [](void * ctx) {
+                whisper_mmap * mm = (whisper_mmap *) ctx;
+
+                return mm->offs >= mm->size;
+            };
+
+            loader.close = [](void * /*ctx*/) { };
+
+            // the context takes ownership of the mapping
+            auto ctx = whisper_init_with_params_no_state_impl(&loader, params, mapping, model_gguf);
+
+            if (ctx) {
+                ctx->path_model = path_model;
+            }
+
+            return ctx;
+        }
+
+        WHISPER_LOG_WARN("%s: failed to mmap '%s' - falling back to reading the file\n", __func__, path_model);
+
+        delete mapping;
+    }
+
 #ifdef _MSC_VER
     // Convert UTF-8 path to wide string (UTF-16) for Windows, resolving character encoding issues.
     std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
@@ -3656,7 +6038,7 @@ struct whisper_context * whisper_init_from_file_with_params_no_state(const char
         fin->close();
     };
 
-    auto ctx = whisper_init_with_params_no_state(&loader, params);
+    auto ctx = whisper_init_with_params_no_state_impl(&loader, params, nullptr, model_gguf);
 
     if (ctx) {
         ctx->path_model = path_model;
@@ -3703,6 +6085,144 @@ struct whisper_context * whisper_init_from_buffer_with_params_no_state(void * bu
 }
 
 struct whisper_context * whisper_init_with_params_no_state(struct whisper_model_loader * loader, struct whisper_context_params params) {
+    return whisper_init_with_params_no_state_impl(loader, params, nullptr, nullptr);
+}
+
+// GGML_NUMA_STRATEGY_DISTRIBUTE of the CPU backend
+typedef void (*whisper_cpu_numa_init_t)(int strategy);
+
+static bool whisper_numa_init(whisper_context & ctx) {
+    const auto & params = ctx.params;
+
+    if (params.numa == WHISPER_NUMA_DISABLED) {
+        return true;
+    }
+
+    ctx.numa_nodes = whisper_numa_get_nodes();
+    if (ctx.numa_nodes.empty()) {
+        WHISPER_LOG_WARN("%s: no NUMA nodes found - ignoring the NUMA mode\n", __func__);
+        return true;
+    }
+
+    // the buffer that wraps the mapped model file
+    auto is_mapped = [&ctx](ggml_backend_buffer_t buf) {
+        return ctx.model.mapping && ggml_backend_buffer_get_base(buf) == ctx.model.mapping->addr;
+    };
+
+    if (params.numa == WHISPER_NUMA_DISTRIBUTE) {
+        // the CPU backend spreads its threads over the nodes - it can only be initialized once per process
+        static std::once_flag once;
+        std::call_once(once, []() {
+            auto fn_numa_init = (whisper_cpu_numa_init_t) whisper_cpu_get_proc_address("ggml_backend_cpu_numa_init");
+            if (fn_numa_init) {
+                fn_numa_init(1);
+            }
+        });
+
+        // the mapped weights stay in the page cache shared with other processes
+        size_t size_interleaved = 0;
+        for (ggml_backend_buffer_t buf : ctx.model.buffers) {
+            if (ggml_backend_buffer_is_host(buf) && !is_mapped(buf) &&
+                whisper_numa_move(ggml_backend_buffer_get_base(buf), ggml_backend_buffer_get_size(buf), ctx.numa_nodes, true)) {
+                size_interleaved += ggml_backend_buffer_get_size(buf);
+            }
+        }
+
+        WHISPER_LOG_INFO("%s: numa = distribute, %zu nodes, %.2f MB of weights interleaved\n", __func__,
+                ctx.numa_nodes.size(), size_interleaved/1e6);
+
+        return true;
+    }
+
+    // WHISPER_NUMA_REPLICATE
+    // the first node uses the weights of the context (moved to the node, unless mapped) and the other nodes a copy,
+    // allocated and filled by a thread on the node
+    const int n_nodes = (int) ctx.numa_nodes.size();
+
+    for (ggml_backend_buffer_t buf : ctx.model.buffers) {
+        if (ggml_backend_buffer_is_host(buf) && !is_mapped(buf)) {
+            whisper_numa_move(ggml_backend_buffer_get_base(buf), ggml_backend_buffer_get_size(buf), ctx.numa_nodes, false);
+        }
+    }
+
+    size_t size_model = 0;
+    for (const auto & it : ctx.model.tensors) {
+        if (it.second->buffer && ggml_backend_buffer_is_host(it.second->buffer)) {
+            size_model += ggml_nbytes(it.second);
+        }
+    }
+
+    ctx.numa_replicas.resize(n_nodes);
+    ctx.numa_replicas[0].node = ctx.numa_nodes[0].id;
+
+    std::vector<char>        ok(n_nodes, 1);
+    std::vector<std::thread> workers;
+
+    for (int i = 1; i < n_nodes; ++i) {
+        workers.emplace_back([&ctx, &ok, i]() {
+            whisper_numa_affinity_scope affinity(&ctx.numa_nodes[i]);
+
+            ctx.numa_replicas[i].node = ctx.numa_nodes[i].id;
+            ok[i] = whisper_model_replicate(ctx.model, ctx.numa_replicas[i]);
+        });
+    }
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    size_t size_replicas = 0;
+    for (int i = 0; i < n_nodes; ++i) {
+        if (!ok[i]) {
+            WHISPER_LOG_ERROR("%s: failed to replicate the weights on node %d\n", __func__, ctx.numa_nodes[i].id);
+            return false;
+        }
+        if (ctx.numa_replicas[i].buffer) {
+            size_replicas += ggml_backend_buffer_get_size(ctx.numa_replicas[i].buffer);
+        }
+    }
+
+    // one set of host weights per node
+    WHISPER_LOG_INFO("%s: numa = replicate, %d nodes, %.2f MB of host weights per node, %.2f MB in total\n", __func__, n_nodes,
+            size_model/1e6, (size_model + size_replicas)/1e6);
+
+    if (params.threadpool) {
+        WHISPER_LOG_WARN("%s: the states use the threadpool of the caller - its threads are not bound to the nodes\n", __func__);
+        return true;
+    }
+
+    // a threadpool on the CPUs of each node
+    for (int i = 0; i < n_nodes; ++i) {
+        const auto & node = ctx.numa_nodes[i];
+
+        struct ggml_threadpool_params tpp = params.threadpool_params ? *params.threadpool_params : ggml_threadpool_params_default((int) node.cpus.size());
+
+        std::fill(tpp.cpumask, tpp.cpumask + GGML_MAX_N_THREADS, false);
+        for (int cpu : node.cpus) {
+            if (cpu < GGML_MAX_N_THREADS) {
+                tpp.cpumask[cpu] = true;
+            }
+        }
+
+        whisper_context_params tparams = params;
+        tparams.threadpool        = nullptr;
+        tparams.threadpool_params = &tpp;
+
+        whisper_threadpool * threadpool = whisper_threadpool_init(tparams);
+        if (!threadpool) {
+            WHISPER_LOG_ERROR("%s: failed to create the threadpool of node %d\n", __func__, node.id);
+            return false;
+        }
+
+        ctx.numa_threadpools.push_back(threadpool);
+
+        WHISPER_LOG_INFO("%s: node %d: %zu CPUs, threadpool = %d threads\n", __func__, node.id, node.cpus.size(), threadpool->n_threads);
+    }
+
+    return true;
+}
+
+static struct whisper_context * whisper_init_with_params_no_state_impl(struct whisper_model_loader * loader, struct whisper_context_params params, whisper_mmap * mapping, const whisper_model_gguf * gguf) {
     ggml_time_init();
 
     if (params.flash_attn && params.dtw_token_timestamps) {
@@ -3710,17 +6230,32 @@ struct whisper_context * whisper_init_with_params_no_state(struct whisper_model_
         params.dtw_token_timestamps = false;
     }
 
+    if (params.type_kv != GGML_TYPE_F16 && params.type_kv != GGML_TYPE_Q8_0 && params.type_kv != GGML_TYPE_Q4_0) {
+        WHISPER_LOG_WARN("%s: unsupported KV cache type %s - using f16\n", __func__, ggml_type_name(params.type_kv));
+        params.type_kv = GGML_TYPE_F16;
+    }
+
+    if (ggml_is_quantized(params.type_kv) && !params.flash_attn) {
+        // without flash attention the V cache is stored transposed, which does not work with quantized rows
+        WHISPER_LOG_WARN("%s: the %s KV cache requires flash_attn - using f16\n", __func__, ggml_type_name(params.type_kv));
+        params.type_kv = GGML_TYPE_F16;
+    }
+
     WHISPER_LOG_INFO("%s: use gpu    = %d\n", __func__, params.use_gpu);
     WHISPER_LOG_INFO("%s: flash attn = %d\n", __func__, params.flash_attn);
+    WHISPER_LOG_INFO("%s: kv type    = %s\n", __func__, ggml_type_name(params.type_kv));
     WHISPER_LOG_INFO("%s: gpu_device = %d\n", __func__, params.gpu_device);
     WHISPER_LOG_INFO("%s: dtw        = %d\n", __func__, params.dtw_token_timestamps);
+    WHISPER_LOG_INFO("%s: numa       = %d\n", __func__, params.numa);
     WHISPER_LOG_INFO("%s: devices    = %zu\n", __func__, ggml_backend_dev_count());
     WHISPER_LOG_INFO("%s: backends   = %zu\n", __func__, ggml_backend_reg_count());
 
     whisper_context * ctx = new whisper_context;
     ctx->params = params;
+    ctx->ktype  = params.type_kv;
+    ctx->model.mapping.reset(mapping);
 
-    if (!whisper_model_load(loader, *ctx)) {
+    if (!whisper_model_load(loader, gguf, *ctx)) {
         loader->close(loader->context);
         WHISPER_LOG_ERROR("%s: failed to load model\n", __func__);
         delete ctx;
@@ -3729,150 +6264,556 @@ struct whisper_context * whisper_init_with_params_no_state(struct whisper_model_
 
     loader->close(loader->context);
 
+    if (!whisper_numa_init(*ctx)) {
+        WHISPER_LOG_ERROR("%s: failed to initialize NUMA\n", __func__);
+        whisper_free(ctx);
+        return nullptr;
+    }
+
+    // with per-node threadpools the threadpool params apply to them
+    if (params.threadpool || (params.threadpool_params && ctx->numa_threadpools.empty())) {
+        ctx->threadpool = whisper_threadpool_init(params);
+        if (!ctx->threadpool) {
+            WHISPER_LOG_ERROR("%s: failed to initialize the threadpool\n", __func__);
+            whisper_free(ctx);
+            return nullptr;
+        }
+        WHISPER_LOG_INFO("%s: threadpool = %d threads%s\n", __func__, ctx->threadpool->n_threads, ctx->threadpool->owned ? "" : " (external)");
+    }
+    ctx->params.threadpool_params = nullptr;
+
+    // DTW without a preset uses the alignment heads of the model file
+    if (ctx->params.dtw_token_timestamps && ctx->params.dtw_aheads_preset == WHISPER_AHEADS_NONE && !ctx->model.aheads.empty()) {
+        ctx->params.dtw_aheads_preset = WHISPER_AHEADS_CUSTOM;
+        ctx->params.dtw_aheads = { ctx->model.aheads.size(), ctx->model.aheads.data() };
+    }
+
+    return ctx;
+}
+
+struct whisper_context * whisper_init_from_file_with_params(const char * path_model, struct whisper_context_params params) {
+    whisper_context * ctx = whisper_init_from_file_with_params_no_state(path_model, params);
+    if (!ctx) {
+        return nullptr;
+    }
+
+    ctx->state = whisper_init_state(ctx);
+    if (!ctx->state) {
+        whisper_free(ctx);
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+struct whisper_context * whisper_init_from_buffer_with_params(void * buffer, size_t buffer_size, struct whisper_context_params params) {
+    whisper_context * ctx = whisper_init_from_buffer_with_params_no_state(buffer, buffer_size, params);
+    if (!ctx) {
+        return nullptr;
+    }
+
+    ctx->state = whisper_init_state(ctx);
+    if (!ctx->state) {
+        whisper_free(ctx);
+        return nullptr;
+    }
+
     return ctx;
 }
 
-struct whisper_context * whisper_init_from_file_with_params(const char * path_model, struct whisper_context_params params) {
-    whisper_context * ctx = whisper_init_from_file_with_params_no_state(path_model, params);
-    if (!ctx) {
-        return nullptr;
+struct whisper_context * whisper_init_with_params(struct whisper_model_loader * loader, struct whisper_context_params params) {
+    whisper_context * ctx = whisper_init_with_params_no_state(loader, params);
+    if (!ctx) {
+        return nullptr;
+    }
+
+    ctx->state = whisper_init_state(ctx);
+    if (!ctx->state) {
+        whisper_free(ctx);
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+struct whisper_context * whisper_init_from_file(const char * path_model) {
+    return whisper_init_from_file_with_params(path_model, whisper_context_default_params());
+}
+
+struct whisper_context * whisper_init_from_buffer(void * buffer, size_t buffer_size) {
+    return whisper_init_from_buffer_with_params(buffer, buffer_size, whisper_context_default_params());
+}
+
+struct whisper_context * whisper_init(struct whisper_model_loader * loader) {
+    return whisper_init_with_params(loader, whisper_context_default_params());
+}
+
+struct whisper_context * whisper_init_from_file_no_state(const char * path_model) {
+    return whisper_init_from_file_with_params_no_state(path_model, whisper_context_default_params());
+}
+
+struct whisper_context * whisper_init_from_buffer_no_state(void * buffer, size_t buffer_size) {
+    return whisper_init_from_buffer_with_params_no_state(buffer, buffer_size, whisper_context_default_params());
+}
+
+struct whisper_context * whisper_init_no_state(struct whisper_model_loader * loader) {
+    return whisper_init_with_params_no_state(loader, whisper_context_default_params());
+}
+
+void whisper_free_state(struct whisper_state * state) {
+    if (state) {
+        whisper_kv_cache_free(state->kv_self);
+        whisper_kv_cache_free(state->kv_cross);
+        whisper_kv_cache_free(state->kv_pad);
+
+#ifdef WHISPER_USE_COREML
+        if (state->ctx_coreml != nullptr) {
+            whisper_coreml_free(state->ctx_coreml);
+            state->ctx_coreml = nullptr;
+        }
+#endif
+
+#ifdef WHISPER_USE_OPENVINO
+        if (state->ctx_openvino != nullptr) {
+            whisper_openvino_free(state->ctx_openvino);
+            state->ctx_openvino = nullptr;
+        }
+#endif
+
+        whisper_batch_free(state->batch);
+
+        ggml_backend_sched_free(state->sched.sched);
+
+        ggml_free(state->ctx_embd);
+        ggml_backend_buffer_free(state->buf_embd);
+
+        for (auto & backend : state->backends) {
+            ggml_backend_free(backend);
+        }
+
+        // [EXPERIMENTAL] Token-level timestamps with DTW
+        aheads_masks_free(state->aheads_masks);
+
+        whisper_mel_graph_free(state->mel_graph);
+
+        whisper_worker_pool_free(state->worker_pool);
+
+        if (state->vad_context != nullptr) {
+            whisper_vad_free(state->vad_context);
+            state->vad_context = nullptr;
+        }
+
+        delete state;
+    }
+}
+
+void whisper_free(struct whisper_context * ctx) {
+    if (ctx) {
+        for (ggml_context * context : ctx->model.ctxs) {
+            ggml_free(context);
+        }
+
+        for (ggml_backend_buffer_t buf : ctx->model.buffers) {
+            ggml_backend_buffer_free(buf);
+        }
+
+        whisper_free_state(ctx->state);
+
+        for (auto & replica : ctx->numa_replicas) {
+            whisper_model_replica_free(replica);
+        }
+
+        for (whisper_threadpool * threadpool : ctx->numa_threadpools) {
+            whisper_threadpool_free(threadpool);
+        }
+
+        whisper_threadpool_free(ctx->threadpool);
+
+        delete ctx;
+    }
+}
+
+void whisper_free_context_params(struct whisper_context_params * params) {
+    if (params) {
+        delete params;
+    }
+}
+
+void whisper_free_params(struct whisper_full_params * params) {
+    if (params) {
+        delete params;
+    }
+}
+
+size_t whisper_state_memory_size(struct whisper_state * state) {
+    size_t size = 0;
+
+    for (ggml_backend_buffer_t buf : {
+            state->kv_self.buffer, state->kv_cross.buffer, state->kv_pad.buffer,
+            state->buf_embd, state->mel_graph.buffer, state->aheads_masks.buffer }) {
+        if (buf) {
+            size += ggml_backend_buffer_get_size(buf);
+        }
+    }
+
+    if (state->sched.sched) {
+        size += whisper_sched_size(state->sched);
+    }
+
+    size += state->prompt_snapshots.size;
+
+    size += sizeof(float)*(state->logits.capacity() + state->mel.data.capacity() + state->mel.pcm.capacity());
+    size += sizeof(float)*(state->inp_mel.capacity() + state->inp_pcm.capacity() + state->inp_mask.capacity());
+
+    for (const auto & decoder : state->decoders) {
+        size += sizeof(float)*(decoder.probs.capacity() + decoder.logits.capacity() + decoder.logprobs.capacity());
+    }
+
+    return size;
+}
+
+// bring a released state back to the condition of a new one, keeping its buffers
+// the K/V data is not cleared: kv_cross is overwritten by the encoder and the unused cells of kv_self are masked out
+static void whisper_state_reset(struct whisper_state & state) {
+    whisper_kv_cache_clear_cells(state.kv_self);
+    whisper_kv_cache_clear_cells(state.kv_cross);
+
+    state.prompt_snapshots.entries.clear();
+    state.prompt_snapshots.size = 0;
+    state.audio_hash = 0;
+
+    state.mel.n_len     = 0;
+    state.mel.n_len_org = 0;
+    state.mel.pcm.clear();
+    state.mel_stream = whisper_mel_stream();
+
+    state.output_ids.clear();
+    state.n_outputs = 0;
+
+    state.result_all.clear();
+    state.prompt_past0.clear();
+    state.prompt_past1.clear();
+    state.energy.clear();
+
+    state.lang_id        = 0;
+    state.no_speech_prob = 0.0f;
+    state.t_beg          = 0;
+    state.t_last         = 0;
+    state.tid_last       = 0;
+
+    state.vad_segments.clear();
+    state.vad_mapping_table.clear();
+    state.has_vad_segments = false;
+
+    state.t_mel_us    = 0;
+    state.t_sample_us = 0;
+    state.t_encode_us = 0;
+    state.t_decode_us = 0;
+    state.t_batchd_us = 0;
+    state.t_prompt_us = 0;
+    state.n_sample    = 0;
+    state.n_encode    = 0;
+    state.n_decode    = 0;
+    state.n_batchd    = 0;
+    state.n_prompt    = 0;
+    state.n_fail_p    = 0;
+    state.n_fail_h    = 0;
+    state.n_reuse     = 0;
+
+    state.prompt_snapshots.n_hit  = 0;
+    state.prompt_snapshots.n_miss = 0;
+    state.prompt_snapshots.n_bytes_reused = 0;
+}
+
+struct whisper_state_pool {
+    whisper_context * ctx = nullptr;
+
+    whisper_state_pool_params params;
+
+    struct entry {
+        whisper_state * state;
+        size_t          mem; // whisper_state_memory_size() when the state was last idle
+    };
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    std::vector<entry> idle;
+    std::vector<entry> busy;
+
+    int32_t n_creating   = 0; // states being created outside of the lock
+    size_t  mem_creating = 0; // their expected memory
+    size_t  mem_freeing  = 0; // memory of the states being freed outside of the lock
+    size_t  mem_state    = 0; // memory of the largest state seen so far - the estimate for a new one
+};
+
+static size_t whisper_state_pool_mem(const whisper_state_pool & pool) {
+    size_t mem = pool.mem_creating + pool.mem_freeing;
+    for (const auto & e : pool.idle) {
+        mem += e.mem;
+    }
+    for (const auto & e : pool.busy) {
+        mem += e.mem;
+    }
+    return mem;
+}
+
+// check if one more state fits in the limits of the pool - must be called with the lock held
+static bool whisper_state_pool_can_grow(const whisper_state_pool & pool) {
+    const int32_t n_states = (int32_t) (pool.idle.size() + pool.busy.size()) + pool.n_creating;
+
+    if (pool.params.n_states_max > 0 && n_states >= pool.params.n_states_max) {
+        return false;
+    }
+
+    // the size of the first state is not known until it is created
+    if (pool.params.mem_max > 0 && n_states > 0 && whisper_state_pool_mem(pool) + pool.mem_state > pool.params.mem_max) {
+        return false;
+    }
+
+    return true;
+}
+
+// free states outside of the lock - their memory is counted in mem_freeing until they are freed,
+// so that a new state is not created before the memory is returned
+static void whisper_state_pool_drop(whisper_state_pool & pool, const std::vector<whisper_state_pool::entry> & entries) {
+    size_t mem = 0;
+    for (const auto & e : entries) {
+        whisper_free_state(e.state);
+        mem += e.mem;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        pool.mem_freeing -= mem;
+    }
+
+    pool.cv.notify_all();
+}
+
+// create a state outside of the lock for a slot reserved with n_creating/mem_creating
+// on success the state is added to `busy`, the reservation is released either way
+static whisper_state * whisper_state_pool_create(whisper_state_pool & pool, size_t mem_reserved) {
+    whisper_state * state = whisper_init_state(pool.ctx);
+
+    const size_t mem = state ? whisper_state_memory_size(state) : 0;
+
+    std::vector<whisper_state_pool::entry> dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+
+        pool.n_creating--;
+        pool.mem_creating -= mem_reserved;
+
+        if (state && pool.params.mem_max > 0 && whisper_state_pool_mem(pool) + mem > pool.params.mem_max) {
+            WHISPER_LOG_ERROR("%s: the state (%.2f MB) does not fit in the memory limit of the pool (%.2f MB)\n", __func__, mem/1e6, pool.params.mem_max/1e6);
+
+            dropped.push_back({ state, mem });
+            pool.mem_freeing += mem;
+            state = nullptr;
+        }
+
+        if (state) {
+            pool.busy.push_back({ state, mem });
+            pool.mem_state = std::max(pool.mem_state, mem);
+        }
+    }
+
+    // a failed reservation may have blocked another thread
+    whisper_state_pool_drop(pool, dropped);
+
+    return state;
+}
+
+struct whisper_state_pool_params whisper_state_pool_default_params() {
+    struct whisper_state_pool_params result = {
+        /*.n_states_init =*/ 1,
+        /*.n_states_idle =*/ -1,
+        /*.n_states_max  =*/ 0,
+        /*.mem_max       =*/ 0,
+    };
+
+    return result;
+}
+
+struct whisper_state_pool * whisper_state_pool_init(struct whisper_context * ctx, struct whisper_state_pool_params params) {
+    whisper_state_pool * pool = new whisper_state_pool;
+
+    pool->ctx    = ctx;
+    pool->params = params;
+
+    std::vector<whisper_state *> states;
+
+    for (int i = 0; i < params.n_states_init; ++i) {
+        whisper_state * state = whisper_state_pool_acquire(pool, false);
+        if (!state) {
+            WHISPER_LOG_ERROR("%s: failed to create state %d of %d\n", __func__, i, params.n_states_init);
+            break;
+        }
+        states.push_back(state);
+    }
+
+    for (whisper_state * state : states) {
+        whisper_state_pool_release(pool, state);
     }
 
-    ctx->state = whisper_init_state(ctx);
-    if (!ctx->state) {
-        whisper_free(ctx);
+    if ((int) states.size() < params.n_states_init) {
+        whisper_state_pool_free(pool);
         return nullptr;
     }
 
-    return ctx;
+    WHISPER_LOG_INFO("%s: %d states, %.2f MB\n", __func__, (int) states.size(), whisper_state_pool_memory_size(pool)/1e6);
+
+    return pool;
 }
 
-struct whisper_context * whisper_init_from_buffer_with_params(void * buffer, size_t buffer_size, struct whisper_context_params params) {
-    whisper_context * ctx = whisper_init_from_buffer_with_params_no_state(buffer, buffer_size, params);
-    if (!ctx) {
-        return nullptr;
-    }
+void whisper_state_pool_free(struct whisper_state_pool * pool) {
+    if (pool) {
+        if (!pool->busy.empty()) {
+            WHISPER_LOG_WARN("%s: %d states are still in use\n", __func__, (int) pool->busy.size());
+        }
 
-    ctx->state = whisper_init_state(ctx);
-    if (!ctx->state) {
-        whisper_free(ctx);
-        return nullptr;
-    }
+        for (auto & e : pool->idle) {
+            whisper_free_state(e.state);
+        }
+        for (auto & e : pool->busy) {
+            whisper_free_state(e.state);
+        }
 
-    return ctx;
+        delete pool;
+    }
 }
 
-struct whisper_context * whisper_init_with_params(struct whisper_model_loader * loader, struct whisper_context_params params) {
-    whisper_context * ctx = whisper_init_with_params_no_state(loader, params);
-    if (!ctx) {
-        return nullptr;
-    }
+struct whisper_state * whisper_state_pool_acquire(struct whisper_state_pool * pool, bool wait) {
+    std::unique_lock<std::mutex> lock(pool->mutex);
 
-    ctx->state = whisper_init_state(ctx);
-    if (!ctx->state) {
-        whisper_free(ctx);
-        return nullptr;
-    }
+    while (true) {
+        if (!pool->idle.empty()) {
+            const auto e = pool->idle.back();
+            pool->idle.pop_back();
+            pool->busy.push_back(e);
 
-    return ctx;
-}
+            return e.state;
+        }
 
-struct whisper_context * whisper_init_from_file(const char * path_model) {
-    return whisper_init_from_file_with_params(path_model, whisper_context_default_params());
-}
+        if (whisper_state_pool_can_grow(*pool)) {
+            const size_t mem_reserved = pool->mem_state;
 
-struct whisper_context * whisper_init_from_buffer(void * buffer, size_t buffer_size) {
-    return whisper_init_from_buffer_with_params(buffer, buffer_size, whisper_context_default_params());
-}
+            pool->n_creating++;
+            pool->mem_creating += mem_reserved;
 
-struct whisper_context * whisper_init(struct whisper_model_loader * loader) {
-    return whisper_init_with_params(loader, whisper_context_default_params());
-}
+            lock.unlock();
 
-struct whisper_context * whisper_init_from_file_no_state(const char * path_model) {
-    return whisper_init_from_file_with_params_no_state(path_model, whisper_context_default_params());
-}
+            return whisper_state_pool_create(*pool, mem_reserved);
+        }
 
-struct whisper_context * whisper_init_from_buffer_no_state(void * buffer, size_t buffer_size) {
-    return whisper_init_from_buffer_with_params_no_state(buffer, buffer_size, whisper_context_default_params());
-}
+        // nothing will be released
+        if (!wait || (pool->busy.empty() && pool->n_creating == 0 && pool->mem_freeing == 0)) {
+            return nullptr;
+        }
 
-struct whisper_context * whisper_init_no_state(struct whisper_model_loader * loader) {
-    return whisper_init_with_params_no_state(loader, whisper_context_default_params());
+        pool->cv.wait(lock);
+    }
 }
 
-void whisper_free_state(struct whisper_state * state) {
-    if (state) {
-        whisper_kv_cache_free(state->kv_self);
-        whisper_kv_cache_free(state->kv_cross);
-        whisper_kv_cache_free(state->kv_pad);
+void whisper_state_pool_release(struct whisper_state_pool * pool, struct whisper_state * state) {
+    auto find_busy = [pool, state]() {
+        return std::find_if(pool->busy.begin(), pool->busy.end(), [state](const whisper_state_pool::entry & x) { return x.state == state; });
+    };
 
-#ifdef WHISPER_USE_COREML
-        if (state->ctx_coreml != nullptr) {
-            whisper_coreml_free(state->ctx_coreml);
-            state->ctx_coreml = nullptr;
-        }
-#endif
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
 
-#ifdef WHISPER_USE_OPENVINO
-        if (state->ctx_openvino != nullptr) {
-            whisper_openvino_free(state->ctx_openvino);
-            state->ctx_openvino = nullptr;
+        if (find_busy() == pool->busy.end()) {
+            WHISPER_LOG_ERROR("%s: the state was not acquired from this pool\n", __func__);
+            return;
         }
-#endif
+    }
 
-        whisper_batch_free(state->batch);
+    // the state stays in `busy` - and counted in the limits of the pool - until it is idle or freed
+    whisper_state_reset(*state);
 
-        ggml_backend_sched_free(state->sched_conv.sched);
-        ggml_backend_sched_free(state->sched_encode.sched);
-        ggml_backend_sched_free(state->sched_cross.sched);
-        ggml_backend_sched_free(state->sched_decode.sched);
+    const size_t mem = whisper_state_memory_size(state);
 
-        for (auto & backend : state->backends) {
-            ggml_backend_free(backend);
+    std::vector<whisper_state_pool::entry> dropped;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+
+        const auto & params = pool->params;
+
+        auto it = find_busy();
+        it->mem = mem;
+
+        // the state may have grown while in use (e.g. kv_self for more decoders)
+        pool->mem_state = std::max(pool->mem_state, mem);
+
+        bool keep = true;
+
+        if (params.n_states_idle >= 0 && (int) pool->idle.size() >= params.n_states_idle) {
+            keep = false;
         }
 
-        // [EXPERIMENTAL] Token-level timestamps with DTW
-        aheads_masks_free(state->aheads_masks);
+        if (params.mem_max > 0 && whisper_state_pool_mem(*pool) > params.mem_max) {
+            keep = false;
+        }
 
-        if (state->vad_context != nullptr) {
-            whisper_vad_free(state->vad_context);
-            state->vad_context = nullptr;
+        if (keep) {
+            pool->idle.push_back(*it);
+        } else {
+            dropped.push_back(*it);
+            pool->mem_freeing += it->mem;
         }
 
-        delete state;
+        pool->busy.erase(it);
     }
+
+    whisper_state_pool_drop(*pool, dropped);
 }
 
-void whisper_free(struct whisper_context * ctx) {
-    if (ctx) {
-        for (ggml_context * context : ctx->model.ctxs) {
-            ggml_free(context);
-        }
+void whisper_state_pool_trim(struct whisper_state_pool * pool, int n_idle) {
+    std::vector<whisper_state_pool::entry> dropped;
 
-        for (ggml_backend_buffer_t buf : ctx->model.buffers) {
-            ggml_backend_buffer_free(buf);
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+
+        while ((int) pool->idle.size() > std::max(n_idle, 0)) {
+            dropped.push_back(pool->idle.back());
+            pool->mem_freeing += pool->idle.back().mem;
+            pool->idle.pop_back();
         }
+    }
 
-        whisper_free_state(ctx->state);
+    whisper_state_pool_drop(*pool, dropped);
+}
 
-        delete ctx;
-    }
+int whisper_state_pool_n_states(struct whisper_state_pool * pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+
+    return pool->idle.size() + pool->busy.size();
 }
 
-void whisper_free_context_params(struct whisper_context_params * params) {
-    if (params) {
-        delete params;
-    }
+int whisper_state_pool_n_idle(struct whisper_state_pool * pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+
+    return pool->idle.size();
 }
 
-void whisper_free_params(struct whisper_full_params * params) {
-    if (params) {
-        delete params;
-    }
+size_t whisper_state_pool_memory_size(struct whisper_state_pool * pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+
+    return whisper_state_pool_mem(*pool) - pool->mem_creating - pool->mem_freeing;
 }
 
 int whisper_pcm_to_mel_with_state(struct whisper_context * ctx, struct whisper_state * state, const float * samples, int n_samples, int n_threads) {
+    // [EXPERIMENTAL] keep the PCM - the mel is computed by the encoder graph
+    if (state->mel_graph.ctx != nullptr && !whisper_encode_external(*state)) {
+        log_mel_spectrogram_pcm(samples, n_samples, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ctx->model.filters.n_mel, state->mel);
+        return 0;
+    }
+
     if (!log_mel_spectrogram(*state, samples, n_samples, WHISPER_SAMPLE_RATE, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ctx->model.filters.n_mel, n_threads, ctx->model.filters, false, state->mel)) {
         WHISPER_LOG_ERROR("%s: failed to compute mel spectrogram\n", __func__);
         return -1;
@@ -3899,6 +6840,7 @@ int whisper_set_mel_with_state(
     state->mel.n_len     = n_len;
     state->mel.n_len_org = n_len;
     state->mel.n_mel     = n_mel;
+    state->mel.pcm.clear();
 
     state->mel.data.resize(n_len*n_mel);
     memcpy(state->mel.data.data(), data, n_len*n_mel*sizeof(float));
@@ -3914,6 +6856,52 @@ int whisper_set_mel(
     return whisper_set_mel_with_state(ctx, ctx->state, data, n_len, n_mel);
 }
 
+int whisper_mel_append_pcm_with_state(struct whisper_context * ctx, struct whisper_state * state, const float * samples, int n_samples) {
+    const int64_t t_start_us = ggml_time_us();
+
+    log_mel_spectrogram_append(state->mel_stream, samples, n_samples, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ctx->model.filters);
+    log_mel_spectrogram_from_stream(state->mel_stream, ctx->model.filters.n_mel, state->mel);
+
+    state->t_mel_us += ggml_time_us() - t_start_us;
+
+    return 0;
+}
+
+int whisper_mel_append_pcm(struct whisper_context * ctx, const float * samples, int n_samples) {
+    return whisper_mel_append_pcm_with_state(ctx, ctx->state, samples, n_samples);
+}
+
+int whisper_mel_trim_with_state(struct whisper_context * ctx, struct whisper_state * state, int n_frames) {
+    auto & stream = state->mel_stream;
+
+    const int n_mel  = ctx->model.filters.n_mel;
+    const int n_held = stream.frames_max.size();
+
+    n_frames = std::max(0, std::min(n_frames, n_held));
+    if (n_frames > 0) {
+        stream.frames.erase(stream.frames.begin(), stream.frames.begin() + n_frames*n_mel);
+        stream.frames_max.erase(stream.frames_max.begin(), stream.frames_max.begin() + n_frames);
+
+        log_mel_spectrogram_from_stream(stream, n_mel, state->mel);
+    }
+
+    return n_held - n_frames;
+}
+
+int whisper_mel_trim(struct whisper_context * ctx, int n_frames) {
+    return whisper_mel_trim_with_state(ctx, ctx->state, n_frames);
+}
+
+void whisper_mel_reset_with_state(struct whisper_context * ctx, struct whisper_state * state) {
+    GGML_UNUSED(ctx);
+
+    state->mel_stream = whisper_mel_stream();
+}
+
+void whisper_mel_reset(struct whisper_context * ctx) {
+    whisper_mel_reset_with_state(ctx, ctx->state);
+}
+
 int whisper_encode_with_state(struct whisper_context * ctx, struct whisper_state * state, int offset, int n_threads) {
     if (!whisper_encode_internal(*ctx, *state, offset, n_threads, nullptr, nullptr)) {
         WHISPER_LOG_ERROR("%s: failed to eval\n", __func__);
@@ -3942,6 +6930,17 @@ int whisper_decode_with_state(struct whisper_context * ctx, struct whisper_state
         return 1;
     }
 
+    // only the last token has logits - move them to the last row to keep the layout of whisper_get_logits()
+    if (n_tokens > 1) {
+        const size_t n_vocab = ctx->model.hparams.n_vocab;
+
+        state->logits.resize(n_tokens*n_vocab);
+        memcpy(state->logits.data() + (n_tokens - 1)*n_vocab, state->logits.data(), n_vocab*sizeof(float));
+
+        state->output_ids[n_tokens - 1] = n_tokens - 1;
+        state->n_outputs = n_tokens;
+    }
+
     return 0;
 }
 
@@ -4170,6 +7169,11 @@ int whisper_n_len_from_state(struct whisper_state * state) {
     return state->mel.n_len_org;
 }
 
+int whisper_n_kv_used_from_state(struct whisper_state * state) {
+    return std::count_if(state->kv_self.cells.begin(), state->kv_self.cells.end(),
+            [](const whisper_kv_cell & cell) { return cell.pos >= 0; });
+}
+
 int whisper_n_len(struct whisper_context * ctx) {
     return ctx->state->mel.n_len_org;
 }
@@ -4198,6 +7202,27 @@ float * whisper_get_logits_from_state(struct whisper_state * state) {
     return state->logits.data();
 }
 
+float * whisper_get_logits_ith(struct whisper_context * ctx, int32_t i) {
+    return whisper_get_logits_ith_from_state(ctx->state, i);
+}
+
+float * whisper_get_logits_ith_from_state(struct whisper_state * state, int32_t i) {
+    const int32_t n_tokens = state->output_ids.size();
+
+    if (i < 0) {
+        i += n_tokens;
+    }
+
+    if (i < 0 || i >= n_tokens || state->output_ids[i] < 0) {
+        WHISPER_LOG_ERROR("%s: no logits for token %d\n", __func__, i);
+        return nullptr;
+    }
+
+    const size_t n_vocab = state->logits.size()/state->n_outputs;
+
+    return state->logits.data() + state->output_ids[i]*n_vocab;
+}
+
 const char * whisper_token_to_str(struct whisper_context * ctx, whisper_token token) {
     return ctx->vocab.id_to_token.at(token).c_str();
 }
@@ -4246,12 +7271,19 @@ struct whisper_timings * whisper_get_timings(struct whisper_context * ctx) {
     if (ctx->state == nullptr) {
         return nullptr;
     }
+    return whisper_get_timings_from_state(ctx->state);
+}
+
+struct whisper_timings * whisper_get_timings_from_state(struct whisper_state * state) {
     whisper_timings * timings = new whisper_timings;
-    timings->sample_ms = 1e-3f * ctx->state->t_sample_us / std::max(1, ctx->state->n_sample);
-    timings->encode_ms = 1e-3f * ctx->state->t_encode_us / std::max(1, ctx->state->n_encode);
-    timings->decode_ms = 1e-3f * ctx->state->t_decode_us / std::max(1, ctx->state->n_decode);
-    timings->batchd_ms = 1e-3f * ctx->state->t_batchd_us / std::max(1, ctx->state->n_batchd);
-    timings->prompt_ms = 1e-3f * ctx->state->t_prompt_us / std::max(1, ctx->state->n_prompt);
+    timings->sample_ms = 1e-3f * state->t_sample_us / std::max(1, state->n_sample);
+    timings->encode_ms = 1e-3f * state->t_encode_us / std::max(1, state->n_encode);
+    timings->decode_ms = 1e-3f * state->t_decode_us / std::max(1, state->n_decode);
+    timings->batchd_ms = 1e-3f * state->t_batchd_us / std::max(1, state->n_batchd);
+    timings->prompt_ms = 1e-3f * state->t_prompt_us / std::max(1, state->n_prompt);
+    timings->n_graph_reuse = state->n_reuse;
+    timings->n_fallback_restore     = state->prompt_snapshots.n_hit;
+    timings->fallback_restore_bytes = state->prompt_snapshots.n_bytes_reused;
     return timings;
 }
 
@@ -4275,6 +7307,11 @@ void whisper_print_timings(struct whisper_context * ctx) {
         WHISPER_LOG_INFO("%s:   decode time = %8.2f ms / %5d runs ( %8.2f ms per run)\n", __func__, 1e-3f * ctx->state->t_decode_us, n_decode, 1e-3f * ctx->state->t_decode_us / n_decode);
         WHISPER_LOG_INFO("%s:   batchd time = %8.2f ms / %5d runs ( %8.2f ms per run)\n", __func__, 1e-3f * ctx->state->t_batchd_us, n_batchd, 1e-3f * ctx->state->t_batchd_us / n_batchd);
         WHISPER_LOG_INFO("%s:   prompt time = %8.2f ms / %5d runs ( %8.2f ms per run)\n", __func__, 1e-3f * ctx->state->t_prompt_us, n_prompt, 1e-3f * ctx->state->t_prompt_us / n_prompt);
+        WHISPER_LOG_INFO("%s:   graph reuse = %5d decoder calls\n", __func__, ctx->state->n_reuse);
+        if (ctx->state->prompt_snapshots.size_max > 0) {
+            const auto & pc = ctx->state->prompt_snapshots;
+            WHISPER_LOG_INFO("%s:     snapshots = %5d restored / %5d missed ( %8.2f MB reused, %8.2f MB used)\n", __func__, pc.n_hit, pc.n_miss, pc.n_bytes_reused/1e6, pc.size/1e6);
+        }
     }
     WHISPER_LOG_INFO("%s:    total time = %8.2f ms\n", __func__, (t_end_us - ctx->t_start_us)/1000.0f);
 }
@@ -4293,6 +7330,10 @@ void whisper_reset_timings(struct whisper_context * ctx) {
         ctx->state->n_decode = 0;
         ctx->state->n_batchd = 0;
         ctx->state->n_prompt = 0;
+        ctx->state->n_reuse  = 0;
+        ctx->state->prompt_snapshots.n_hit  = 0;
+        ctx->state->prompt_snapshots.n_miss = 0;
+        ctx->state->prompt_snapshots.n_bytes_reused = 0;
     }
 }
 
@@ -6099,18 +9140,23 @@ static const std::vector<std::string> non_speech_tokens = {
     "♪♪♪","♩", "♪", "♫", "♬", "♭", "♮", "♯"
 };
 
-static void whisper_compute_logprobs(
-                const std::vector<float> & logits,
-                              const int    n_logits,
-                      std::vector<float> & logprobs) {
-    const float logit_max = *std::max_element(logits.begin(), logits.end());
+static float whisper_logsumexp(const float * logits, int n_logits, float logit_max) {
     float logsumexp = 0.0f;
     for (int i = 0; i < n_logits; ++i) {
         if (logits[i] > -INFINITY) {
             logsumexp += expf(logits[i] - logit_max);
         }
     }
-    logsumexp = logf(logsumexp) + logit_max;
+
+    return logf(logsumexp) + logit_max;
+}
+
+static void whisper_compute_logprobs(
+                const std::vector<float> & logits,
+                              const int    n_logits,
+                      std::vector<float> & logprobs) {
+    const float logit_max = *std::max_element(logits.begin(), logits.end());
+    const float logsumexp = whisper_logsumexp(logits.data(), n_logits, logit_max);
 
     for (int i = 0; i < n_logits; ++i) {
         if (logits[i] > -INFINITY) {
@@ -6135,10 +9181,136 @@ static void whisper_compute_probs(
     }
 }
 
+static float whisper_max(const float * x, int n) {
+    float res = -INFINITY;
+    for (int i = 0; i < n; ++i) {
+        res = std::max(res, x[i]);
+    }
+
+    return res;
+}
+
+// compute the sampling summary of the probs of the decoder (see whisper_decoder::best_id)
+static void whisper_compute_probs_summary(
+        const whisper_vocab & vocab,
+            whisper_decoder & decoder) {
+    const auto & probs = decoder.probs;
+
+    const int n_logits = vocab.n_vocab;
+
+    decoder.best_id = -1;
+    decoder.ts_id   = -1;
+    decoder.ts_sum  = 0.0;
+    decoder.ts_max  = 0.0;
+
+    float best_p = 0.0f;
+    for (int i = 0; i < n_logits; ++i) {
+        if (best_p < probs[i]) {
+            best_p = probs[i];
+            decoder.best_id = i;
+        }
+    }
+
+    for (int i = vocab.token_beg; i < n_logits; ++i) {
+        decoder.ts_sum += probs[i];
+        if (decoder.ts_max < probs[i]) {
+            decoder.ts_max = probs[i];
+            decoder.ts_id  = i;
+        }
+    }
+}
+
+// the logits that do not depend on the decoded tokens are suppressed with a mask that is computed once per whisper_full call
+static void whisper_logits_suppress_init(
+              struct whisper_context & ctx,
+               struct whisper_state  & state,
+    const struct whisper_full_params & params) {
+    const auto & vocab = ctx.vocab;
+
+    const int n_logits = vocab.n_vocab;
+
+    auto & mask = state.logits_suppress;
+    mask.assign(n_logits, 0);
+
+    // suppress <|notimestamps|> token
+    // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L410-L412
+    mask[vocab.token_not] |= WHISPER_SUPPRESS_PRE;
+    if (params.no_timestamps) {
+        for (int i = vocab.token_beg; i < n_logits; ++i) {
+            mask[i] |= WHISPER_SUPPRESS_PRE;
+        }
+    }
+
+    // suppress sot and nosp tokens
+    mask[vocab.token_sot]  |= WHISPER_SUPPRESS_PRE;
+    mask[vocab.token_nosp] |= WHISPER_SUPPRESS_PRE;
+
+    // [TDRZ] when tinydiarize is disabled, suppress solm token
+    if (params.tdrz_enable == false) {
+        mask[vocab.token_solm] |= WHISPER_SUPPRESS_PRE;
+    }
+
+    // suppress task tokens
+    mask[vocab.token_translate]  |= WHISPER_SUPPRESS_PRE;
+    mask[vocab.token_transcribe] |= WHISPER_SUPPRESS_PRE;
+    mask[vocab.token_prev]       |= WHISPER_SUPPRESS_PRE;
+
+    // suppress lang tokens
+    for (size_t i = 0; i < g_lang.size(); ++i) {
+        mask[whisper_token_lang(&ctx, i)] |= WHISPER_SUPPRESS_PRE;
+    }
+
+    // suppress non-speech tokens
+    // ref: https://github.com/openai/whisper/blob/7858aa9c08d98f75575035ecd6481f462d66ca27/whisper/tokenizer.py#L224-L253
+    if (params.suppress_nst) {
+        for (const std::string & token : non_speech_tokens) {
+            const std::string suppress_tokens[] = {token, " " + token};
+            for (const std::string & suppress_token : suppress_tokens) {
+                if (vocab.token_to_id.find(suppress_token) != vocab.token_to_id.end()) {
+                    mask[vocab.token_to_id.at(suppress_token)] |= WHISPER_SUPPRESS_POST;
+                }
+            }
+        }
+
+        // allow hyphens "-" and single quotes "'" between words, but not at the beginning of a word
+        if (vocab.token_to_id.find(" -") != vocab.token_to_id.end()) {
+            mask[vocab.token_to_id.at(" -")] |= WHISPER_SUPPRESS_POST;
+        }
+        if (vocab.token_to_id.find(" '") != vocab.token_to_id.end()) {
+            mask[vocab.token_to_id.at(" '")] |= WHISPER_SUPPRESS_POST;
+        }
+    }
+
+    // suppress any tokens matching a regular expression
+    // ref: https://github.com/openai/whisper/discussions/1041
+    if (params.suppress_regex != nullptr) {
+        if (!state.suppress_regex_valid || state.suppress_regex != params.suppress_regex) {
+            state.suppress_regex_valid = false;
+            state.suppress_regex_tokens.clear();
+
+            std::regex re(params.suppress_regex);
+            for (const auto & token_id : vocab.token_to_id) {
+                if (std::regex_match(token_id.first, re)) {
+                    state.suppress_regex_tokens.push_back(token_id.second);
+                }
+            }
+
+            state.suppress_regex       = params.suppress_regex;
+            state.suppress_regex_valid = true;
+        }
+
+        for (const whisper_token id : state.suppress_regex_tokens) {
+            mask[id] |= WHISPER_SUPPRESS_POST;
+        }
+    }
+}
+
 // process the logits for the selected decoder
 // - applies logit filters
 // - computes logprobs and probs
-// TODO: optimize
+// - computes the summary of the probs used for sampling
+// the work is fused into a few passes over the vocab - the reductions are kept sequential so that the results
+// do not depend on the vectorization
 static void whisper_process_logits(
               struct whisper_context & ctx,
                struct whisper_state  & state,
@@ -6150,106 +9322,63 @@ static void whisper_process_logits(
 
     const bool is_initial = tokens_cur.size() == 0;
     const int  n_logits   = vocab.id_to_token.size();
+    const int  n_text     = vocab.token_beg;
 
     WHISPER_ASSERT(n_logits == ctx.vocab.n_vocab);
+    WHISPER_ASSERT((int) state.logits_suppress.size() == n_logits);
 
-    // extract the logits for the last token
-    // we will be mutating, and therefore we don't want to use the ctx.logits buffer directly
     auto & probs    = decoder.probs;
     auto & logits   = decoder.logits;
     auto & logprobs = decoder.logprobs;
-    {
-        logits.resize(n_logits);
-        memcpy(logits.data(), state.logits.data() + decoder.i_batch*n_logits, n_logits*sizeof(float));
-
-        if (temperature > 0.0f) {
-            for (int i = 0; i < n_logits; i++) {
-                logits[i] /= temperature;
-            }
-        }
 
-        // will be populated a bit later
-        probs.resize(n_logits);
-        logprobs.resize(n_logits);
-    }
+    logits.resize(n_logits);
+    probs.resize(n_logits);
+    logprobs.resize(n_logits);
 
     // apply logit filters here
     // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L480-L493
     {
-        // suppress blank
-        // https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L388-L390
-        if (params.suppress_blank) {
-            if (is_initial) {
-                logits[vocab.token_eot]           = -INFINITY;
-                logits[vocab.token_to_id.at(" ")] = -INFINITY;
-            }
-        }
+        // extract the logits for the last token together with the temperature and the static suppression mask
+        // we will be mutating, and therefore we don't want to use the ctx.logits buffer directly
+        {
+            const float   * src  = state.logits.data() + state.output_ids[decoder.i_batch]*n_logits;
+            const uint8_t * mask = state.logits_suppress.data();
 
-        // suppress <|notimestamps|> token
-        // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L410-L412
-        logits[vocab.token_not] = -INFINITY;
-        if (params.no_timestamps) {
-            for (int i = vocab.token_beg; i < n_logits; ++i) {
-                logits[i] = -INFINITY;
-            }
-        }
+            // without a filter callback, all static filters can be applied at once
+            const uint8_t flags = params.logits_filter_callback ? WHISPER_SUPPRESS_PRE : WHISPER_SUPPRESS_PRE | WHISPER_SUPPRESS_POST;
 
-        // suppress sot and nosp tokens
-        logits[vocab.token_sot]  = -INFINITY;
-        logits[vocab.token_nosp] = -INFINITY;
+            float * dst = logits.data();
 
-        // [TDRZ] when tinydiarize is disabled, suppress solm token
-        if (params.tdrz_enable == false) {
-            logits[vocab.token_solm] = -INFINITY;
+            if (temperature > 0.0f) {
+                for (int i = 0; i < n_logits; i++) {
+                    dst[i] = (mask[i] & flags) ? -INFINITY : src[i]/temperature;
+                }
+            } else {
+                for (int i = 0; i < n_logits; i++) {
+                    dst[i] = (mask[i] & flags) ? -INFINITY : src[i];
+                }
+            }
         }
 
-        // suppress task tokens
-        logits[vocab.token_translate]  = -INFINITY;
-        logits[vocab.token_transcribe] = -INFINITY;
-        logits[vocab.token_prev]       = -INFINITY;
-
-        // suppress lang tokens
-        for (size_t i = 0; i < g_lang.size(); ++i) {
-            logits[whisper_token_lang(&ctx, i)] = -INFINITY;
+        // suppress blank
+        // https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L388-L390
+        if (params.suppress_blank) {
+            if (is_initial) {
+                logits[vocab.token_eot]           = -INFINITY;
+                logits[vocab.token_to_id.at(" ")] = -INFINITY;
+            }
         }
 
-        // suppress prev token
-        logits[vocab.token_prev] = -INFINITY;
-
         if (params.logits_filter_callback) {
             params.logits_filter_callback(&ctx, &state, tokens_cur.data(), tokens_cur.size(), logits.data(), params.logits_filter_callback_user_data);
-        }
 
-        // suppress any tokens matching a regular expression
-        // ref: https://github.com/openai/whisper/discussions/1041
-        if (params.suppress_regex != nullptr) {
-            std::regex re(params.suppress_regex);
-            for (std::pair<whisper_vocab::token, whisper_vocab::id> token_id : vocab.token_to_id) {
-                if (std::regex_match(token_id.first, re)) {
-                    logits[token_id.second] = -INFINITY;
-                }
-            }
-        }
+            const uint8_t * mask = state.logits_suppress.data();
 
-        // suppress non-speech tokens
-        // ref: https://github.com/openai/whisper/blob/7858aa9c08d98f75575035ecd6481f462d66ca27/whisper/tokenizer.py#L224-L253
-        if (params.suppress_nst) {
-            for (const std::string & token : non_speech_tokens) {
-                const std::string suppress_tokens[] = {token, " " + token};
-                for (const std::string & suppress_token : suppress_tokens) {
-                    if (vocab.token_to_id.find(suppress_token) != vocab.token_to_id.end()) {
-                        logits[vocab.token_to_id.at(suppress_token)] = -INFINITY;
-                    }
+            for (int i = 0; i < n_logits; i++) {
+                if (mask[i] & WHISPER_SUPPRESS_POST) {
+                    logits[i] = -INFINITY;
                 }
             }
-
-            // allow hyphens "-" and single quotes "'" between words, but not at the beginning of a word
-            if (vocab.token_to_id.find(" -") != vocab.token_to_id.end()) {
-                logits[vocab.token_to_id.at(" -")] = -INFINITY;
-            }
-            if (vocab.token_to_id.find(" '") != vocab.token_to_id.end()) {
-                logits[vocab.token_to_id.at(" '")] = -INFINITY;
-            }
         }
 
         // timestamps have to appear in pairs, except directly before EOT; mask logits accordingly
@@ -6262,13 +9391,9 @@ static void whisper_process_logits(
 
             if (last_was_timestamp) {
                 if (penultimate_was_timestamp) {
-                    for (int i = vocab.token_beg; i < n_logits; ++i) {
-                        logits[i] = -INFINITY;
-                    }
+                    std::fill(logits.begin() + vocab.token_beg, logits.end(), -INFINITY);
                 } else {
-                    for (int i = 0; i < vocab.token_eot; ++i) {
-                        logits[i] = -INFINITY;
-                    }
+                    std::fill(logits.begin(), logits.begin() + vocab.token_eot, -INFINITY);
                 }
             }
         }
@@ -6294,67 +9419,122 @@ static void whisper_process_logits(
             }
         }
 
-        // populate the logprobs array (log_softmax)
-        whisper_compute_logprobs(logits, n_logits, logprobs);
+        // log_softmax normalization
+        const float text_logit_max = whisper_max(logits.data(),          n_text);
+        const float ts_logit_max   = whisper_max(logits.data() + n_text, n_logits - n_text);
+
+        const float logsumexp = whisper_logsumexp(logits.data(), n_logits, std::max(text_logit_max, ts_logit_max));
 
+        // the max logprob is the max logit shifted by the normalization
+        const auto logprob_max = [&](float logit_max) {
+            return logit_max > -INFINITY ? logit_max - logsumexp : -INFINITY;
+        };
+
+        // populate the logprobs and the probs of the timestamp tokens and compute their logsumexp
         // if sum of probability over timestamps is above any other token, sample timestamp
         // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L431-L437
+        float timestamp_logprob = -INFINITY;
         {
-            // logsumexp over timestamps
-            float timestamp_logprob = -INFINITY;
-            {
-                float logsumexp = 0.0f;
-                const float logprob_max = *std::max_element(logprobs.begin() + vocab.token_beg, logprobs.end());
-                for (int i = vocab.token_beg; i < n_logits; ++i) {
-                    if (logprobs[i] > -INFINITY) {
-                        logsumexp += expf(logprobs[i] - logprob_max);
-                    }
+            const float ts_logprob_max = logprob_max(ts_logit_max);
+
+            decoder.ts_id  = -1;
+            decoder.ts_sum = 0.0;
+            decoder.ts_max = 0.0;
+
+            float ts_logsumexp = 0.0f;
+            for (int i = n_text; i < n_logits; ++i) {
+                if (logits[i] > -INFINITY) {
+                    logprobs[i] = logits[i] - logsumexp;
+                    probs[i]    = expf(logprobs[i]);
+
+                    ts_logsumexp += expf(logprobs[i] - ts_logprob_max);
+                } else {
+                    logprobs[i] = -INFINITY;
+                    probs[i]    = 0.0f;
                 }
-                if (logsumexp > 0.0f) {
-                    timestamp_logprob = logf(logsumexp) + logprob_max;
+
+                decoder.ts_sum += probs[i];
+                if (decoder.ts_max < probs[i]) {
+                    decoder.ts_max = probs[i];
+                    decoder.ts_id  = i;
                 }
             }
 
-            const float max_text_token_logprob = *std::max_element(logprobs.begin(), logprobs.begin() + vocab.token_beg);
+            if (ts_logsumexp > 0.0f) {
+                timestamp_logprob = logf(ts_logsumexp) + ts_logprob_max;
+            }
+        }
 
-            //WHISPER_LOG_INFO("timestamp_logprob=%f max_text_token_logprob=%f\n", timestamp_logprob, max_text_token_logprob);
+        const float max_text_token_logprob = logprob_max(text_logit_max);
 
-            if (timestamp_logprob > max_text_token_logprob) {
-                for (int i = 0; i < vocab.token_beg; ++i) {
-                    logits[i]   = -INFINITY;
-                    logprobs[i] = -INFINITY;
-                }
-            } else {
-                if (params.n_grammar_rules > 0) {
-                    whisper_suppress_invalid_grammar(ctx, params, logits, decoder.grammar);
+        //WHISPER_LOG_INFO("timestamp_logprob=%f max_text_token_logprob=%f\n", timestamp_logprob, max_text_token_logprob);
 
-                    // populate the logprobs array (log_softmax)
-                    {
-                        const float logit_max = *std::max_element(logits.begin(), logits.end());
-                        float logsumexp = 0.0f;
-                        for (int i = 0; i < n_logits; ++i) {
-                            if (logits[i] > -INFINITY) {
-                                logsumexp += expf(logits[i] - logit_max);
-                            }
-                        }
-                        logsumexp = logf(logsumexp) + logit_max;
+        if (timestamp_logprob > max_text_token_logprob) {
+            std::fill(logits.begin(),   logits.begin()   + n_text, -INFINITY);
+            std::fill(logprobs.begin(), logprobs.begin() + n_text, -INFINITY);
+            std::fill(probs.begin(),    probs.begin()    + n_text, 0.0f);
+
+            decoder.best_id = decoder.ts_id;
+        } else if (params.n_grammar_rules > 0) {
+            whisper_suppress_invalid_grammar(ctx, params, logits, decoder.grammar);
+
+            // populate the logprobs array (log_softmax)
+            whisper_compute_logprobs(logits, n_logits, logprobs);
+            whisper_compute_probs(logits, n_logits, logprobs, probs);
+
+            whisper_compute_probs_summary(vocab, decoder);
+        } else {
+            // populate the logprobs and the probs of the text tokens
+            decoder.best_id = -1;
+
+            float best_p = 0.0f;
+
+            if (params.strategy == WHISPER_SAMPLING_GREEDY && temperature < 1e-6f) {
+                // only the most probable token is sampled, so its prob is the only one needed
+                // expf is monotonic - only the logprobs close to the max can round to the same prob, which makes
+                // this pick the same (first) token as the full scan below
+                const float logprob_min = max_text_token_logprob - 1e-3f;
 
-                        for (int i = 0; i < n_logits; ++i) {
-                            if (logits[i] > -INFINITY) {
-                                logprobs[i] = logits[i] - logsumexp;
-                            } else {
-                                logprobs[i] = -INFINITY;
+                for (int i = 0; i < n_text; ++i) {
+                    if (logits[i] > -INFINITY) {
+                        logprobs[i] = logits[i] - logsumexp;
+
+                        if (logprobs[i] >= logprob_min) {
+                            probs[i] = expf(logprobs[i]);
+
+                            if (best_p < probs[i]) {
+                                best_p = probs[i];
+                                decoder.best_id = i;
                             }
                         }
+                    } else {
+                        logprobs[i] = -INFINITY;
+                    }
+                }
+            } else {
+                for (int i = 0; i < n_text; ++i) {
+                    if (logits[i] > -INFINITY) {
+                        logprobs[i] = logits[i] - logsumexp;
+                        probs[i]    = expf(logprobs[i]);
+                    } else {
+                        logprobs[i] = -INFINITY;
+                        probs[i]    = 0.0f;
+                    }
+
+                    if (best_p < probs[i]) {
+                        best_p = probs[i];
+                        decoder.best_id = i;
                     }
                 }
             }
+
+            // on ties the first token wins
+            if (decoder.ts_id >= 0 && best_p < decoder.ts_max) {
+                decoder.best_id = decoder.ts_id;
+            }
         }
     }
 
-    // compute probs
-    whisper_compute_probs(logits, n_logits, logprobs, probs);
-
 #if 0
     // print first 100 logits - token string : logit
     //for (int i = 0; i < 10; i++) {
@@ -6435,35 +9615,21 @@ static whisper_token_data whisper_sample_token(
     const auto & probs    = decoder.probs;
     const auto & logprobs = decoder.logprobs;
 
-    const int n_logits = vocab.n_vocab;
-
+    // the probs summary is computed by whisper_process_logits
     {
-        double sum_ts = 0.0;
-        double max_ts = 0.0;
-
-        for (int i = vocab.token_beg; i < n_logits; i++) {
-            if (probs[i] == -INFINITY) {
-                continue;
-            }
-
-            sum_ts += probs[i];
-            if (max_ts < probs[i]) {
-                max_ts = probs[i];
-                result.tid = i;
-            }
+        if (decoder.ts_id >= 0) {
+            result.tid = decoder.ts_id;
         }
 
-        result.pt    = max_ts/(sum_ts + 1e-10);
-        result.ptsum = sum_ts;
+        result.pt    = decoder.ts_max/(decoder.ts_sum + 1e-10);
+        result.ptsum = decoder.ts_sum;
     }
 
     if (best) {
-        for (int i = 0; i < n_logits; ++i) {
-            if (result.p < probs[i]) {
-                result.id   = i;
-                result.p    = probs[i];
-                result.plog = logprobs[i];
-            }
+        if (decoder.best_id >= 0) {
+            result.id   = decoder.best_id;
+            result.p    = probs[result.id];
+            result.plog = logprobs[result.id];
         }
     } else {
         std::discrete_distribution<> dist(probs.begin(), probs.end());
@@ -6481,63 +9647,22 @@ static whisper_token_data whisper_sample_token(
     return result;
 }
 
-static std::vector<whisper_token_data> whisper_sample_token_topk(
+// sample k candidate tokens for the next beam search step into result[0..k)
+static void whisper_sample_token_topk(
             whisper_context & ctx,
             whisper_decoder & decoder,
-                        int   k) {
+                        int   k,
+         whisper_token_data * result) {
     const auto & vocab = ctx.vocab;
 
     const auto & probs    = decoder.probs;
-    const auto & logits   = decoder.logits;
     const auto & logprobs = decoder.logprobs;
 
-    const int n_logits = vocab.n_vocab;
-
-    auto & logits_id = decoder.logits_id;
-
-    logits_id.resize(n_logits);
-    for (int i = 0; i < n_logits; ++i) {
-        logits_id[i].first = logits[i];
-        logits_id[i].second = i;
-    }
-
-    {
-        using pair_type = std::remove_reference<decltype(logits_id)>::type::value_type;
-        std::partial_sort(
-                logits_id.begin(),
-                logits_id.begin() + k, logits_id.end(),
-                [](const pair_type & a, const pair_type & b) {
-            return a.first > b.first;
-        });
-    }
-
-    std::vector<whisper_token_data> result;
-    result.reserve(k);
-
-    whisper_token tid = vocab.token_beg;
-
-    float pt    = 0.0;
-    float ptsum = 0.0;
-
-    {
-        double sum_ts = 0.0;
-        double max_ts = 0.0;
-
-        for (int i = vocab.token_beg; i < n_logits; i++) {
-            if (probs[i] == -INFINITY) {
-                continue;
-            }
-
-            sum_ts += probs[i];
-            if (max_ts < probs[i]) {
-                max_ts = probs[i];
-                tid = i;
-            }
-        }
+    // the probs summary is computed by whisper_process_logits
+    const whisper_token tid = decoder.ts_id >= 0 ? decoder.ts_id : vocab.token_beg;
 
-        pt    = max_ts/(sum_ts + 1e-10);
-        ptsum = sum_ts;
-    }
+    const float pt    = decoder.ts_max/(decoder.ts_sum + 1e-10);
+    const float ptsum = decoder.ts_sum;
 
     std::discrete_distribution<> dist(probs.begin(), probs.end());
 
@@ -6545,15 +9670,13 @@ static std::vector<whisper_token_data> whisper_sample_token_topk(
         const auto id = dist(decoder.rng);
         //printf("XXX %d %d %f %f %f %f\n", id, tid, probs[id], logprobs[id], pt, ptsum);
 
-        result.push_back({ id, tid, probs[id], logprobs[id], pt, ptsum, -1, -1, -1, 0.0f, });
+        result[i] = { id, tid, probs[id], logprobs[id], pt, ptsum, -1, -1, -1, 0.0f, };
 
         if (result[i].id >= vocab.token_beg) {
             result[i].tid = result[i].id;
             result[i].pt  = result[i].p;
         }
     }
-
-    return result;
 }
 
 // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L178-L192
@@ -6789,12 +9912,27 @@ static bool whisper_vad(
     return true;
 }
 
+// smallest audio context that covers the remaining audio starting at seek, plus a safety margin
+// the encoder positional embedding is sliced to this size, so the encoder and the cross-attention
+// only process the frames that actually contain audio
+static int whisper_audio_ctx_auto(const struct whisper_context * ctx, int seek, int seek_end) {
+    const int n_audio_ctx = ctx->model.hparams.n_audio_ctx;
+
+    const int n_frames = std::min(seek_end - seek, 2*n_audio_ctx);
+    const int n_ctx    = GGML_PAD((n_frames + 1)/2 + WHISPER_AUDIO_CTX_AUTO_MARGIN, 64);
+
+    return std::min(n_ctx, n_audio_ctx);
+}
+
 int whisper_full_with_state(
         struct whisper_context * ctx,
           struct whisper_state * state,
     struct whisper_full_params   params,
                    const float * samples,
                            int   n_samples) {
+    // keep the threadpool running between the graphs of the call
+    whisper_threadpool_scope threadpool_scope(state->threadpool);
+
     // clear old results
     auto & result_all = state->result_all;
 
@@ -6889,11 +10027,12 @@ int whisper_full_with_state(
         decoder.probs.resize   (ctx->vocab.n_vocab);
         decoder.logits.resize  (ctx->vocab.n_vocab);
         decoder.logprobs.resize(ctx->vocab.n_vocab);
-        decoder.logits_id.reserve(ctx->model.hparams.n_vocab);
 
         decoder.rng = std::mt19937(j);
     }
 
+    whisper_logits_suppress_init(*ctx, *state, params);
+
     // the accumulated text context split into static (prompt_past0) and dynamic (prompt_past1)
     auto & prompt_past0 = state->prompt_past0;
     auto & prompt_past1 = state->prompt_past1;
@@ -6948,7 +10087,13 @@ int whisper_full_with_state(
         WHISPER_LOG_ERROR("%s: audio_ctx is larger than the maximum allowed (%d > %d)\n", __func__, params.audio_ctx, whisper_n_audio_ctx(ctx));
         return -5;
     }
-    state->exp_n_audio_ctx = params.audio_ctx;
+    state->exp_n_audio_ctx = params.audio_ctx > 0 ? params.audio_ctx : 0;
+
+    // audio_ctx == -1: pick the audio context per segment based on the remaining audio
+    const bool audio_ctx_auto = params.audio_ctx == -1;
+
+    // set when the reduced context produced a suspicious segment - re-decode it with the full context
+    bool audio_ctx_full = false;
 
     // these tokens determine the task that will be performed
     std::vector<whisper_token> prompt_init = { whisper_token_sot(ctx), };
@@ -6982,18 +10127,46 @@ int whisper_full_with_state(
     std::vector<whisper_token> prompt;
     prompt.reserve(whisper_n_text_ctx(ctx));
 
+    // the prompt that is currently stored in the KV cache as sequence 0 and the logits of its last token
+    // a temperature fallback with the same prompt reuses them instead of decoding the prompt again
+    std::vector<whisper_token> prompt_cached;
+    std::vector<float>         prompt_cached_logits;
+
+    // a beam search candidate is the sequence of its decoder extended with one token
+    // the sequence itself is copied only if the candidate is selected
     struct beam_candidate {
         int decoder_idx;
-        int seek_delta;
 
+        whisper_token_data token;
+
+        double sum_logprobs_all; // of the extended sequence
+    };
+
+    // the state of a decoder that is the source of another decoder in the current beam search step
+    struct beam_source {
+        int  seek_delta;
+        bool has_ts;
+
+        whisper_sequence sequence;
+        whisper_grammar  grammar;
+    };
+
+    // a finished beam search hypothesis (see whisper_full_params.beam_search.patience)
+    struct beam_finished {
+        int  seek_delta;
         bool has_ts;
+        bool failed;
 
         whisper_sequence sequence;
-        whisper_grammar grammar;
     };
 
-    std::vector<std::vector<beam_candidate>> bc_per_dec(n_decoders);
-    std::vector<beam_candidate> beam_candidates;
+    const int beam_size = std::max(1, params.beam_search.beam_size);
+
+    // candidates of decoder j are stored at [j*beam_size, (j + 1)*beam_size)
+    std::vector<beam_candidate>     beam_candidates(n_decoders*beam_size);
+    std::vector<whisper_token_data> beam_tokens    (n_decoders*beam_size);
+    std::vector<beam_source>        beam_sources   (n_decoders);
+    std::vector<beam_finished>      beam_hyps;
 
     // main loop
     while (true) {
@@ -7016,12 +10189,19 @@ int whisper_full_with_state(
             }
         }
 
+        if (audio_ctx_auto) {
+            state->exp_n_audio_ctx = audio_ctx_full ? 0 : whisper_audio_ctx_auto(ctx, seek, seek_end);
+        }
+
         // encode audio features starting at offset seek
         if (!whisper_encode_internal(*ctx, *state, seek, params.n_threads, params.abort_callback, params.abort_callback_user_data)) {
             WHISPER_LOG_ERROR("%s: failed to encode\n", __func__);
             return -6;
         }
 
+        // the cached prompt was computed with the cross-attention of the previous audio segment
+        prompt_cached.clear();
+
         // if there is a very short audio segment left to process, we remove any past prompt since it tends
         // to confuse the decoder and often make it repeat or hallucinate stuff
         if (seek > seek_start && seek + 500 >= seek_end) {
@@ -7082,8 +10262,17 @@ int whisper_full_with_state(
                 }
             }
 
+            // [patience] with beam search, the decoding continues until this many hypotheses have finished
+            // the decoders that finish a hypothesis continue from the best remaining candidates
+            // ref: https://arxiv.org/pdf/2204.05424.pdf
+            int n_hyps_max = 0;
+            if (params.strategy == whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH && params.beam_search.patience > 0.0f) {
+                n_hyps_max = std::max(1, (int) std::round(n_decoders_cur*params.beam_search.patience));
+            }
+
+            beam_hyps.clear();
+
             // init prompt and kv cache for the current iteration
-            // TODO: do not recompute the prompt if it is the same as previous time
             {
                 prompt.clear();
 
@@ -7122,48 +10311,89 @@ int whisper_full_with_state(
                 if (state->kv_self_n_dec < n_decoders_cur) {
                     WHISPER_LOG_DEBUG("%s: recreating KV cache: n_decoders_cur = %d\n", __func__, n_decoders_cur);
 
+                    // the cached decoder graph references the old KV cache
+                    whisper_decoder_graph_reset(*state);
+
+                    // the prompt of the failed attempt is decoded again for the same audio in the new cache
+                    if (!prompt_cached.empty()) {
+                        whisper_prompt_snapshot_store(*ctx, *state, prompt_cached);
+                    }
+
                     whisper_kv_cache_free(state->kv_self);
 
-                    // overallocate to workaround KV cache fragmentation issues
-                    const int factor = n_decoders_cur > 1 ? n_decoders_cur + 2 : 1;
+                    // the decoders share the cells of the prompt and of the common prefixes of their sequences,
+                    // so besides the prompt (at most n_text_ctx/2 tokens) each decoder needs at most n_text_ctx/2 cells
+                    const int n_text_ctx = ctx->model.hparams.n_text_ctx;
 
-                    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], ctx->itype,
+                    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], ctx->ktype,
                                 ctx->model.hparams.n_text_state,
                                 ctx->model.hparams.n_text_layer,
-                                GGML_PAD(ctx->model.hparams.n_text_ctx, 256)*factor)) {
+                                GGML_PAD((n_text_ctx/2)*(n_decoders_cur + 1), 256))) {
                         WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for self-attention cache\n", __func__);
-                        whisper_free_state(state);
+                        // the state is owned by the caller (e.g. a state pool) - the next call recreates the cache
+                        whisper_kv_cache_free(state->kv_self);
+                        state->kv_self_n_dec = 0;
                         return -7;
                     }
 
                     state->kv_self_n_dec = n_decoders_cur;
+
+                    prompt_cached.clear();
                 }
 
-                whisper_kv_cache_clear(state->kv_self);
+                // index of the last prompt token in the decoded batch
+                int i_batch_last = 0;
+
+                if (prompt == prompt_cached) {
+                    WHISPER_LOG_DEBUG("%s: reusing the KV cache of the prompt (%d tokens)\n", __func__, (int) prompt.size());
+
+                    // keep the prompt cells of sequence 0 and drop everything decoded after them
+                    whisper_kv_cache_seq_keep(state->kv_self, 0);
+                    whisper_kv_cache_seq_rm  (state->kv_self, 0, prompt.size(), -1);
+
+                    // restore the logits of the last prompt token
+                    state->logits = prompt_cached_logits;
+
+                    state->output_ids.assign(1, 0);
+                    state->n_outputs = 1;
+                } else {
+                    whisper_kv_cache_clear(state->kv_self);
+
+                    // decode only the part of the prompt that is not in a snapshot
+                    const int n_past = whisper_prompt_snapshot_restore(*ctx, *state, prompt);
 
-                whisper_batch_prep_legacy(state->batch, prompt.data(), prompt.size(), 0, 0);
+                    whisper_batch_prep_legacy(state->batch, prompt.data() + n_past, prompt.size() - n_past, n_past, 0);
 
-                if (!whisper_decode_internal(*ctx, *state, state->batch, params.n_threads, false, params.abort_callback, params.abort_callback_user_data)) {
-                    WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
-                    return -8;
+                    if (!whisper_decode_internal(*ctx, *state, state->batch, params.n_threads, false, params.abort_callback, params.abort_callback_user_data)) {
+                        WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
+                        return -8;
+                    }
+
+                    i_batch_last = state->batch.n_tokens - 1;
+
+                    prompt_cached        = prompt;
+                    prompt_cached_logits = state->logits;
                 }
 
                 // Calculate no_speech probability after first decode.
                 // This has to be done before any logit filtering. Hence we cannot use the probs from the whisper_process_logits.
                 {
                     const int n_logits = ctx->vocab.id_to_token.size();
-                    std::vector<float> logprobs(n_logits);
-                    std::vector<float> probs(n_logits);
 
-                    whisper_compute_logprobs(state->logits, n_logits, logprobs);
-                    whisper_compute_probs(state->logits, n_logits, logprobs, probs);
-                    state->no_speech_prob = probs[whisper_token_nosp(ctx)];
+                    const float * logits = state->logits.data() + state->output_ids[i_batch_last]*n_logits;
+
+                    const float logit_max = whisper_max(logits, n_logits);
+                    const float logsumexp = whisper_logsumexp(logits, n_logits, logit_max);
+
+                    const float logit_nosp = logits[whisper_token_nosp(ctx)];
+
+                    state->no_speech_prob = logit_nosp == -INFINITY ? 0.0f : expf(logit_nosp - logsumexp);
                 }
 
                 {
                     const int64_t t_start_sample_us = ggml_time_us();
 
-                    state->decoders[0].i_batch = prompt.size() - 1;
+                    state->decoders[0].i_batch = i_batch_last;
 
                     whisper_process_logits(*ctx, *state, state->decoders[0], params, t_cur);
 
@@ -7175,6 +10405,11 @@ int whisper_full_with_state(
                         memcpy(decoder.probs.data(),    state->decoders[0].probs.data(),    decoder.probs.size()*sizeof(decoder.probs[0]));
                         memcpy(decoder.logits.data(),   state->decoders[0].logits.data(),   decoder.logits.size()*sizeof(decoder.logits[0]));
                         memcpy(decoder.logprobs.data(), state->decoders[0].logprobs.data(), decoder.logprobs.size()*sizeof(decoder.logprobs[0]));
+
+                        decoder.best_id = state->decoders[0].best_id;
+                        decoder.ts_id   = state->decoders[0].ts_id;
+                        decoder.ts_sum  = state->decoders[0].ts_sum;
+                        decoder.ts_max  = state->decoders[0].ts_max;
                     }
 
                     state->t_sample_us += ggml_time_us() - t_start_sample_us;
@@ -7184,14 +10419,7 @@ int whisper_full_with_state(
             for (int i = 0, n_max = whisper_n_text_ctx(ctx)/2 - 4; i < n_max; ++i) {
                 const int64_t t_start_sample_us = ggml_time_us();
 
-                if (params.strategy == whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH) {
-                    for (auto & bc : bc_per_dec) {
-                        bc.clear();
-                    }
-                }
-
                 // sampling
-                // TODO: avoid memory allocations, optimize, avoid threads?
                 {
                     std::atomic<int> j_cur(0);
 
@@ -7205,6 +10433,9 @@ int whisper_full_with_state(
 
                             auto & decoder = state->decoders[j];
 
+                            // mark the candidates of the decoder as unused
+                            beam_candidates[j*beam_size].decoder_idx = -1;
+
                             if (decoder.completed || decoder.failed) {
                                 continue;
                             }
@@ -7222,99 +10453,156 @@ int whisper_full_with_state(
                                     } break;
                                 case whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH:
                                     {
-                                        const auto tokens_new = whisper_sample_token_topk(*ctx, decoder, params.beam_search.beam_size);
+                                        whisper_token_data * tokens_new = beam_tokens.data() + j*beam_size;
 
-                                        for (const auto & token : tokens_new) {
-                                            bc_per_dec[j].push_back({ j, decoder.seek_delta, decoder.has_ts, decoder.sequence, decoder.grammar, });
-                                            bc_per_dec[j].back().sequence.tokens.push_back(token);
-                                            bc_per_dec[j].back().sequence.sum_logprobs_all += token.plog;
+                                        whisper_sample_token_topk(*ctx, decoder, beam_size, tokens_new);
+
+                                        for (int k = 0; k < beam_size; ++k) {
+                                            beam_candidates[j*beam_size + k] = { j, tokens_new[k], decoder.sequence.sum_logprobs_all + tokens_new[k].plog, };
                                         }
                                     } break;
                             };
                         }
                     };
 
-                    const int n_threads = std::min(params.n_threads, n_decoders_cur);
+                    whisper_worker_pool_run(state->worker_pool, std::min(params.n_threads, n_decoders_cur), process);
+                }
 
-                    if (n_threads == 1) {
-                        process();
-                    } else {
-                        std::vector<std::thread> threads(n_threads - 1);
+                // for beam-search, choose the top candidates and update the KV caches
+                if (params.strategy == whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH) {
+                    // gather the candidates of the decoders that were sampled
+                    int n_cand = 0;
+                    for (int j = 0; j < n_decoders_cur; ++j) {
+                        if (beam_candidates[j*beam_size].decoder_idx < 0) {
+                            continue;
+                        }
 
-                        for (int t = 0; t < n_threads - 1; ++t) {
-                            threads[t] = std::thread(process);
+                        for (int k = 0; k < beam_size; ++k) {
+                            beam_candidates[n_cand++] = beam_candidates[j*beam_size + k];
                         }
 
-                        process();
+                        state->n_sample += 1;
+                    }
 
-                        for (int t = 0; t < n_threads - 1; ++t) {
-                            threads[t].join();
+                    // the candidates are consumed in order of decreasing sum of logprobs
+                    // they are popped from a heap on demand, so only the candidates that are used get ordered
+                    const auto cand_less = [](const beam_candidate & a, const beam_candidate & b) {
+                        if (a.sum_logprobs_all != b.sum_logprobs_all) {
+                            return a.sum_logprobs_all < b.sum_logprobs_all;
                         }
-                    }
-                }
+                        if (a.decoder_idx != b.decoder_idx) {
+                            return a.decoder_idx > b.decoder_idx;
+                        }
+                        return a.token.id > b.token.id;
+                    };
 
-                beam_candidates.clear();
-                for (const auto & bc : bc_per_dec) {
-                    beam_candidates.insert(beam_candidates.end(), bc.begin(), bc.end());
+                    std::make_heap(beam_candidates.begin(), beam_candidates.begin() + n_cand, cand_less);
 
-                    if (!bc.empty()) {
-                        state->n_sample += 1;
-                    }
-                }
+                    int n_heap = n_cand;
 
-                // for beam-search, choose the top candidates and update the KV caches
-                if (params.strategy == whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH) {
-                    std::sort(
-                            beam_candidates.begin(),
-                            beam_candidates.end(),
-                            [](const beam_candidate & a, const beam_candidate & b) {
-                        if (a.sequence.sum_logprobs_all != b.sequence.sum_logprobs_all) {
-                            return a.sequence.sum_logprobs_all > b.sequence.sum_logprobs_all;
+                    // the c-th best candidate
+                    const auto cand_at = [&](int c) -> const beam_candidate & {
+                        while (n_cand - n_heap <= c) {
+                            std::pop_heap(beam_candidates.begin(), beam_candidates.begin() + n_heap, cand_less);
+                            --n_heap;
+                        }
+
+                        return beam_candidates[n_cand - 1 - c];
+                    };
+
+                    // two candidates are the same sequence if they extend equal sequences with the same token
+                    // seq_class[j] is the first decoder with the same sequence as decoder j
+                    int seq_class[WHISPER_MAX_DECODERS];
+                    for (int j = 0; j < n_decoders_cur; ++j) {
+                        seq_class[j] = j;
+                        for (int jj = 0; jj < j; ++jj) {
+                            if (seq_class[jj] == jj && whisper_sequence_tokens_equal(state->decoders[jj].sequence, state->decoders[j].sequence)) {
+                                seq_class[j] = jj;
+                                break;
+                            }
                         }
-                        return a.decoder_idx < b.decoder_idx;
-                    });
+                    }
+
+                    const auto cand_equal = [&](const beam_candidate & a, const beam_candidate & b) {
+                        return a.token.id == b.token.id && seq_class[a.decoder_idx] == seq_class[b.decoder_idx];
+                    };
+
+                    int cur_c = 0;
 
-                    uint32_t cur_c = 0;
+                    // the source decoder of each decoder (-1 - unchanged) and the selected candidate
+                    whisper_seq_id seq_src [WHISPER_MAX_DECODERS];
+                    beam_candidate cand_sel[WHISPER_MAX_DECODERS];
 
                     for (int j = 0; j < n_decoders_cur; ++j) {
                         auto & decoder = state->decoders[j];
 
-                        if (decoder.completed || decoder.failed) {
+                        seq_src[j] = -1;
+
+                        // [patience] the decoders of finished hypotheses are reused
+                        if (decoder.failed || (decoder.completed && n_hyps_max == 0) || n_cand == 0) {
                             continue;
                         }
 
-                        if (cur_c >= beam_candidates.size()) {
+                        if (cur_c >= n_cand) {
                             cur_c = 0;
                         }
 
-                        auto & cur = beam_candidates[cur_c++];
+                        const auto & cur = cand_at(cur_c++);
 
-                        while (beam_candidates.size() > cur_c && whisper_sequence_tokens_equal(beam_candidates[cur_c].sequence, cur.sequence) && i > 0) {
+                        while (i > 0 && n_cand > cur_c && cand_equal(cand_at(cur_c), cur)) {
                             ++cur_c;
                         }
 
-                        decoder.seek_delta = cur.seek_delta;
-                        decoder.has_ts     = cur.has_ts;
-                        decoder.sequence   = cur.sequence;
-                        decoder.grammar    = cur.grammar;
+                        seq_src [j] = cur.decoder_idx;
+                        cand_sel[j] = cur;
 
-                        whisper_kv_cache_seq_cp(state->kv_self, cur.decoder_idx, WHISPER_MAX_DECODERS + j, -1, -1);
+                        // snapshot the sources before any decoder is updated - a decoder can be the source of
+                        // another decoder and be reassigned itself
+                        if (cur.decoder_idx != j) {
+                            const auto & src = state->decoders[cur.decoder_idx];
 
-                        WHISPER_LOG_DEBUG("%s: beam search: decoder %d: from decoder %d: token = %10s, plog = %8.5f, sum_logprobs = %8.5f\n",
-                                __func__, j, cur.decoder_idx, ctx->vocab.id_to_token.at(decoder.sequence.tokens.back().id).c_str(), decoder.sequence.tokens.back().plog, decoder.sequence.sum_logprobs_all);
+                            auto & dst = beam_sources[j];
+
+                            dst.seek_delta = src.seek_delta;
+                            dst.has_ts     = src.has_ts;
+                            dst.sequence   = src.sequence;
+
+                            // the grammar rules are the same for all decoders - only the parse state is copied
+                            dst.grammar.stacks       = src.grammar.stacks;
+                            dst.grammar.partial_utf8 = src.grammar.partial_utf8;
+                        }
                     }
 
                     for (int j = 0; j < n_decoders_cur; ++j) {
+                        if (seq_src[j] < 0) {
+                            continue;
+                        }
+
                         auto & decoder = state->decoders[j];
 
-                        if (decoder.completed || decoder.failed) {
-                            continue;
+                        const auto & cur = cand_sel[j];
+
+                        if (cur.decoder_idx != j) {
+                            auto & src = beam_sources[j];
+
+                            // swap to keep the allocated buffers of both for the next steps
+                            decoder.seek_delta = src.seek_delta;
+                            decoder.has_ts     = src.has_ts;
+                            std::swap(decoder.sequence,             src.sequence);
+                            std::swap(decoder.grammar.stacks,       src.grammar.stacks);
+                            std::swap(decoder.grammar.partial_utf8, src.grammar.partial_utf8);
                         }
 
-                        whisper_kv_cache_seq_rm(state->kv_self, j,                           -1, -1);
-                        whisper_kv_cache_seq_cp(state->kv_self, WHISPER_MAX_DECODERS + j, j, -1, -1);
-                        whisper_kv_cache_seq_rm(state->kv_self, WHISPER_MAX_DECODERS + j,    -1, -1);
+                        decoder.sequence.tokens.push_back(cur.token);
+                        decoder.sequence.sum_logprobs_all = cur.sum_logprobs_all;
+
+                        decoder.completed = false;
+
+                        WHISPER_LOG_DEBUG("%s: beam search: decoder %d: from decoder %d: token = %10s, plog = %8.5f, sum_logprobs = %8.5f\n",
+                                __func__, j, cur.decoder_idx, ctx->vocab.id_to_token.at(cur.token.id).c_str(), cur.token.plog, cur.sum_logprobs_all);
                     }
+
+                    whisper_kv_cache_seq_remap(state->kv_self, seq_src, n_decoders_cur);
                 }
 
                 // update the decoder state
@@ -7385,6 +10673,11 @@ int whisper_full_with_state(
 
                             WHISPER_LOG_DEBUG("%s: decoder %d completed\n", __func__, j);
                             completed = true;
+
+                            if ((int) beam_hyps.size() < n_hyps_max) {
+                                beam_hyps.push_back({ seek_delta, has_ts, false, decoder.sequence, });
+                            }
+
                             continue;
                         }
 
@@ -7405,6 +10698,11 @@ int whisper_full_with_state(
                     }
                 }
 
+                // [patience] stop when enough hypotheses have finished
+                if (n_hyps_max > 0 && (int) beam_hyps.size() >= n_hyps_max) {
+                    break;
+                }
+
                 // check if all decoders have finished (i.e. completed or failed)
                 {
                     bool completed_all = true;
@@ -7462,7 +10760,6 @@ int whisper_full_with_state(
 
                     const int64_t t_start_sample_us = ggml_time_us();
 
-                    // TODO: avoid memory allocations, optimize, avoid threads?
                     {
                         std::atomic<int> j_cur(0);
 
@@ -7484,23 +10781,7 @@ int whisper_full_with_state(
                             }
                         };
 
-                        const int n_threads = std::min(params.n_threads, n_decoders_cur);
-
-                        if (n_threads == 1) {
-                            process();
-                        } else {
-                            std::vector<std::thread> threads(n_threads - 1);
-
-                            for (int t = 0; t < n_threads - 1; ++t) {
-                                threads[t] = std::thread(process);
-                            }
-
-                            process();
-
-                            for (int t = 0; t < n_threads - 1; ++t) {
-                                threads[t].join();
-                            }
-                        }
+                        whisper_worker_pool_run(state->worker_pool, std::min(params.n_threads, n_decoders_cur), process);
                     }
 
                     state->t_sample_us += ggml_time_us() - t_start_sample_us;
@@ -7511,32 +10792,81 @@ int whisper_full_with_state(
             {
                 double best_score = -INFINITY;
 
-                for (int j = 0; j < n_decoders_cur; ++j) {
-                    auto & decoder = state->decoders[j];
-
-                    if (decoder.failed) {
-                        continue;
-                    }
+                // returns false if the sequence failed
+                const auto rank_sequence = [&](whisper_sequence & sequence, int j) {
+                    GGML_UNUSED(j);
 
-                    decoder.sequence.tokens.resize(decoder.sequence.result_len);
-                    whisper_sequence_score(params, decoder.sequence);
+                    sequence.tokens.resize(sequence.result_len);
+                    whisper_sequence_score(params, sequence);
 
                     WHISPER_LOG_DEBUG("%s: decoder %2d: score = %8.5f, result_len = %3d, avg_logprobs = %8.5f, entropy = %8.5f\n",
-                            __func__, j, decoder.sequence.score, decoder.sequence.result_len, decoder.sequence.avg_logprobs, decoder.sequence.entropy);
+                            __func__, j, sequence.score, sequence.result_len, sequence.avg_logprobs, sequence.entropy);
 
-                    if (decoder.sequence.result_len > 32 && decoder.sequence.entropy < params.entropy_thold) {
+                    if (sequence.result_len > 32 && sequence.entropy < params.entropy_thold) {
                         WHISPER_LOG_DEBUG("%s: decoder %2d: failed due to entropy %8.5f < %8.5f\n",
-                                __func__, j, decoder.sequence.entropy, params.entropy_thold);
+                                __func__, j, sequence.entropy, params.entropy_thold);
 
-                        decoder.failed = true;
                         state->n_fail_h++;
 
-                        continue;
+                        return false;
+                    }
+
+                    return true;
+                };
+
+                if (!beam_hyps.empty()) {
+                    // [patience] the finished hypotheses are ranked instead of the decoders
+                    int best_hyp_id = -1;
+
+                    for (int h = 0; h < (int) beam_hyps.size(); ++h) {
+                        auto & hyp = beam_hyps[h];
+
+                        hyp.failed = !rank_sequence(hyp.sequence, h);
+                        if (hyp.failed) {
+                            continue;
+                        }
+
+                        if (best_score < hyp.sequence.score) {
+                            best_score = hyp.sequence.score;
+                            best_hyp_id = h;
+                        }
+                    }
+
+                    // the results are taken from the best decoder - move the best hypothesis there
+                    best_decoder_id = 0;
+
+                    auto & decoder = state->decoders[best_decoder_id];
+
+                    if (best_hyp_id >= 0) {
+                        auto & hyp = beam_hyps[best_hyp_id];
+
+                        decoder.seek_delta = hyp.seek_delta;
+                        decoder.has_ts     = hyp.has_ts;
+                        decoder.sequence   = std::move(hyp.sequence);
+                        decoder.failed     = false;
+                        decoder.completed  = true;
+                    } else {
+                        decoder.failed = true;
                     }
 
-                    if (best_score < decoder.sequence.score) {
-                        best_score = decoder.sequence.score;
-                        best_decoder_id = j;
+                    WHISPER_LOG_DEBUG("%s: best hypothesis = %d (out of %d)\n", __func__, best_hyp_id, (int) beam_hyps.size());
+                } else {
+                    for (int j = 0; j < n_decoders_cur; ++j) {
+                        auto & decoder = state->decoders[j];
+
+                        if (decoder.failed) {
+                            continue;
+                        }
+
+                        if (!rank_sequence(decoder.sequence, j)) {
+                            decoder.failed = true;
+                            continue;
+                        }
+
+                        if (best_score < decoder.sequence.score) {
+                            best_score = decoder.sequence.score;
+                            best_decoder_id = j;
+                        }
                     }
                 }
 
@@ -7570,6 +10900,30 @@ int whisper_full_with_state(
             WHISPER_LOG_DEBUG("\n%s: failed to decode with temperature = %.2f\n", __func__, t_cur);
         }
 
+        // with a reduced audio context, the decoder cannot see past the end of the window
+        // if the result looks truncated - failed or timestamps close to the edge - re-decode with the full context
+        if (audio_ctx_auto && !audio_ctx_full && state->exp_n_audio_ctx > 0 && state->exp_n_audio_ctx < whisper_n_audio_ctx(ctx)) {
+            const auto & best_decoder = state->decoders[best_decoder_id];
+
+            const int ts_edge = state->exp_n_audio_ctx - WHISPER_AUDIO_CTX_AUTO_MARGIN/2;
+
+            bool truncated = best_decoder.failed;
+            for (int i = 0; i < best_decoder.sequence.result_len && !truncated; ++i) {
+                const auto & token = best_decoder.sequence.tokens[i];
+                if (token.id > whisper_token_beg(ctx) && token.id - whisper_token_beg(ctx) > ts_edge) {
+                    truncated = true;
+                }
+            }
+
+            if (truncated) {
+                WHISPER_LOG_DEBUG("%s: segment at %d truncated with audio_ctx = %d, retrying with the full context\n", __func__, seek, state->exp_n_audio_ctx);
+                audio_ctx_full = true;
+                continue;
+            }
+        }
+
+        audio_ctx_full = false;
+
         // output results through a user-provided callback
         {
             const auto & best_decoder = state->decoders[best_decoder_id];
@@ -8246,6 +11600,19 @@ WHISPER_API const char * whisper_bench_ggml_mul_mat_str(int n_threads) {
     // put a bunch of random data in the buffer
     for (size_t i = 0; i < buf.size(); i++) buf[i] = i;
 
+    // one CPU backend and threadpool for all runs, so that the thread creation is not measured
+    ggml_backend_ptr backend { ggml_backend_init_by_type(GGML_BACKEND_DEVICE_TYPE_CPU, nullptr) };
+
+    whisper_context_params cparams = whisper_context_default_params();
+
+    struct ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+    cparams.threadpool_params = &tpp;
+
+    whisper_threadpool * threadpool = whisper_threadpool_init(cparams);
+    if (threadpool) {
+        whisper_threadpool_attach(threadpool, { backend.get() });
+    }
+
     for (int j = 0; j < (int) sizes.size(); j++) {
         int n_q4_0 = 0;
         int n_q4_1 = 0;
@@ -8298,12 +11665,12 @@ WHISPER_API const char * whisper_bench_ggml_mul_mat_str(int n_threads) {
             double tsum = 0.0;
 
             // heat-up
-            ggml_graph_compute_helper(gf, n_threads, nullptr, nullptr);
+            ggml_graph_compute_helper(backend.get(), gf, n_threads);
 
             for (int i = 0; i < n_max; ++i) {
                 const int64_t t0 = ggml_time_us();
 
-                ggml_graph_compute_helper(gf, n_threads, nullptr, nullptr);
+                ggml_graph_compute_helper(backend.get(), gf, n_threads);
 
                 const int64_t t1 = ggml_time_us();
 
@@ -8336,6 +11703,10 @@ WHISPER_API const char * whisper_bench_ggml_mul_mat_str(int n_threads) {
         s += strbuf;
     }
 
+    // the backend keeps a pointer to the threadpool
+    backend.reset();
+    whisper_threadpool_free(threadpool);
+
     return s.c_str();
 }
 
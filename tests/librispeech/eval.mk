@@ -5,6 +5,7 @@ WHISPER_MODEL = tiny
 
 WHISPER_CLI = $(WHISPER_PREFIX)build/bin/whisper-cli
 WHISPER_FLAGS = --no-prints --language en --output-txt
+WHISPER_KV_TYPE = f16
 
 # You can create eval.conf to override the WHISPER_* variables
 # defined above.
@@ -26,7 +27,7 @@ $(DONE): $(TRANS_TXTS)
 # Note: This task writes to a temporary file first to
 # create the target file atomically.
 %.flac.txt: %.flac
-	$(WHISPER_CLI) $(WHISPER_FLAGS) --model $(WHISPER_PREFIX)models/ggml-$(WHISPER_MODEL).bin --file $^ --output-file $^.tmp
+	$(WHISPER_CLI) $(WHISPER_FLAGS) --kv-type $(WHISPER_KV_TYPE) --model $(WHISPER_PREFIX)models/ggml-$(WHISPER_MODEL).bin --file $^ --output-file $^.tmp
 	mv $^.tmp.txt $^.txt
 
 archive:
@@ -0,0 +1,98 @@
+// compares the mixed-radix FFT of the mel spectrogram against a naive DFT
+
+#include "whisper-fft.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+
+// bins [0, n/2] of the DFT of a real input, in double precision
+static std::vector<double> dft_naive(const std::vector<float> & in) {
+    const int n = (int) in.size();
+
+    std::vector<double> out(2*(n/2 + 1));
+    for (int k = 0; k <= n/2; ++k) {
+        double re = 0.0;
+        double im = 0.0;
+        for (int j = 0; j < n; ++j) {
+            // reduce k*j mod n, so that the angle stays accurate for the large sizes
+            const double theta = (2*M_PI*((int64_t) k*j % n))/n;
+            re += in[j]*cos(theta);
+            im -= in[j]*sin(theta);
+        }
+        out[2*k + 0] = re;
+        out[2*k + 1] = im;
+    }
+
+    return out;
+}
+
+static bool test_fft(int n, bool window, double max_err, std::mt19937 & rng) {
+    whisper_fft_plan plan;
+    plan.init(n);
+
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<float> in(n);
+    for (int i = 0; i < n; ++i) {
+        in[i] = dist(rng);
+        if (window) {
+            // a Hann-windowed frame, as in log_mel_spectrogram_frame
+            in[i] *= 0.5f*(1.0f - cosf((2.0f*M_PI*i)/n));
+        }
+    }
+
+    // the output of whisper_fft is followed by 2 floats of padding in the mel spectrogram
+    std::vector<float> out(n + 2);
+    std::vector<float> work(4*plan.m);
+
+    whisper_fft(plan, in.data(), out.data(), work.data());
+
+    const std::vector<double> ref = dft_naive(in);
+
+    // error relative to the largest magnitude of the reference spectrum
+    double err = 0.0;
+    double mag = 0.0;
+    for (int k = 0; k <= n/2; ++k) {
+        err = std::max(err, std::hypot(out[2*k + 0] - ref[2*k + 0], out[2*k + 1] - ref[2*k + 1]));
+        mag = std::max(mag, std::hypot(ref[2*k + 0], ref[2*k + 1]));
+    }
+    err /= mag;
+
+    const bool ok = err <= max_err;
+
+    char desc[64];
+    snprintf(desc, sizeof(desc), "FFT(n=%d,window=%d)", n, window);
+    printf("  %-30s err = %.3e %s\n", desc, err, ok ? "OK" : "FAIL");
+
+    return ok;
+}
+
+int main() {
+    std::mt19937 rng(1234);
+
+    bool ok = true;
+
+    for (bool window : { false, true }) {
+        // WHISPER_N_FFT - the complex size is 200 = 4*2*5*5
+        ok &= test_fft(400, window, 1e-5, rng);
+
+        // powers of two - radix 4 and 2 only
+        for (int n : { 2, 4, 8, 16, 64, 256, 512, 1024 }) {
+            ok &= test_fft(n, window, 1e-5, rng);
+        }
+
+        // the other radices, alone and mixed
+        for (int n : { 6, 10, 18, 50, 120, 240, 480, 1000 }) {
+            ok &= test_fft(n, window, 1e-5, rng);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+// compares fused/specialized ggml CPU ops against the same computation built from the basic ops
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+
+static void init_tensor_uniform(struct ggml_tensor * t, std::mt19937 & rng, float min = -1.0f, float max = 1.0f) {
+    std::uniform_real_distribution<float> dist(min, max);
+
+    std::vector<float> data(ggml_nelements(t));
+    for (auto & x : data) {
+        x = dist(rng);
+    }
+
+    switch (t->type) {
+        case GGML_TYPE_F32: memcpy(t->data, data.data(), data.size()*sizeof(float)); break;
+        case GGML_TYPE_F16: ggml_fp32_to_fp16_row(data.data(), (ggml_fp16_t *) t->data, data.size()); break;
+        default: assert(false);
+    }
+}
+
+// normalized mean squared error, as in test-backend-ops
+static double nmse(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    assert(a->type == GGML_TYPE_F32 && b->type == GGML_TYPE_F32);
+    assert(ggml_are_same_shape(a, b) && ggml_is_contiguous(a) && ggml_is_contiguous(b));
+
+    const float * pa = (const float *) a->data;
+    const float * pb = (const float *) b->data;
+
+    double err = 0.0;
+    double ref = 0.0;
+    for (int64_t i = 0; i < ggml_nelements(a); ++i) {
+        err += (pa[i] - pb[i])*(pa[i] - pb[i]);
+        ref += pb[i]*pb[i];
+    }
+
+    return err/ref;
+}
+
+// out and ref must be in the same context, which is used to compute the graph
+static bool test_compare(
+        struct ggml_context * ctx, struct ggml_tensor * out, struct ggml_tensor * ref,
+        int n_threads, double max_nmse, const char * desc) {
+    struct ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+    ggml_build_forward_expand(gf, ref);
+
+    if (ggml_graph_compute_with_ctx(ctx, gf, n_threads) != GGML_STATUS_SUCCESS) {
+        fprintf(stderr, "%s: %s: compute failed\n", __func__, desc);
+        return false;
+    }
+
+    const double err = nmse(out, ref);
+    const bool   ok  = std::isfinite(err) && err <= max_nmse;
+
+    printf("  %-70s nmse = %.3e %s\n", desc, err, ok ? "OK" : "FAIL");
+
+    return ok;
+}
+
+// ggml_conv_1d always builds an F16 im2col, which the CPU backend supports only for F16 kernels
+static struct ggml_tensor * conv_1d(struct ggml_context * ctx, struct ggml_tensor * a, struct ggml_tensor * b, int s0, int p0, int d0) {
+    if (a->type == GGML_TYPE_F16) {
+        return ggml_conv_1d(ctx, a, b, s0, p0, d0);
+    }
+
+    struct ggml_tensor * im2col = ggml_im2col(ctx, a, b, s0, 0, p0, 0, d0, 0, false, GGML_TYPE_F32);
+
+    struct ggml_tensor * result =
+        ggml_mul_mat(ctx,
+                ggml_reshape_2d(ctx, im2col, im2col->ne[0], im2col->ne[2]*im2col->ne[1]),
+                ggml_reshape_2d(ctx, a, a->ne[0]*a->ne[1], a->ne[2]));
+
+    return ggml_reshape_3d(ctx, result, im2col->ne[1], a->ne[2], im2col->ne[2]);
+}
+
+// GGML_OP_CONV_1D_GELU vs gelu(conv_1d(a, b) + c)
+static bool test_conv_1d_gelu(ggml_type type_a, int64_t K, int64_t IC, int64_t OC, int64_t L, int s0, int p0, int d0, int n_threads) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 256*1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+
+    struct ggml_context * ctx = ggml_init(params);
+    assert(ctx != nullptr);
+
+    std::mt19937 rng(42);
+
+    struct ggml_tensor * a = ggml_new_tensor_3d(ctx, type_a,        K, IC, OC);
+    struct ggml_tensor * b = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, L, IC);
+    struct ggml_tensor * c = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, 1, OC);
+
+    init_tensor_uniform(a, rng);
+    init_tensor_uniform(b, rng);
+    init_tensor_uniform(c, rng);
+
+    struct ggml_tensor * out = ggml_conv_1d_gelu(ctx, a, b, c, s0, p0, d0);
+    struct ggml_tensor * ref = ggml_gelu(ctx, ggml_add(ctx, conv_1d(ctx, a, b, s0, p0, d0), c));
+
+    char desc[128];
+    snprintf(desc, sizeof(desc), "CONV_1D_GELU(type_a=%s,K=%d,IC=%d,OC=%d,L=%d,s0=%d,p0=%d,d0=%d,nt=%d)",
+            ggml_type_name(type_a), (int) K, (int) IC, (int) OC, (int) L, s0, p0, d0, n_threads);
+
+    const bool ok = test_compare(ctx, out, ref, n_threads, 1e-7, desc);
+
+    ggml_free(ctx);
+
+    return ok;
+}
+
+enum mask_mode {
+    MASK_NONE,
+    MASK_RANDOM, // random -INF entries and a fully masked leading range spanning whole KV chunks
+    MASK_ALIBI,  // -distance position bias (with max_bias > 0) and the same -INF entries
+};
+
+// GGML_OP_FLASH_ATTN_EXT vs softmax(k*q*scale + mask)*v
+// with few q rows the CPU backend splits the KV sequence across the threads (split-K)
+static bool test_flash_attn_ext(
+        ggml_type type_kv, int64_t D, int64_t n_head, int64_t n_head_kv, int64_t n_q, int64_t n_kv,
+        mask_mode mode, int n_threads) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 256*1024*1024,
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ false,
+    };
+
+    struct ggml_context * ctx = ggml_init(params);
+    assert(ctx != nullptr);
+
+    std::mt19937 rng(42);
+
+    const float scale    = 0.5f;
+    const float max_bias = mode == MASK_ALIBI ? 8.0f : 0.0f;
+
+    struct ggml_tensor * q = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, D, n_q,  n_head);
+    struct ggml_tensor * k = ggml_new_tensor_3d(ctx, type_kv,       D, n_kv, n_head_kv);
+    struct ggml_tensor * v = ggml_new_tensor_3d(ctx, type_kv,       D, n_kv, n_head_kv);
+
+    init_tensor_uniform(q, rng);
+    init_tensor_uniform(k, rng);
+    init_tensor_uniform(v, rng);
+
+    struct ggml_tensor * mask = nullptr;
+    if (mode != MASK_NONE) {
+        mask = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, n_kv, GGML_PAD(n_q, GGML_KQ_MASK_PAD));
+
+        std::uniform_int_distribution<int> dist(0, 3);
+
+        ggml_fp16_t * data = (ggml_fp16_t *) mask->data;
+        for (int64_t i1 = 0; i1 < mask->ne[1]; ++i1) {
+            for (int64_t i0 = 0; i0 < n_kv; ++i0) {
+                float val = mode == MASK_ALIBI ? -(float) std::abs(i0 - (n_kv - n_q + i1)) : 0.0f;
+                if (i0 < n_kv/4 || dist(rng) == 0) {
+                    val = -INFINITY;
+                }
+                data[i1*n_kv + i0] = ggml_fp32_to_fp16(val);
+            }
+        }
+    }
+
+    struct ggml_tensor * out = ggml_flash_attn_ext(ctx, q, k, v, mask, scale, max_bias, 0.0f);
+    ggml_flash_attn_ext_set_prec(out, GGML_PREC_F32);
+
+    struct ggml_tensor * kq  = ggml_soft_max_ext(ctx, ggml_mul_mat(ctx, k, q), mask, scale, max_bias); // [n_kv, n_q, n_head]
+    struct ggml_tensor * kqv = ggml_mul_mat(ctx, ggml_cont(ctx, ggml_transpose(ctx, v)), kq);          // [D, n_q, n_head]
+    struct ggml_tensor * ref = ggml_cont(ctx, ggml_permute(ctx, kqv, 0, 2, 1, 3));                      // [D, n_head, n_q]
+
+    static const char * mask_names[] = { "none", "random", "alibi" };
+
+    char desc[128];
+    snprintf(desc, sizeof(desc), "FLASH_ATTN_EXT(type_kv=%s,D=%d,n_head=%d/%d,n_q=%d,n_kv=%d,mask=%s,nt=%d)",
+            ggml_type_name(type_kv), (int) D, (int) n_head, (int) n_head_kv, (int) n_q, (int) n_kv, mask_names[mode], n_threads);
+
+    const bool ok = test_compare(ctx, out, ref, n_threads, type_kv == GGML_TYPE_F32 ? 1e-7 : 5e-4, desc);
+
+    ggml_free(ctx);
+
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+
+    for (ggml_type type_a : { GGML_TYPE_F32, GGML_TYPE_F16 }) {
+        for (int n_threads : { 1, 4 }) {
+            for (int K : { 1, 3, 5 }) {
+                for (int s0 : { 1, 2 }) {
+                    for (int p0 : { 0, 1, K + 1 }) {
+                        ok &= test_conv_1d_gelu(type_a, K, 7, 13, 37, s0, p0, 1, n_threads);
+                    }
+                }
+            }
+
+            ok &= test_conv_1d_gelu(type_a, 3, 5, 8, 40, 1, 2, 2, n_threads);
+
+            // the encoder convolutions of a whisper model, several im2col batches
+            ok &= test_conv_1d_gelu(type_a, 3,  80, 384, 3000, 1, 1, 1, n_threads);
+            ok &= test_conv_1d_gelu(type_a, 3, 384, 384, 3000, 2, 1, 1, n_threads);
+        }
+    }
+
+    for (ggml_type type_kv : { GGML_TYPE_F32, GGML_TYPE_F16 }) {
+        for (mask_mode mode : { MASK_NONE, MASK_RANDOM, MASK_ALIBI }) {
+            // 1 thread is the unsplit reference path, 8 threads split n_kv into up to 32 chunks
+            for (int n_threads : { 1, 8 }) {
+                ok &= test_flash_attn_ext(type_kv,  64, 1, 1, 1, 4096, mode, n_threads);
+                ok &= test_flash_attn_ext(type_kv,  64, 6, 6, 1, 1500, mode, n_threads);
+                ok &= test_flash_attn_ext(type_kv,  64, 6, 2, 1,  448, mode, n_threads);
+                ok &= test_flash_attn_ext(type_kv, 128, 4, 4, 3,  777, mode, n_threads);
+            }
+        }
+    }
+
+    return ok ? 0 : 1;
+}
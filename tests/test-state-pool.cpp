@@ -0,0 +1,192 @@
+#include "whisper.h"
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+
+void assert_default_params(const struct whisper_state_pool_params & params) {
+    assert(params.n_states_init == 1);
+    assert(params.n_states_idle == -1);
+    assert(params.n_states_max  == 0);
+    assert(params.mem_max       == 0);
+}
+
+void test_recycle(struct whisper_context * ctx) {
+    struct whisper_state_pool_params params = whisper_state_pool_default_params();
+    params.n_states_init = 2;
+
+    struct whisper_state_pool * pool = whisper_state_pool_init(ctx, params);
+    assert(pool != nullptr);
+    assert(whisper_state_pool_n_states(pool) == 2);
+    assert(whisper_state_pool_n_idle(pool)   == 2);
+
+    const size_t mem = whisper_state_pool_memory_size(pool);
+    assert(mem > 0);
+
+    struct whisper_state * state = whisper_state_pool_acquire(pool, false);
+    assert(state != nullptr);
+    assert(whisper_state_memory_size(state) > 0);
+    assert(whisper_state_memory_size(state) <= mem);
+    assert(whisper_state_pool_n_idle(pool) == 1);
+
+    // a released state is handed out again instead of creating a new one
+    whisper_state_pool_release(pool, state);
+    assert(whisper_state_pool_n_idle(pool) == 2);
+
+    struct whisper_state * state_again = whisper_state_pool_acquire(pool, false);
+    assert(state_again == state);
+    assert(whisper_full_n_segments_from_state(state_again) == 0);
+    whisper_state_pool_release(pool, state_again);
+
+    whisper_state_pool_trim(pool, 0);
+    assert(whisper_state_pool_n_states(pool) == 0);
+    assert(whisper_state_pool_memory_size(pool) == 0);
+
+    whisper_state_pool_free(pool);
+}
+
+void test_limits(struct whisper_context * ctx) {
+    struct whisper_state_pool_params params = whisper_state_pool_default_params();
+    params.n_states_init = 1;
+    params.n_states_idle = 1;
+
+    struct whisper_state_pool * pool = whisper_state_pool_init(ctx, params);
+    assert(pool != nullptr);
+
+    const size_t mem_state = whisper_state_pool_memory_size(pool);
+    whisper_state_pool_free(pool);
+
+    // room for two states
+    params.mem_max = 2*mem_state + mem_state/2;
+
+    pool = whisper_state_pool_init(ctx, params);
+    assert(pool != nullptr);
+
+    struct whisper_state * state0 = whisper_state_pool_acquire(pool, false);
+    struct whisper_state * state1 = whisper_state_pool_acquire(pool, false);
+    assert(state0 != nullptr);
+    assert(state1 != nullptr);
+    assert(state0 != state1);
+
+    // the memory limit is reached
+    assert(whisper_state_pool_acquire(pool, false) == nullptr);
+    assert(whisper_state_pool_n_states(pool) == 2);
+
+    // a waiting thread gets the state that is released
+    struct whisper_state * state2 = nullptr;
+    std::thread waiter([&]() {
+        state2 = whisper_state_pool_acquire(pool, true);
+    });
+    whisper_state_pool_release(pool, state1);
+    waiter.join();
+    assert(state2 != nullptr);
+
+    // only one idle state is kept
+    whisper_state_pool_release(pool, state0);
+    whisper_state_pool_release(pool, state2);
+    assert(whisper_state_pool_n_idle(pool)   == 1);
+    assert(whisper_state_pool_n_states(pool) == 1);
+
+    whisper_state_pool_free(pool);
+}
+
+// 10 s of a chirp - a single decoding window
+static std::vector<float> make_audio() {
+    std::vector<float> pcm(10*WHISPER_SAMPLE_RATE);
+    for (size_t i = 0; i < pcm.size(); ++i) {
+        const float t = (float) i/WHISPER_SAMPLE_RATE;
+        pcm[i] = 0.5f*sinf(2.0f*M_PI*(200.0f + 50.0f*t)*t);
+    }
+    return pcm;
+}
+
+static struct whisper_full_params make_full_params() {
+    struct whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    wparams.n_threads        = 2;
+    wparams.print_progress   = false;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = false;
+    wparams.no_context       = false;
+    wparams.initial_prompt   = "hello world";
+    // every attempt fails, so the prompt of the first attempt is snapshotted when the fallback adds decoders
+    wparams.logprob_thold    = 0.0f;
+    wparams.no_speech_thold  = 1.0f;
+    return wparams;
+}
+
+void test_reset(struct whisper_context * ctx) {
+    struct whisper_state_pool_params params = whisper_state_pool_default_params();
+    params.n_states_init = 1;
+
+    struct whisper_state_pool * pool = whisper_state_pool_init(ctx, params);
+    assert(pool != nullptr);
+
+    const std::vector<float> pcm = make_audio();
+    const struct whisper_full_params wparams = make_full_params();
+
+    struct whisper_state * state = whisper_state_pool_acquire(pool, false);
+    assert(state != nullptr);
+
+    assert(whisper_full_with_state(ctx, state, wparams, pcm.data(), (int) pcm.size()) == 0);
+
+    // the prompt and the decoded tokens
+    const int n_kv_used = whisper_n_kv_used_from_state(state);
+    assert(n_kv_used > 0);
+
+    struct whisper_timings * timings = whisper_get_timings_from_state(state);
+    assert(timings->n_fallback_restore == 1 && timings->fallback_restore_bytes > 0);
+    delete timings;
+
+    whisper_state_pool_release(pool, state);
+
+    // the state is handed out again, as if it was new
+    assert(whisper_state_pool_acquire(pool, false) == state);
+
+    assert(whisper_full_n_segments_from_state(state) == 0);
+    assert(whisper_n_len_from_state(state) == 0);
+    assert(whisper_n_kv_used_from_state(state) == 0);
+
+    timings = whisper_get_timings_from_state(state);
+    assert(timings->n_fallback_restore == 0 && timings->fallback_restore_bytes == 0);
+    delete timings;
+
+    // no prompt or snapshot remnants: the same transcription decodes the same prompt, without restoring it
+    // (the KV cache of the state already has room for all decoders, so no snapshot is taken this time)
+    assert(whisper_full_with_state(ctx, state, wparams, pcm.data(), (int) pcm.size()) == 0);
+    assert(whisper_n_kv_used_from_state(state) == n_kv_used);
+
+    timings = whisper_get_timings_from_state(state);
+    assert(timings->n_fallback_restore == 0);
+    delete timings;
+
+    whisper_state_pool_release(pool, state);
+    whisper_state_pool_free(pool);
+}
+
+int main() {
+    std::string whisper_model_path = WHISPER_MODEL_PATH;
+
+    assert_default_params(whisper_state_pool_default_params());
+
+    struct whisper_context_params cparams = whisper_context_default_params();
+    cparams.use_gpu = false;
+    cparams.fallback_snapshot_size = 16*1024*1024;
+
+    struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(whisper_model_path.c_str(), cparams);
+    assert(ctx != nullptr);
+
+    test_recycle(ctx);
+    test_limits(ctx);
+    test_reset(ctx);
+
+    whisper_free(ctx);
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "whisper.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#include <cassert>
+
+// the expected ids were produced with tiktoken, using the GPT-2 pre-tokenizer regex and the vocab of the test model
+// as mergeable ranks (token string -> token id)
+//
+// the test models store the vocab as text, so the single byte tokens >= 0x80 and the tokens with partial UTF-8
+// sequences were replaced by U+FFFD. the single bytes are restored below, the partial sequences are not, so
+// non-ASCII text that does not merge into whole codepoints ends up as byte tokens - on both sides
+struct test_case {
+    const char * text;
+    std::vector<whisper_token> ids;
+};
+
+static const std::vector<test_case> k_tests = {
+        { "Hello world", { 15496, 995 } },
+        { " And so my fellow Americans, ask not what your country can do for you", { 843, 523, 616, 5891, 3399, 11, 1265, 407, 644, 534, 1499, 460, 466, 329, 345 } },
+        { "don't", { 9099, 470 } },
+        { "I'll", { 40, 1183 } },
+        { "it's  a\n\n test\t\tok ", { 270, 338, 220, 257, 628, 1332, 197, 197, 482, 220 } },
+        { "  leading spaces", { 220, 3756, 9029 } },
+        { "1234567 3.14 2024", { 10163, 2231, 3134, 513, 13, 1415, 48609 } },
+        { "café naïve Zürich", { 66, 1878, 2634, 41492, 1168, 9116, 7527 } },
+        { "Привет мир", { 140, 253, 21169, 18849, 38857, 16843, 20375, 220, 43108, 18849, 21169 } },
+        { "你好，世界", { 160, 121, 254, 161, 98, 121, 171, 120, 234, 160, 116, 244, 163, 243, 234 } },
+        { "日本語のテキスト", { 162, 245, 98, 162, 250, 105, 164, 103, 252, 159, 223, 106, 159, 225, 228, 159, 224, 255, 159, 224, 117, 159, 225, 230 } },
+        { "emoji 🙂👍🏽!", { 368, 31370, 220, 172, 253, 247, 224, 172, 253, 239, 235, 172, 253, 237, 121, 0 } },
+};
+
+template <typename T>
+static T read_safe(const std::vector<char> & buf, size_t & pos) {
+    T res;
+    assert(pos + sizeof(T) <= buf.size());
+    memcpy(&res, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return res;
+}
+
+// byte b of the GPT-2 vocab is token id gpt2_byte_order()[b]
+static std::vector<int> gpt2_byte_order() {
+    std::vector<int> bytes;
+    for (int b = '!'; b <= '~'; ++b) bytes.push_back(b);
+    for (int b = 0xA1; b <= 0xAC; ++b) bytes.push_back(b);
+    for (int b = 0xAE; b <= 0xFF; ++b) bytes.push_back(b);
+
+    std::vector<int> order(256, -1);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        order[bytes[i]] = (int) i;
+    }
+
+    int id = (int) bytes.size();
+    for (int b = 0; b < 256; ++b) {
+        if (order[b] < 0) {
+            order[b] = id++;
+        }
+    }
+
+    return order;
+}
+
+// the model file with the first 256 tokens of the vocab replaced by the raw bytes
+static std::vector<char> load_model_with_byte_tokens(const char * path) {
+    std::ifstream fin(path, std::ios::binary);
+    assert(fin);
+
+    const std::vector<char> src((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+    size_t pos = 0;
+
+    assert(read_safe<uint32_t>(src, pos) == 0x67676d6c);
+    pos += 11*sizeof(int32_t); // hparams
+
+    const int32_t n_mel = read_safe<int32_t>(src, pos);
+    const int32_t n_fft = read_safe<int32_t>(src, pos);
+    pos += (size_t) n_mel*n_fft*sizeof(float);
+
+    const int32_t n_vocab = read_safe<int32_t>(src, pos);
+    assert(n_vocab >= 256);
+
+    std::vector<std::string> tokens(n_vocab);
+    for (auto & token : tokens) {
+        const uint32_t len = read_safe<uint32_t>(src, pos);
+        assert(pos + len <= src.size());
+        token.assign(src.data() + pos, len);
+        pos += len;
+    }
+
+    const std::vector<int> order = gpt2_byte_order();
+    for (int b = 0; b < 256; ++b) {
+        tokens[order[b]] = std::string(1, (char) b);
+    }
+
+    std::vector<char> dst(src.begin(), src.begin() + (ptrdiff_t) (4 + 11*sizeof(int32_t) + 2*sizeof(int32_t) + (size_t) n_mel*n_fft*sizeof(float)));
+    dst.insert(dst.end(), (const char *) &n_vocab, (const char *) &n_vocab + sizeof(n_vocab));
+    for (const auto & token : tokens) {
+        const uint32_t len = token.size();
+        dst.insert(dst.end(), (const char *) &len, (const char *) &len + sizeof(len));
+        dst.insert(dst.end(), token.begin(), token.end());
+    }
+    dst.insert(dst.end(), src.begin() + (ptrdiff_t) pos, src.end());
+
+    return dst;
+}
+
+static void test_tokenize(struct whisper_context * ctx, const test_case & test) {
+    const int n_text = (int) strlen(test.text);
+
+    std::vector<whisper_token> ids(n_text + 1);
+    const int n_ids = whisper_tokenize(ctx, test.text, ids.data(), (int) ids.size());
+    assert(n_ids >= 0);
+    ids.resize(n_ids);
+
+    if (ids != test.ids) {
+        fprintf(stderr, "%s: mismatch for '%s':\n", __func__, test.text);
+        fprintf(stderr, "  expected:");
+        for (const auto id : test.ids) fprintf(stderr, " %d", id);
+        fprintf(stderr, "\n  got:     ");
+        for (const auto id : ids) fprintf(stderr, " %d", id);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+
+    assert(whisper_token_count(ctx, test.text) == n_ids);
+
+    // the tokens concatenate back to the input
+    std::string text;
+    for (const auto id : ids) {
+        text += whisper_token_to_str(ctx, id);
+    }
+    assert(text == test.text);
+}
+
+int main() {
+    std::string whisper_model_path = WHISPER_MODEL_PATH;
+
+    std::vector<char> model = load_model_with_byte_tokens(whisper_model_path.c_str());
+
+    struct whisper_context_params cparams = whisper_context_default_params();
+    cparams.use_gpu = false;
+
+    struct whisper_context * ctx = whisper_init_from_buffer_with_params_no_state(model.data(), model.size(), cparams);
+    assert(ctx != nullptr);
+
+    for (const auto & test : k_tests) {
+        test_tokenize(ctx, test);
+    }
+
+    whisper_free(ctx);
+
+    return 0;
+}